@@ -6,213 +6,1990 @@
  * All rights reserved. Distributed under the terms of the MIT license.
  */
 
-#include <kernel/fs_index.h>
-#include <MimeType.h>
-#include <Path.h>
-#include <Resources.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
 #include <stdio.h>
-#include <Volume.h>
-#include <VolumeRoster.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-status_t InstallMimeTypeFromResource(const char* path);
-status_t DeleteMimeType(const char* mimeType);
-status_t GetInstalledMimeTypes(const char* supertype, BMessage* types);
-void PrintUsage(const char* name);
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CommandServer.h"
+#include "DirectoryWatcher.h"
+#include "ExtensionIndex.h"
+#include "FileAttributes.h"
+#include "IndexManager.h"
+#include "IndexRegistry.h"
+#include "InstallCache.h"
+#include "Manifest.h"
+#include "MappedFile.h"
+#include "MimeDatabase.h"
+#include "MimeSnapshot.h"
+#include "MimeTransaction.h"
+#include "MimeTypeBundle.h"
+#include "OutputFormat.h"
+#include "Query.h"
+#include "SharedMimeInfo.h"
+#include "Stats.h"
+#include "TypeGraph.h"
+#include "TypeIdentifier.h"
+#include "TypeLister.h"
+#include "WorkStealingPool.h"
+#include "WorkerPool.h"
 
-#define ATTR_INDEX "attr:searchable"
+// State kept between commands: for one command in a process of its own, or
+// for all commands of the server.
+struct command_context {
+    MimeDatabase*                   database;
+    std::vector<std::string>        volumes;
+    // loaded by the first identify, dropped when the DB is changed
+    std::unique_ptr<TypeIdentifier> identifier;
+    // loaded by the first command that needs it, dropped when the DB is changed
+    std::unique_ptr<TypeGraph>      graph;
+    // whether the above are kept for the next command
+    bool                            serving;
+};
+
+int StripGlobalOptions(int argc, char** argv, const char** _databaseDirectory,
+    const char** _server, std::vector<std::string>& volumes, const char** _stats);
+int RunCommand(command_context& context, int argc, char** argv);
+int RunCommandWithStats(command_context& context, int argc, char** argv, const char* stats);
+status_t LoadTypeGraph(command_context& context);
+int Serve(MimeDatabase& database, const char* path);
+status_t InstallMimeTypeFromResource(MimeDatabase& database,
+    const std::vector<std::string>& volumes, const char* path, InstallCache& cache, bool force,
+    bool& skipped);
+status_t InstallMimeTypesFromResources(MimeDatabase& database,
+    const std::vector<std::string>& volumes, const std::vector<std::string>& paths,
+    int32 jobs, InstallCache& cache, bool force);
+status_t InstallMimeTypeBundles(MimeDatabase& database, const std::vector<std::string>& volumes,
+    MimeTypeBundle* bundles, int32 count, const char* sources);
+status_t ImportSharedMimeInfo(MimeDatabase& database, const std::vector<std::string>& volumes,
+    const std::vector<std::string>& paths);
+status_t WatchResources(MimeDatabase& database, const std::vector<std::string>& volumes,
+    const char* directory, int32 debounce, int32 jobs);
+status_t PlanManifest(MimeDatabase& database, const std::vector<std::string>& volumes,
+    const char* path, output_format format, int32 jobs, bool apply);
+void PrintPlan(const ManifestPlan& plan, output_format format);
+status_t ApplyPlan(MimeDatabase& database, const std::vector<std::string>& volumes,
+    ManifestPlan& plan, int32 jobs);
+status_t CreateIndices(MimeDatabase& database, const std::vector<std::string>& volumes,
+    const MimeTypeBundle* bundles, int32 count);
+status_t AddIndexVolumes(IndexManager& indices, const std::vector<std::string>& volumes);
+status_t PrintIndexStatus(MimeDatabase& database, const std::vector<std::string>& volumes,
+    output_format format);
+status_t RemoveOrphanedIndices(MimeDatabase& database, const std::vector<std::string>& volumes);
+status_t UpdateIndices(const std::vector<std::string>& volumes);
+status_t QueryFiles(MimeDatabase& database, const std::vector<std::string>& volumes,
+    const char* type, const char* predicate, bool explain);
+void UpdateExtensionIndex(MimeDatabase& database, const MimeTypeBundle* bundles,
+    const MimeTypeChanges* changes, int32 count);
+status_t CollectResourcePaths(const char* path, std::vector<std::string>& paths);
+status_t CollectResourcePathsFromList(const char* listPath, std::vector<std::string>& paths);
+status_t UninstallMimeTypes(MimeDatabase& database, const TypeGraph& graph,
+    const std::vector<std::string>& volumes, const char* type, bool recursive, bool keepIndices);
+status_t IdentifyFiles(const TypeIdentifier& identifier, const std::vector<std::string>& paths,
+    output_format format, int32 jobs, bool writeType, bool force);
+status_t LookupExtensions(MimeDatabase& database, const std::vector<std::string>& extensions,
+    bool rebuild);
+status_t ExportMimeTypes(MimeDatabase& database, const TypeGraph& graph,
+    const std::vector<std::string>& selection, const char* directory, int32 jobs);
+status_t ListRelations(const TypeGraph& graph, const char* source, const char* target,
+    output_format format);
+status_t BuildSnapshot(MimeDatabase& database, const char* path);
+status_t PrintSnapshotInfo(const char* path);
+void PrintUsage(const char* name);
 
 int
 main(int argc, char** argv)
 {
+    const char* databaseDirectory = getenv("MIME_DB_DIR");
+    const char* server = getenv("MIME_SERVER");
+    const char* stats = NULL;
+    std::vector<std::string> volumes;
+    argc = StripGlobalOptions(argc, argv, &databaseDirectory, &server, volumes, &stats);
+
+    if (argc == 1) {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // the server runs commands in the working directories of its clients
+    std::string absoluteDirectory;
+    if (strcmp(argv[1], "serve") == 0 && databaseDirectory != NULL
+        && databaseDirectory[0] != '/') {
+        char directory[B_PATH_NAME_LENGTH];
+        if (getcwd(directory, sizeof(directory)) == NULL) {
+            fprintf(stderr, "cannot get the working directory: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        absoluteDirectory = std::string(directory) + "/" + databaseDirectory;
+        databaseDirectory = absoluteDirectory.c_str();
+    }
+
+    std::unique_ptr<MimeDatabase> database(MimeDatabase::Create(databaseDirectory));
+    if (database.get() == NULL) {
+        fprintf(stderr, "failed to open MIME DB: %s\n", strerror(B_NO_MEMORY));
+        return EXIT_FAILURE;
+    }
+
+    if (strcmp(argv[1], "serve") == 0) {
+        if (argc > 3) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        std::string path = argc == 3 ? argv[2] : CommandServer::PathFor(*database);
+        return Serve(*database, path.c_str());
+    }
+
+    if (server != NULL) {
+        // the server has its own DB, only the volumes are passed on
+        std::string path = server[0] != '\0' ? server : CommandServer::PathFor(*database);
+        std::vector<std::string> options;
+        for (const std::string& volume : volumes)
+            options.push_back("--volume=" + volume);
+        if (stats != NULL)
+            options.push_back(stats[0] != '\0' ? std::string("--stats=") + stats : "--stats");
+        std::vector<char*> arguments(argv, argv + argc);
+        for (size_t i = 0; i < options.size(); i++)
+            arguments.insert(arguments.begin() + 1 + i, &options[i][0]);
+        return RunCommandClient(path.c_str(), (int)arguments.size(), arguments.data());
+    }
+
+    command_context context;
+    context.database = database.get();
+    context.volumes = volumes;
+    context.serving = false;
+    return RunCommandWithStats(context, argc, argv, stats);
+}
+
+// Global options may appear anywhere, they are removed from the arguments.
+// --server without a path uses the default socket, --stats without a format
+// prints a table.
+int StripGlobalOptions(int argc, char** argv, const char** _databaseDirectory,
+        const char** _server, std::vector<std::string>& volumes, const char** _stats) {
+    int count = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--db=", strlen("--db=")) == 0)
+            *_databaseDirectory = argv[i] + strlen("--db=");
+        else if (strcmp(argv[i], "--server") == 0)
+            *_server = "";
+        else if (strncmp(argv[i], "--server=", strlen("--server=")) == 0)
+            *_server = argv[i] + strlen("--server=");
+        else if (strncmp(argv[i], "--volume=", strlen("--volume=")) == 0)
+            volumes.push_back(argv[i] + strlen("--volume="));
+        else if (strcmp(argv[i], "--stats") == 0)
+            *_stats = "";
+        else if (strncmp(argv[i], "--stats=", strlen("--stats=")) == 0)
+            *_stats = argv[i] + strlen("--stats=");
+        else
+            argv[count++] = argv[i];
+    }
+    return count;
+}
+
+// Runs the command collecting phase times and counters, which are printed to
+// stderr afterwards, so they reach clients of the server as well.
+int RunCommandWithStats(command_context& context, int argc, char** argv, const char* stats) {
+    if (stats == NULL)
+        return RunCommand(context, argc, argv);
+
+#ifdef MIME_NO_STATS
+    fprintf(stderr, "--stats is not available, mime was built with MIME_NO_STATS.\n");
+    return EXIT_FAILURE;
+#else
+    bool json = strcmp(stats, "json") == 0;
+    if (!json && stats[0] != '\0') {
+        fprintf(stderr, "unknown stats format %s, only json is supported.\n", stats);
+        return EXIT_FAILURE;
+    }
+
+    Stats::Start();
+    int status = RunCommand(context, argc, argv);
+    Stats::Stop();
+    Stats::Print(stderr, json);
+    return status;
+#endif
+}
+
+// Runs one command, for this process or for a client of the server.
+int RunCommand(command_context& context, int argc, char** argv) {
     if (argc == 1) {
         PrintUsage(argv[0]);
         return EXIT_FAILURE;
     }
+
+    // fail before touching the DB, not after installing
+    for (const std::string& volume : context.volumes) {
+        std::unique_ptr<IndexVolume> indexVolume(IndexVolume::Create(volume.c_str()));
+        status_t result = indexVolume.get() != NULL ? indexVolume->InitCheck() : B_NO_MEMORY;
+        if (result != B_OK) {
+            fprintf(stderr, "cannot use volume %s for indices: %s\n", volume.c_str(),
+                strerror(result));
+            return EXIT_FAILURE;
+        }
+    }
+    MimeDatabase& database = *context.database;
+    const std::vector<std::string>& volumes = context.volumes;
+
     status_t result;
     const char* command = argv[1];
     if (strncmp(command, "install", strlen("install")) == 0) {
-        result = InstallMimeTypeFromResource(argv[2]);
+        std::vector<std::string> paths;
+        int32 jobs = 0;
+        bool force = false;
+        result = B_OK;
+        for (int i = 2; i < argc; i++) {
+            status_t argResult;
+            if (strcmp(argv[i], "--from-list") == 0 && i + 1 < argc) {
+                argResult = CollectResourcePathsFromList(argv[++i], paths);
+            } else if (strncmp(argv[i], "--jobs=", strlen("--jobs=")) == 0) {
+                jobs = atoi(argv[i] + strlen("--jobs="));
+                continue;
+            } else if (strcmp(argv[i], "--force") == 0) {
+                force = true;
+                continue;
+            } else {
+                argResult = CollectResourcePaths(argv[i], paths);
+            }
+            if (argResult != B_OK)
+                result = argResult;
+        }
+        if (paths.empty()) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        // a cache that cannot be read only costs installing everything again
+        InstallCache cache(database, volumes);
+        status_t cacheResult = cache.Load();
+        if (cacheResult != B_OK) {
+            fprintf(stderr, "ignoring install cache %s: %s\n",
+                InstallCache::PathFor(database).c_str(), strerror(cacheResult));
+        }
+
         if (result != B_OK) {
-            fprintf(stderr, "failed to install MIME type %s: %s\n", argv[2], strerror(result));
+            fprintf(stderr, "failed to collect resource files, nothing installed.\n");
+        } else if (paths.size() == 1) {
+            const char* path = paths[0].c_str();
+            bool skipped;
+            result = InstallMimeTypeFromResource(database, volumes, path, cache, force,
+                skipped);
+            if (result != B_OK) {
+                fprintf(stderr, "failed to install MIME type %s: %s\n", path, strerror(result));
+            } else if (skipped) {
+                printf("MIME type %s unchanged since it was last installed, skipped.\n", path);
+            } else {
+                printf("successfully installed MIME type %s.\n", path);
+            }
         } else {
-            printf("successfully installed MIME type %s.\n", argv[2]);
+            result = InstallMimeTypesFromResources(database, volumes, paths, jobs, cache, force);
+        }
+        context.identifier.reset();
+        context.graph.reset();
+
+        if (!force) {
+            printf("install cache: %" B_PRId32 " hits, %" B_PRId32 " misses\n",
+                cache.CountHits(), cache.CountMisses());
+        }
+        cacheResult = cache.Save();
+        if (cacheResult != B_OK) {
+            fprintf(stderr, "failed to write install cache: %s\n", strerror(cacheResult));
+        }
+    }
+    else if (strcmp(command, "import-xml") == 0) {
+        if (argc < 3) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        std::vector<std::string> paths(argv + 2, argv + argc);
+        result = ImportSharedMimeInfo(database, volumes, paths);
+        context.identifier.reset();
+        context.graph.reset();
+    }
+    else if (strcmp(command, "watch") == 0) {
+        const char* directory = NULL;
+        int32 debounce = 500;
+        int32 jobs = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strncmp(argv[i], "--debounce=", strlen("--debounce=")) == 0)
+                debounce = atoi(argv[i] + strlen("--debounce="));
+            else if (strncmp(argv[i], "--jobs=", strlen("--jobs=")) == 0)
+                jobs = atoi(argv[i] + strlen("--jobs="));
+            else if (directory == NULL)
+                directory = argv[i];
+            else
+                directory = "";
+        }
+        if (directory == NULL || directory[0] == '\0' || debounce < 0) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        result = WatchResources(database, volumes, directory, debounce, jobs);
+        context.identifier.reset();
+        context.graph.reset();
+    }
+    else if (strcmp(command, "plan") == 0 || strcmp(command, "apply") == 0) {
+        bool apply = strcmp(command, "apply") == 0;
+        output_format format = OUTPUT_FORMAT_TSV;
+        const char* manifest = NULL;
+        int32 jobs = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strncmp(argv[i], "--format=", strlen("--format=")) == 0) {
+                if (ParseOutputFormat(argv[i] + strlen("--format="), format) != B_OK) {
+                    fprintf(stderr, "unknown output format %s\n", argv[i] + strlen("--format="));
+                    return EXIT_FAILURE;
+                }
+            } else if (strncmp(argv[i], "--jobs=", strlen("--jobs=")) == 0)
+                jobs = atoi(argv[i] + strlen("--jobs="));
+            else if (manifest == NULL)
+                manifest = argv[i];
+            else
+                manifest = "";
+        }
+        if (manifest == NULL || manifest[0] == '\0') {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        result = PlanManifest(database, volumes, manifest, format, jobs, apply);
+        if (apply) {
+            context.identifier.reset();
+            context.graph.reset();
         }
     }
     else if (strncmp(command, "uninstall", strlen("uninstall")) == 0) {
-        result = DeleteMimeType(argv[2]);
-        if (result != B_OK) {
-            fprintf(stderr, "failed to uninstall MIME type %s: %s\n", argv[2], strerror(result));
-        } else {
-            printf("successfully uninstalled MIME type %s.\n", argv[2]);
+        const char* type = NULL;
+        bool recursive = false;
+        bool keepIndices = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--recursive") == 0)
+                recursive = true;
+            else if (strcmp(argv[i], "--keep-indices") == 0)
+                keepIndices = true;
+            else if (type == NULL)
+                type = argv[i];
+            else
+                type = "";
+        }
+        if (type == NULL || type[0] == '\0') {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (LoadTypeGraph(context) != B_OK)
+            return EXIT_FAILURE;
+        result = UninstallMimeTypes(database, *context.graph, volumes, type, recursive,
+            keepIndices);
+        context.identifier.reset();
+        context.graph.reset();
+    }
+    else if (strcmp(command, "index") == 0) {
+        output_format format = OUTPUT_FORMAT_TSV;
+        const char* action = NULL;
+        for (int i = 2; i < argc; i++) {
+            if (strncmp(argv[i], "--format=", strlen("--format=")) == 0) {
+                if (ParseOutputFormat(argv[i] + strlen("--format="), format) != B_OK) {
+                    fprintf(stderr, "unknown output format %s\n", argv[i] + strlen("--format="));
+                    return EXIT_FAILURE;
+                }
+            } else if (action == NULL)
+                action = argv[i];
+            else
+                action = "";
         }
+
+        if (action != NULL && strcmp(action, "status") == 0)
+            result = PrintIndexStatus(database, volumes, format);
+        else if (action != NULL && strcmp(action, "gc") == 0)
+            result = RemoveOrphanedIndices(database, volumes);
+        else if (action != NULL && strcmp(action, "update") == 0)
+            result = UpdateIndices(volumes);
+        else {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    else if (strcmp(command, "query") == 0) {
+        const char* type = NULL;
+        const char* predicate = NULL;
+        bool explain = false;
+        bool extra = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--explain") == 0)
+                explain = true;
+            else if (type == NULL)
+                type = argv[i];
+            else if (predicate == NULL)
+                predicate = argv[i];
+            else
+                extra = true;
+        }
+        if (predicate == NULL || extra) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        result = QueryFiles(database, volumes, type, predicate, explain);
     }
     else if (strncmp(command, "list", strlen("list")) == 0) {
-        BMessage entityTypes;
-        result = GetInstalledMimeTypes("entity", &entityTypes);
-        if (result != B_OK) {
-            fprintf(stderr, "failed to query MIME type DB: %s\n", strerror(result));
+        output_format format = OUTPUT_FORMAT_TSV;
+        const char* fields = NULL;
+        std::vector<std::string> types;
+        for (int i = 2; i < argc; i++) {
+            if (strncmp(argv[i], "--format=", strlen("--format=")) == 0) {
+                if (ParseOutputFormat(argv[i] + strlen("--format="), format) != B_OK) {
+                    fprintf(stderr, "unknown output format %s\n", argv[i] + strlen("--format="));
+                    return EXIT_FAILURE;
+                }
+            } else if (strncmp(argv[i], "--fields=", strlen("--fields=")) == 0) {
+                fields = argv[i] + strlen("--fields=");
+            } else
+                types.push_back(argv[i]);
         }
-        printf("installed entities:\n");
-        entityTypes.PrintToStream();
 
-        BMessage relationTypes;
-        result = GetInstalledMimeTypes("relation", &relationTypes);
-        if (result != B_OK) {
-            fprintf(stderr, "failed to query MIME type DB: %s\n", strerror(result));
+        // The server keeps the whole graph for the next command. Otherwise,
+        // the lister loads one supertype at a time, so records stream out
+        // before the rest of the DB is read.
+        if (context.serving && LoadTypeGraph(context) != B_OK)
+            return EXIT_FAILURE;
+        TypeLister lister(database, context.graph.get(), format);
+        if (fields != NULL && lister.SetFields(fields) != B_OK)
+            return EXIT_FAILURE;
+        lister.SetVolumes(volumes);
+
+        result = lister.List(types, stdout);
+    }
+    else if (strcmp(command, "lookup-ext") == 0) {
+        std::vector<std::string> extensions;
+        bool rebuild = false;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--rebuild") == 0)
+                rebuild = true;
+            else
+                extensions.push_back(argv[i]);
+        }
+        if (extensions.empty() && !rebuild) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        result = LookupExtensions(database, extensions, rebuild);
+    }
+    else if (strcmp(command, "export") == 0) {
+        const char* directory = NULL;
+        int32 jobs = 0;
+        std::vector<std::string> types;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+                directory = argv[++i];
+            else if (strncmp(argv[i], "--output=", strlen("--output=")) == 0)
+                directory = argv[i] + strlen("--output=");
+            else if (strncmp(argv[i], "--jobs=", strlen("--jobs=")) == 0)
+                jobs = atoi(argv[i] + strlen("--jobs="));
+            else
+                types.push_back(argv[i]);
+        }
+        if (directory == NULL) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (LoadTypeGraph(context) != B_OK)
+            return EXIT_FAILURE;
+        result = ExportMimeTypes(database, *context.graph, types, directory, jobs);
+    }
+    else if (strcmp(command, "relations") == 0) {
+        output_format format = OUTPUT_FORMAT_TSV;
+        std::vector<const char*> types;
+        for (int i = 2; i < argc; i++) {
+            if (strncmp(argv[i], "--format=", strlen("--format=")) == 0) {
+                if (ParseOutputFormat(argv[i] + strlen("--format="), format) != B_OK) {
+                    fprintf(stderr, "unknown output format %s\n", argv[i] + strlen("--format="));
+                    return EXIT_FAILURE;
+                }
+            } else
+                types.push_back(argv[i]);
+        }
+        if (types.size() != 2) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (LoadTypeGraph(context) != B_OK)
+            return EXIT_FAILURE;
+        result = ListRelations(*context.graph, types[0], types[1], format);
+    }
+    else if (strcmp(command, "snapshot") == 0) {
+        if (argc < 3 || argc > 4
+            || (strcmp(argv[2], "build") != 0 && strcmp(argv[2], "info") != 0)) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        std::string path = argc == 4 ? argv[3] : MimeSnapshot::PathFor(database);
+        if (strcmp(argv[2], "build") == 0)
+            result = BuildSnapshot(database, path.c_str());
+        else
+            result = PrintSnapshotInfo(path.c_str());
+    }
+    else if (strcmp(command, "identify") == 0) {
+        std::vector<std::string> paths;
+        output_format format = OUTPUT_FORMAT_TSV;
+        int32 jobs = 0;
+        bool writeType = false;
+        bool force = false;
+        for (int i = 2; i < argc; i++) {
+            if (strncmp(argv[i], "--format=", strlen("--format=")) == 0) {
+                if (ParseOutputFormat(argv[i] + strlen("--format="), format) != B_OK) {
+                    fprintf(stderr, "unknown output format %s\n", argv[i] + strlen("--format="));
+                    return EXIT_FAILURE;
+                }
+            } else if (strncmp(argv[i], "--jobs=", strlen("--jobs=")) == 0) {
+                jobs = atoi(argv[i] + strlen("--jobs="));
+            } else if (strcmp(argv[i], "--write") == 0) {
+                writeType = true;
+            } else if (strcmp(argv[i], "--force") == 0) {
+                force = true;
+            } else
+                paths.push_back(argv[i]);
+        }
+        if (paths.empty()) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        // kept loaded for the next command, when serving, like the type graph
+        if (context.identifier.get() == NULL) {
+            std::unique_ptr<TypeIdentifier> identifier(new TypeIdentifier);
+            result = identifier->SetTo(database);
+            if (result != B_OK) {
+                fprintf(stderr, "failed to load MIME types from MIME DB: %s\n",
+                    strerror(result));
+                return EXIT_FAILURE;
+            }
+            context.identifier.swap(identifier);
         }
-        printf("installed relations:\n");
-        relationTypes.PrintToStream();
+
+        result = IdentifyFiles(*context.identifier, paths, format, jobs, writeType, force);
     }
     else {
         fprintf(stderr, "unknown command %s\n", command);
         return EXIT_FAILURE;
     }
 
-	return result == B_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+    return result == B_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Kept loaded for the next command, when serving.
+status_t LoadTypeGraph(command_context& context) {
+    if (context.graph.get() != NULL)
+        return B_OK;
+
+    std::unique_ptr<TypeGraph> graph(new TypeGraph);
+    status_t result = graph->Load(*context.database);
+    if (result != B_OK) {
+        fprintf(stderr, "failed to load MIME types from MIME DB: %s\n", strerror(result));
+        return result;
+    }
+    context.graph.swap(graph);
+    return B_OK;
 }
 
 void PrintUsage(const char* progname) {
-    BPath path(progname);
+    const char* leaf = strrchr(progname, '/');
+    leaf = leaf != NULL ? leaf + 1 : progname;
 
-    printf("Usage: %s <operation> [mime-type]\n", path.Leaf());
+    printf("Usage: %s [--db=<dir>] [--volume=<path>]... [--server[=<socket>]] <operation> "
+        "[mime-type]\n", leaf);
+    printf("       %s install [--jobs=N] [--force] [--from-list <file>] <resource file|dir>...\n",
+        leaf);
+    printf("       %s import-xml <shared-mime-info file>...\n", leaf);
+    printf("       %s watch [--jobs=N] [--debounce=<ms>] <dir>\n", leaf);
+    printf("       %s plan|apply [--jobs=N] [--format=tsv|json] <manifest>\n", leaf);
+    printf("       %s uninstall [--recursive] [--keep-indices] <type|supertype>\n", leaf);
+    printf("       %s list [--format=tsv|json] [--fields=<field,...>|all] [type|supertype]...\n",
+        leaf);
+    printf("       %s lookup-ext [--rebuild] <extension>...\n", leaf);
+    printf("       %s index [--format=tsv|json] status|gc|update\n", leaf);
+    printf("       %s query [--explain] <type> '<attribute> <op> <value> [&& ...]'\n", leaf);
+    printf("       %s export [--jobs=N] -o <dir> [type|supertype]...\n", leaf);
+    printf("       %s relations [--format=tsv|json] <source type> <target type>\n", leaf);
+    printf("       %s snapshot build|info [<file>]\n", leaf);
+    printf("       %s serve [<socket>]\n", leaf);
+    printf("       %s identify [--jobs=N] [--format=tsv|json] [--write [--force]] <file|dir>...\n",
+        leaf);
     printf("where operation is one of:\n\n");
-    printf("install     installs MIME type in MIME db\n");
-    printf("uninstall   uninstalls MIME type from MIME db\n");
-    printf("list        lists entities and relations in MIME db\n");
+    printf("install     installs MIME types from resource files in MIME db, skipping files\n"
+        "            unchanged since their last install (all are installed with --force)\n");
+    printf("import-xml  installs the types of freedesktop.org shared-mime-info XML files\n"
+        "            (e.g. freedesktop.org.xml), converting magic to sniffer rules\n");
+    printf("watch       installs the resource files of <dir> that changed since their last\n"
+        "            install, then those written or moved into it until interrupted; a\n"
+        "            burst of changes is installed in one transaction once no file\n"
+        "            changed for the debounce time (default 500 ms)\n");
+    printf("plan        compares the types and volumes a manifest lists (lines of bundle\n"
+        "            <resource file|dir>, volume <path>, manage <supertype>) with the MIME\n"
+        "            db and the indices, one record per type to install, update or delete\n"
+        "            and per index to create or remove, without changing anything\n");
+    printf("apply       plans, then makes the changes, in one transaction that writes\n"
+        "            different types in parallel\n");
+    printf("uninstall   uninstalls MIME type from MIME db, a supertype with all its subtypes\n"
+        "            with --recursive, and removes the indices no other type declares\n"
+        "            searchable (kept with --keep-indices)\n");
+    printf("list        lists the installed types (or the given ones, and the subtypes of the\n"
+        "            given supertypes), one record per type (fields: type,\n"
+        "            short_description, long_description, preferred_app, sniffer_rule,\n"
+        "            extensions, attributes, indices, icon; default type,short_description)\n");
+    printf("lookup-ext  lists the types claiming a file name extension, from the index kept\n"
+        "            next to the MIME db (rebuilt from the db with --rebuild)\n");
+    printf("index       status compares the indices of the volumes with the searchable\n"
+        "            attributes of the installed types (missing, wrong_type, and orphaned:\n"
+        "            created for types since uninstalled), gc removes the orphaned ones,\n"
+        "            update reads the attributes of all files into stand-in indices\n");
+    printf("query       lists the files of the type whose attributes match, ops are == != <\n"
+        "            <= > >=, strings may use * ? [...] with == and !=; the terms are\n"
+        "            checked against the attributes of the type and planned against the\n"
+        "            indices, most selective first (shown with --explain)\n");
+    printf("export      writes installed types (all by default) as resource files to\n"
+        "            <dir>/<supertype>/<subtype>.rsrc, to be installed again elsewhere\n");
+    printf("relations   lists the relation types that can lead from a file of the source\n"
+        "            type to one of the target type, by the relation:sources and\n"
+        "            relation:targets their attribute info names (any entity if none)\n");
+    printf("snapshot    builds a read-only binary copy of all types next to the MIME db\n"
+        "            (or in <file>) for services to map, or shows what one holds\n");
+    printf("serve       keeps the MIME db loaded and runs the commands of clients started\n"
+        "            with --server, on a local socket next to the MIME db (or <socket>)\n");
+    printf("identify    guesses the type of files by sniffer rules and extensions, --write\n"
+        "            stores it as %s where there is none yet (all with --force)\n",
+        FILE_TYPE_ATTR);
+    printf("\n--db=<dir>  use the MIME DB stored in <dir> (also MIME_DB_DIR) instead of the ");
+#ifdef __HAIKU__
+    printf("system one\n");
+#else
+    printf("default\n            %s\n", MimeDatabase::DefaultDirectory());
+#endif
+    printf("--volume=<path>\n            create (or for list, check, for query, search) attribute\n"
+        "            indices on the volume of <path>, may be repeated (default: ");
+#ifdef __HAIKU__
+    printf("%s)\n", IndexVolume::DefaultPath());
+#else
+    printf("none,\n            indices are left alone without it)\n");
+#endif
+    printf("--server[=<socket>]\n            run the command in the server (also MIME_SERVER), which "
+        "uses its\n            own MIME db\n");
+    printf("--stats[=json]\n            print the time spent in each phase of the command and what it\n"
+        "            read and wrote to stderr, as a table or one JSON object\n");
 
     return;
 }
 
-status_t InstallMimeTypeFromResource(const char* path) {
-    BResources resources(path);
-    if (! BFile(path, B_READ_ONLY).IsReadable()) {
-        fprintf(stderr, "cannot read resources from path %s: check path is valid!\n", path);
-        return B_ERROR;
+// Keeps the DB open for clients started with --server, until interrupted.
+int Serve(MimeDatabase& database, const char* path) {
+    command_context context;
+    context.database = &database;
+    context.serving = true;
+
+    CommandServer server(path, [&context](int argc, char** argv) {
+        const char* databaseDirectory = NULL;
+        const char* serverSocket = NULL;
+        const char* stats = NULL;
+        context.volumes.clear();
+        argc = StripGlobalOptions(argc, argv, &databaseDirectory, &serverSocket,
+            context.volumes, &stats);
+        if (databaseDirectory != NULL || serverSocket != NULL) {
+            fprintf(stderr, "the server only serves its own MIME DB\n");
+            return EXIT_FAILURE;
+        }
+        if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+            fprintf(stderr, "the server is already running\n");
+            return EXIT_FAILURE;
+        }
+        if (argc > 1 && strcmp(argv[1], "watch") == 0) {
+            fprintf(stderr, "watch runs until interrupted, start it without --server\n");
+            return EXIT_FAILURE;
+        }
+        return RunCommandWithStats(context, argc, argv, stats);
+    });
+
+    status_t result = server.Listen();
+    if (result != B_OK) {
+        fprintf(stderr, "cannot listen on %s: %s\n", path,
+            result == B_BUSY ? "another server is running" : strerror(result));
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "serving MIME DB %s on %s\n", database.Location().c_str(), path);
+    result = server.Run();
+    if (result != B_OK) {
+        fprintf(stderr, "server stopped: %s\n", strerror(result));
+        return EXIT_FAILURE;
     }
+    return EXIT_SUCCESS;
+}
 
-    status_t result = resources.InitCheck();
+status_t InstallMimeTypeFromResource(MimeDatabase& database,
+        const std::vector<std::string>& volumes, const char* path, InstallCache& cache,
+        bool force, bool& skipped) {
+    // a file that cannot be hashed is left to the parser to report
+    install_cache_entry entry;
+    bool hashed = cache.Hash(path, entry) == B_OK;
+    skipped = hashed && !force && cache.IsUnchanged(entry);
+    if (skipped)
+        return B_OK;
+
+    MimeTypeBundle bundle;
+    status_t result = ParseMimeTypeBundle(path, bundle);
     if (result != B_OK) {
-        fprintf(stderr, "error initializing resources from path %s: %s\n", path, strerror(result));
+        fprintf(stderr, "%s\n", bundle.error.c_str());
+        return result;
+    }
+
+    MimeTypeChanges changes;
+    result = ApplyMimeTypeBundle(database, bundle, &changes);
+    if (result != B_OK)
         return result;
+
+    UpdateExtensionIndex(database, &bundle, &changes, 1);
+
+    result = CreateIndices(database, volumes, &bundle, 1);
+    if (result == B_OK && hashed)
+        cache.Store(entry, bundle.type);
+    return result;
+}
+
+status_t InstallMimeTypesFromResources(MimeDatabase& database,
+        const std::vector<std::string>& volumes, const std::vector<std::string>& paths,
+        int32 jobs, InstallCache& cache, bool force) {
+    int32 count = (int32)paths.size();
+    std::vector<install_cache_entry> entries(count);
+    std::vector<char> changed(count, true);
+    std::vector<char> hashed(count, false);
+
+    // files unchanged since their last install are skipped before parsing
+    WorkerPool pool(jobs);
+    pool.ForEach(count, [&](int32 index) {
+        hashed[index] = cache.Hash(paths[index].c_str(), entries[index]) == B_OK;
+        changed[index] = !hashed[index] || force || !cache.IsUnchanged(entries[index]);
+    });
+
+    std::vector<int32> changedFiles;
+    for (int32 i = 0; i < count; i++) {
+        if (changed[i])
+            changedFiles.push_back(i);
     }
+    int32 changedCount = (int32)changedFiles.size();
+    if (changedCount < count) {
+        printf("%" B_PRId32 " of %" B_PRId32 " resource files unchanged since they were last "
+            "installed, skipped.\n", count - changedCount, count);
+    }
+    if (changedCount == 0)
+        return B_OK;
+
+    // parse phase: independent per file, runs on all workers
+    std::vector<MimeTypeBundle> bundles(changedCount);
+    pool.ForEach(changedCount, [&](int32 index) {
+        ParseMimeTypeBundle(paths[changedFiles[index]].c_str(), bundles[index]);
+    });
+
+    status_t result = InstallMimeTypeBundles(database, volumes, bundles.data(), changedCount,
+        "resource files");
 
-    BMimeType mimeType;
-    BMessage message;
-    const void *type, *sDesc, *lDesc, *attrInfo, *extens, *snifferRule, *prefApp, *icon;
-    size_t* size = new size_t;
+    // only a fully successful install is remembered, anything else is retried
+    if (result == B_OK) {
+        for (int32 i = 0; i < changedCount; i++) {
+            if (hashed[changedFiles[i]])
+                cache.Store(entries[changedFiles[i]], bundles[i].type);
+        }
+    }
+    return result;
+}
 
-    // get Type
-    type = resources.LoadResource(B_STRING_TYPE, "META:TYPE", size);
-    if (type == NULL) {
-        return B_ERROR;
+// Stages the bundles that were parsed and commits them as one unit, so
+// either all of their types are installed or the DB is left unchanged. A
+// bundle that failed to parse is reported as failed and doesn't hold up the
+// others. Prints a report.
+status_t InstallMimeTypeBundles(MimeDatabase& database, const std::vector<std::string>& volumes,
+        MimeTypeBundle* bundles, int32 count, const char* sources) {
+    std::vector<MimeTypeChanges> changes(count);
+    MimeTransaction transaction(database);
+    int32 failed = 0;
+    for (int32 i = 0; i < count; i++) {
+        MimeTypeBundle& bundle = bundles[i];
+        if (bundle.status == B_OK)
+            bundle.status = StageMimeTypeBundle(transaction, bundle, changes[i]);
+        else
+            fprintf(stderr, "%s\n", bundle.error.c_str());
+        if (bundle.status != B_OK)
+            failed++;
     }
 
-    const char* mime = reinterpret_cast<const char*>(type);
-    mimeType.SetTo(mime);
-    if (!mimeType.IsValid()) {
-        fprintf(stderr, "error initializing MIME type %s from resource %s: %s\n", mime, path, strerror(result));
+    status_t result = transaction.Commit();
+    int32 unchanged = 0;
+    for (int32 i = 0; i < count; i++) {
+        MimeTypeBundle& bundle = bundles[i];
+        if (bundle.status != B_OK)
+            continue;
+        if (result != B_OK) {
+            bundle.status = result;
+            failed++;
+            continue;
+        }
+        FinishMimeTypeBundle(bundle, changes[i]);
+        if (changes[i].IsEmpty())
+            unchanged++;
+    }
+
+    printf("\n%-8s %-40s %-32s %s\n", "RESULT", "MIME TYPE", "CHANGES", "SOURCE");
+    for (int32 i = 0; i < count; i++) {
+        const MimeTypeBundle& bundle = bundles[i];
+        printf("%-8s %-40s %-32s %s\n", bundle.status == B_OK ? "OK" : "FAILED",
+            bundle.type != NULL ? bundle.type : "-",
+            bundle.status == B_OK ? changes[i].Describe().c_str() : "-", bundle.path.c_str());
+    }
+    printf("%" B_PRId32 " of %" B_PRId32 " %s installed (%" B_PRId32 " unchanged), %" B_PRId32
+        " failed.\n", count - failed, count, sources, unchanged, failed);
+
+    if (result == B_OK) {
+        UpdateExtensionIndex(database, bundles, changes.data(), count);
+        result = CreateIndices(database, volumes, bundles, count);
+    }
+
+    return failed == 0 && result == B_OK ? B_OK : B_ERROR;
+}
+
+// All files are read before anything is installed, a file that cannot be
+// parsed installs nothing.
+status_t ImportSharedMimeInfo(MimeDatabase& database, const std::vector<std::string>& volumes,
+        const std::vector<std::string>& paths) {
+    std::vector<std::unique_ptr<SharedMimeInfo> > files;
+    int32 count = 0;
+    for (const std::string& path : paths) {
+        std::unique_ptr<SharedMimeInfo> file(new SharedMimeInfo);
+        status_t result = file->SetTo(path.c_str());
+        if (result != B_OK) {
+            fprintf(stderr, "%s\n", file->Error().c_str());
+            fprintf(stderr, "failed to read shared-mime-info file, nothing installed.\n");
+            return result;
+        }
+
+        printf("read %" B_PRId32 " MIME types from %s (%" B_PRId32 " globs without "
+            "extension skipped, %" B_PRId32 " magic rules simplified)\n", file->CountTypes(),
+            path.c_str(), file->CountSkippedGlobs(), file->CountSimplifiedRules());
+        count += file->CountTypes();
+        files.push_back(std::move(file));
+    }
+
+    std::vector<MimeTypeBundle> bundles(count);
+    int32 index = 0;
+    for (const std::unique_ptr<SharedMimeInfo>& file : files) {
+        for (int32 i = 0; i < file->CountTypes(); i++)
+            file->GetBundle(i, bundles[index++]);
+    }
+
+    return InstallMimeTypeBundles(database, volumes, bundles.data(), count, "MIME types");
+}
+
+// Installs what changed while nobody watched, then every batch of changed
+// files, until interrupted. A batch that fails is reported and retried with
+// the next change of its files; removed files leave their types installed.
+status_t WatchResources(MimeDatabase& database, const std::vector<std::string>& volumes,
+        const char* directory, int32 debounce, int32 jobs) {
+    // watched before the first install, so no change can slip in between
+    std::unique_ptr<DirectoryWatcher> watcher(DirectoryWatcher::Create(directory));
+    status_t result = watcher.get() != NULL ? watcher->InitCheck() : B_NO_MEMORY;
+    if (result != B_OK) {
+        fprintf(stderr, "cannot watch %s: %s\n", directory, strerror(result));
         return result;
     }
-    if (mimeType.IsInstalled()) {
-        printf("MIME type %s is already installed, updating...\n", mime);
-    } else {
-        // we need to install as first step, since all other MimeType operations act on the MIME DB directly:(
-        result = mimeType.Install();
+
+    InstallCache cache(database, volumes);
+    status_t cacheResult = cache.Load();
+    if (cacheResult != B_OK) {
+        fprintf(stderr, "ignoring install cache %s: %s\n",
+            InstallCache::PathFor(database).c_str(), strerror(cacheResult));
+    }
+
+    std::vector<std::string> changed;
+    std::vector<std::string> removed;
+    result = CollectResourcePaths(watcher->Path(), changed);
+    while (result == B_OK) {
+        if (!changed.empty()) {
+            InstallMimeTypesFromResources(database, volumes, changed, jobs, cache, false);
+            cacheResult = cache.Save();
+            if (cacheResult != B_OK)
+                fprintf(stderr, "failed to write install cache: %s\n", strerror(cacheResult));
+        }
+        for (const std::string& path : removed)
+            printf("%s was removed, its MIME type stays installed.\n", path.c_str());
+
+        printf("watching %s for changed resource files.\n", watcher->Path());
+        fflush(stdout);
+        result = watcher->WaitForChanges(debounce, changed, removed);
+    }
+
+    if (result == B_INTERRUPTED)
+        return B_OK;
+    fprintf(stderr, "stopped watching %s: %s\n", directory, strerror(result));
+    return result;
+}
+
+// The volumes of the manifest replace the --volume ones. Nothing is applied
+// unless every bundle could be planned; the plan is printed first either way.
+status_t PlanManifest(MimeDatabase& database, const std::vector<std::string>& volumes,
+        const char* path, output_format format, int32 jobs, bool apply) {
+    Manifest manifest;
+    status_t result = manifest.SetTo(path);
+    if (result != B_OK) {
+        fprintf(stderr, "%s\n", manifest.Error().c_str());
+        return result;
+    }
+
+    std::vector<std::string> paths;
+    for (const std::string& bundle : manifest.Bundles()) {
+        status_t bundleResult = CollectResourcePaths(bundle.c_str(), paths);
+        if (bundleResult != B_OK)
+            result = bundleResult;
+    }
+    if (result != B_OK) {
+        fprintf(stderr, "failed to collect resource files, nothing %s.\n",
+            apply ? "applied" : "planned");
+        return result;
+    }
+
+    const std::vector<std::string>& planVolumes
+        = manifest.Volumes().empty() ? volumes : manifest.Volumes();
+    ManifestPlan plan(database);
+    result = plan.SetTo(paths, planVolumes, manifest.ManagedSupertypes(), jobs);
+    if (result != B_OK) {
+        fprintf(stderr, "failed to plan manifest %s, nothing %s.\n", path,
+            apply ? "applied" : "planned");
+        return result;
+    }
+
+    PrintPlan(plan, format);
+    if (!apply)
+        return B_OK;
+    if (!plan.HasChanges()) {
+        printf("nothing to apply.\n");
+        return B_OK;
+    }
+    return ApplyPlan(database, planVolumes, plan, jobs);
+}
+
+// One record per step, in the order apply takes them; a summary goes to
+// stderr, so a plan without changes prints no records.
+void PrintPlan(const ManifestPlan& plan, output_format format) {
+    bool json = format == OUTPUT_FORMAT_JSON;
+    if (!json)
+        printf("action\tname\tvolume\tdetail\tsource\n");
+
+    for (const plan_step& step : plan.Steps()) {
+        std::string line;
+        if (json) {
+            line = "{\"action\":";
+            AppendJsonString(line, plan_action_name(step.action));
+            line += ",\"name\":";
+            AppendJsonString(line, step.name);
+            line += ",\"volume\":";
+            AppendJsonString(line, step.volume);
+            line += ",\"detail\":";
+            AppendJsonString(line, step.detail);
+            line += ",\"source\":";
+            AppendJsonString(line, step.source);
+            line += '}';
+        } else {
+            AppendTsvField(line, plan_action_name(step.action));
+            line += '\t';
+            AppendTsvField(line, step.name);
+            line += '\t';
+            AppendTsvField(line, step.volume);
+            line += '\t';
+            AppendTsvField(line, step.detail);
+            line += '\t';
+            AppendTsvField(line, step.source);
+        }
+        printf("%s\n", line.c_str());
+    }
+
+    fprintf(stderr, "%" B_PRId32 " to install, %" B_PRId32 " to update, %" B_PRId32 " to delete, "
+        "%" B_PRId32 " unchanged; %" B_PRId32 " indices to create, %" B_PRId32 " to remove, "
+        "%" B_PRId32 " conflicting\n", plan.CountSteps(PLAN_INSTALL),
+        plan.CountSteps(PLAN_UPDATE), plan.CountSteps(PLAN_DELETE), plan.CountUnchanged(),
+        plan.CountSteps(PLAN_CREATE_INDEX), plan.CountSteps(PLAN_REMOVE_INDEX),
+        plan.CountSteps(PLAN_INDEX_CONFLICT));
+}
+
+// All types go into one transaction, whose writes to different types run in
+// parallel, so the DB ends up as planned or unchanged. Like after install,
+// the extension index and the indices of the volumes follow the commit; the
+// registry forgets the deleted types before orphans are removed. Conflicting
+// indices are left as they are.
+status_t ApplyPlan(MimeDatabase& database, const std::vector<std::string>& volumes,
+        ManifestPlan& plan, int32 jobs) {
+    MimeTypeBundle* bundles = plan.Bundles();
+    int32 count = plan.CountBundles();
+    const std::vector<std::string>& deleted = plan.DeletedTypes();
+
+    std::vector<MimeTypeChanges> changes(count);
+    MimeTransaction transaction(database);
+    for (int32 i = 0; i < count; i++) {
+        status_t result = StageMimeTypeBundle(transaction, bundles[i], changes[i]);
         if (result != B_OK) {
-            fprintf(stderr, "error installing MIME type %s from resource %s: %s\n", mime, path, strerror(result));
+            fprintf(stderr, "cannot apply %s: %s\n", bundles[i].path.c_str(), strerror(result));
             return result;
         }
     }
+    for (const std::string& type : deleted)
+        transaction.Delete(type.c_str());
+
+    status_t result = transaction.Commit(jobs);
+    if (result != B_OK) {
+        fprintf(stderr, "failed to apply manifest, the MIME DB is unchanged: %s\n",
+            strerror(result));
+        return result;
+    }
+    STATS_ADD(STATS_TYPES_DELETED, deleted.size());
+
+    for (int32 i = 0; i < count; i++) {
+        if (!changes[i].IsEmpty())
+            FinishMimeTypeBundle(bundles[i], changes[i]);
+    }
+    for (const std::string& type : deleted)
+        printf("MIME type %s: deleted\n", type.c_str());
+
+    UpdateExtensionIndex(database, bundles, changes.data(), count);
+    if (!deleted.empty()) {
+        std::vector<extension_change> extensionChanges(deleted.size());
+        for (size_t i = 0; i < deleted.size(); i++)
+            extensionChanges[i].type = deleted[i];
+        status_t indexResult = ExtensionIndex::Update(database, extensionChanges);
+        if (indexResult != B_OK)
+            fprintf(stderr, "failed to update extension index: %s\n", strerror(indexResult));
+    }
+
+    result = CreateIndices(database, volumes, bundles, count);
+    if (!deleted.empty()) {
+        IndexRegistry registry(database);
+        status_t registryResult = registry.Load();
+        if (registryResult == B_OK) {
+            registry.RemoveTypes(deleted);
+            registryResult = registry.Save();
+        }
+        if (registryResult != B_OK) {
+            fprintf(stderr, "failed to update index registry %s: %s\n",
+                IndexRegistry::PathFor(database).c_str(), strerror(registryResult));
+        }
+    }
+    if (plan.CountSteps(PLAN_REMOVE_INDEX) > 0) {
+        status_t removeResult = RemoveOrphanedIndices(database, volumes);
+        if (result == B_OK)
+            result = removeResult;
+    }
+
+    printf("applied manifest: %" B_PRId32 " installed, %" B_PRId32 " updated, %zu deleted.\n",
+        plan.CountSteps(PLAN_INSTALL), plan.CountSteps(PLAN_UPDATE), deleted.size());
+    return result;
+}
+
+// Checks the indices of all installed types, not only the changed ones, so an
+// index removed in the meantime is recreated. Listing them once per volume
+// keeps this cheap. The index registry learns what each type declares on each
+// volume, also when that is nothing anymore.
+status_t CreateIndices(MimeDatabase& database, const std::vector<std::string>& volumes,
+        const MimeTypeBundle* bundles, int32 count) {
+    STATS_TIMER(STATS_PHASE_CREATE_INDICES);
+    IndexManager indices;
+    for (int32 i = 0; i < count; i++) {
+        const MimeTypeBundle& bundle = bundles[i];
+        if (bundle.status == B_OK && bundle.attrInfo.InitCheck() == B_OK)
+            indices.AddIndices(bundle.attrInfo, bundle.type);
+    }
+
+    status_t result = AddIndexVolumes(indices, volumes);
+    if (result != B_OK)
+        return result;
+
+    // the registry only helps cleaning up later, it doesn't fail the install
+    IndexRegistry registry(database);
+    status_t registryResult = registry.Load();
+    if (registryResult == B_BAD_DATA) {
+        fprintf(stderr, "replacing damaged index registry %s\n",
+            IndexRegistry::PathFor(database).c_str());
+        registryResult = B_OK;
+    }
+    if (registryResult == B_OK) {
+        std::vector<index_entry> attributes;
+        for (int32 i = 0; i < indices.CountVolumes(); i++) {
+            const char* volume = indices.VolumeAt(i)->Name();
+            for (int32 j = 0; j < count; j++) {
+                const MimeTypeBundle& bundle = bundles[j];
+                if (bundle.status != B_OK)
+                    continue;
+                attributes.clear();
+                if (bundle.attrInfo.InitCheck() == B_OK)
+                    IndexManager::GetSearchableAttributes(bundle.attrInfo, attributes);
+                registry.SetDeclarations(volume, bundle.type, attributes);
+            }
+        }
+        registryResult = registry.Save();
+    }
+    if (registryResult != B_OK) {
+        fprintf(stderr, "failed to update index registry %s: %s\n",
+            IndexRegistry::PathFor(database).c_str(), strerror(registryResult));
+    }
+
+    return indices.CreateMissingIndices();
+}
+
+// --volume paths, or the default volume if there is one
+status_t AddIndexVolumes(IndexManager& indices, const std::vector<std::string>& volumes) {
+    std::vector<std::string> paths = IndexVolume::PathsOrDefault(volumes);
+
+    status_t result = B_OK;
+    for (const std::string& path : paths) {
+        status_t volumeResult = indices.AddVolume(path.c_str());
+        if (volumeResult != B_OK) {
+            fprintf(stderr, "cannot use volume %s for indices: %s\n", path.c_str(),
+                strerror(volumeResult));
+            result = volumeResult;
+        }
+    }
+    return result;
+}
+
+// The index is derived from the DB, failing to update it doesn't fail the
+// install; lookup-ext --rebuild recreates it.
+void UpdateExtensionIndex(MimeDatabase& database, const MimeTypeBundle* bundles,
+        const MimeTypeChanges* changes, int32 count) {
+    STATS_TIMER(STATS_PHASE_EXTENSION_INDEX);
+    std::vector<extension_change> extensionChanges;
+    for (int32 i = 0; i < count; i++) {
+        const MimeTypeBundle& bundle = bundles[i];
+        if (bundle.status != B_OK
+            || (changes[i].fields & (1 << MIME_FIELD_EXTENSIONS)) == 0)
+            continue;
+
+        extension_change change;
+        change.type = bundle.type;
+        ExtensionIndex::GetExtensions(bundle.extensions, change.extensions);
+        extensionChanges.push_back(change);
+    }
 
-    // get short description (used as type name in prefs)
-    sDesc = resources.LoadResource('MSDC', "META:S:DESC", size);
-    if (sDesc == NULL) {
-        return B_ERROR;
+    status_t result = ExtensionIndex::Update(database, extensionChanges);
+    if (result != B_OK)
+        fprintf(stderr, "failed to update extension index: %s\n", strerror(result));
+}
+
+status_t CollectResourcePaths(const char* path, std::vector<std::string>& paths) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        status_t error = errno;
+        fprintf(stderr, "cannot access %s: %s\n", path, strerror(error));
+        return error;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        paths.push_back(path);
+        return B_OK;
     }
-    mimeType.SetShortDescription(reinterpret_cast<const char*>(sDesc));
 
-    // get long description (optional)
-    lDesc = resources.LoadResource('MLDC', "META:L:DESC", size);
-    if (lDesc != NULL) {
-        mimeType.SetLongDescription(reinterpret_cast<const char*>(lDesc));
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        status_t error = errno;
+        fprintf(stderr, "cannot read directory %s: %s\n", path, strerror(error));
+        return error;
     }
 
-    // get preferred app
-    prefApp = resources.LoadResource('MSIG', "META:PREF_APP", size);
-    if (prefApp != NULL) {
-        mimeType.SetPreferredApp(reinterpret_cast<const char*>(prefApp));
+    std::vector<std::string> entries;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.')
+            continue;
+        std::string child(path);
+        if (child.back() != '/')
+            child += "/";
+        child += entry->d_name;
+        entries.push_back(child);
     }
+    closedir(dir);
+
+    // directory order is arbitrary, keep installs reproducible
+    std::sort(entries.begin(), entries.end());
 
-    // get sniffer rule
-    snifferRule = resources.LoadResource(B_STRING_TYPE, "META:SNIFF_RULE", size);
-    if (snifferRule != NULL) {
-        mimeType.SetSnifferRule(reinterpret_cast<const char*>(snifferRule));
+    status_t result = B_OK;
+    for (const std::string& entry : entries) {
+        status_t entryResult = CollectResourcePaths(entry.c_str(), paths);
+        if (entryResult != B_OK)
+            result = entryResult;
     }
+    return result;
+}
 
-    // get extensions
-    extens = resources.LoadResource(B_MESSAGE_TYPE, "META:EXTENS", size);
-    if (extens != NULL && message.Unflatten(reinterpret_cast<const char*>(extens)) == B_OK) {
-        mimeType.SetFileExtensions(&message);
+status_t CollectResourcePathsFromList(const char* listPath, std::vector<std::string>& paths) {
+    FILE* list = strcmp(listPath, "-") == 0 ? stdin : fopen(listPath, "r");
+    if (list == NULL) {
+        status_t error = errno;
+        fprintf(stderr, "cannot open list file %s: %s\n", listPath, strerror(error));
+        return error;
     }
 
-    // get attribute info
-    attrInfo = resources.LoadResource(B_MESSAGE_TYPE, "META:ATTR_INFO", size);
-    if (attrInfo != NULL && message.Unflatten(reinterpret_cast<const char*>(attrInfo)) == B_OK) {
-        mimeType.SetAttrInfo(&message);
+    status_t result = B_OK;
+    char line[B_PATH_NAME_LENGTH];
+    while (fgets(line, sizeof(line), list) != NULL) {
+        std::string entry(line);
+        size_t start = entry.find_first_not_of(" \t\r\n");
+        if (start == std::string::npos || entry[start] == '#')
+            continue;
+        entry = entry.substr(start, entry.find_last_not_of(" \t\r\n") - start + 1);
+        status_t entryResult = CollectResourcePaths(entry.c_str(), paths);
+        if (entryResult != B_OK)
+            result = entryResult;
+    }
 
-        // check if attribute should be added to index
-        int32 indexAttrCount;
-        message.GetInfo(ATTR_INDEX, NULL, &indexAttrCount);
-        BVolume bootVolume; // FIXME
-        BVolumeRoster().GetBootVolume(&bootVolume);
+    if (list != stdin)
+        fclose(list);
+    return result;
+}
 
-        for (int i = 0; i < indexAttrCount; i++) {
-            const char* attrName = message.GetString("attr:name", i, "");
-            const char* attrPublicName = message.GetString("attr:public_name", i, "");
-            uint32      attrType = message.GetUInt32("attr:type", i, B_STRING_TYPE);
+// Removes the type, or with recursive a supertype and all its subtypes, in one
+// transaction. Afterwards the indices of their searchable attributes that no
+// remaining type declares are removed from the volumes.
+status_t UninstallMimeTypes(MimeDatabase& database, const TypeGraph& graph,
+        const std::vector<std::string>& volumes, const char* type, bool recursive,
+        bool keepIndices) {
+    if (!IsValidMimeType(type)) {
+        fprintf(stderr, "%s is not a valid MIME type.\n", type);
+        return B_BAD_VALUE;
+    }
+    const type_node* node = graph.Find(type);
+    if (node == NULL) {
+        fprintf(stderr, "MIME type %s is not installed.\n", type);
+        return B_ENTRY_NOT_FOUND;
+    }
 
-            if (message.GetBool("attr:searchable", i, false)) {
-                // add to index
-                printf("adding attribute %s ['%s'] to index...", attrPublicName, attrName);
-                int result = fs_create_index(bootVolume.Device(), attrName, attrType, 0);
-                if (result == 0) {
-                    printf("OK\n");
-                } else {
-                    printf("ERROR: %s\n", strerror(result));
+    std::vector<const type_node*> removed;
+    graph.GetDescendants(node, removed);
+    if (!removed.empty() && !recursive) {
+        fprintf(stderr, "supertype %s has %zu subtype(s), uninstall them first or use "
+            "--recursive.\n", type, removed.size());
+        return B_BUSY;
+    }
+    removed.push_back(node);
+
+    // conflicting attribute types don't matter here, only names are compared
+    IndexManager indices;
+    std::vector<std::string> types;
+    std::map<std::string, type_code> released;
+    MimeTransaction transaction(database);
+    for (const type_node* removedType : removed) {
+        for (int32 i = 0; i < removedType->attributeCount; i++) {
+            const type_attribute& attribute = removedType->attributes[i];
+            if (attribute.searchable && attribute.name[0] != '\0')
+                released.insert(std::make_pair(attribute.name, attribute.type));
+        }
+        types.push_back(removedType->name);
+        transaction.Delete(removedType->name);
+    }
+    for (const auto& attribute : released)
+        indices.AddIndex(attribute.first.c_str(), attribute.second, type);
+
+    status_t result;
+    {
+        STATS_TIMER(STATS_PHASE_DELETE);
+        result = transaction.Commit();
+    }
+    if (result != B_OK) {
+        fprintf(stderr, "failed to uninstall MIME type %s: %s\n", type, strerror(result));
+        return result;
+    }
+    STATS_ADD(STATS_TYPES_DELETED, types.size());
+
+    if (types.size() == 1)
+        printf("successfully uninstalled MIME type %s.\n", type);
+    else {
+        printf("successfully uninstalled MIME type %s and its %zu subtype(s).\n", type,
+            types.size() - 1);
+    }
+
+    std::vector<extension_change> changes(types.size());
+    for (size_t i = 0; i < types.size(); i++)
+        changes[i].type = types[i];
+    status_t indexResult = ExtensionIndex::Update(database, changes);
+    if (indexResult != B_OK)
+        fprintf(stderr, "failed to update extension index: %s\n", strerror(indexResult));
+
+    // the registry forgets the types even if their indices are kept
+    IndexRegistry registry(database);
+    status_t registryResult = registry.Load();
+    if (registryResult == B_OK)
+        registry.RemoveTypes(types);
+
+    if (!keepIndices && indices.CountIndices() > 0) {
+        index_declarations declarations;
+        result = IndexManager::GetDeclarations(database, declarations);
+        if (result != B_OK) {
+            fprintf(stderr, "cannot tell which indices are still used, keeping them: %s\n",
+                strerror(result));
+            result = B_OK;
+        } else if ((result = AddIndexVolumes(indices, volumes)) == B_OK) {
+            result = indices.RemoveUnusedIndices(declarations);
+            std::vector<index_entry> existing;
+            for (int32 i = 0; i < indices.CountVolumes() && registryResult == B_OK; i++) {
+                IndexVolume* volume = indices.VolumeAt(i);
+                if (volume->GetIndices(existing) == B_OK)
+                    registry.Prune(volume->Name(), existing);
+            }
+        }
+    }
+
+    if (registryResult == B_OK)
+        registryResult = registry.Save();
+    if (registryResult != B_OK) {
+        fprintf(stderr, "failed to update index registry %s: %s\n",
+            IndexRegistry::PathFor(database).c_str(), strerror(registryResult));
+    }
+    return result;
+}
+
+// One record per index the installed types declare searchable or the index
+// registry remembers, for each volume; a summary per volume goes to stderr.
+status_t PrintIndexStatus(MimeDatabase& database, const std::vector<std::string>& volumes,
+        output_format format) {
+    index_declarations declarations;
+    status_t result = IndexManager::GetDeclarations(database, declarations);
+    if (result != B_OK) {
+        fprintf(stderr, "failed to read the declared indices: %s\n", strerror(result));
+        return result;
+    }
+
+    IndexRegistry registry(database);
+    status_t registryResult = registry.Load();
+    if (registryResult != B_OK) {
+        fprintf(stderr, "ignoring index registry %s, orphans are not reported: %s\n",
+            IndexRegistry::PathFor(database).c_str(), strerror(registryResult));
+    }
+
+    IndexManager indices;
+    result = AddIndexVolumes(indices, volumes);
+    if (result != B_OK)
+        return result;
+
+    bool json = format == OUTPUT_FORMAT_JSON;
+    if (!json)
+        printf("volume\tindex\ttype\tstate\tmime_types\n");
+
+    std::vector<index_check> checks;
+    for (int32 i = 0; i < indices.CountVolumes(); i++) {
+        IndexVolume& volume = *indices.VolumeAt(i);
+        status_t volumeResult = registry.Check(volume, declarations, checks);
+        if (volumeResult != B_OK) {
+            fprintf(stderr, "failed to read indices of volume %s: %s\n", volume.Name(),
+                strerror(volumeResult));
+            result = volumeResult;
+            continue;
+        }
+
+        int32 counts[INDEX_STATE_ORPHANED + 1] = {};
+        for (const index_check& check : checks) {
+            counts[check.state]++;
+            std::string line;
+            if (json) {
+                line = "{\"volume\":";
+                AppendJsonString(line, volume.Name());
+                line += ",\"index\":";
+                AppendJsonString(line, check.name);
+                line += ",\"type\":";
+                AppendJsonString(line, type_code_string(check.type));
+                line += ",\"state\":";
+                AppendJsonString(line, index_state_name(check.state));
+                line += ",\"mime_types\":[";
+                for (size_t j = 0; j < check.mimeTypes.size(); j++) {
+                    if (j > 0)
+                        line += ',';
+                    AppendJsonString(line, check.mimeTypes[j]);
                 }
+                line += "]}";
             } else {
-                printf("keeping attribute %s ['%s'] in index...", attrPublicName, attrName);
-                printf("OK\n");
+                AppendTsvField(line, volume.Name());
+                line += '\t';
+                AppendTsvField(line, check.name);
+                line += '\t';
+                AppendTsvField(line, type_code_string(check.type));
+                line += '\t';
+                line += index_state_name(check.state);
+                line += '\t';
+                for (size_t j = 0; j < check.mimeTypes.size(); j++) {
+                    if (j > 0)
+                        line += ',';
+                    AppendTsvField(line, check.mimeTypes[j]);
+                }
             }
+            printf("%s\n", line.c_str());
         }
+
+        fprintf(stderr, "volume %s: %" B_PRId32 " ok, %" B_PRId32 " missing, %" B_PRId32
+            " wrong type, %" B_PRId32 " orphaned\n", volume.Name(), counts[INDEX_STATE_OK],
+            counts[INDEX_STATE_MISSING], counts[INDEX_STATE_WRONG_TYPE],
+            counts[INDEX_STATE_ORPHANED]);
     }
+    return result;
+}
 
-    // get icon
-    icon = resources.LoadResource(B_VECTOR_ICON_TYPE, "META:ICON", size);
-    if (icon != NULL && *size > 0) {
-        mimeType.SetIcon(reinterpret_cast<const uint8*>(icon), *size);
+// Removes the orphaned indices of every volume in one pass over the volume,
+// and forgets them in the registry.
+status_t RemoveOrphanedIndices(MimeDatabase& database, const std::vector<std::string>& volumes) {
+    index_declarations declarations;
+    status_t result = IndexManager::GetDeclarations(database, declarations);
+    if (result != B_OK) {
+        fprintf(stderr, "failed to read the declared indices: %s\n", strerror(result));
+        return result;
     }
 
-    return B_OK;
+    IndexRegistry registry(database);
+    result = registry.Load();
+    if (result != B_OK) {
+        fprintf(stderr, "cannot read index registry %s: %s\n",
+            IndexRegistry::PathFor(database).c_str(), strerror(result));
+        return result;
+    }
+
+    std::vector<std::string> paths = IndexVolume::PathsOrDefault(volumes);
+
+    std::vector<index_check> checks;
+    std::vector<index_entry> existing;
+    for (const std::string& path : paths) {
+        // orphans differ per volume, so does what is removed
+        IndexManager orphans;
+        status_t volumeResult = orphans.AddVolume(path.c_str());
+        if (volumeResult == B_OK)
+            volumeResult = registry.Check(*orphans.VolumeAt(0), declarations, checks);
+        if (volumeResult != B_OK) {
+            fprintf(stderr, "cannot check indices of volume %s: %s\n", path.c_str(),
+                strerror(volumeResult));
+            result = volumeResult;
+            continue;
+        }
+
+        IndexVolume& volume = *orphans.VolumeAt(0);
+        for (const index_check& check : checks) {
+            if (check.state == INDEX_STATE_ORPHANED)
+                orphans.AddIndex(check.name.c_str(), check.type, "");
+        }
+        if (orphans.CountIndices() == 0)
+            printf("volume %s: no orphaned indices\n", volume.Name());
+        else {
+            volumeResult = orphans.RemoveUnusedIndices(declarations);
+            if (volumeResult != B_OK)
+                result = volumeResult;
+        }
+
+        if (volume.GetIndices(existing) == B_OK)
+            registry.Prune(volume.Name(), existing);
+    }
+
+    status_t registryResult = registry.Save();
+    if (registryResult != B_OK) {
+        fprintf(stderr, "failed to update index registry %s: %s\n",
+            IndexRegistry::PathFor(database).c_str(), strerror(registryResult));
+        return registryResult;
+    }
+    return result;
 }
 
-status_t DeleteMimeType(const char* type) {
-    BMimeType mimeType(type);
-    status_t result;
+// File systems keep their indices current themselves, the stand-in indices
+// only change here.
+status_t UpdateIndices(const std::vector<std::string>& volumes) {
+    std::vector<std::string> paths = IndexVolume::PathsOrDefault(volumes);
+    if (paths.empty()) {
+        fprintf(stderr, "no volume to update, pass --volume=<path>\n");
+        return B_BAD_VALUE;
+    }
 
-    if (!mimeType.IsValid()) {
-        fprintf(stderr, "%s is not a valid MIME type.\n", type);
+    status_t result = B_OK;
+    for (const std::string& path : paths) {
+        std::unique_ptr<IndexVolume> volume(IndexVolume::Create(path.c_str()));
+        status_t volumeResult = volume.get() != NULL ? volume->InitCheck() : B_NO_MEMORY;
+        int64 files = 0;
+        int64 keys = 0;
+        if (volumeResult == B_OK)
+            volumeResult = volume->UpdateIndices(files, keys);
+
+        if (volumeResult == B_NOT_SUPPORTED) {
+            printf("volume %s: indices are kept up to date by the file system\n",
+                volume->Name());
+        } else if (volumeResult != B_OK) {
+            fprintf(stderr, "failed to update indices of volume %s: %s\n", path.c_str(),
+                strerror(volumeResult));
+            result = volumeResult;
+        } else {
+            printf("volume %s: %" B_PRId64 " key(s) of %" B_PRId64 " file(s) indexed\n",
+                volume->Name(), keys, files);
+        }
+    }
+    return result;
+}
+
+// Matching files are printed as they are found; the plan (with --explain)
+// and a summary per volume go to stderr.
+status_t QueryFiles(MimeDatabase& database, const std::vector<std::string>& volumes,
+        const char* type, const char* predicate, bool explain) {
+    if (!database.IsInstalled(type)) {
+        fprintf(stderr, "MIME type %s is not installed\n", type);
+        return B_ENTRY_NOT_FOUND;
+    }
+
+    std::string data;
+    FlatMessage attrInfo;
+    status_t result = database.GetField(type, MIME_FIELD_ATTR_INFO, data);
+    if (result == B_OK)
+        attrInfo.SetTo(data.data(), data.size());
+    else if (result != B_ENTRY_NOT_FOUND) {
+        fprintf(stderr, "failed to read the attributes of %s: %s\n", type, strerror(result));
         return result;
     }
-    if (!mimeType.IsInstalled()) {
-        printf("MIME type %s is not installed, skipping...", type);
+
+    Query query;
+    if (query.SetTo(type, attrInfo, predicate) != B_OK) {
+        fprintf(stderr, "invalid query: %s\n", query.Error().c_str());
+        return B_BAD_VALUE;
+    }
+
+    std::vector<std::string> paths = IndexVolume::PathsOrDefault(volumes);
+    if (paths.empty()) {
+        fprintf(stderr, "no volume to query, pass --volume=<path>\n");
+        return B_BAD_VALUE;
     }
 
-    return mimeType.Delete();
+    result = B_OK;
+    for (const std::string& path : paths) {
+        std::unique_ptr<IndexVolume> volume(IndexVolume::Create(path.c_str()));
+        status_t volumeResult = volume.get() != NULL ? volume->InitCheck() : B_NO_MEMORY;
+        if (volumeResult == B_OK) {
+            STATS_TIMER(STATS_PHASE_QUERY_PLAN);
+            volumeResult = query.Plan(*volume);
+        }
+        if (volumeResult != B_OK) {
+            fprintf(stderr, "cannot query volume %s: %s\n", path.c_str(),
+                strerror(volumeResult));
+            result = volumeResult;
+            continue;
+        }
+        if (explain) {
+            fprintf(stderr, "volume %s:\n%squery: %s\n", volume->Name(),
+                query.Describe().c_str(), query.FsPredicate().c_str());
+        }
+
+        int64 matches = 0;
+        int64 checked = 0;
+        {
+            STATS_TIMER(STATS_PHASE_QUERY);
+            volumeResult = query.Run(*volume, [&matches](const char* file) {
+                matches++;
+                printf("%s\n", file);
+                return true;
+            }, checked);
+        }
+        STATS_ADD(STATS_FILES_CHECKED, checked);
+        STATS_ADD(STATS_FILES_MATCHED, matches);
+        if (volumeResult != B_OK) {
+            fprintf(stderr, "query on volume %s failed: %s\n", volume->Name(),
+                strerror(volumeResult));
+            result = volumeResult;
+            continue;
+        }
+
+        if (checked > 0) {
+            fprintf(stderr, "volume %s: %" B_PRId64 " matching file(s), %" B_PRId64
+                " checked\n", volume->Name(), matches, checked);
+        } else {
+            fprintf(stderr, "volume %s: %" B_PRId64 " matching file(s)\n", volume->Name(),
+                matches);
+        }
+    }
+    return result;
 }
 
-status_t
-GetInstalledMimeTypes(const char* supertype, BMessage* types)
-{
-	return BMimeType::GetInstalledTypes(supertype, types);
+// Output is streamed as files are identified, in no particular order; the
+// summary goes to stderr to keep stdout machine readable.
+status_t IdentifyFiles(const TypeIdentifier& identifier, const std::vector<std::string>& paths,
+        output_format format, int32 jobs, bool writeType, bool force) {
+    struct worker_state {
+        std::string         output;
+        std::vector<uint8>  buffer;
+        int64               sources[IDENTIFY_SOURCE_DEFAULT + 1] = {};
+        int64               written = 0;
+        int64               failed = 0;
+    };
+
+    WorkStealingPool pool(jobs);
+    std::vector<worker_state> states(pool.ThreadCount());
+    std::mutex outputLock;
+    const size_t kFlushSize = 64 * 1024;
+    const size_t kBatchSize = 64;
+
+    auto flush = [&](std::string& output) {
+        std::lock_guard<std::mutex> locker(outputLock);
+        fwrite(output.data(), 1, output.size(), stdout);
+        output.clear();
+    };
+
+    auto identify = [&](const std::string& path, int32 worker) {
+        worker_state& state = states[worker];
+        identify_result identified;
+        status_t fileResult = identifier.IdentifyFile(path.c_str(), state.buffer, identified);
+        if (fileResult != B_OK) {
+            fprintf(stderr, "cannot read %s: %s\n", path.c_str(), strerror(fileResult));
+            state.failed++;
+            return;
+        }
+        state.sources[identified.source]++;
+
+        if (writeType) {
+            std::string current;
+            bool typed = ReadAttribute(path.c_str(), FILE_TYPE_ATTR, current) == B_OK
+                && current.size() > 1;
+            if ((!typed || force) && strcmp(current.c_str(), identified.type) != 0) {
+                fileResult = WriteAttribute(path.c_str(), FILE_TYPE_ATTR, B_MIME_STRING_TYPE,
+                    identified.type, strlen(identified.type) + 1);
+                if (fileResult != B_OK) {
+                    fprintf(stderr, "cannot write type of %s: %s\n", path.c_str(),
+                        strerror(fileResult));
+                    state.failed++;
+                } else
+                    state.written++;
+            }
+        }
+
+        std::string& output = state.output;
+        if (format == OUTPUT_FORMAT_JSON) {
+            output += "{\"path\":";
+            AppendJsonString(output, path);
+            output += ",\"type\":";
+            AppendJsonString(output, identified.type);
+            output += ",\"source\":";
+            AppendJsonString(output, identify_source_name(identified.source));
+            output += "}\n";
+        } else {
+            AppendTsvField(output, path);
+            output += '\t';
+            AppendTsvField(output, identified.type);
+            output += '\t';
+            output += identify_source_name(identified.source);
+            output += '\n';
+        }
+        if (output.size() >= kFlushSize)
+            flush(output);
+    };
+
+    // directories become tasks of their own, files are identified in batches
+    std::function<void(const std::string&, int32)> visit;
+    visit = [&](const std::string& directory, int32 worker) {
+        DIR* dir = opendir(directory.c_str());
+        if (dir == NULL) {
+            fprintf(stderr, "cannot read directory %s: %s\n", directory.c_str(),
+                strerror(errno));
+            states[worker].failed++;
+            return;
+        }
+
+        std::vector<std::string> files;
+        while (struct dirent* entry = readdir(dir)) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+
+            std::string path = directory;
+            if (path.back() != '/')
+                path += "/";
+            path += entry->d_name;
+
+            // symlinks are not followed, they could form cycles
+            bool isDirectory;
+            bool isFile;
+#ifdef _DIRENT_HAVE_D_TYPE
+            if (entry->d_type != DT_UNKNOWN) {
+                isDirectory = entry->d_type == DT_DIR;
+                isFile = entry->d_type == DT_REG;
+            } else
+#endif
+            {
+                struct stat st;
+                if (lstat(path.c_str(), &st) != 0)
+                    continue;
+                isDirectory = S_ISDIR(st.st_mode);
+                isFile = S_ISREG(st.st_mode);
+            }
+
+            if (isDirectory) {
+                pool.Submit([&visit, path](int32 worker) { visit(path, worker); });
+            } else if (isFile) {
+                files.push_back(path);
+                if (files.size() == kBatchSize) {
+                    pool.Submit([&identify, files](int32 worker) {
+                        for (const std::string& file : files)
+                            identify(file, worker);
+                    });
+                    files.clear();
+                }
+            }
+        }
+        closedir(dir);
+
+        for (const std::string& file : files)
+            identify(file, worker);
+    };
+
+    for (const std::string& path : paths) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            fprintf(stderr, "cannot access %s: %s\n", path.c_str(), strerror(errno));
+            states[0].failed++;
+        } else if (S_ISDIR(st.st_mode)) {
+            pool.Submit([&visit, path](int32 worker) { visit(path, worker); });
+        } else {
+            pool.Submit([&identify, path](int32 worker) { identify(path, worker); });
+        }
+    }
+
+    pool.Run();
+
+    worker_state total;
+    for (worker_state& state : states) {
+        flush(state.output);
+        for (int32 i = 0; i <= IDENTIFY_SOURCE_DEFAULT; i++)
+            total.sources[i] += state.sources[i];
+        total.written += state.written;
+        total.failed += state.failed;
+    }
+    fflush(stdout);
+
+    int64 identified = total.sources[IDENTIFY_SOURCE_SNIFFER]
+        + total.sources[IDENTIFY_SOURCE_EXTENSION] + total.sources[IDENTIFY_SOURCE_DEFAULT];
+    fprintf(stderr, "identified %" B_PRId64 " files (%" B_PRId64 " by sniffer rule, %" B_PRId64
+        " by extension, %" B_PRId64 " defaulted), %" B_PRId64 " types written, %" B_PRId64
+        " failed.\n", identified, total.sources[IDENTIFY_SOURCE_SNIFFER],
+        total.sources[IDENTIFY_SOURCE_EXTENSION], total.sources[IDENTIFY_SOURCE_DEFAULT],
+        total.written, total.failed);
+
+    return total.failed == 0 ? B_OK : B_ERROR;
+}
+
+// With more than one extension, every type is prefixed by its extension.
+status_t LookupExtensions(MimeDatabase& database, const std::vector<std::string>& extensions,
+        bool rebuild) {
+    std::string path = ExtensionIndex::PathFor(database);
+    ExtensionIndex index;
+    if (rebuild || index.SetTo(path.c_str()) != B_OK) {
+        status_t result = ExtensionIndex::Rebuild(database);
+        if (result == B_OK)
+            result = index.SetTo(path.c_str());
+        if (result != B_OK) {
+            fprintf(stderr, "failed to build extension index %s: %s\n", path.c_str(),
+                strerror(result));
+            return result;
+        }
+    }
+
+    status_t result = B_OK;
+    std::vector<std::string_view> types;
+    for (const std::string& extension : extensions) {
+        status_t lookupResult = index.Lookup(extension.c_str(), types);
+        if (lookupResult != B_OK) {
+            if (lookupResult == B_ENTRY_NOT_FOUND)
+                fprintf(stderr, "no type claims extension %s\n", extension.c_str());
+            else
+                fprintf(stderr, "failed to look up extension %s: %s\n", extension.c_str(),
+                    strerror(lookupResult));
+            result = lookupResult;
+            continue;
+        }
+
+        for (std::string_view type : types) {
+            if (extensions.size() > 1)
+                printf("%s\t", extension.c_str());
+            printf("%.*s\n", (int)type.size(), type.data());
+        }
+    }
+    return result;
+}
+
+// Supertypes are exported along with their subtypes, but only if they have a
+// short description of their own; otherwise they could not be installed.
+status_t ExportMimeTypes(MimeDatabase& database, const TypeGraph& graph,
+        const std::vector<std::string>& selection, const char* directory, int32 jobs) {
+    std::vector<std::string> types;
+    for (int32 i = 0; selection.empty() && i < graph.CountTypes(); i++)
+        types.push_back(graph.TypeAt(i)->name);
+    std::vector<const type_node*> selected;
+    for (const std::string& type : selection) {
+        const type_node* node = graph.Find(type.c_str());
+        if (node == NULL) {
+            fprintf(stderr, "MIME type %s is not installed\n", type.c_str());
+            return B_ENTRY_NOT_FOUND;
+        }
+        selected.push_back(node);
+        graph.GetDescendants(node, selected);
+    }
+    for (const type_node* node : selected)
+        types.push_back(node->name);
+    status_t result = B_OK;
+
+    // all directories first, the types are then written in any order
+    std::sort(types.begin(), types.end());
+    types.erase(std::unique(types.begin(), types.end()), types.end());
+    int32 count = (int32)types.size();
+    std::vector<std::string> paths(count);
+    for (int32 i = 0; i < count && result == B_OK; i++) {
+        std::string path = std::string(directory) + "/" + types[i];
+        std::transform(path.begin(), path.end(), path.begin(), ::tolower);
+        paths[i] = path + ".rsrc";
+        result = CreateDirectories(path.substr(0, path.find_last_of('/')).c_str());
+        if (result != B_OK)
+            fprintf(stderr, "cannot create directory for %s: %s\n", path.c_str(),
+                strerror(result));
+    }
+    if (result != B_OK)
+        return result;
+
+    std::vector<status_t> results(count);
+    WorkerPool pool(jobs);
+    pool.ForEach(count, [&](int32 index) {
+        results[index] = WriteMimeTypeBundle(database, types[index].c_str(),
+            paths[index].c_str());
+    });
+
+    int32 exported = 0;
+    int32 skipped = 0;
+    int32 failed = 0;
+    for (int32 i = 0; i < count; i++) {
+        if (results[i] == B_OK)
+            exported++;
+        else if (results[i] == B_NAME_NOT_FOUND && types[i].find('/') == std::string::npos)
+            skipped++;
+        else {
+            fprintf(stderr, "failed to export MIME type %s: %s\n", types[i].c_str(),
+                results[i] == B_NAME_NOT_FOUND ? "it has no short description"
+                    : strerror(results[i]));
+            failed++;
+        }
+    }
+
+    printf("exported %" B_PRId32 " MIME types to %s, %" B_PRId32 " supertypes without "
+        "description skipped, %" B_PRId32 " failed.\n", exported, directory, skipped, failed);
+    return failed == 0 ? B_OK : B_ERROR;
+}
+
+// One record per relation type that connects the two types, with the
+// endpoints it declares (null in JSON, empty in TSV, for any entity).
+status_t ListRelations(const TypeGraph& graph, const char* source, const char* target,
+        output_format format) {
+    const type_node* sourceType = graph.Find(source);
+    const type_node* targetType = graph.Find(target);
+    if (sourceType == NULL || targetType == NULL) {
+        fprintf(stderr, "MIME type %s is not installed\n",
+            sourceType == NULL ? source : target);
+        return B_ENTRY_NOT_FOUND;
+    }
+
+    bool json = format == OUTPUT_FORMAT_JSON;
+    if (!json)
+        printf("relation\tsources\ttargets\n");
+
+    auto appendEndpoints = [json](std::string& line, const type_node** endpoints,
+            int32 count) {
+        if (json && endpoints == NULL) {
+            line += "null";
+            return;
+        }
+        if (json)
+            line += '[';
+        for (int32 i = 0; i < count; i++) {
+            if (i > 0)
+                line += ',';
+            if (json)
+                AppendJsonString(line, endpoints[i]->name);
+            else
+                AppendTsvField(line, endpoints[i]->name);
+        }
+        if (json)
+            line += ']';
+    };
+
+    int32 count = 0;
+    for (int32 i = 0; i < graph.CountTypes(); i++) {
+        const type_node* relation = graph.TypeAt(i);
+        if (!graph.CanRelate(relation, sourceType, targetType))
+            continue;
+
+        std::string line;
+        if (json) {
+            line = "{\"relation\":";
+            AppendJsonString(line, relation->name);
+            line += ",\"sources\":";
+            appendEndpoints(line, relation->sources, relation->sourceCount);
+            line += ",\"targets\":";
+            appendEndpoints(line, relation->targets, relation->targetCount);
+            line += '}';
+        } else {
+            AppendTsvField(line, relation->name);
+            line += '\t';
+            appendEndpoints(line, relation->sources, relation->sourceCount);
+            line += '\t';
+            appendEndpoints(line, relation->targets, relation->targetCount);
+        }
+        printf("%s\n", line.c_str());
+        count++;
+    }
+
+    fprintf(stderr, "%" B_PRId32 " relation type(s) from %s to %s\n", count, sourceType->name,
+        targetType->name);
+    return B_OK;
+}
+
+status_t BuildSnapshot(MimeDatabase& database, const char* path) {
+    status_t result = MimeSnapshot::Build(database, path);
+    if (result != B_OK) {
+        fprintf(stderr, "failed to build snapshot %s: %s\n", path, strerror(result));
+        return result;
+    }
+    return PrintSnapshotInfo(path);
+}
+
+status_t PrintSnapshotInfo(const char* path) {
+    MimeSnapshot snapshot;
+    status_t result = snapshot.SetTo(path);
+    if (result != B_OK) {
+        fprintf(stderr, "failed to open snapshot %s: %s\n", path, strerror(result));
+        return result;
+    }
+
+    int32 extensions = 0;
+    int32 attributes = 0;
+    int32 rules = 0;
+    int32 invalidRules = 0;
+    SnifferRule rule;
+    for (int32 i = 0; i < snapshot.CountTypes(); i++) {
+        extensions += snapshot.CountExtensions(i);
+        attributes += snapshot.CountAttributes(i);
+        if (snapshot.GetSnifferRuleAt(i, rule) == B_OK)
+            rules++;
+        else if (snapshot.StringFieldAt(i, MIME_FIELD_SNIFFER_RULE) != NULL)
+            invalidRules++;
+    }
+
+    printf("snapshot %s: %" B_PRId32 " types, %" B_PRId32 " extensions, %" B_PRId32
+        " attributes, %" B_PRId32 " compiled sniffer rules\n", path, snapshot.CountTypes(),
+        extensions, attributes, rules);
+    if (invalidRules > 0)
+        printf("  %" B_PRId32 " sniffer rules did not compile\n", invalidRules);
+    return B_OK;
 }
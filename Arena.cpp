@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+Arena::Arena(size_t chunkSize)
+    :
+    fNext(NULL),
+    fRemaining(0),
+    fChunkSize(chunkSize),
+    fSize(0),
+    fCapacity(0)
+{
+}
+
+Arena::~Arena()
+{
+    Clear();
+}
+
+void*
+Arena::Allocate(size_t size, size_t alignment)
+{
+    size_t padding = (alignment - (uintptr_t)fNext % alignment) % alignment;
+    if (fNext == NULL || padding + size > fRemaining) {
+        // large blocks get a chunk of their own, the current one stays in use
+        size_t chunkSize = size + alignment > fChunkSize ? size + alignment : fChunkSize;
+        uint8* chunk = (uint8*)malloc(chunkSize);
+        if (chunk == NULL)
+            return NULL;
+        fChunks.push_back(chunk);
+        fCapacity += chunkSize;
+
+        padding = (alignment - (uintptr_t)chunk % alignment) % alignment;
+        if (chunkSize > fChunkSize) {
+            fSize += size;
+            return chunk + padding;
+        }
+        fNext = chunk;
+        fRemaining = chunkSize;
+    }
+
+    uint8* block = fNext + padding;
+    fNext = block + size;
+    fRemaining -= padding + size;
+    fSize += size;
+    return block;
+}
+
+const char*
+Arena::CopyString(const char* string, size_t length)
+{
+    char* copy = (char*)Allocate(length + 1, 1);
+    if (copy == NULL)
+        return NULL;
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+void
+Arena::Clear()
+{
+    for (uint8* chunk : fChunks)
+        free(chunk);
+    fChunks.clear();
+    fNext = NULL;
+    fRemaining = 0;
+    fSize = 0;
+    fCapacity = 0;
+}
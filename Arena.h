@@ -0,0 +1,50 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "Platform.h"
+
+// Hands out memory from large chunks that are only freed all at once, for
+// structures built in one go and then read, like the type graph. Nothing
+// allocated from it is destructed.
+class Arena {
+public:
+                            Arena(size_t chunkSize = 64 * 1024);
+                            ~Arena();
+
+            // NULL if out of memory
+            void*           Allocate(size_t size,
+                                size_t alignment = alignof(max_align_t));
+            template<typename T>
+            T*              AllocateArray(size_t count)
+                                { return (T*)Allocate(count * sizeof(T),
+                                    alignof(T)); }
+            // a NUL terminated copy
+            const char*     CopyString(const char* string, size_t length);
+
+            void            Clear();
+
+            // bytes handed out, and taken from the system for that
+            size_t          Size() const { return fSize; }
+            size_t          Capacity() const { return fCapacity; }
+
+private:
+                            Arena(const Arena&);
+            Arena&          operator=(const Arena&);
+
+            std::vector<uint8*> fChunks;
+            uint8*          fNext;
+            size_t          fRemaining;
+            size_t          fChunkSize;
+            size_t          fSize;
+            size_t          fCapacity;
+};
+
+#endif // _ARENA_H
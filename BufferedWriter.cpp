@@ -0,0 +1,116 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "BufferedWriter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+BufferedWriter::BufferedWriter(size_t bufferSize)
+    :
+    fFD(-1),
+    fStatus(B_NO_INIT),
+    fBuffer(std::max<size_t>(bufferSize, 1)),
+    fBuffered(0),
+    fPosition(0)
+{
+}
+
+BufferedWriter::~BufferedWriter()
+{
+    Close();
+}
+
+status_t
+BufferedWriter::SetTo(const char* path)
+{
+    Close();
+
+    fBuffered = 0;
+    fPosition = 0;
+    fFD = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    return fStatus = fFD >= 0 ? B_OK : errno;
+}
+
+status_t
+BufferedWriter::Write(const void* _data, size_t size)
+{
+    if (fStatus != B_OK)
+        return fStatus;
+
+    const uint8* data = (const uint8*)_data;
+    fPosition += size;
+
+    // large writes bypass the buffer once it is flushed
+    if (fBuffered + size > fBuffer.size()) {
+        if (Flush() != B_OK)
+            return fStatus;
+        if (size >= fBuffer.size())
+            return _WriteAll(data, size);
+    }
+
+    memcpy(&fBuffer[fBuffered], data, size);
+    fBuffered += size;
+    return B_OK;
+}
+
+status_t
+BufferedWriter::WriteZeros(size_t size)
+{
+    static const uint8 kZeros[256] = {};
+    while (size > 0 && fStatus == B_OK) {
+        size_t chunk = std::min(size, sizeof(kZeros));
+        Write(kZeros, chunk);
+        size -= chunk;
+    }
+    return fStatus;
+}
+
+status_t
+BufferedWriter::Flush()
+{
+    if (fStatus != B_OK || fBuffered == 0)
+        return fStatus;
+
+    size_t size = fBuffered;
+    fBuffered = 0;
+    return _WriteAll(fBuffer.data(), size);
+}
+
+status_t
+BufferedWriter::Close()
+{
+    if (fFD < 0)
+        return fStatus;
+
+    Flush();
+    if (close(fFD) != 0 && fStatus == B_OK)
+        fStatus = errno;
+    fFD = -1;
+
+    status_t result = fStatus;
+    if (fStatus == B_OK)
+        fStatus = B_NO_INIT;
+    return result;
+}
+
+status_t
+BufferedWriter::_WriteAll(const uint8* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = write(fFD, data, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0)
+            return fStatus = errno;
+        data += written;
+        size -= written;
+    }
+    return B_OK;
+}
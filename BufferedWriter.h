@@ -0,0 +1,45 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _BUFFERED_WRITER_H
+#define _BUFFERED_WRITER_H
+
+#include "Platform.h"
+
+#include <vector>
+
+// Writes a new file through a buffer, so many small writes turn into a few
+// large ones. The first error sticks: later writes are ignored and Close()
+// returns it, so callers only need to check the result of Close().
+class BufferedWriter {
+public:
+                            BufferedWriter(size_t bufferSize = 64 * 1024);
+                            ~BufferedWriter();
+
+            // creates the file, or truncates an existing one
+            status_t        SetTo(const char* path);
+            status_t        InitCheck() const { return fStatus; }
+
+            status_t        Write(const void* data, size_t size);
+            status_t        WriteZeros(size_t size);
+            status_t        Flush();
+            // flushes and closes the file
+            status_t        Close();
+
+            off_t           Position() const { return fPosition; }
+
+private:
+                            BufferedWriter(const BufferedWriter&);
+            BufferedWriter& operator=(const BufferedWriter&);
+
+            status_t        _WriteAll(const uint8* data, size_t size);
+
+            int             fFD;
+            status_t        fStatus;
+            std::vector<uint8> fBuffer;
+            size_t          fBuffered;
+            off_t           fPosition;
+};
+
+#endif // _BUFFERED_WRITER_H
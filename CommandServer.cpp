@@ -0,0 +1,592 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "CommandServer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <thread>
+
+static const uint32 kMaxRequestSize = 1024 * 1024;
+// output is sent in frames of up to this size, plus the kind
+static const size_t kChunkSize = 16 * 1024;
+// a command is paused while this much of its output waits for its client
+static const size_t kMaxQueuedOutput = 1024 * 1024;
+
+struct CommandServer::command {
+    bool                active;
+    int                 client;         // -1 once the client is gone
+    std::string         request;        // the arguments point into it
+    std::vector<char*>  arguments;
+    // read ends of the pipes, -1 once the command closed them
+    int                 output;
+    int                 error;
+    // write ends, handed to the command
+    int                 outputWriter;
+    int                 errorWriter;
+    int                 status;
+    std::thread         thread;
+};
+
+static volatile sig_atomic_t sQuit = 0;
+
+static void
+handle_quit(int)
+{
+    sQuit = 1;
+}
+
+static status_t
+make_address(const char* path, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+        return B_BAD_VALUE;
+    strcpy(address.sun_path, path);
+    return B_OK;
+}
+
+static status_t
+send_all(int socket, const void* _data, size_t size)
+{
+    const uint8* data = (const uint8*)_data;
+    while (size > 0) {
+        ssize_t sent = send(socket, data, size, 0);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return B_OK;
+}
+
+// returns B_ENTRY_NOT_FOUND if the peer closed the connection before the first byte
+static status_t
+receive_all(int socket, void* _data, size_t size)
+{
+    uint8* data = (uint8*)_data;
+    size_t received = 0;
+    while (received < size) {
+        ssize_t count = recv(socket, data + received, size - received, 0);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        if (count == 0)
+            return received == 0 ? B_ENTRY_NOT_FOUND : B_IO_ERROR;
+        received += count;
+    }
+    return B_OK;
+}
+
+static status_t
+send_frame(int socket, const std::string& payload)
+{
+    uint32 size = (uint32)payload.size();
+    status_t result = send_all(socket, &size, sizeof(size));
+    if (result != B_OK)
+        return result;
+    return send_all(socket, payload.data(), payload.size());
+}
+
+static status_t
+receive_frame(int socket, uint32 maxSize, std::string& payload)
+{
+    uint32 size;
+    status_t result = receive_all(socket, &size, sizeof(size));
+    if (result != B_OK)
+        return result;
+    if (size > maxSize)
+        return B_BAD_DATA;
+
+    payload.resize(size);
+    result = receive_all(socket, &payload[0], size);
+    return result == B_ENTRY_NOT_FOUND ? B_IO_ERROR : result;
+}
+
+static void
+append_frame(std::string& output, uint8 kind, const void* data, size_t size)
+{
+    uint32 frameSize = (uint32)size + 1;
+    output.append((const char*)&frameSize, sizeof(frameSize));
+    output += (char)kind;
+    output.append((const char*)data, size);
+}
+
+static void
+append_message(std::string& output, const std::string& message, int32 status)
+{
+    append_frame(output, RESPONSE_ERROR, message.data(), message.size());
+    append_frame(output, RESPONSE_EXIT, &status, sizeof(status));
+}
+
+CommandServer::CommandServer(const char* path, command_handler handler)
+    :
+    fPath(path),
+    fHandler(handler),
+    fSocket(-1)
+{
+}
+
+CommandServer::~CommandServer()
+{
+    if (fSocket >= 0) {
+        close(fSocket);
+        unlink(fPath.c_str());
+    }
+}
+
+status_t
+CommandServer::Listen()
+{
+    sockaddr_un address;
+    if (make_address(fPath.c_str(), address) != B_OK)
+        return B_BAD_VALUE;
+
+    // a socket left behind by a server that is gone is replaced
+    struct stat st;
+    if (lstat(fPath.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode))
+            return B_FILE_EXISTS;
+
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe < 0)
+            return errno;
+        bool running = connect(probe, (sockaddr*)&address, sizeof(address)) == 0;
+        close(probe);
+        if (running)
+            return B_BUSY;
+        unlink(fPath.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return errno;
+
+    // only the owner of the DB may talk to the server
+    mode_t mask = umask(0077);
+    int result = bind(fd, (sockaddr*)&address, sizeof(address));
+    umask(mask);
+    if (result != 0 || listen(fd, 64) != 0) {
+        status_t error = errno;
+        close(fd);
+        return error;
+    }
+
+    fSocket = fd;
+    return B_OK;
+}
+
+status_t
+CommandServer::Run()
+{
+    if (fSocket < 0)
+        return B_NO_INIT;
+
+    // no SA_RESTART, so poll() returns when asked to quit
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_quit;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // commands run in the working directory of their client
+    int directory = open(".", O_RDONLY);
+    if (directory < 0)
+        return errno;
+
+    std::map<int, connection> clients;
+    command running;
+    running.active = false;
+    std::vector<pollfd> sockets;
+
+    status_t result = B_OK;
+    while (!sQuit) {
+        while (!running.active && !fRequests.empty()) {
+            request next = std::move(fRequests.front());
+            fRequests.pop_front();
+            connection& client = clients[next.client];
+            if (_StartCommand(next, client, running) == B_BAD_DATA)
+                client.broken = true;
+        }
+
+        // a client that is done, or can't be answered anymore, is dropped
+        for (auto entry = clients.begin(); entry != clients.end();) {
+            int socket = entry->first;
+            const connection& client = entry->second;
+            bool waiting = (running.active && running.client == socket)
+                || std::any_of(fRequests.begin(), fRequests.end(),
+                    [socket](const request& queued) { return queued.client == socket; });
+            if (!client.broken && (client.reading || waiting || !client.output.empty())) {
+                entry++;
+                continue;
+            }
+
+            fRequests.erase(std::remove_if(fRequests.begin(), fRequests.end(),
+                [socket](const request& queued) { return queued.client == socket; }),
+                fRequests.end());
+            if (running.active && running.client == socket)
+                running.client = -1;
+            close(socket);
+            entry = clients.erase(entry);
+        }
+
+        sockets.clear();
+        sockets.push_back(pollfd{ fSocket, POLLIN, 0 });
+        for (const auto& entry : clients) {
+            short events = entry.second.reading ? POLLIN : 0;
+            if (!entry.second.output.empty())
+                events |= POLLOUT;
+            // a closed connection would keep reporting POLLHUP
+            if (events != 0)
+                sockets.push_back(pollfd{ entry.first, events, 0 });
+        }
+
+        // the output of the command waits in the pipes while its client is behind
+        connection* commandClient = NULL;
+        if (running.active && running.client >= 0)
+            commandClient = &clients[running.client];
+        size_t pipes = sockets.size();
+        if (running.active
+            && (commandClient == NULL || commandClient->output.size() < kMaxQueuedOutput)) {
+            if (running.output >= 0)
+                sockets.push_back(pollfd{ running.output, POLLIN, 0 });
+            if (running.error >= 0)
+                sockets.push_back(pollfd{ running.error, POLLIN, 0 });
+        }
+
+        if (poll(sockets.data(), sockets.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            result = errno;
+            break;
+        }
+
+        for (size_t i = pipes; i < sockets.size(); i++) {
+            if (sockets[i].revents == 0)
+                continue;
+            if (sockets[i].fd == running.output)
+                _RelayOutput(running.output, RESPONSE_OUTPUT, commandClient);
+            else
+                _RelayOutput(running.error, RESPONSE_ERROR, commandClient);
+        }
+
+        // the command restores the standard output and error when it is done
+        if (running.active && running.output < 0 && running.error < 0) {
+            running.thread.join();
+            running.active = false;
+            if (fchdir(directory) != 0)
+                sQuit = 1;
+            if (commandClient != NULL) {
+                append_frame(commandClient->output, RESPONSE_EXIT, &running.status,
+                    sizeof(running.status));
+            }
+        }
+
+        for (size_t i = 1; i < pipes; i++) {
+            connection& client = clients[sockets[i].fd];
+            if ((sockets[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0 && client.reading
+                && _Receive(sockets[i].fd, client) != B_OK)
+                client.broken = true;
+            if (!client.output.empty() && !client.broken
+                && _Send(sockets[i].fd, client) != B_OK)
+                client.broken = true;
+        }
+
+        if ((sockets[0].revents & POLLIN) != 0) {
+            int socket = accept(fSocket, NULL, NULL);
+            if (socket >= 0) {
+                fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+                clients[socket] = connection{ std::string(), std::string(), true, false };
+            }
+        }
+    }
+
+    // a command still running fails to write its output, and ends
+    if (running.active) {
+        if (running.output >= 0)
+            close(running.output);
+        if (running.error >= 0)
+            close(running.error);
+        running.thread.join();
+        fchdir(directory);
+    }
+    for (const auto& entry : clients)
+        close(entry.first);
+    close(directory);
+    return result;
+}
+
+/*static*/ std::string
+CommandServer::PathFor(const MimeDatabase& database)
+{
+    return database.SidecarPath(COMMAND_SOCKET_NAME);
+}
+
+// Reads what the client sent so far without blocking, and queues every
+// complete request. Fails if the connection is broken or a request is bad;
+// a closed connection only stops reading, its requests are still answered.
+status_t
+CommandServer::_Receive(int socket, connection& client)
+{
+    char buffer[16 * 1024];
+    while (true) {
+        ssize_t count = recv(socket, buffer, sizeof(buffer), 0);
+        if (count > 0) {
+            client.input.append(buffer, count);
+            continue;
+        }
+        if (count == 0)
+            client.reading = false;
+        else if (errno == EINTR)
+            continue;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return errno;
+        break;
+    }
+
+    size_t start = 0;
+    while (client.input.size() - start >= sizeof(uint32)) {
+        uint32 size;
+        memcpy(&size, client.input.data() + start, sizeof(size));
+        if (size > kMaxRequestSize)
+            return B_BAD_DATA;
+        if (client.input.size() - start - sizeof(size) < size)
+            break;
+
+        fRequests.push_back(request{ socket,
+            client.input.substr(start + sizeof(size), size) });
+        start += sizeof(size) + size;
+    }
+    client.input.erase(0, start);
+    return B_OK;
+}
+
+// sends as much of the queued output as the client takes right now
+status_t
+CommandServer::_Send(int socket, connection& client)
+{
+    size_t sent = 0;
+    status_t result = B_OK;
+    while (sent < client.output.size()) {
+        ssize_t count = send(socket, client.output.data() + sent,
+            client.output.size() - sent, 0);
+        if (count >= 0) {
+            sent += count;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            result = errno;
+        break;
+    }
+    client.output.erase(0, sent);
+    return result;
+}
+
+// Starts the command of the request on a thread of its own. Returns
+// B_BAD_DATA for a malformed request; when the command can't be started,
+// the client is told so and the error returned.
+status_t
+CommandServer::_StartCommand(request& next, connection& client, command& running)
+{
+    std::string& data = next.data;
+    if (data.empty() || data.back() != '\0')
+        return B_BAD_DATA;
+
+    running.arguments.clear();
+    for (size_t start = 0; start < data.size(); start += strlen(&data[start]) + 1)
+        running.arguments.push_back(&data[start]);
+    // the working directory and at least argv[0]
+    if (running.arguments.size() < 2)
+        return B_BAD_DATA;
+
+    const char* directory = running.arguments[0];
+    if (chdir(directory) != 0) {
+        status_t result = errno;
+        append_message(client.output, std::string("cannot change to directory ")
+            + directory + ": " + strerror(result) + "\n", EXIT_FAILURE);
+        return result;
+    }
+    running.arguments.erase(running.arguments.begin());
+    running.arguments.push_back(NULL);
+
+    int outputPipe[2];
+    int errorPipe[2];
+    if (pipe(outputPipe) != 0) {
+        status_t result = errno;
+        append_message(client.output, std::string("cannot capture output: ")
+            + strerror(result) + "\n", EXIT_FAILURE);
+        return result;
+    }
+    if (pipe(errorPipe) != 0) {
+        status_t result = errno;
+        close(outputPipe[0]);
+        close(outputPipe[1]);
+        append_message(client.output, std::string("cannot capture output: ")
+            + strerror(result) + "\n", EXIT_FAILURE);
+        return result;
+    }
+    fcntl(outputPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(errorPipe[0], F_SETFL, O_NONBLOCK);
+
+    running.active = true;
+    running.client = next.client;
+    running.request.swap(data);
+    running.output = outputPipe[0];
+    running.error = errorPipe[0];
+    running.outputWriter = outputPipe[1];
+    running.errorWriter = errorPipe[1];
+    running.status = EXIT_FAILURE;
+
+    // signals are left to the server loop
+    sigset_t quitSignals;
+    sigset_t previous;
+    sigemptyset(&quitSignals);
+    sigaddset(&quitSignals, SIGINT);
+    sigaddset(&quitSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &quitSignals, &previous);
+    running.thread = std::thread(&CommandServer::_RunCommand, this, std::ref(running));
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return B_OK;
+}
+
+// Runs on the command thread, with the standard output and error going to
+// the pipes; restoring them when done closes the pipes.
+void
+CommandServer::_RunCommand(command& running)
+{
+    fflush(stdout);
+    fflush(stderr);
+    int savedOutput = dup(STDOUT_FILENO);
+    int savedError = dup(STDERR_FILENO);
+    dup2(running.outputWriter, STDOUT_FILENO);
+    dup2(running.errorWriter, STDERR_FILENO);
+    close(running.outputWriter);
+    close(running.errorWriter);
+
+    running.status = fHandler((int)running.arguments.size() - 1, running.arguments.data());
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(savedOutput, STDOUT_FILENO);
+    dup2(savedError, STDERR_FILENO);
+    close(savedOutput);
+    close(savedError);
+}
+
+// Sends what the command wrote to the pipe on to its client, if it is still
+// there. Closes the pipe at its end.
+void
+CommandServer::_RelayOutput(int& pipe, uint8 kind, connection* client)
+{
+    char buffer[kChunkSize];
+    ssize_t count = read(pipe, buffer, sizeof(buffer));
+    if (count > 0) {
+        if (client != NULL && !client->broken)
+            append_frame(client->output, kind, buffer, count);
+        return;
+    }
+    if (count < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+
+    close(pipe);
+    pipe = -1;
+}
+
+// #pragma mark - client
+
+int
+RunCommandClient(const char* path, int argc, char** argv)
+{
+    sockaddr_un address;
+    if (make_address(path, address) != B_OK) {
+        fprintf(stderr, "mime server socket path %s is too long\n", path);
+        return EXIT_FAILURE;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "cannot connect to mime server at %s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return EXIT_FAILURE;
+    }
+
+    char directory[B_PATH_NAME_LENGTH];
+    if (getcwd(directory, sizeof(directory)) == NULL) {
+        fprintf(stderr, "cannot get the working directory: %s\n", strerror(errno));
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    std::string request(directory, strlen(directory) + 1);
+    for (int i = 0; i < argc; i++)
+        request.append(argv[i], strlen(argv[i]) + 1);
+
+    // output is passed on as it arrives, until the exit status
+    int32 status = EXIT_FAILURE;
+    bool exited = false;
+    std::string frame;
+    status_t result = send_frame(fd, request);
+    while (result == B_OK && !exited) {
+        result = receive_frame(fd, kChunkSize + 1, frame);
+        if (result == B_OK && frame.empty())
+            result = B_BAD_DATA;
+        if (result != B_OK)
+            break;
+
+        const char* data = frame.data() + 1;
+        size_t size = frame.size() - 1;
+        switch ((uint8)frame[0]) {
+            case RESPONSE_OUTPUT:
+                fwrite(data, 1, size, stdout);
+                fflush(stdout);
+                break;
+            case RESPONSE_ERROR:
+                fwrite(data, 1, size, stderr);
+                break;
+            case RESPONSE_EXIT:
+                if (size != sizeof(status)) {
+                    result = B_BAD_DATA;
+                    break;
+                }
+                memcpy(&status, data, sizeof(status));
+                exited = true;
+                break;
+            default:
+                result = B_BAD_DATA;
+                break;
+        }
+    }
+    close(fd);
+
+    if (result != B_OK) {
+        fprintf(stderr, "no complete answer from mime server at %s: %s\n", path,
+            strerror(result == B_ENTRY_NOT_FOUND ? B_IO_ERROR : result));
+        return EXIT_FAILURE;
+    }
+    return status;
+}
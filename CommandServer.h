@@ -0,0 +1,87 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _COMMAND_SERVER_H
+#define _COMMAND_SERVER_H
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "MimeDatabase.h"
+
+#define COMMAND_SOCKET_NAME "socket"
+
+// runs one command line in the server process, returns its exit status
+typedef std::function<int(int argc, char** argv)> command_handler;
+
+enum response_kind {
+    RESPONSE_OUTPUT = 1,    // a chunk of the standard output
+    RESPONSE_ERROR,         // a chunk of the standard error
+    RESPONSE_EXIT           // the exit status, the last frame of a response
+};
+
+// Answers mime command lines sent over a Unix domain socket, so the DB
+// backend and everything loaded from it stay resident between commands.
+//
+// Every message is a frame: a uint32 payload size in host byte order, then
+// the payload. A request holds NUL terminated strings, the working directory
+// of the client and its arguments starting with argv[0]. The response is a
+// series of frames whose payload starts with a response_kind byte: chunks of
+// the standard output and error of the command as it writes them, then its
+// int32 exit status. A connection can carry any number of requests.
+//
+// Any number of clients may be connected, but commands run one at a time,
+// on a thread of their own: their output is captured by redirecting the
+// standard output and error of the whole process to pipes. The server keeps
+// reading requests and sending queued output meanwhile, without waiting for
+// any client; only the command of a client that doesn't take its output is
+// held up, once enough of it is queued.
+class CommandServer {
+public:
+                            CommandServer(const char* path,
+                                command_handler handler);
+                            ~CommandServer();
+
+            // fails with B_BUSY if another server is using the socket
+            status_t        Listen();
+            // serves requests until SIGINT or SIGTERM
+            status_t        Run();
+
+    static  std::string     PathFor(const MimeDatabase& database);
+
+private:
+            struct connection {
+                std::string input;      // received, not yet handled
+                std::string output;     // frames not yet sent
+                bool        reading;    // false once the client closed its side
+                bool        broken;     // nothing can be sent anymore
+            };
+
+            struct request {
+                int         client;
+                std::string data;
+            };
+
+            struct command;
+
+            status_t        _Receive(int socket, connection& client);
+            status_t        _Send(int socket, connection& client);
+            status_t        _StartCommand(request& next,
+                                connection& client, command& running);
+            void            _RunCommand(command& running);
+            void            _RelayOutput(int& pipe, uint8 kind,
+                                connection* client);
+
+            std::string     fPath;
+            command_handler fHandler;
+            int             fSocket;
+            std::deque<request> fRequests;
+};
+// sends the command line to the server and prints its output, returns the
+// exit status of the command
+int RunCommandClient(const char* path, int argc, char** argv);
+
+#endif // _COMMAND_SERVER_H
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "ContentHash.h"
+
+#include <string.h>
+
+#include "MappedFile.h"
+
+static const uint64 kPrime1 = 0x9e3779b185ebca87ULL;
+static const uint64 kPrime2 = 0xc2b2ae3d27d4eb4fULL;
+static const uint64 kPrime3 = 0x165667b19e3779f9ULL;
+static const uint64 kPrime4 = 0x85ebca77c2b2ae63ULL;
+static const uint64 kPrime5 = 0x27d4eb2f165667c5ULL;
+
+static inline uint64
+rotate_left(uint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// the input is defined as little endian
+static inline uint64
+read_uint64(const uint8* data)
+{
+    uint64 value;
+    memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static inline uint32
+read_uint32(const uint8* data)
+{
+    uint32 value;
+    memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+static inline uint64
+xxh_round(uint64 accumulator, uint64 input)
+{
+    accumulator += input * kPrime2;
+    accumulator = rotate_left(accumulator, 31);
+    return accumulator * kPrime1;
+}
+
+static inline uint64
+merge_round(uint64 accumulator, uint64 value)
+{
+    accumulator ^= xxh_round(0, value);
+    return accumulator * kPrime1 + kPrime4;
+}
+
+uint64
+HashData(const void* _data, size_t size, uint64 seed)
+{
+    const uint8* data = reinterpret_cast<const uint8*>(_data);
+    const uint8* end = data + size;
+    uint64 hash;
+
+    if (size >= 32) {
+        // four independent lanes over 32 byte stripes
+        uint64 v1 = seed + kPrime1 + kPrime2;
+        uint64 v2 = seed + kPrime2;
+        uint64 v3 = seed;
+        uint64 v4 = seed - kPrime1;
+        const uint8* limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read_uint64(data));
+            v2 = xxh_round(v2, read_uint64(data + 8));
+            v3 = xxh_round(v3, read_uint64(data + 16));
+            v4 = xxh_round(v4, read_uint64(data + 24));
+            data += 32;
+        } while (data <= limit);
+
+        hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12)
+            + rotate_left(v4, 18);
+        hash = merge_round(hash, v1);
+        hash = merge_round(hash, v2);
+        hash = merge_round(hash, v3);
+        hash = merge_round(hash, v4);
+    } else
+        hash = seed + kPrime5;
+
+    hash += (uint64)size;
+
+    while (data + 8 <= end) {
+        hash ^= xxh_round(0, read_uint64(data));
+        hash = rotate_left(hash, 27) * kPrime1 + kPrime4;
+        data += 8;
+    }
+    if (data + 4 <= end) {
+        hash ^= (uint64)read_uint32(data) * kPrime1;
+        hash = rotate_left(hash, 23) * kPrime2 + kPrime3;
+        data += 4;
+    }
+    while (data < end) {
+        hash ^= (*data++) * kPrime5;
+        hash = rotate_left(hash, 11) * kPrime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+status_t
+HashFile(const char* path, uint64& hash, off_t* _size)
+{
+    MappedFile file;
+    status_t result = file.SetTo(path);
+    if (result != B_OK)
+        return result;
+
+    hash = HashData(file.Data(), file.Size());
+    if (_size != NULL)
+        *_size = (off_t)file.Size();
+    return B_OK;
+}
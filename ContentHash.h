@@ -0,0 +1,18 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _CONTENT_HASH_H
+#define _CONTENT_HASH_H
+
+#include "Platform.h"
+
+// xxHash64 (XXH64 by Yann Collet), a fast non-cryptographic hash, used to
+// tell whether file contents changed. Results are the same as the reference
+// implementation on every host.
+uint64 HashData(const void* data, size_t size, uint64 seed = 0);
+
+// hashes the contents of the file, mapped rather than read
+status_t HashFile(const char* path, uint64& hash, off_t* _size = NULL);
+
+#endif // _CONTENT_HASH_H
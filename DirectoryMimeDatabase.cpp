@@ -0,0 +1,257 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "DirectoryMimeDatabase.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "FileAttributes.h"
+#include "MappedFile.h"
+#include "Stats.h"
+
+DirectoryMimeDatabase::DirectoryMimeDatabase(const char* directory)
+    :
+    fDirectory(directory)
+{
+    while (fDirectory.size() > 1 && fDirectory.back() == '/')
+        fDirectory.pop_back();
+}
+
+const char*
+DirectoryMimeDatabase::Name() const
+{
+    return "directory";
+}
+
+std::string
+DirectoryMimeDatabase::PathFor(const char* type) const
+{
+    std::string path = fDirectory + "/";
+    for (const char* c = type; *c != '\0'; c++)
+        path += tolower(*c);
+    return path;
+}
+
+bool
+DirectoryMimeDatabase::IsInstalled(const char* type)
+{
+    if (!IsValidMimeType(type))
+        return false;
+
+    struct stat st;
+    return stat(PathFor(type).c_str(), &st) == 0;
+}
+
+status_t
+DirectoryMimeDatabase::Install(const char* type)
+{
+    if (!IsValidMimeType(type))
+        return B_BAD_VALUE;
+    if (IsInstalled(type))
+        return B_FILE_EXISTS;
+
+    status_t result = CreateDirectories(fDirectory.c_str());
+    if (result != B_OK)
+        return result;
+
+    const char* slash = strchr(type, '/');
+    if (slash == NULL)
+        return _CreateEntry(PathFor(type).c_str(), type, true);
+
+    std::string supertype(type, slash - type);
+    if (!IsInstalled(supertype.c_str())) {
+        result = _CreateEntry(PathFor(supertype.c_str()).c_str(), supertype.c_str(), true);
+        if (result != B_OK)
+            return result;
+    }
+
+    return _CreateEntry(PathFor(type).c_str(), type, false);
+}
+
+status_t
+DirectoryMimeDatabase::Delete(const char* type)
+{
+    if (!IsValidMimeType(type))
+        return B_BAD_VALUE;
+    if (!IsInstalled(type))
+        return B_ENTRY_NOT_FOUND;
+
+    std::string path = PathFor(type);
+    int result = strchr(type, '/') == NULL ? rmdir(path.c_str()) : unlink(path.c_str());
+    return result != 0 ? errno : B_OK;
+}
+
+status_t
+DirectoryMimeDatabase::SetField(const char* type, mime_field field, const void* data,
+    size_t size)
+{
+    if (field < 0 || field >= MIME_FIELD_COUNT)
+        return B_BAD_VALUE;
+
+    mime_field_value value = { field, data, size };
+    return SetFields(type, &value, 1);
+}
+
+// opens the type file once for all fields, instead of once per field
+status_t
+DirectoryMimeDatabase::SetFields(const char* type, const mime_field_value* values,
+    int32 count)
+{
+    if (!IsInstalled(type))
+        return B_ENTRY_NOT_FOUND;
+
+    int fd = open(PathFor(type).c_str(), O_RDONLY);
+    if (fd < 0)
+        return errno;
+
+    status_t result = B_OK;
+    for (int32 i = 0; i < count && result == B_OK; i++) {
+        mime_field field = values[i].field;
+        if (field < 0 || field >= MIME_FIELD_COUNT) {
+            result = B_BAD_VALUE;
+            break;
+        }
+
+        const mime_field_info& info = kMimeFields[field];
+        const void* data = values[i].data;
+        size_t size = values[i].size;
+        STATS_ADD(STATS_DB_WRITES, 1);
+        if (data == NULL) {
+            result = RemoveAttribute(fd, info.attribute);
+            if (result == B_ENTRY_NOT_FOUND)
+                result = B_OK;
+        } else if (field == MIME_FIELD_ICON) {
+            STATS_TIMER(STATS_PHASE_ICONS);
+            STATS_ADD(STATS_ICONS_WRITTEN, 1);
+            STATS_ADD(STATS_BYTES_WRITTEN, size);
+            result = WriteAttribute(fd, info.attribute, info.attributeType, data, size);
+        } else {
+            STATS_ADD(STATS_BYTES_WRITTEN, size);
+            result = WriteAttribute(fd, info.attribute, info.attributeType, data, size);
+        }
+
+        if (result == B_BUFFER_OVERFLOW) {
+            fprintf(stderr, "%s of %s: %zu bytes are more than the file system "
+                "stores in the attributes of a file\n", info.name, type, size);
+        }
+    }
+
+    close(fd);
+    return result;
+}
+
+status_t
+DirectoryMimeDatabase::GetField(const char* type, mime_field field, std::string& data)
+{
+    if (field < 0 || field >= MIME_FIELD_COUNT)
+        return B_BAD_VALUE;
+    if (!IsValidMimeType(type))
+        return B_BAD_VALUE;
+
+    status_t result = ReadAttribute(PathFor(type).c_str(), kMimeFields[field].attribute, data);
+    STATS_ADD(STATS_DB_READS, 1);
+    if (result == B_OK)
+        STATS_ADD(STATS_BYTES_READ, data.size());
+    return result;
+}
+
+status_t
+DirectoryMimeDatabase::GetInstalledSupertypes(std::vector<std::string>& supertypes)
+{
+    supertypes.clear();
+    return _ReadTypes(fDirectory, NULL, true, supertypes);
+}
+
+status_t
+DirectoryMimeDatabase::GetInstalledTypes(const char* supertype,
+    std::vector<std::string>& types)
+{
+    STATS_TIMER(STATS_PHASE_LIST_TYPES);
+    types.clear();
+    if (supertype != NULL) {
+        if (!IsValidMimeType(supertype) || strchr(supertype, '/') != NULL)
+            return B_BAD_VALUE;
+        status_t result = _ReadTypes(PathFor(supertype), supertype, false, types);
+        STATS_ADD(STATS_TYPES_LISTED, types.size());
+        return result;
+    }
+
+    // like BMimeType::GetInstalledTypes(), all types include the supertypes
+    std::vector<std::string> supertypes;
+    status_t result = GetInstalledSupertypes(supertypes);
+    if (result != B_OK)
+        return result;
+
+    for (const std::string& super : supertypes) {
+        types.push_back(super);
+        std::vector<std::string> subtypes;
+        result = _ReadTypes(PathFor(super.c_str()), super.c_str(), false, subtypes);
+        if (result != B_OK)
+            return result;
+        types.insert(types.end(), subtypes.begin(), subtypes.end());
+    }
+    STATS_ADD(STATS_TYPES_LISTED, types.size());
+    return B_OK;
+}
+
+status_t
+DirectoryMimeDatabase::_CreateEntry(const char* path, const char* type, bool directory)
+{
+    if (directory) {
+        if (mkdir(path, 0755) != 0)
+            return errno;
+    } else {
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0)
+            return errno;
+        close(fd);
+    }
+
+    return WriteAttribute(path, MIME_TYPE_ATTR, B_MIME_STRING_TYPE, type, strlen(type) + 1);
+}
+
+// The file names are lower case, the original spelling is kept in META:TYPE.
+status_t
+DirectoryMimeDatabase::_ReadTypes(const std::string& directory, const char* fallbackPrefix,
+    bool directories, std::vector<std::string>& types)
+{
+    DIR* dir = opendir(directory.c_str());
+    if (dir == NULL) {
+        // an empty or missing DB has no types
+        return errno == ENOENT ? B_OK : errno;
+    }
+
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        std::string path = directory + "/" + entry->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || S_ISDIR(st.st_mode) != directories)
+            continue;
+
+        std::string type;
+        if (ReadAttribute(path.c_str(), MIME_TYPE_ATTR, type) == B_OK && !type.empty()) {
+            type.resize(strnlen(type.c_str(), type.size()));
+        } else {
+            type = fallbackPrefix != NULL
+                ? std::string(fallbackPrefix) + "/" + entry->d_name : entry->d_name;
+        }
+        types.push_back(type);
+    }
+    closedir(dir);
+
+    std::sort(types.begin(), types.end());
+    return B_OK;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _DIRECTORY_MIME_DATABASE_H
+#define _DIRECTORY_MIME_DATABASE_H
+
+#include "MimeDatabase.h"
+
+// MIME DB stored like Haiku's mime_db: one directory per supertype and one
+// file per subtype, named after the lower case type, with the META:*
+// fields as file attributes. Works without the registrar, e.g. on Linux.
+class DirectoryMimeDatabase : public MimeDatabase {
+public:
+                            DirectoryMimeDatabase(const char* directory);
+
+    virtual const char*     Name() const;
+    virtual std::string     Location() const { return fDirectory; }
+            const char*     Directory() const { return fDirectory.c_str(); }
+
+    virtual bool            IsInstalled(const char* type);
+    virtual status_t        Install(const char* type);
+    virtual status_t        Delete(const char* type);
+
+    virtual status_t        SetField(const char* type, mime_field field,
+                                const void* data, size_t size);
+    virtual status_t        SetFields(const char* type,
+                                const mime_field_value* values, int32 count);
+    virtual status_t        GetField(const char* type, mime_field field,
+                                std::string& data);
+
+    virtual status_t        GetInstalledSupertypes(
+                                std::vector<std::string>& supertypes);
+    virtual status_t        GetInstalledTypes(const char* supertype,
+                                std::vector<std::string>& types);
+
+            std::string     PathFor(const char* type) const;
+
+private:
+            status_t        _CreateEntry(const char* path, const char* type,
+                                bool directory);
+            status_t        _ReadTypes(const std::string& directory,
+                                const char* fallbackPrefix, bool directories,
+                                std::vector<std::string>& types);
+
+            std::string     fDirectory;
+};
+
+#endif // _DIRECTORY_MIME_DATABASE_H
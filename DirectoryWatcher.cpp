@@ -0,0 +1,567 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "DirectoryWatcher.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+
+#ifdef __HAIKU__
+#include <Messenger.h>
+#include <NodeMonitor.h>
+#else
+#include <sys/inotify.h>
+#endif
+
+// a burst of events is cut after this many debounce times
+static const int32 kMaxDebounces = 10;
+
+static volatile sig_atomic_t sQuit = 0;
+
+static void
+handle_quit(int)
+{
+    sQuit = 1;
+}
+
+static bigtime_t
+milliseconds()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (bigtime_t)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+DirectoryWatcher::DirectoryWatcher(const char* path)
+    :
+    fRoot(path),
+    fEventCount(0)
+{
+    while (fRoot.size() > 1 && fRoot.back() == '/')
+        fRoot.pop_back();
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+}
+
+status_t
+DirectoryWatcher::WaitForChanges(int32 debounce, std::vector<std::string>& changed,
+    std::vector<std::string>& removed)
+{
+    changed.clear();
+    removed.clear();
+
+    // no SA_RESTART, so poll() returns when asked to quit
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_quit;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    pollfd events = { Descriptor(), POLLIN, 0 };
+    bigtime_t first = -1;
+    bigtime_t last = -1;
+    while (!sQuit) {
+        // nothing pending: sleep until there is
+        int timeout = -1;
+        if (first >= 0) {
+            bigtime_t due = std::min(last + debounce, first + kMaxDebounces * debounce);
+            bigtime_t now = milliseconds();
+            if (now >= due)
+                break;
+            timeout = (int)(due - now);
+        }
+
+        int count = poll(&events, 1, timeout);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        if (count == 0)
+            continue;
+
+        int64 eventCount = fEventCount;
+        status_t result = ReadEvents();
+        if (result != B_OK)
+            return result;
+        if (fEventCount != eventCount) {
+            last = milliseconds();
+            if (first < 0)
+                first = last;
+        }
+    }
+    if (sQuit)
+        return B_INTERRUPTED;
+
+    for (const std::string& path : fChanged) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            fRemoved.insert(path);
+        else if (S_ISREG(st.st_mode))
+            changed.push_back(path);
+    }
+    removed.assign(fRemoved.begin(), fRemoved.end());
+    fChanged.clear();
+    fRemoved.clear();
+    return B_OK;
+}
+
+/*static*/ DirectoryWatcher*
+DirectoryWatcher::Create(const char* path)
+{
+#ifdef __HAIKU__
+    return new(std::nothrow) NodeMonitorWatcher(path);
+#else
+    return new(std::nothrow) InotifyWatcher(path);
+#endif
+}
+
+void
+DirectoryWatcher::FileChanged(const std::string& path)
+{
+    fRemoved.erase(path);
+    fChanged.insert(path);
+    fEventCount++;
+}
+
+void
+DirectoryWatcher::FileRemoved(const std::string& path)
+{
+    fChanged.erase(path);
+    fRemoved.insert(path);
+    fEventCount++;
+}
+
+void
+DirectoryWatcher::DirectoryChanged(const std::string& path)
+{
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL)
+        return;
+
+    while (struct dirent* entry = readdir(dir)) {
+        if (IsHidden(entry->d_name))
+            continue;
+        std::string child = path + "/" + entry->d_name;
+        struct stat st;
+        if (stat(child.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            DirectoryChanged(child);
+        else
+            FileChanged(child);
+    }
+    closedir(dir);
+}
+
+#ifdef __HAIKU__
+
+NodeMonitorWatcher::Monitor::Monitor(NodeMonitorWatcher& watcher)
+    :
+    BLooper("directory watcher"),
+    fWatcher(watcher)
+{
+}
+
+void
+NodeMonitorWatcher::Monitor::MessageReceived(BMessage* message)
+{
+    if (message->what != B_NODE_MONITOR) {
+        BLooper::MessageReceived(message);
+        return;
+    }
+
+    node_event event;
+    int32 device = -1;
+    int64 directory = -1;
+    int64 node = -1;
+    const char* name = NULL;
+    event.opcode = 0;
+    event.toDirectory = -1;
+    event.fields = 0;
+    message->FindInt32("opcode", &event.opcode);
+    message->FindInt32("device", &device);
+    message->FindInt64("node", &node);
+    message->FindInt32("fields", &event.fields);
+    if (event.opcode == B_ENTRY_MOVED) {
+        message->FindInt64("from directory", &directory);
+        int64 toDirectory = -1;
+        message->FindInt64("to directory", &toDirectory);
+        event.toDirectory = toDirectory;
+    } else
+        message->FindInt64("directory", &directory);
+    if (message->FindString("name", &name) == B_OK)
+        event.name = name;
+    event.device = device;
+    event.directory = directory;
+    event.node = node;
+
+    std::lock_guard<std::mutex> lock(fWatcher.fLock);
+    fWatcher.fEvents.push_back(event);
+    // if the pipe is full, the watcher has been woken up already
+    char wakeUp = 0;
+    write(fWatcher.fPipe[1], &wakeUp, 1);
+}
+
+NodeMonitorWatcher::NodeMonitorWatcher(const char* path)
+    :
+    DirectoryWatcher(path),
+    fMonitor(NULL),
+    fInitStatus(B_NO_INIT)
+{
+    fPipe[0] = fPipe[1] = -1;
+    if (pipe(fPipe) != 0) {
+        fInitStatus = errno;
+        return;
+    }
+    fcntl(fPipe[0], F_SETFL, fcntl(fPipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fPipe[1], F_SETFL, fcntl(fPipe[1], F_GETFL) | O_NONBLOCK);
+
+    struct stat st;
+    if (stat(fRoot.c_str(), &st) != 0) {
+        fInitStatus = errno;
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        fInitStatus = B_NOT_A_DIRECTORY;
+        return;
+    }
+
+    fMonitor = new(std::nothrow) Monitor(*this);
+    if (fMonitor == NULL) {
+        fInitStatus = B_NO_MEMORY;
+        return;
+    }
+    fMonitor->Run();
+    fInitStatus = _Watch(fRoot, false);
+}
+
+NodeMonitorWatcher::~NodeMonitorWatcher()
+{
+    if (fMonitor != NULL) {
+        stop_watching(BMessenger(fMonitor));
+        if (fMonitor->Lock())
+            fMonitor->Quit();
+    }
+    if (fPipe[0] >= 0)
+        close(fPipe[0]);
+    if (fPipe[1] >= 0)
+        close(fPipe[1]);
+}
+
+status_t
+NodeMonitorWatcher::InitCheck() const
+{
+    return fInitStatus;
+}
+
+int
+NodeMonitorWatcher::Descriptor() const
+{
+    return fPipe[0];
+}
+
+status_t
+NodeMonitorWatcher::ReadEvents()
+{
+    char buffer[64];
+    while (read(fPipe[0], buffer, sizeof(buffer)) > 0)
+        ;
+
+    std::vector<node_event> events;
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+        events.swap(fEvents);
+    }
+    for (const node_event& event : events)
+        _HandleEvent(event);
+
+    // the directory itself is gone
+    return fPaths.empty() ? B_ENTRY_NOT_FOUND : B_OK;
+}
+
+// Directories are watched for their entries and for being removed themselves,
+// files for being written. Files found
+// in a directory that was created or moved in are reported right away; they
+// may have been written before the directory was watched.
+status_t
+NodeMonitorWatcher::_Watch(const std::string& path, bool report)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return errno;
+
+    node_ref ref;
+    ref.device = st.st_dev;
+    ref.node = st.st_ino;
+    bool isDirectory = S_ISDIR(st.st_mode);
+    status_t result = watch_node(&ref,
+        isDirectory ? B_WATCH_DIRECTORY | B_WATCH_NAME : B_WATCH_STAT, BMessenger(fMonitor));
+    if (result != B_OK)
+        return result;
+    fPaths[ref] = path;
+
+    if (!isDirectory) {
+        if (report)
+            FileChanged(path);
+        return B_OK;
+    }
+
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL)
+        return errno;
+    while (struct dirent* entry = readdir(dir)) {
+        if (IsHidden(entry->d_name))
+            continue;
+        result = _Watch(path + "/" + entry->d_name, true);
+        if (result != B_OK)
+            break;
+    }
+    closedir(dir);
+    return result;
+}
+
+void
+NodeMonitorWatcher::_Unwatch(const std::string& path)
+{
+    for (auto iterator = fPaths.begin(); iterator != fPaths.end();) {
+        const std::string& watched = iterator->second;
+        if (watched == path || (watched.compare(0, path.size(), path) == 0
+                && watched[path.size()] == '/')) {
+            watch_node(&iterator->first, B_STOP_WATCHING, BMessenger(fMonitor));
+            iterator = fPaths.erase(iterator);
+        } else
+            iterator++;
+    }
+}
+
+void
+NodeMonitorWatcher::_HandleEvent(const node_event& event)
+{
+    node_ref ref;
+    ref.device = event.device;
+    ref.node = event.node;
+    auto found = fPaths.find(ref);
+    std::string path;
+
+    switch (event.opcode) {
+        case B_ENTRY_CREATED:
+        {
+            // a new file is reported when it was written, not before
+            struct stat st;
+            if (_PathFor(event.device, event.directory, event.name, path)
+                && stat(path.c_str(), &st) == 0)
+                _Watch(path, S_ISDIR(st.st_mode));
+            break;
+        }
+
+        case B_ENTRY_MOVED:
+            if (found != fPaths.end()) {
+                std::string from = found->second;
+                _Unwatch(from);
+                FileRemoved(from);
+            }
+            if (_PathFor(event.device, event.toDirectory, event.name, path))
+                _Watch(path, true);
+            break;
+
+        case B_ENTRY_REMOVED:
+            if (found != fPaths.end()) {
+                std::string removed = found->second;
+                _Unwatch(removed);
+                FileRemoved(removed);
+            }
+            break;
+
+        case B_STAT_CHANGED:
+            if (found != fPaths.end() && (event.fields & B_STAT_INTERIM_UPDATE) == 0
+                && (event.fields & B_STAT_MODIFICATION_TIME) != 0)
+                FileChanged(found->second);
+            break;
+    }
+}
+
+bool
+NodeMonitorWatcher::_PathFor(dev_t device, ino_t directory, const std::string& name,
+    std::string& path)
+{
+    node_ref ref;
+    ref.device = device;
+    ref.node = directory;
+    auto found = fPaths.find(ref);
+    if (found == fPaths.end() || name.empty() || IsHidden(name.c_str()))
+        return false;
+
+    path = found->second + "/" + name;
+    return true;
+}
+
+#else // !__HAIKU__
+
+// Only directories are watched: they report files closed after writing, and
+// entries moved or removed.
+static const uint32 kWatchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM
+    | IN_MOVED_TO | IN_ONLYDIR;
+
+InotifyWatcher::InotifyWatcher(const char* path)
+    :
+    DirectoryWatcher(path),
+    fDescriptor(-1),
+    fInitStatus(B_NO_INIT)
+{
+    fDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fDescriptor < 0) {
+        fInitStatus = errno;
+        return;
+    }
+
+    struct stat st;
+    if (stat(fRoot.c_str(), &st) != 0) {
+        fInitStatus = errno;
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        fInitStatus = B_NOT_A_DIRECTORY;
+        return;
+    }
+    fInitStatus = _Watch(fRoot, false);
+}
+
+InotifyWatcher::~InotifyWatcher()
+{
+    if (fDescriptor >= 0)
+        close(fDescriptor);
+}
+
+status_t
+InotifyWatcher::InitCheck() const
+{
+    return fInitStatus;
+}
+
+int
+InotifyWatcher::Descriptor() const
+{
+    return fDescriptor;
+}
+
+status_t
+InotifyWatcher::ReadEvents()
+{
+    while (true) {
+        ssize_t length = read(fDescriptor, fBuffer, sizeof(fBuffer));
+        if (length < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            return errno;
+        }
+
+        for (char* next = fBuffer; next < fBuffer + length;) {
+            const inotify_event* event = (const inotify_event*)next;
+            next += sizeof(inotify_event) + event->len;
+
+            // events were lost, the install cache skips what did not change
+            if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                DirectoryChanged(fRoot);
+                continue;
+            }
+
+            auto found = fDirectories.find(event->wd);
+            if (found == fDirectories.end())
+                continue;
+            if ((event->mask & IN_IGNORED) != 0) {
+                fDirectories.erase(found);
+                continue;
+            }
+            if (event->len == 0 || IsHidden(event->name))
+                continue;
+
+            std::string path = found->second + "/" + event->name;
+            if ((event->mask & IN_ISDIR) != 0) {
+                if ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+                    status_t result = _Watch(path, true);
+                    if (result != B_OK) {
+                        fprintf(stderr, "cannot watch directory %s: %s\n", path.c_str(),
+                            strerror(result));
+                    }
+                } else if ((event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+                    _Unwatch(path);
+                    FileRemoved(path);
+                }
+            } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0)
+                FileChanged(path);
+            else if ((event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0)
+                FileRemoved(path);
+        }
+    }
+
+    // the directory itself is gone
+    return fDirectories.empty() ? B_ENTRY_NOT_FOUND : B_OK;
+}
+
+// Files found in a directory that was created or moved in are reported right
+// away, they may have been written before the directory was watched.
+status_t
+InotifyWatcher::_Watch(const std::string& path, bool report)
+{
+    int watch = inotify_add_watch(fDescriptor, path.c_str(), kWatchMask);
+    if (watch < 0)
+        return errno;
+    fDirectories[watch] = path;
+
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL)
+        return errno;
+
+    status_t result = B_OK;
+    while (struct dirent* entry = readdir(dir)) {
+        if (IsHidden(entry->d_name))
+            continue;
+        std::string child = path + "/" + entry->d_name;
+        struct stat st;
+        if (stat(child.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode)) {
+            result = _Watch(child, report);
+            if (result != B_OK)
+                break;
+        } else if (report)
+            FileChanged(child);
+    }
+    closedir(dir);
+    return result;
+}
+
+void
+InotifyWatcher::_Unwatch(const std::string& path)
+{
+    for (auto iterator = fDirectories.begin(); iterator != fDirectories.end();) {
+        const std::string& watched = iterator->second;
+        if (watched == path || (watched.compare(0, path.size(), path) == 0
+                && watched[path.size()] == '/')) {
+            inotify_rm_watch(fDescriptor, iterator->first);
+            iterator = fDirectories.erase(iterator);
+        } else
+            iterator++;
+    }
+}
+
+#endif // !__HAIKU__
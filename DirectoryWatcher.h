@@ -0,0 +1,157 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _DIRECTORY_WATCHER_H
+#define _DIRECTORY_WATCHER_H
+
+#include "Platform.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef __HAIKU__
+#include <map>
+#include <mutex>
+
+#include <Looper.h>
+#include <Node.h>
+#else
+#include <unordered_map>
+#endif
+
+// Reports the files written, moved in, moved away or removed below a
+// directory, like CollectResourcePaths() finds them: hidden entries are left
+// out. On Haiku this is node monitoring, elsewhere inotify.
+//
+// Events are coalesced per path, so a file written many times is reported
+// once, and a file only counts as changed when it was closed after writing
+// (or moved in complete), never half written.
+class DirectoryWatcher {
+public:
+    virtual                 ~DirectoryWatcher();
+
+    virtual status_t        InitCheck() const = 0;
+            const char*     Path() const { return fRoot.c_str(); }
+
+            // Blocks until something changes, then until nothing changed for
+            // the debounce time (in milliseconds), so a burst of events comes
+            // as one batch; a burst that does not pause is cut after ten
+            // times that. Changed files are sorted, and ones that are gone
+            // again by then count as removed. Returns B_INTERRUPTED on
+            // SIGINT or SIGTERM.
+            status_t        WaitForChanges(int32 debounce,
+                                std::vector<std::string>& changed,
+                                std::vector<std::string>& removed);
+
+    static  DirectoryWatcher* Create(const char* path);
+
+protected:
+                            DirectoryWatcher(const char* path);
+
+            // what poll() waits on until there are events
+    virtual int             Descriptor() const = 0;
+            // takes the pending events without blocking
+    virtual status_t        ReadEvents() = 0;
+
+            void            FileChanged(const std::string& path);
+            void            FileRemoved(const std::string& path);
+            // all files below the directory, when events were lost
+            void            DirectoryChanged(const std::string& path);
+
+    static  bool            IsHidden(const char* name)
+                                { return name[0] == '.'; }
+
+            std::string     fRoot;
+
+private:
+            std::set<std::string> fChanged;
+            std::set<std::string> fRemoved;
+            // also counts the events coalesced into the sets
+            int64           fEventCount;
+};
+
+#ifdef __HAIKU__
+
+class NodeMonitorWatcher : public DirectoryWatcher {
+public:
+                            NodeMonitorWatcher(const char* path);
+    virtual                 ~NodeMonitorWatcher();
+
+    virtual status_t        InitCheck() const;
+
+protected:
+    virtual int             Descriptor() const;
+    virtual status_t        ReadEvents();
+
+private:
+            // gets the node monitor messages in a thread of its own
+            class Monitor : public BLooper {
+            public:
+                            Monitor(NodeMonitorWatcher& watcher);
+
+        virtual void        MessageReceived(BMessage* message);
+
+            private:
+                NodeMonitorWatcher& fWatcher;
+            };
+
+            // the fields of a node monitor message
+            struct node_event {
+                int32       opcode;
+                dev_t       device;
+                ino_t       directory;
+                ino_t       toDirectory;
+                ino_t       node;
+                int32       fields;
+                std::string name;
+            };
+
+            status_t        _Watch(const std::string& path, bool report);
+            void            _Unwatch(const std::string& path);
+            void            _HandleEvent(const node_event& event);
+            bool            _PathFor(dev_t device, ino_t directory,
+                                const std::string& name, std::string& path);
+
+            Monitor*        fMonitor;
+            // written by the monitor to wake up poll()
+            int             fPipe[2];
+            status_t        fInitStatus;
+
+            // shared with the monitor thread
+            std::mutex      fLock;
+            std::vector<node_event> fEvents;
+            // the watched nodes, for the events that only name the node;
+            // only used by the thread waiting for changes
+            std::map<node_ref, std::string> fPaths;
+};
+
+#else // !__HAIKU__
+
+class InotifyWatcher : public DirectoryWatcher {
+public:
+                            InotifyWatcher(const char* path);
+    virtual                 ~InotifyWatcher();
+
+    virtual status_t        InitCheck() const;
+
+protected:
+    virtual int             Descriptor() const;
+    virtual status_t        ReadEvents();
+
+private:
+            status_t        _Watch(const std::string& path, bool report);
+            void            _Unwatch(const std::string& path);
+
+            int             fDescriptor;
+            status_t        fInitStatus;
+            // the directory of each watch
+            std::unordered_map<int, std::string> fDirectories;
+            // events are read in place, so memory stays flat while watching
+            alignas(int)    char fBuffer[64 * 1024];
+};
+
+#endif // !__HAIKU__
+
+#endif // _DIRECTORY_WATCHER_H
@@ -0,0 +1,438 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "ExtensionIndex.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+
+#define EXTENSION_INDEX_MAGIC   'MEXT'
+#define EXTENSION_INDEX_VERSION 1
+
+// All offsets are relative to the start of the file, all values are in host
+// byte order; an index from another host is not recognized and rebuilt.
+struct extension_index_header {
+    uint32      magic;
+    uint32      version;
+    uint32      extensionCount;
+    uint32      bucketCount;
+    uint32      seedsOffset;        // uint32 seed per bucket
+    uint32      slotsOffset;        // extension_index_slot per extension
+    uint32      typesOffset;        // uint32 string offsets of the types
+    uint32      typeCount;
+    uint32      stringsOffset;      // NUL terminated strings
+    uint32      stringsSize;
+};
+
+struct extension_index_slot {
+    uint32      extension;          // string offset
+    uint32      firstType;          // index into the types
+    uint32      typeCount;
+};
+
+// #pragma mark - hashing
+
+static inline uint64
+hash_string(std::string_view string)
+{
+    // FNV-1a
+    uint64 hash = 0xcbf29ce484222325ULL;
+    for (char c : string) {
+        hash ^= (uint8)c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static inline uint64
+mix(uint64 value)
+{
+    // splitmix64 finalizer
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+static inline uint32
+bucket_for(uint64 hash, uint32 bucketCount)
+{
+    return (uint32)(mix(hash) % bucketCount);
+}
+
+static inline uint32
+slot_for(uint64 hash, uint32 seed, uint32 slotCount)
+{
+    return (uint32)(mix(hash + (seed + 1) * 0x9e3779b97f4a7c15ULL) % slotCount);
+}
+
+// Hash and displace: the keys are spread over buckets, then every bucket,
+// biggest first, gets the first seed that puts all its keys into free slots.
+static bool
+build_perfect_hash(const std::vector<uint64>& hashes, uint32 bucketCount,
+    std::vector<uint32>& seeds, std::vector<uint32>& slots)
+{
+    uint32 count = (uint32)hashes.size();
+    std::vector<std::vector<uint32> > buckets(bucketCount);
+    for (uint32 i = 0; i < count; i++)
+        buckets[bucket_for(hashes[i], bucketCount)].push_back(i);
+
+    std::vector<uint32> order(bucketCount);
+    for (uint32 i = 0; i < bucketCount; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32 a, uint32 b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    const uint32 kMaxSeed = 1 << 20;
+    std::vector<bool> taken(count, false);
+    std::vector<uint32> candidate;
+    seeds.assign(bucketCount, 0);
+    slots.assign(count, 0);
+
+    for (uint32 bucket : order) {
+        const std::vector<uint32>& keys = buckets[bucket];
+        if (keys.empty())
+            break;
+
+        uint32 seed = 0;
+        for (; seed < kMaxSeed; seed++) {
+            candidate.clear();
+            bool fits = true;
+            for (uint32 key : keys) {
+                uint32 slot = slot_for(hashes[key], seed, count);
+                if (taken[slot]
+                    || std::find(candidate.begin(), candidate.end(), slot) != candidate.end()) {
+                    fits = false;
+                    break;
+                }
+                candidate.push_back(slot);
+            }
+            if (fits)
+                break;
+        }
+        if (seed == kMaxSeed)
+            return false;
+
+        seeds[bucket] = seed;
+        for (size_t i = 0; i < keys.size(); i++) {
+            taken[candidate[i]] = true;
+            slots[keys[i]] = candidate[i];
+        }
+    }
+    return true;
+}
+
+// #pragma mark - ExtensionIndex
+
+ExtensionIndex::ExtensionIndex()
+{
+    Unset();
+}
+
+status_t
+ExtensionIndex::SetTo(const char* path)
+{
+    Unset();
+
+    status_t result = fFile.SetTo(path);
+    if (result != B_OK)
+        return fStatus = result;
+
+    const uint8* data = fFile.Data();
+    size_t size = fFile.Size();
+    if (size < sizeof(extension_index_header))
+        return fStatus = B_BAD_DATA;
+
+    const extension_index_header* header = (const extension_index_header*)data;
+    if (header->magic != EXTENSION_INDEX_MAGIC || header->version != EXTENSION_INDEX_VERSION)
+        return fStatus = B_BAD_DATA;
+
+    // check that all tables are within the file, before using any of them
+    if ((header->extensionCount > 0 && header->bucketCount == 0)
+        || !range_fits(header->seedsOffset, (uint64)header->bucketCount * sizeof(uint32), size)
+        || !range_fits(header->slotsOffset,
+            (uint64)header->extensionCount * sizeof(extension_index_slot), size)
+        || !range_fits(header->typesOffset, (uint64)header->typeCount * sizeof(uint32), size)
+        || !range_fits(header->stringsOffset, header->stringsSize, size)
+        || (header->stringsSize > 0 && data[header->stringsOffset + header->stringsSize - 1] != '\0')
+        || header->seedsOffset % 4 != 0 || header->slotsOffset % 4 != 0
+        || header->typesOffset % 4 != 0)
+        return fStatus = B_BAD_DATA;
+
+    fHeader = header;
+    fSeeds = (const uint32*)(data + header->seedsOffset);
+    fSlots = (const extension_index_slot*)(data + header->slotsOffset);
+    fTypes = (const uint32*)(data + header->typesOffset);
+    fStrings = (const char*)(data + header->stringsOffset);
+    return fStatus = B_OK;
+}
+
+void
+ExtensionIndex::Unset()
+{
+    fFile.Unset();
+    fStatus = B_NO_INIT;
+    fHeader = NULL;
+    fSeeds = NULL;
+    fSlots = NULL;
+    fTypes = NULL;
+    fStrings = NULL;
+}
+
+int32
+ExtensionIndex::CountExtensions() const
+{
+    return fStatus == B_OK ? (int32)fHeader->extensionCount : 0;
+}
+
+status_t
+ExtensionIndex::Lookup(const char* _extension, std::vector<std::string_view>& types) const
+{
+    types.clear();
+    if (fStatus != B_OK)
+        return fStatus;
+    if (fHeader->extensionCount == 0)
+        return B_ENTRY_NOT_FOUND;
+
+    std::string extension = NormalizeExtension(_extension);
+    uint64 hash = hash_string(extension);
+    uint32 seed = fSeeds[bucket_for(hash, fHeader->bucketCount)];
+    const extension_index_slot& slot
+        = fSlots[slot_for(hash, seed, fHeader->extensionCount)];
+
+    // the hash maps unknown extensions to some slot as well
+    const char* name = _StringAt(slot.extension);
+    if (name == NULL || extension != name)
+        return B_ENTRY_NOT_FOUND;
+    if (slot.firstType > fHeader->typeCount
+        || slot.typeCount > fHeader->typeCount - slot.firstType)
+        return B_BAD_DATA;
+
+    for (uint32 i = 0; i < slot.typeCount; i++) {
+        const char* type = _StringAt(fTypes[slot.firstType + i]);
+        if (type == NULL)
+            return B_BAD_DATA;
+        types.push_back(type);
+    }
+    return B_OK;
+}
+
+status_t
+ExtensionIndex::GetEntries(extension_map& entries) const
+{
+    entries.clear();
+    if (fStatus != B_OK)
+        return fStatus;
+
+    for (uint32 i = 0; i < fHeader->extensionCount; i++) {
+        const extension_index_slot& slot = fSlots[i];
+        const char* name = _StringAt(slot.extension);
+        if (name == NULL || slot.firstType > fHeader->typeCount
+            || slot.typeCount > fHeader->typeCount - slot.firstType)
+            return B_BAD_DATA;
+
+        std::vector<std::string>& types = entries[name];
+        for (uint32 j = 0; j < slot.typeCount; j++) {
+            const char* type = _StringAt(fTypes[slot.firstType + j]);
+            if (type == NULL)
+                return B_BAD_DATA;
+            types.push_back(type);
+        }
+    }
+    return B_OK;
+}
+
+const char*
+ExtensionIndex::_StringAt(uint32 offset) const
+{
+    return offset < fHeader->stringsSize ? fStrings + offset : NULL;
+}
+
+/*static*/ std::string
+ExtensionIndex::PathFor(const MimeDatabase& database)
+{
+    return database.SidecarPath(EXTENSION_INDEX_NAME);
+}
+
+/*static*/ std::string
+ExtensionIndex::NormalizeExtension(std::string_view extension)
+{
+    if (!extension.empty() && extension[0] == '.')
+        extension.remove_prefix(1);
+
+    std::string normalized(extension);
+    for (char& c : normalized)
+        c = tolower((uint8)c);
+    return normalized;
+}
+
+/*static*/ void
+ExtensionIndex::GetExtensions(const FlatMessage& message, std::vector<std::string>& extensions)
+{
+    extensions.clear();
+    FlatMessageField field = message.FindField("extensions", B_STRING_TYPE);
+    for (int32 i = 0; i < field.CountItems(); i++) {
+        std::string extension = NormalizeExtension(field.StringAt(i));
+        if (!extension.empty()
+            && std::find(extensions.begin(), extensions.end(), extension) == extensions.end())
+            extensions.push_back(extension);
+    }
+}
+
+/*static*/ status_t
+ExtensionIndex::Write(const char* path, const extension_map& entries)
+{
+    std::vector<std::string> extensions;
+    std::vector<uint64> hashes;
+    for (const auto& entry : entries) {
+        if (entry.second.empty())
+            continue;
+        extensions.push_back(entry.first);
+        hashes.push_back(hash_string(entry.first));
+    }
+    uint32 count = (uint32)extensions.size();
+
+    // about four keys per bucket; fewer make a seed easier to find
+    std::vector<uint32> seeds;
+    std::vector<uint32> slotOf;
+    uint32 bucketCount = std::max<uint32>(1, (count + 3) / 4);
+    while (count > 0 && !build_perfect_hash(hashes, bucketCount, seeds, slotOf)) {
+        if (bucketCount >= count)
+            return B_ERROR;
+        bucketCount = std::min(count, bucketCount * 2);
+    }
+    if (count == 0)
+        seeds.assign(bucketCount, 0);
+
+    // strings are shared, most types claim several extensions
+    std::string strings;
+    std::unordered_map<std::string, uint32> stringOffsets;
+    auto add_string = [&](const std::string& string) {
+        auto found = stringOffsets.find(string);
+        if (found != stringOffsets.end())
+            return found->second;
+        uint32 offset = (uint32)strings.size();
+        strings.append(string.c_str(), string.size() + 1);
+        stringOffsets[string] = offset;
+        return offset;
+    };
+
+    std::vector<extension_index_slot> slots(count);
+    std::vector<uint32> types;
+    for (uint32 i = 0; i < count; i++) {
+        const std::vector<std::string>& entryTypes = entries.at(extensions[i]);
+        extension_index_slot& slot = slots[slotOf[i]];
+        slot.extension = add_string(extensions[i]);
+        slot.firstType = (uint32)types.size();
+        slot.typeCount = (uint32)entryTypes.size();
+        for (const std::string& type : entryTypes)
+            types.push_back(add_string(type));
+    }
+
+    extension_index_header header;
+    header.magic = EXTENSION_INDEX_MAGIC;
+    header.version = EXTENSION_INDEX_VERSION;
+    header.extensionCount = count;
+    header.bucketCount = bucketCount;
+    header.seedsOffset = sizeof(header);
+    header.slotsOffset = header.seedsOffset + bucketCount * sizeof(uint32);
+    header.typesOffset = header.slotsOffset + count * sizeof(extension_index_slot);
+    header.typeCount = (uint32)types.size();
+    header.stringsOffset = header.typesOffset + header.typeCount * sizeof(uint32);
+    header.stringsSize = (uint32)strings.size();
+
+    std::string data((const char*)&header, sizeof(header));
+    data.append((const char*)seeds.data(), seeds.size() * sizeof(uint32));
+    data.append((const char*)slots.data(), slots.size() * sizeof(extension_index_slot));
+    data.append((const char*)types.data(), types.size() * sizeof(uint32));
+    data.append(strings);
+
+    return ReplaceFile(path, data.data(), data.size());
+}
+
+/*static*/ status_t
+ExtensionIndex::Build(MimeDatabase& database, extension_map& entries)
+{
+    entries.clear();
+
+    std::vector<std::string> types;
+    status_t result = database.GetInstalledTypes(NULL, types);
+    if (result != B_OK)
+        return result;
+
+    std::string data;
+    std::vector<std::string> extensions;
+    for (const std::string& type : types) {
+        if (database.GetField(type.c_str(), MIME_FIELD_EXTENSIONS, data) != B_OK)
+            continue;
+
+        GetExtensions(FlatMessage(data.data(), data.size()), extensions);
+        for (const std::string& extension : extensions)
+            entries[extension].push_back(type);
+    }
+
+    // keep the order independent of the backend
+    for (auto& entry : entries)
+        std::sort(entry.second.begin(), entry.second.end());
+    return B_OK;
+}
+
+/*static*/ status_t
+ExtensionIndex::Rebuild(MimeDatabase& database)
+{
+    extension_map entries;
+    status_t result = Build(database, entries);
+    if (result != B_OK)
+        return result;
+    return Write(PathFor(database).c_str(), entries);
+}
+
+/*static*/ status_t
+ExtensionIndex::Update(MimeDatabase& database, const std::vector<extension_change>& changes)
+{
+    if (changes.empty())
+        return B_OK;
+
+    std::string path = PathFor(database);
+    ExtensionIndex index;
+    extension_map entries;
+    if (index.SetTo(path.c_str()) != B_OK || index.GetEntries(entries) != B_OK)
+        return Rebuild(database);
+    index.Unset();
+
+    std::set<std::string> changedTypes;
+    for (const extension_change& change : changes)
+        changedTypes.insert(change.type);
+
+    // drop the old extensions of the changed types, then add the new ones
+    for (auto entry = entries.begin(); entry != entries.end();) {
+        std::vector<std::string>& types = entry->second;
+        types.erase(std::remove_if(types.begin(), types.end(),
+            [&](const std::string& type) { return changedTypes.count(type) != 0; }),
+            types.end());
+        if (types.empty())
+            entry = entries.erase(entry);
+        else
+            ++entry;
+    }
+
+    for (const extension_change& change : changes) {
+        for (const std::string& extension : change.extensions) {
+            std::vector<std::string>& types = entries[NormalizeExtension(extension)];
+            auto position = std::lower_bound(types.begin(), types.end(), change.type);
+            if (position == types.end() || *position != change.type)
+                types.insert(position, change.type);
+        }
+    }
+
+    return Write(path.c_str(), entries);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _EXTENSION_INDEX_H
+#define _EXTENSION_INDEX_H
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FlatMessage.h"
+#include "MappedFile.h"
+#include "MimeDatabase.h"
+
+#define EXTENSION_INDEX_NAME "extensions"
+
+// extension (lower case, without dot) -> sorted types claiming it
+typedef std::map<std::string, std::vector<std::string> > extension_map;
+
+struct extension_index_header;
+struct extension_index_slot;
+
+struct extension_change {
+    std::string                 type;
+    std::vector<std::string>    extensions;     // empty to remove the type
+};
+
+// Persisted reverse index of the META:EXTENS fields of all types, stored next
+// to the MIME DB. The file is mapped and looked up in place through a minimal
+// perfect hash of the extensions, so a lookup costs one hash and one compare
+// instead of reading every installed type.
+class ExtensionIndex {
+public:
+                            ExtensionIndex();
+
+            status_t        SetTo(const char* path);
+            void            Unset();
+            status_t        InitCheck() const { return fStatus; }
+
+            int32           CountExtensions() const;
+            // returns B_ENTRY_NOT_FOUND if no type claims the extension
+            status_t        Lookup(const char* extension,
+                                std::vector<std::string_view>& types) const;
+            status_t        GetEntries(extension_map& entries) const;
+
+    static  std::string     PathFor(const MimeDatabase& database);
+    static  std::string     NormalizeExtension(std::string_view extension);
+    static  void            GetExtensions(const FlatMessage& message,
+                                std::vector<std::string>& extensions);
+
+    static  status_t        Write(const char* path, const extension_map& entries);
+    // reads the extensions of all installed types
+    static  status_t        Build(MimeDatabase& database, extension_map& entries);
+    static  status_t        Rebuild(MimeDatabase& database);
+    // applies the new extension lists of the given types to the index, or
+    // builds it from the DB (which must already have the changes) if needed
+    static  status_t        Update(MimeDatabase& database,
+                                const std::vector<extension_change>& changes);
+
+private:
+            const char*     _StringAt(uint32 offset) const;
+
+            MappedFile      fFile;
+            status_t        fStatus;
+            const extension_index_header* fHeader;
+            const uint32*   fSeeds;
+            const extension_index_slot* fSlots;
+            const uint32*   fTypes;
+            const char*     fStrings;
+};
+
+#endif // _EXTENSION_INDEX_H
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "FileAttributes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __HAIKU__
+#include <fs_attr.h>
+#else
+#include <string.h>
+#include <sys/statvfs.h>
+#include <sys/xattr.h>
+
+#define XATTR_PREFIX "user."
+#endif
+
+#ifdef __HAIKU__
+
+status_t
+ReadAttribute(const char* path, const char* name, std::string& data, type_code* _type)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return errno;
+
+    attr_info info;
+    status_t result = B_OK;
+    if (fs_stat_attr(fd, name, &info) != 0) {
+        result = errno;
+    } else {
+        data.resize(info.size);
+        ssize_t bytesRead = fs_read_attr(fd, name, info.type, 0, &data[0], info.size);
+        if (bytesRead < 0)
+            result = errno;
+        else
+            data.resize(bytesRead);
+        if (_type != NULL)
+            *_type = info.type;
+    }
+
+    close(fd);
+    return result;
+}
+
+status_t
+WriteAttribute(int fd, const char* name, type_code type, const void* data, size_t size)
+{
+    // replace, don't overwrite in place, so a shorter value truncates
+    fs_remove_attr(fd, name);
+    ssize_t written = fs_write_attr(fd, name, type, 0, data, size);
+    return written < 0 ? errno : B_OK;
+}
+
+status_t
+RemoveAttribute(int fd, const char* name)
+{
+    return fs_remove_attr(fd, name) != 0 ? errno : B_OK;
+}
+
+#else // !__HAIKU__
+
+// Extended attributes have no type, so it is stored in front of the value:
+// a tag that no text value starts with, followed by the type in big endian.
+// Values without the tag, as written by other tools, are read unchanged.
+static const char kTypeTag[4] = { '\0', 'T', 'Y', 'P' };
+static const size_t kTypeHeaderSize = sizeof(kTypeTag) + sizeof(uint32);
+
+static inline std::string
+xattr_name(const char* name)
+{
+    return std::string(XATTR_PREFIX) + name;
+}
+
+status_t
+ReadAttribute(const char* path, const char* name, std::string& data, type_code* _type)
+{
+    std::string attribute = xattr_name(name);
+    while (true) {
+        ssize_t size = getxattr(path, attribute.c_str(), NULL, 0);
+        if (size < 0)
+            return errno == ENODATA ? B_ENTRY_NOT_FOUND : errno;
+
+        data.resize(size);
+        size = getxattr(path, attribute.c_str(), &data[0], size);
+        if (size >= 0) {
+            data.resize(size);
+            break;
+        }
+        // value grew in between
+        if (errno != ERANGE)
+            return errno;
+    }
+
+    type_code type = B_RAW_TYPE;
+    if (data.size() >= kTypeHeaderSize
+        && memcmp(data.data(), kTypeTag, sizeof(kTypeTag)) == 0) {
+        const uint8* header = (const uint8*)data.data() + sizeof(kTypeTag);
+        type = ((uint32)header[0] << 24) | ((uint32)header[1] << 16)
+            | ((uint32)header[2] << 8) | header[3];
+        data.erase(0, kTypeHeaderSize);
+    }
+    if (_type != NULL)
+        *_type = type;
+    return B_OK;
+}
+
+status_t
+WriteAttribute(int fd, const char* name, type_code type, const void* data, size_t size)
+{
+    std::string value(kTypeTag, sizeof(kTypeTag));
+    value += (char)(type >> 24);
+    value += (char)(type >> 16);
+    value += (char)(type >> 8);
+    value += (char)type;
+    value.append((const char*)data, size);
+
+    if (fsetxattr(fd, xattr_name(name).c_str(), value.data(), value.size(), 0) == 0)
+        return B_OK;
+
+    // ext4 keeps all attributes of a file in one block, and no file system
+    // takes more than 64 KB per value; tell that apart from a full disk
+    status_t result = errno;
+    struct statvfs info;
+    if (result == E2BIG
+        || (result == ENOSPC && fstatvfs(fd, &info) == 0 && info.f_bavail > 0))
+        return B_BUFFER_OVERFLOW;
+    return result;
+}
+
+status_t
+RemoveAttribute(int fd, const char* name)
+{
+    if (fremovexattr(fd, xattr_name(name).c_str()) != 0)
+        return errno == ENODATA ? B_ENTRY_NOT_FOUND : errno;
+    return B_OK;
+}
+
+#endif // !__HAIKU__
+
+status_t
+WriteAttribute(const char* path, const char* name, type_code type, const void* data,
+    size_t size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return errno;
+
+    status_t result = WriteAttribute(fd, name, type, data, size);
+    close(fd);
+    return result;
+}
+
+status_t
+RemoveAttribute(const char* path, const char* name)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return errno;
+
+    status_t result = RemoveAttribute(fd, name);
+    close(fd);
+    return result;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _FILE_ATTRIBUTES_H
+#define _FILE_ATTRIBUTES_H
+
+#include "Platform.h"
+
+#include <string>
+
+// Path based access to file attributes: BFS attributes on Haiku, "user."
+// extended attributes elsewhere, where the type is stored in front of the
+// value. Extended attributes are limited in size (ext4 fits all of a file's
+// attributes into one block, usually 4 KB); a value that doesn't fit fails
+// with B_BUFFER_OVERFLOW.
+
+status_t ReadAttribute(const char* path, const char* name, std::string& data,
+    type_code* _type = NULL);
+status_t WriteAttribute(const char* path, const char* name, type_code type,
+    const void* data, size_t size);
+status_t RemoveAttribute(const char* path, const char* name);
+
+// same on an open file descriptor, to write many attributes of one node
+status_t WriteAttribute(int fd, const char* name, type_code type,
+    const void* data, size_t size);
+status_t RemoveAttribute(int fd, const char* name);
+
+#endif // _FILE_ATTRIBUTES_H
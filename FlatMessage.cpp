@@ -0,0 +1,469 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "FlatMessage.h"
+
+#include <string.h>
+
+// flattened message layout, see MessagePrivate.h in the Haiku sources
+static const uint32 kMessageFormatHaiku = '1FMH';
+static const uint32 kMessageFormatHaikuSwapped = 'HMF1';
+static const size_t kMessageHeaderSize = 12 * sizeof(uint32);
+static const size_t kFieldHeaderSize = 24;
+static const size_t kHashTableSize = 5;
+static const uint32 kMessageFlagValid = 0x0001;
+static const uint16 kFieldFlagValid = 0x0001;
+static const uint16 kFieldFlagFixedSize = 0x0002;
+
+static inline uint16
+read_uint16(const uint8* data, bool swapped)
+{
+    uint16 value;
+    memcpy(&value, data, sizeof(value));
+    return swapped ? __builtin_bswap16(value) : value;
+}
+
+static inline uint32
+read_uint32(const uint8* data, bool swapped)
+{
+    uint32 value;
+    memcpy(&value, data, sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+// same as BMessage::_HashName()
+static uint32
+hash_name(const char* name)
+{
+    uint32 result = 0;
+    char ch;
+    while ((ch = *name++) != 0) {
+        result = (result << 7) ^ (result >> 24);
+        result ^= ch;
+    }
+    result ^= result << 12;
+    return result;
+}
+
+FlatMessageField::FlatMessageField()
+    :
+    fHeader(NULL),
+    fData(NULL),
+    fType(0),
+    fCount(0),
+    fDataSize(0),
+    fFixedSize(false),
+    fSwapped(false),
+    fLastIndex(0),
+    fLastOffset(0)
+{
+}
+
+bool
+FlatMessageField::ItemAt(int32 index, const void** _data, size_t* _size) const
+{
+    if (index < 0 || index >= fCount)
+        return false;
+
+    if (fFixedSize) {
+        size_t itemSize = fDataSize / fCount;
+        *_data = fData + index * itemSize;
+        *_size = itemSize;
+        return true;
+    }
+
+    // variable sized items are stored as size followed by data, so walk
+    // from the last position when possible
+    int32 current = 0;
+    uint32 offset = 0;
+    if (index >= fLastIndex) {
+        current = fLastIndex;
+        offset = fLastOffset;
+    }
+
+    while (true) {
+        if (offset + sizeof(uint32) > fDataSize)
+            return false;
+        uint32 size = read_uint32(fData + offset, fSwapped);
+        if ((uint64)offset + sizeof(uint32) + size > fDataSize)
+            return false;
+        if (current == index) {
+            fLastIndex = current;
+            fLastOffset = offset;
+            *_data = fData + offset + sizeof(uint32);
+            *_size = size;
+            return true;
+        }
+        offset += sizeof(uint32) + size;
+        current++;
+    }
+}
+
+std::string_view
+FlatMessageField::StringAt(int32 index, std::string_view defaultValue) const
+{
+    const void* data;
+    size_t size;
+    if (fType != B_STRING_TYPE || !ItemAt(index, &data, &size) || size == 0)
+        return defaultValue;
+
+    const char* string = reinterpret_cast<const char*>(data);
+    return std::string_view(string, strnlen(string, size));
+}
+
+int32
+FlatMessageField::Int32At(int32 index, int32 defaultValue) const
+{
+    return (int32)UInt32At(index, (uint32)defaultValue);
+}
+
+uint32
+FlatMessageField::UInt32At(int32 index, uint32 defaultValue) const
+{
+    const void* data;
+    size_t size;
+    if ((fType != B_INT32_TYPE && fType != B_UINT32_TYPE)
+        || !ItemAt(index, &data, &size) || size != sizeof(uint32))
+        return defaultValue;
+
+    return read_uint32(reinterpret_cast<const uint8*>(data), fSwapped);
+}
+
+bool
+FlatMessageField::BoolAt(int32 index, bool defaultValue) const
+{
+    const void* data;
+    size_t size;
+    if (fType != B_BOOL_TYPE || !ItemAt(index, &data, &size) || size != 1)
+        return defaultValue;
+
+    return *reinterpret_cast<const uint8*>(data) != 0;
+}
+
+bool
+FlatMessageField::HasSameData(const FlatMessageField& other) const
+{
+    if (fType != other.fType || fCount != other.fCount)
+        return false;
+
+    bool swapped = fSwapped != other.fSwapped;
+    for (int32 i = 0; i < fCount; i++) {
+        const void* data;
+        const void* otherData;
+        size_t size, otherSize;
+        if (!ItemAt(i, &data, &size) || !other.ItemAt(i, &otherData, &otherSize)
+            || size != otherSize)
+            return false;
+
+        if (swapped && fFixedSize && (size == 2 || size == 4 || size == 8)) {
+            // fixed size numbers in different byte order
+            const uint8* a = reinterpret_cast<const uint8*>(data);
+            const uint8* b = reinterpret_cast<const uint8*>(otherData);
+            for (size_t j = 0; j < size; j++) {
+                if (a[j] != b[size - 1 - j])
+                    return false;
+            }
+        } else if (memcmp(data, otherData, size) != 0)
+            return false;
+    }
+    return true;
+}
+
+FlatMessage::FlatMessage()
+    :
+    fBuffer(NULL),
+    fSize(0),
+    fStatus(B_NO_INIT),
+    fSwapped(false),
+    fWhat(0),
+    fFieldCount(0),
+    fHashTableSize(0),
+    fHashTable(NULL),
+    fFields(NULL),
+    fData(NULL),
+    fDataSize(0)
+{
+}
+
+FlatMessage::FlatMessage(const void* data, size_t size)
+    :
+    FlatMessage()
+{
+    SetTo(data, size);
+}
+
+status_t
+FlatMessage::SetTo(const void* data, size_t size)
+{
+    *this = FlatMessage();
+    if (data == NULL || size < kMessageHeaderSize)
+        return fStatus = B_BAD_VALUE;
+
+    const uint8* buffer = reinterpret_cast<const uint8*>(data);
+    uint32 format = read_uint32(buffer, false);
+    if (format == kMessageFormatHaiku)
+        fSwapped = false;
+    else if (format == kMessageFormatHaikuSwapped)
+        fSwapped = true;
+    else
+        return fStatus = B_NOT_SUPPORTED;
+
+    fBuffer = buffer;
+    fWhat = _ReadUInt32(buffer + 4);
+    fDataSize = _ReadUInt32(buffer + 36);
+    uint32 fieldCount = _ReadUInt32(buffer + 40);
+    fHashTableSize = _ReadUInt32(buffer + 44);
+
+    uint64 hashTableOffset = kMessageHeaderSize;
+    uint64 fieldsOffset = hashTableOffset + (uint64)fHashTableSize * sizeof(int32);
+    uint64 dataOffset = fieldsOffset + (uint64)fieldCount * kFieldHeaderSize;
+    if (fieldCount > INT32_MAX || dataOffset + fDataSize > size)
+        return fStatus = B_BAD_DATA;
+
+    fSize = dataOffset + fDataSize;
+    fFieldCount = (int32)fieldCount;
+    fHashTable = buffer + hashTableOffset;
+    fFields = buffer + fieldsOffset;
+    fData = buffer + dataOffset;
+
+    // validate the field directory once, so lookups need no further checks
+    for (int32 i = 0; i < fFieldCount; i++) {
+        const uint8* header = fFields + i * kFieldHeaderSize;
+        uint16 flags = read_uint16(header, fSwapped);
+        uint16 nameLength = read_uint16(header + 2, fSwapped);
+        uint32 count = _ReadUInt32(header + 8);
+        uint32 fieldSize = _ReadUInt32(header + 12);
+        uint32 offset = _ReadUInt32(header + 16);
+
+        if (nameLength == 0 || count > INT32_MAX
+            || (uint64)offset + nameLength + fieldSize > fDataSize
+            || fData[offset + nameLength - 1] != '\0'
+            || ((flags & kFieldFlagFixedSize) != 0 && count > 0 && fieldSize % count != 0)) {
+            *this = FlatMessage();
+            return fStatus = B_BAD_DATA;
+        }
+    }
+
+    return fStatus = B_OK;
+}
+
+FlatMessageField
+FlatMessage::FieldAt(int32 index) const
+{
+    FlatMessageField field;
+    if (fStatus != B_OK || index < 0 || index >= fFieldCount)
+        return field;
+
+    const uint8* header = fFields + index * kFieldHeaderSize;
+    uint16 nameLength = read_uint16(header + 2, fSwapped);
+    uint32 offset = _ReadUInt32(header + 16);
+    const char* name = reinterpret_cast<const char*>(fData + offset);
+
+    field.fHeader = header;
+    field.fName = std::string_view(name, nameLength - 1);
+    field.fType = _ReadUInt32(header + 4);
+    field.fCount = (int32)_ReadUInt32(header + 8);
+    field.fDataSize = _ReadUInt32(header + 12);
+    field.fData = fData + offset + nameLength;
+    field.fFixedSize = (read_uint16(header, fSwapped) & kFieldFlagFixedSize) != 0;
+    field.fSwapped = fSwapped;
+    return field;
+}
+
+FlatMessageField
+FlatMessage::FindField(const char* name) const
+{
+    if (fStatus != B_OK || fHashTableSize == 0)
+        return FlatMessageField();
+
+    std::string_view key(name);
+    int32 index = (int32)_ReadUInt32(fHashTable
+        + (hash_name(name) % fHashTableSize) * sizeof(int32));
+
+    // follow the hash chain; bounded in case of a corrupt chain
+    for (int32 steps = 0; index >= 0 && index < fFieldCount && steps < fFieldCount; steps++) {
+        FlatMessageField field = FieldAt(index);
+        if (field.Name() == key)
+            return field;
+        index = (int32)_ReadUInt32(field.fHeader + 20);
+    }
+
+    return FlatMessageField();
+}
+
+FlatMessageField
+FlatMessage::FindField(const char* name, type_code type) const
+{
+    FlatMessageField field = FindField(name);
+    if (field.IsValid() && field.Type() != type)
+        return FlatMessageField();
+    return field;
+}
+
+std::string_view
+FlatMessage::GetString(const char* name, int32 index, std::string_view defaultValue) const
+{
+    return FindField(name).StringAt(index, defaultValue);
+}
+
+uint32
+FlatMessage::GetUInt32(const char* name, int32 index, uint32 defaultValue) const
+{
+    return FindField(name).UInt32At(index, defaultValue);
+}
+
+bool
+FlatMessage::GetBool(const char* name, int32 index, bool defaultValue) const
+{
+    return FindField(name).BoolAt(index, defaultValue);
+}
+
+bool
+FlatMessage::HasSameData(const FlatMessage& other) const
+{
+    if (fStatus != B_OK || other.fStatus != B_OK)
+        return false;
+    if (fFieldCount != other.fFieldCount)
+        return false;
+
+    for (int32 i = 0; i < fFieldCount; i++) {
+        FlatMessageField field = FieldAt(i);
+        std::string_view name = field.Name();
+        // names are NUL terminated in the flattened data
+        FlatMessageField otherField = other.FindField(name.data());
+        if (!otherField.IsValid() || !field.HasSameData(otherField))
+            return false;
+    }
+    return true;
+}
+
+/*static*/ bool
+FlatMessage::IsFlatMessage(const void* data, size_t size)
+{
+    if (data == NULL || size < kMessageHeaderSize)
+        return false;
+
+    uint32 format = read_uint32(reinterpret_cast<const uint8*>(data), false);
+    return format == kMessageFormatHaiku || format == kMessageFormatHaikuSwapped;
+}
+
+uint32
+FlatMessage::_ReadUInt32(const uint8* data) const
+{
+    return read_uint32(data, fSwapped);
+}
+
+// #pragma mark - FlatMessageWriter
+
+static inline void
+append_uint16(std::string& data, uint16 value)
+{
+    data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static inline void
+append_uint32(std::string& data, uint32 value)
+{
+    data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+FlatMessageWriter::FlatMessageWriter(uint32 what)
+    :
+    fWhat(what)
+{
+}
+
+status_t
+FlatMessageWriter::AddData(const char* name, type_code type, const void* data, size_t size,
+    bool fixedSize)
+{
+    if (name == NULL || name[0] == '\0' || (data == NULL && size > 0) || size > UINT32_MAX)
+        return B_BAD_VALUE;
+
+    field* target = NULL;
+    for (field& existing : fFields) {
+        if (existing.name == name) {
+            target = &existing;
+            break;
+        }
+    }
+    if (target == NULL) {
+        fFields.push_back(field());
+        target = &fFields.back();
+        target->name = name;
+        target->type = type;
+        target->fixedSize = fixedSize;
+        target->count = 0;
+    } else if (target->type != type) {
+        return B_BAD_TYPE;
+    }
+
+    // like BMessage, fixed size fields keep the size of their first item
+    if (target->fixedSize && target->count > 0 && size != target->data.size() / target->count)
+        return B_BAD_VALUE;
+
+    if (!target->fixedSize)
+        append_uint32(target->data, (uint32)size);
+    target->data.append(reinterpret_cast<const char*>(data), size);
+    target->count++;
+    return B_OK;
+}
+
+status_t
+FlatMessageWriter::AddString(const char* name, const char* string)
+{
+    return AddData(name, B_STRING_TYPE, string, strlen(string) + 1, false);
+}
+
+void
+FlatMessageWriter::Flatten(std::string& data) const
+{
+    int32 hashTable[kHashTableSize];
+    for (size_t i = 0; i < kHashTableSize; i++)
+        hashTable[i] = -1;
+    std::vector<int32> nextField(fFields.size(), -1);
+
+    // new fields are appended to the end of their hash chain, like BMessage
+    uint32 dataSize = 0;
+    for (size_t i = 0; i < fFields.size(); i++) {
+        int32* link = &hashTable[hash_name(fFields[i].name.c_str()) % kHashTableSize];
+        while (*link >= 0)
+            link = &nextField[*link];
+        *link = (int32)i;
+        dataSize += fFields[i].name.size() + 1 + fFields[i].data.size();
+    }
+
+    // header, in host byte order like the reader expects it
+    append_uint32(data, kMessageFormatHaiku);
+    append_uint32(data, fWhat);
+    append_uint32(data, kMessageFlagValid);
+    for (int32 i = 0; i < 6; i++) {
+        // target, specifier, area, reply port, target and team are unset
+        append_uint32(data, (uint32)-1);
+    }
+    append_uint32(data, dataSize);
+    append_uint32(data, (uint32)fFields.size());
+    append_uint32(data, kHashTableSize);
+    for (size_t i = 0; i < kHashTableSize; i++)
+        append_uint32(data, (uint32)hashTable[i]);
+
+    uint32 offset = 0;
+    for (size_t i = 0; i < fFields.size(); i++) {
+        const field& field = fFields[i];
+        append_uint16(data, kFieldFlagValid | (field.fixedSize ? kFieldFlagFixedSize : 0));
+        append_uint16(data, (uint16)(field.name.size() + 1));
+        append_uint32(data, field.type);
+        append_uint32(data, field.count);
+        append_uint32(data, (uint32)field.data.size());
+        append_uint32(data, offset);
+        append_uint32(data, (uint32)nextField[i]);
+        offset += field.name.size() + 1 + field.data.size();
+    }
+
+    for (const field& field : fFields) {
+        data.append(field.name.c_str(), field.name.size() + 1);
+        data += field.data;
+    }
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _FLAT_MESSAGE_H
+#define _FLAT_MESSAGE_H
+
+#include "Platform.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One field of a FlatMessage. Items are read directly from the flattened
+// data; sequential access by increasing index is O(1) per item.
+class FlatMessageField {
+public:
+                            FlatMessageField();
+
+            bool            IsValid() const { return fHeader != NULL; }
+            std::string_view Name() const { return fName; }
+            type_code       Type() const { return fType; }
+            int32           CountItems() const { return fCount; }
+
+            bool            ItemAt(int32 index, const void** _data,
+                                size_t* _size) const;
+
+            // strings are returned without the terminating NUL
+            std::string_view StringAt(int32 index,
+                                std::string_view defaultValue = {}) const;
+            int32           Int32At(int32 index, int32 defaultValue = 0) const;
+            uint32          UInt32At(int32 index, uint32 defaultValue = 0) const;
+            bool            BoolAt(int32 index, bool defaultValue = false) const;
+
+            // same type and items, regardless of layout and byte order
+            bool            HasSameData(const FlatMessageField& other) const;
+
+private:
+            friend class FlatMessage;
+
+            const uint8*    fHeader;
+            const uint8*    fData;
+            std::string_view fName;
+            type_code       fType;
+            int32           fCount;
+            uint32          fDataSize;
+            bool            fFixedSize;
+            bool            fSwapped;
+
+            // position of the last variable sized item looked up
+    mutable int32           fLastIndex;
+    mutable uint32          fLastOffset;
+};
+
+// Read-only view of a flattened BMessage (Haiku message format). SetTo()
+// validates the header and the field directory once; lookups use the hash
+// table of the flattened message and never allocate or copy. The data must
+// stay valid as long as the view and the fields returned from it are used.
+class FlatMessage {
+public:
+                            FlatMessage();
+                            FlatMessage(const void* data, size_t size);
+
+            status_t        SetTo(const void* data, size_t size);
+            status_t        InitCheck() const { return fStatus; }
+
+            const void*     Data() const { return fBuffer; }
+            uint32          What() const { return fWhat; }
+            int32           CountFields() const { return fFieldCount; }
+            size_t          FlattenedSize() const { return fSize; }
+
+            FlatMessageField FieldAt(int32 index) const;
+            FlatMessageField FindField(const char* name) const;
+            FlatMessageField FindField(const char* name, type_code type) const;
+
+            // BMessage::Get*() style accessors for single lookups
+            std::string_view GetString(const char* name, int32 index,
+                                std::string_view defaultValue = {}) const;
+            uint32          GetUInt32(const char* name, int32 index,
+                                uint32 defaultValue = 0) const;
+            bool            GetBool(const char* name, int32 index,
+                                bool defaultValue = false) const;
+
+            // compares the fields (but not what), not the flattened layout
+            bool            HasSameData(const FlatMessage& other) const;
+
+    static  bool            IsFlatMessage(const void* data, size_t size);
+
+private:
+            uint32          _ReadUInt32(const uint8* data) const;
+
+            const uint8*    fBuffer;
+            size_t          fSize;
+            status_t        fStatus;
+            bool            fSwapped;
+            uint32          fWhat;
+            int32           fFieldCount;
+            uint32          fHashTableSize;
+            const uint8*    fHashTable;
+            const uint8*    fFields;
+            const uint8*    fData;
+            uint32          fDataSize;
+};
+
+// Builds a flattened BMessage in the Haiku message format, for fields like
+// META:EXTENS that are stored as messages. Items added under the same name
+// are appended to that field.
+class FlatMessageWriter {
+public:
+                            FlatMessageWriter(uint32 what = 0);
+
+            // fails with B_BAD_TYPE if the field exists with another type
+            status_t        AddData(const char* name, type_code type,
+                                const void* data, size_t size,
+                                bool fixedSize = true);
+            status_t        AddString(const char* name, const char* string);
+
+            int32           CountFields() const
+                                { return (int32)fFields.size(); }
+            // appends the flattened message to the data
+            void            Flatten(std::string& data) const;
+
+private:
+            struct field {
+                std::string name;
+                type_code   type;
+                bool        fixedSize;
+                uint32      count;
+                std::string data;       // variable sized items with size
+            };
+
+            uint32          fWhat;
+            std::vector<field> fFields;
+};
+
+#endif // _FLAT_MESSAGE_H
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "IndexKey.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void
+append_big_endian(std::string& key, uint64 value, size_t size)
+{
+    for (size_t i = size; i-- > 0;)
+        key += (char)(uint8)(value >> (i * 8));
+}
+
+static void
+make_signed_key(std::string& key, int64 value, size_t size)
+{
+    uint64 sign = (uint64)1 << (size * 8 - 1);
+    append_big_endian(key, (uint64)value ^ sign, size);
+}
+
+// negative numbers sort in reverse by their bits, so those are all flipped
+static void
+make_float_key(std::string& key, uint64 bits, size_t size)
+{
+    uint64 sign = (uint64)1 << (size * 8 - 1);
+    uint64 mask = size == 8 ? ~(uint64)0 : ((uint64)1 << (size * 8)) - 1;
+    append_big_endian(key, (bits & sign) != 0 ? ~bits & mask : bits | sign, size);
+}
+
+static void
+make_string_key(std::string& key, const char* data, size_t size)
+{
+    const char* end = (const char*)memchr(data, '\0', size);
+    if (end != NULL)
+        size = end - data;
+    key.assign(data, size < MAX_INDEX_KEY_LENGTH ? size : MAX_INDEX_KEY_LENGTH);
+}
+
+bool
+IsIndexKeyType(type_code type)
+{
+    switch (type) {
+        case B_STRING_TYPE:
+        case B_MIME_STRING_TYPE:
+        case B_INT32_TYPE:
+        case B_UINT32_TYPE:
+        case B_INT64_TYPE:
+        case B_UINT64_TYPE:
+        case B_TIME_TYPE:
+        case B_FLOAT_TYPE:
+        case B_DOUBLE_TYPE:
+            return true;
+    }
+    return false;
+}
+
+status_t
+MakeIndexKey(type_code type, const void* data, size_t size, std::string& key)
+{
+    key.clear();
+    switch (type) {
+        case B_STRING_TYPE:
+        case B_MIME_STRING_TYPE:
+            make_string_key(key, (const char*)data, size);
+            return B_OK;
+
+        case B_INT32_TYPE:
+        case B_UINT32_TYPE:
+        {
+            if (size != sizeof(uint32))
+                return B_BAD_DATA;
+            uint32 value;
+            memcpy(&value, data, sizeof(value));
+            if (type == B_INT32_TYPE)
+                make_signed_key(key, (int32)value, sizeof(value));
+            else
+                append_big_endian(key, value, sizeof(value));
+            return B_OK;
+        }
+
+        case B_INT64_TYPE:
+        case B_UINT64_TYPE:
+        case B_TIME_TYPE:
+        {
+            // time_t is 32 bit on some platforms, keys are always 64 bit
+            uint64 value;
+            if (type == B_TIME_TYPE && size == sizeof(int32)) {
+                int32 value32;
+                memcpy(&value32, data, sizeof(value32));
+                value = (uint64)(int64)value32;
+            } else if (size == sizeof(value))
+                memcpy(&value, data, sizeof(value));
+            else
+                return B_BAD_DATA;
+            if (type == B_UINT64_TYPE)
+                append_big_endian(key, value, sizeof(value));
+            else
+                make_signed_key(key, (int64)value, sizeof(value));
+            return B_OK;
+        }
+
+        case B_FLOAT_TYPE:
+        {
+            uint32 bits;
+            if (size != sizeof(bits))
+                return B_BAD_DATA;
+            memcpy(&bits, data, sizeof(bits));
+            make_float_key(key, bits, sizeof(bits));
+            return B_OK;
+        }
+
+        case B_DOUBLE_TYPE:
+        {
+            uint64 bits;
+            if (size != sizeof(bits))
+                return B_BAD_DATA;
+            memcpy(&bits, data, sizeof(bits));
+            make_float_key(key, bits, sizeof(bits));
+            return B_OK;
+        }
+    }
+    return B_BAD_TYPE;
+}
+
+status_t
+ParseIndexKey(type_code type, const char* text, std::string& key)
+{
+    if (type == B_STRING_TYPE || type == B_MIME_STRING_TYPE)
+        return MakeIndexKey(type, text, strlen(text), key);
+    if (!IsIndexKeyType(type))
+        return B_BAD_TYPE;
+    if (text[0] == '\0')
+        return B_BAD_VALUE;
+
+    char* end;
+    errno = 0;
+    switch (type) {
+        case B_INT32_TYPE:
+        case B_INT64_TYPE:
+        case B_TIME_TYPE:
+        {
+            long long value = strtoll(text, &end, 10);
+            if (*end != '\0' || errno != 0
+                || (type == B_INT32_TYPE && (value < INT32_MIN || value > INT32_MAX)))
+                return B_BAD_VALUE;
+            if (type == B_INT32_TYPE) {
+                int32 value32 = (int32)value;
+                return MakeIndexKey(type, &value32, sizeof(value32), key);
+            }
+            int64 value64 = value;
+            return MakeIndexKey(type, &value64, sizeof(value64), key);
+        }
+
+        case B_UINT32_TYPE:
+        case B_UINT64_TYPE:
+        {
+            if (text[0] == '-')
+                return B_BAD_VALUE;
+            unsigned long long value = strtoull(text, &end, 10);
+            if (*end != '\0' || errno != 0
+                || (type == B_UINT32_TYPE && value > UINT32_MAX))
+                return B_BAD_VALUE;
+            if (type == B_UINT32_TYPE) {
+                uint32 value32 = (uint32)value;
+                return MakeIndexKey(type, &value32, sizeof(value32), key);
+            }
+            uint64 value64 = value;
+            return MakeIndexKey(type, &value64, sizeof(value64), key);
+        }
+
+        case B_FLOAT_TYPE:
+        {
+            float value = strtof(text, &end);
+            if (*end != '\0' || errno != 0 || value != value)
+                return B_BAD_VALUE;
+            return MakeIndexKey(type, &value, sizeof(value), key);
+        }
+
+        case B_DOUBLE_TYPE:
+        {
+            double value = strtod(text, &end);
+            if (*end != '\0' || errno != 0 || value != value)
+                return B_BAD_VALUE;
+            return MakeIndexKey(type, &value, sizeof(value), key);
+        }
+    }
+    return B_BAD_TYPE;
+}
+
+int
+CompareIndexKeys(const std::string& a, const std::string& b)
+{
+    // char_traits<char> compares as unsigned char, like memcmp()
+    int result = a.compare(b);
+    return result < 0 ? -1 : (result > 0 ? 1 : 0);
+}
+
+index_range::index_range()
+    :
+    hasLower(false),
+    hasUpper(false)
+{
+}
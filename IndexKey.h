@@ -0,0 +1,41 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _INDEX_KEY_H
+#define _INDEX_KEY_H
+
+#include "Platform.h"
+
+#include <string>
+
+// longer string keys are cut, like BFS does
+#define MAX_INDEX_KEY_LENGTH 255
+
+// Attribute values as index keys: encoded so that comparing the bytes, a
+// shorter key first on a common prefix, orders them like the values. Numbers
+// become big endian with the sign bit flipped, strings are kept up to their
+// terminating NUL.
+
+bool IsIndexKeyType(type_code type);
+
+// the key of an attribute value as read from a file
+status_t MakeIndexKey(type_code type, const void* data, size_t size,
+    std::string& key);
+// The key of a value written in a query, B_BAD_VALUE if the text is not a
+// value of the type.
+status_t ParseIndexKey(type_code type, const char* text, std::string& key);
+
+int CompareIndexKeys(const std::string& a, const std::string& b);
+
+// keys from lower to upper, both included, open where there is no bound
+struct index_range {
+                    index_range();
+
+    std::string     lower;
+    std::string     upper;
+    bool            hasLower;
+    bool            hasUpper;
+};
+
+#endif // _INDEX_KEY_H
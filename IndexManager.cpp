@@ -0,0 +1,322 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "IndexManager.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unordered_map>
+
+#include "Stats.h"
+#include "WorkerPool.h"
+
+struct IndexManager::volume_report {
+    status_t                    status;
+    int32                       existing;
+    int32                       created;
+    int32                       removed;
+    int32                       failed;
+    std::vector<std::string>    lines;
+};
+
+// indices BFS creates on every volume, whatever types are installed
+static const char* const kSystemIndices[] = {
+    "name",
+    "size",
+    "last_modified",
+    "BEOS:APP_SIG",
+    "BEOS:TYPE"
+};
+
+std::string
+type_code_string(type_code type)
+{
+    char buffer[16];
+    char chars[4] = { (char)(type >> 24), (char)(type >> 16), (char)(type >> 8), (char)type };
+    if (isprint(chars[0]) && isprint(chars[1]) && isprint(chars[2]) && isprint(chars[3]))
+        snprintf(buffer, sizeof(buffer), "%.4s", chars);
+    else
+        snprintf(buffer, sizeof(buffer), "0x%08" B_PRIx32, (uint32)type);
+    return buffer;
+}
+
+IndexManager::IndexManager()
+{
+}
+
+IndexManager::~IndexManager()
+{
+}
+
+status_t
+IndexManager::AddVolume(const char* path)
+{
+    std::unique_ptr<IndexVolume> volume(IndexVolume::Create(path));
+    if (volume.get() == NULL)
+        return B_NO_MEMORY;
+
+    status_t result = volume->InitCheck();
+    if (result != B_OK)
+        return result;
+
+    fVolumes.push_back(std::move(volume));
+    return B_OK;
+}
+
+void
+IndexManager::AddIndices(const FlatMessage& attrInfo, const char* mimeType)
+{
+    std::vector<index_entry> attributes;
+    GetSearchableAttributes(attrInfo, attributes);
+    for (const index_entry& attribute : attributes)
+        AddIndex(attribute.name.c_str(), attribute.type, mimeType);
+}
+
+void
+IndexManager::AddIndex(const char* name, type_code type, const char* mimeType)
+{
+    auto found = fIndices.find(name);
+    if (found == fIndices.end()) {
+        fIndices[name] = index_request{ type, mimeType };
+        return;
+    }
+
+    // an index has a single type, the first MIME type wins
+    if (found->second.type != type) {
+        fprintf(stderr, "attribute %s of %s has type %s, but %s declares it as %s, "
+            "keeping %s\n", name, mimeType, type_code_string(type).c_str(),
+            found->second.mimeType.c_str(), type_code_string(found->second.type).c_str(),
+            type_code_string(found->second.type).c_str());
+    }
+}
+
+status_t
+IndexManager::CreateMissingIndices()
+{
+    if (fIndices.empty() || fVolumes.empty())
+        return B_OK;
+
+    int32 count = (int32)fVolumes.size();
+    std::vector<volume_report> reports(count);
+
+    // volumes are independent, don't let a slow one hold up the others
+    WorkerPool pool(count);
+    pool.ForEach(count, [&](int32 index) {
+        _ProcessVolume(*fVolumes[index], reports[index]);
+    });
+
+    status_t result = B_OK;
+    for (int32 i = 0; i < count; i++) {
+        const volume_report& report = reports[i];
+        if (report.status != B_OK) {
+            fprintf(stderr, "failed to read indices of volume %s: %s\n",
+                fVolumes[i]->Name(), strerror(report.status));
+            result = report.status;
+            continue;
+        }
+
+        printf("volume %s: %" B_PRId32 " indices needed, %" B_PRId32 " present, %" B_PRId32
+            " created, %" B_PRId32 " failed\n", fVolumes[i]->Name(), CountIndices(),
+            report.existing, report.created, report.failed);
+        for (const std::string& line : report.lines)
+            printf("  %s\n", line.c_str());
+
+        if (report.failed > 0)
+            result = B_ERROR;
+    }
+    return result;
+}
+
+status_t
+IndexManager::RemoveUnusedIndices(const index_declarations& declarations)
+{
+    if (fIndices.empty() || fVolumes.empty())
+        return B_OK;
+
+    int32 count = (int32)fVolumes.size();
+    std::vector<volume_report> reports(count);
+
+    WorkerPool pool(count);
+    pool.ForEach(count, [&](int32 index) {
+        _RemoveFromVolume(*fVolumes[index], declarations, reports[index]);
+    });
+
+    status_t result = B_OK;
+    for (int32 i = 0; i < count; i++) {
+        const volume_report& report = reports[i];
+        if (report.status != B_OK) {
+            fprintf(stderr, "failed to read indices of volume %s: %s\n",
+                fVolumes[i]->Name(), strerror(report.status));
+            result = report.status;
+            continue;
+        }
+
+        printf("volume %s: %" B_PRId32 " indices released, %" B_PRId32 " still used, %" B_PRId32
+            " removed, %" B_PRId32 " failed\n", fVolumes[i]->Name(), CountIndices(),
+            report.existing, report.removed, report.failed);
+        for (const std::string& line : report.lines)
+            printf("  %s\n", line.c_str());
+
+        if (report.failed > 0)
+            result = B_ERROR;
+    }
+    return result;
+}
+
+/*static*/ void
+IndexManager::GetSearchableAttributes(const FlatMessage& attrInfo,
+    std::vector<index_entry>& attributes)
+{
+    FlatMessageField names = attrInfo.FindField("attr:name");
+    FlatMessageField types = attrInfo.FindField("attr:type");
+    FlatMessageField searchable = attrInfo.FindField(ATTR_INDEX);
+    int32 indexAttrCount = searchable.CountItems();
+
+    for (int32 i = 0; i < indexAttrCount; i++) {
+        if (!searchable.BoolAt(i, false))
+            continue;
+
+        std::string name(names.StringAt(i));
+        if (!name.empty())
+            attributes.push_back(index_entry{ name, types.UInt32At(i, B_STRING_TYPE) });
+    }
+}
+
+/*static*/ status_t
+IndexManager::GetDeclarations(MimeDatabase& database, index_declarations& declarations)
+{
+    declarations.clear();
+    std::vector<std::string> types;
+    status_t result = database.GetInstalledTypes(NULL, types);
+    if (result != B_OK)
+        return result;
+
+    std::string data;
+    std::vector<index_entry> attributes;
+    for (const std::string& type : types) {
+        result = database.GetField(type.c_str(), MIME_FIELD_ATTR_INFO, data);
+        if (result == B_ENTRY_NOT_FOUND)
+            continue;
+        if (result != B_OK)
+            return result;
+
+        FlatMessage attrInfo(data.data(), data.size());
+        if (attrInfo.InitCheck() != B_OK)
+            continue;
+        attributes.clear();
+        GetSearchableAttributes(attrInfo, attributes);
+        for (const index_entry& attribute : attributes) {
+            auto found = declarations.find(attribute.name);
+            if (found == declarations.end()) {
+                found = declarations.insert(
+                    std::make_pair(attribute.name, index_declaration())).first;
+                found->second.type = attribute.type;
+            }
+            found->second.mimeTypes.push_back(type);
+            found->second.types.push_back(attribute.type);
+        }
+    }
+    return B_OK;
+}
+
+/*static*/ bool
+IndexManager::IsSystemIndex(const char* name)
+{
+    for (const char* systemIndex : kSystemIndices) {
+        if (strcmp(name, systemIndex) == 0)
+            return true;
+    }
+    return false;
+}
+
+void
+IndexManager::_ProcessVolume(IndexVolume& volume, volume_report& report)
+{
+    report.existing = 0;
+    report.created = 0;
+    report.failed = 0;
+
+    std::vector<index_entry> indices;
+    report.status = volume.GetIndices(indices);
+    if (report.status != B_OK)
+        return;
+
+    std::unordered_map<std::string, type_code> existing;
+    for (const index_entry& index : indices)
+        existing[index.name] = index.type;
+
+    for (const auto& entry : fIndices) {
+        const char* name = entry.first.c_str();
+        const index_request& request = entry.second;
+
+        auto found = existing.find(entry.first);
+        if (found != existing.end()) {
+            report.existing++;
+            if (found->second != request.type) {
+                // recreating it would drop the index data of other types
+                report.lines.push_back("index " + entry.first + " has type "
+                    + type_code_string(found->second) + ", " + request.mimeType + " needs "
+                    + type_code_string(request.type));
+            }
+            continue;
+        }
+
+        status_t result = volume.CreateIndex(name, request.type);
+        if (result == B_FILE_EXISTS) {
+            // created by someone else since we listed the indices
+            report.existing++;
+        } else if (result == B_OK) {
+            report.created++;
+            STATS_ADD(STATS_INDICES_CREATED, 1);
+            report.lines.push_back("created index " + entry.first + " ("
+                + type_code_string(request.type) + ") for " + request.mimeType);
+        } else {
+            report.failed++;
+            report.lines.push_back("failed to create index " + entry.first + ": "
+                + strerror(result));
+        }
+    }
+}
+
+void
+IndexManager::_RemoveFromVolume(IndexVolume& volume,
+    const index_declarations& declarations, volume_report& report)
+{
+    report.existing = 0;
+    report.removed = 0;
+    report.failed = 0;
+
+    std::vector<index_entry> indices;
+    report.status = volume.GetIndices(indices);
+    if (report.status != B_OK)
+        return;
+
+    std::unordered_map<std::string, type_code> existing;
+    for (const index_entry& index : indices)
+        existing[index.name] = index.type;
+
+    for (const auto& entry : fIndices) {
+        const char* name = entry.first.c_str();
+        if (declarations.find(entry.first) != declarations.end() || IsSystemIndex(name)) {
+            report.existing++;
+            continue;
+        }
+        if (existing.find(entry.first) == existing.end())
+            continue;
+
+        status_t result = volume.RemoveIndex(name);
+        if (result == B_OK || result == B_ENTRY_NOT_FOUND) {
+            report.removed++;
+            report.lines.push_back("removed index " + entry.first + ", no type declares it "
+                "anymore");
+        } else {
+            report.failed++;
+            report.lines.push_back("failed to remove index " + entry.first + ": "
+                + strerror(result));
+        }
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _INDEX_MANAGER_H
+#define _INDEX_MANAGER_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FlatMessage.h"
+#include "IndexVolume.h"
+#include "MimeDatabase.h"
+
+#define ATTR_INDEX "attr:searchable"
+
+// what the installed types declare searchable, for one attribute
+struct index_declaration {
+    type_code                   type;       // as the first type declares it
+    std::vector<std::string>    mimeTypes;
+    std::vector<type_code>      types;      // as each of them declares it
+};
+
+typedef std::map<std::string, index_declaration> index_declarations;
+
+// the four characters of the type code if printable, hex otherwise
+std::string type_code_string(type_code type);
+
+// Creates the indices for the searchable attributes of many MIME types at
+// once, or removes them again once no type declares them anymore. The existing
+// indices of each volume are listed a single time, and every volume is handled
+// by its own worker.
+class IndexManager {
+public:
+                            IndexManager();
+                            ~IndexManager();
+
+            status_t        AddVolume(const char* path);
+            int32           CountVolumes() const
+                                { return (int32)fVolumes.size(); }
+
+    // adds the searchable attributes of a META:ATTR_INFO message
+            void            AddIndices(const FlatMessage& attrInfo,
+                                const char* mimeType);
+            void            AddIndex(const char* name, type_code type,
+                                const char* mimeType);
+            int32           CountIndices() const
+                                { return (int32)fIndices.size(); }
+
+    // prints a report per volume; fails if any index could not be created
+            status_t        CreateMissingIndices();
+    // Removes the added indices that are not among the declarations, i.e.
+    // that no installed type declares searchable. Indices the file system
+    // keeps by itself are never removed. Prints a report per volume.
+            status_t        RemoveUnusedIndices(
+                                const index_declarations& declarations);
+
+            IndexVolume*    VolumeAt(int32 index) const
+                                { return fVolumes[index].get(); }
+
+    // the searchable attributes of a META:ATTR_INFO message
+    static  void            GetSearchableAttributes(const FlatMessage& attrInfo,
+                                std::vector<index_entry>& attributes);
+    // collects which types in the DB declare which attributes searchable
+    static  status_t        GetDeclarations(MimeDatabase& database,
+                                index_declarations& declarations);
+    static  bool            IsSystemIndex(const char* name);
+
+private:
+            struct index_request {
+                type_code   type;
+                std::string mimeType;   // first type that asked for it
+            };
+
+            struct volume_report;
+
+            void            _ProcessVolume(IndexVolume& volume,
+                                volume_report& report);
+            void            _RemoveFromVolume(IndexVolume& volume,
+                                const index_declarations& declarations,
+                                volume_report& report);
+
+            std::vector<std::unique_ptr<IndexVolume> > fVolumes;
+            std::map<std::string, index_request> fIndices;
+};
+
+#endif // _INDEX_MANAGER_H
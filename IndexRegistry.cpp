@@ -0,0 +1,294 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "IndexRegistry.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "MappedFile.h"
+
+#define INDEX_REGISTRY_MAGIC    'MIRG'
+#define INDEX_REGISTRY_VERSION  1
+
+// All values are in host byte order, like the install cache. The header is
+// followed by one index_registry_record per index and volume, then the volume
+// and index names without terminating NUL, then typeCount MIME types, each a
+// uint32 length and the name.
+struct index_registry_header {
+    uint32      magic;
+    uint32      version;
+    uint32      recordCount;
+    uint32      reserved;
+};
+
+struct index_registry_record {
+    uint32      type;
+    uint32      volumeLength;
+    uint32      nameLength;
+    uint32      typeCount;
+};
+
+// reads a length prefixed string, advancing the offset
+static bool
+read_string(const uint8* data, size_t size, size_t& offset, uint32 length, std::string& string)
+{
+    if (length > size - offset)
+        return false;
+    string.assign((const char*)data + offset, length);
+    offset += length;
+    return true;
+}
+
+const char*
+index_state_name(index_state state)
+{
+    switch (state) {
+        case INDEX_STATE_OK:
+            return "ok";
+        case INDEX_STATE_MISSING:
+            return "missing";
+        case INDEX_STATE_WRONG_TYPE:
+            return "wrong_type";
+        case INDEX_STATE_ORPHANED:
+            return "orphaned";
+    }
+    return "unknown";
+}
+
+IndexRegistry::IndexRegistry(const MimeDatabase& database)
+    :
+    fDatabase(database),
+    fChanged(false)
+{
+}
+
+status_t
+IndexRegistry::Load()
+{
+    fVolumes.clear();
+    fChanged = false;
+
+    MappedFile file;
+    status_t result = file.SetTo(PathFor(fDatabase).c_str());
+    if (result != B_OK)
+        return result == B_ENTRY_NOT_FOUND ? B_OK : result;
+
+    const uint8* data = file.Data();
+    size_t size = file.Size();
+    const index_registry_header* header = (const index_registry_header*)data;
+    if (size < sizeof(index_registry_header) || header->magic != INDEX_REGISTRY_MAGIC
+        || header->version != INDEX_REGISTRY_VERSION)
+        return B_BAD_DATA;
+
+    size_t offset = sizeof(index_registry_header);
+    for (uint32 i = 0; i < header->recordCount; i++) {
+        index_registry_record record;
+        std::string volume;
+        std::string name;
+        if (size - offset < sizeof(record)) {
+            fVolumes.clear();
+            return B_BAD_DATA;
+        }
+        memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+        if (!read_string(data, size, offset, record.volumeLength, volume)
+            || !read_string(data, size, offset, record.nameLength, name)) {
+            fVolumes.clear();
+            return B_BAD_DATA;
+        }
+
+        index_record& entry = fVolumes[volume][name];
+        entry.type = record.type;
+        for (uint32 j = 0; j < record.typeCount; j++) {
+            uint32 length;
+            std::string mimeType;
+            if (size - offset < sizeof(length)) {
+                fVolumes.clear();
+                return B_BAD_DATA;
+            }
+            memcpy(&length, data + offset, sizeof(length));
+            offset += sizeof(length);
+            if (!read_string(data, size, offset, length, mimeType)) {
+                fVolumes.clear();
+                return B_BAD_DATA;
+            }
+            entry.mimeTypes.insert(mimeType);
+        }
+    }
+    return B_OK;
+}
+
+status_t
+IndexRegistry::Save()
+{
+    if (!fChanged)
+        return B_OK;
+
+    index_registry_header header;
+    header.magic = INDEX_REGISTRY_MAGIC;
+    header.version = INDEX_REGISTRY_VERSION;
+    header.recordCount = 0;
+    header.reserved = 0;
+    for (const auto& volume : fVolumes)
+        header.recordCount += (uint32)volume.second.size();
+
+    std::string data((const char*)&header, sizeof(header));
+    for (const auto& volume : fVolumes) {
+        for (const auto& entry : volume.second) {
+            index_registry_record record;
+            record.type = entry.second.type;
+            record.volumeLength = (uint32)volume.first.size();
+            record.nameLength = (uint32)entry.first.size();
+            record.typeCount = (uint32)entry.second.mimeTypes.size();
+            data.append((const char*)&record, sizeof(record));
+            data += volume.first;
+            data += entry.first;
+            for (const std::string& mimeType : entry.second.mimeTypes) {
+                uint32 length = (uint32)mimeType.size();
+                data.append((const char*)&length, sizeof(length));
+                data += mimeType;
+            }
+        }
+    }
+
+    status_t result = ReplaceFile(PathFor(fDatabase).c_str(), data.data(), data.size());
+    if (result == B_OK)
+        fChanged = false;
+    return result;
+}
+
+void
+IndexRegistry::SetDeclarations(const char* volume, const char* mimeType,
+    const std::vector<index_entry>& attributes)
+{
+    volume_records& records = fVolumes[volume];
+    for (auto& entry : records) {
+        if (entry.second.mimeTypes.erase(mimeType) > 0)
+            fChanged = true;
+    }
+
+    for (const index_entry& attribute : attributes) {
+        auto found = records.find(attribute.name);
+        if (found == records.end()) {
+            found = records.insert(std::make_pair(attribute.name, index_record())).first;
+            found->second.type = attribute.type;
+        }
+        if (found->second.mimeTypes.insert(mimeType).second)
+            fChanged = true;
+    }
+}
+
+void
+IndexRegistry::RemoveTypes(const std::vector<std::string>& mimeTypes)
+{
+    for (auto& volume : fVolumes) {
+        for (auto& entry : volume.second) {
+            for (const std::string& mimeType : mimeTypes) {
+                if (entry.second.mimeTypes.erase(mimeType) > 0)
+                    fChanged = true;
+            }
+        }
+    }
+}
+
+void
+IndexRegistry::Prune(const char* volume, const std::vector<index_entry>& existing)
+{
+    auto found = fVolumes.find(volume);
+    if (found == fVolumes.end())
+        return;
+
+    std::set<std::string> names;
+    for (const index_entry& index : existing)
+        names.insert(index.name);
+
+    volume_records& records = found->second;
+    for (auto entry = records.begin(); entry != records.end();) {
+        if (entry->second.mimeTypes.empty() && names.find(entry->first) == names.end()) {
+            entry = records.erase(entry);
+            fChanged = true;
+        } else
+            entry++;
+    }
+    if (records.empty())
+        fVolumes.erase(found);
+}
+
+const IndexRegistry::volume_records*
+IndexRegistry::RecordsFor(const char* volume) const
+{
+    auto found = fVolumes.find(volume);
+    return found != fVolumes.end() ? &found->second : NULL;
+}
+
+status_t
+IndexRegistry::Check(IndexVolume& volume, const index_declarations& declarations,
+    std::vector<index_check>& checks) const
+{
+    checks.clear();
+    std::vector<index_entry> indices;
+    status_t result = volume.GetIndices(indices);
+    if (result != B_OK)
+        return result;
+
+    std::unordered_map<std::string, type_code> existing;
+    for (const index_entry& index : indices)
+        existing[index.name] = index.type;
+
+    for (const auto& declaration : declarations) {
+        index_check check;
+        check.name = declaration.first;
+        check.declaredType = declaration.second.type;
+        check.type = check.declaredType;
+        check.mimeTypes = declaration.second.mimeTypes;
+
+        auto found = existing.find(declaration.first);
+        if (found == existing.end())
+            check.state = INDEX_STATE_MISSING;
+        else {
+            // every declaring type has to get the type it asked for
+            check.type = found->second;
+            check.state = INDEX_STATE_OK;
+            for (type_code type : declaration.second.types) {
+                if (type != found->second)
+                    check.state = INDEX_STATE_WRONG_TYPE;
+            }
+        }
+        checks.push_back(check);
+    }
+
+    const volume_records* records = RecordsFor(volume.Name());
+    if (records != NULL) {
+        for (const auto& record : *records) {
+            auto found = existing.find(record.first);
+            if (declarations.find(record.first) != declarations.end()
+                || found == existing.end() || IndexManager::IsSystemIndex(record.first.c_str()))
+                continue;
+
+            index_check check;
+            check.name = record.first;
+            check.type = found->second;
+            check.declaredType = record.second.type;
+            check.state = INDEX_STATE_ORPHANED;
+            check.mimeTypes.assign(record.second.mimeTypes.begin(),
+                record.second.mimeTypes.end());
+            checks.push_back(check);
+        }
+    }
+
+    std::sort(checks.begin(), checks.end(), [](const index_check& a, const index_check& b) {
+        return a.name < b.name;
+    });
+    return B_OK;
+}
+
+/*static*/ std::string
+IndexRegistry::PathFor(const MimeDatabase& database)
+{
+    return database.SidecarPath(INDEX_REGISTRY_NAME);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _INDEX_REGISTRY_H
+#define _INDEX_REGISTRY_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "IndexManager.h"
+#include "IndexVolume.h"
+#include "MimeDatabase.h"
+
+#define INDEX_REGISTRY_NAME "index-refs"
+
+enum index_state {
+    INDEX_STATE_OK = 0,
+    INDEX_STATE_MISSING,        // declared searchable, but not on the volume
+    INDEX_STATE_WRONG_TYPE,     // on the volume with another type
+    INDEX_STATE_ORPHANED        // on the volume, but no type declares it
+};
+
+const char* index_state_name(index_state state);
+
+struct index_check {
+    std::string                 name;
+    type_code                   type;       // on the volume if it exists
+    type_code                   declaredType;
+    index_state                 state;
+    std::vector<std::string>    mimeTypes;  // declaring it, or that did
+};
+
+// Which MIME types rely on which attribute index of which volume, kept in a
+// file next to the MIME DB. Install records what each type declares
+// searchable for the volumes it was installed for, uninstall drops the types
+// again. An index whose record has no types left is orphaned: mime created or
+// needed it once, but nothing uses it anymore. Indices the registry never
+// saw, like those of other applications, are not mime's to remove.
+class IndexRegistry {
+public:
+            struct index_record {
+                type_code   type;
+                std::set<std::string> mimeTypes;
+            };
+            // by index name
+            typedef std::map<std::string, index_record> volume_records;
+
+                            IndexRegistry(const MimeDatabase& database);
+
+            // a missing file starts an empty registry
+            status_t        Load();
+            // writes the registry if it changed
+            status_t        Save();
+
+            // replaces what the type declares searchable on the volume
+            void            SetDeclarations(const char* volume,
+                                const char* mimeType,
+                                const std::vector<index_entry>& attributes);
+            // the types are gone, from all volumes
+            void            RemoveTypes(
+                                const std::vector<std::string>& mimeTypes);
+            // forgets records without types whose index is not among the
+            // existing ones of the volume anymore
+            void            Prune(const char* volume,
+                                const std::vector<index_entry>& existing);
+
+            // NULL if nothing was recorded for the volume
+            const volume_records* RecordsFor(const char* volume) const;
+
+            // Compares the indices of the volume with what the installed
+            // types declare, and with what the registry remembers, sorted by
+            // name. Indices neither declared nor recorded are left out.
+            status_t        Check(IndexVolume& volume,
+                                const index_declarations& declarations,
+                                std::vector<index_check>& checks) const;
+
+    static  std::string     PathFor(const MimeDatabase& database);
+
+private:
+            const MimeDatabase& fDatabase;
+            std::map<std::string, volume_records> fVolumes;
+            bool            fChanged;
+};
+
+#endif // _INDEX_REGISTRY_H
@@ -0,0 +1,330 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "IndexTree.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#define INDEX_NODE_LEAF     1
+#define INDEX_NODE_INNER    2
+
+// Every page starts with this. Leaf entries are a uint16 key and path length
+// followed by key and path, inner entries the uint32 page of a child, a
+// uint16 key length and the first key of that child.
+struct index_tree_node {
+    uint16          kind;
+    uint16          count;
+    uint32          next;           // leaves only, 0 for the last one
+};
+
+static const size_t kLeafEntryHeader = 2 * sizeof(uint16);
+static const size_t kInnerEntryHeader = sizeof(uint32) + sizeof(uint16);
+
+// false if the entry runs past the end of the page
+static bool
+read_leaf_entry(const uint8* page, size_t pageSize, size_t& offset, std::string& key,
+    std::string& path)
+{
+    uint16 lengths[2];
+    if (pageSize - offset < kLeafEntryHeader)
+        return false;
+    memcpy(lengths, page + offset, sizeof(lengths));
+    offset += kLeafEntryHeader;
+    if (pageSize - offset < (size_t)lengths[0] + lengths[1])
+        return false;
+    key.assign((const char*)page + offset, lengths[0]);
+    path.assign((const char*)page + offset + lengths[0], lengths[1]);
+    offset += lengths[0] + lengths[1];
+    return true;
+}
+
+static bool
+read_inner_entry(const uint8* page, size_t pageSize, size_t& offset, uint32& child,
+    std::string& key)
+{
+    uint16 length;
+    if (pageSize - offset < kInnerEntryHeader)
+        return false;
+    memcpy(&child, page + offset, sizeof(child));
+    memcpy(&length, page + offset + sizeof(child), sizeof(length));
+    offset += kInnerEntryHeader;
+    if (pageSize - offset < length)
+        return false;
+    key.assign((const char*)page + offset, length);
+    offset += length;
+    return true;
+}
+
+// appends the page to the file data, padded to the page size
+static void
+finish_page(std::string& data, std::string& page, uint16 kind, uint16 count, uint32 next)
+{
+    index_tree_node node = { kind, count, next };
+    memcpy(&page[0], &node, sizeof(node));
+    page.resize(INDEX_TREE_PAGE_SIZE, '\0');
+    data += page;
+    page.assign(sizeof(node), '\0');
+}
+
+status_t
+WriteIndexTree(const char* path, type_code type, std::vector<index_tree_entry>& entries)
+{
+    std::sort(entries.begin(), entries.end(),
+        [](const index_tree_entry& a, const index_tree_entry& b) {
+            int compare = CompareIndexKeys(a.key, b.key);
+            return compare != 0 ? compare < 0 : a.path < b.path;
+        });
+
+    index_tree_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = INDEX_FILE_MAGIC;
+    header.type = type;
+    header.treeMagic = INDEX_TREE_MAGIC;
+    header.pageSize = INDEX_TREE_PAGE_SIZE;
+    header.entryCount = entries.size();
+
+    struct child_page {
+        uint32          page;
+        std::string     key;
+    };
+    std::vector<child_page> level;
+    std::string data(INDEX_TREE_PAGE_SIZE, '\0');
+    std::string page(sizeof(index_tree_node), '\0');
+    uint16 count = 0;
+
+    // the leaves, each pointing to the page after it
+    for (const index_tree_entry& entry : entries) {
+        size_t size = kLeafEntryHeader + entry.key.size() + entry.path.size();
+        if (size > INDEX_TREE_PAGE_SIZE - sizeof(index_tree_node))
+            return B_BAD_VALUE;
+        if (page.size() + size > INDEX_TREE_PAGE_SIZE) {
+            uint32 pageNumber = (uint32)(data.size() / INDEX_TREE_PAGE_SIZE);
+            finish_page(data, page, INDEX_NODE_LEAF, count, pageNumber + 1);
+            count = 0;
+        }
+        if (count == 0) {
+            level.push_back(child_page{ (uint32)(data.size() / INDEX_TREE_PAGE_SIZE),
+                entry.key });
+        }
+
+        uint16 lengths[2] = { (uint16)entry.key.size(), (uint16)entry.path.size() };
+        page.append((const char*)lengths, sizeof(lengths));
+        page += entry.key;
+        page += entry.path;
+        count++;
+    }
+    if (count > 0)
+        finish_page(data, page, INDEX_NODE_LEAF, count, 0);
+
+    if (!level.empty()) {
+        header.firstLeaf = level.front().page;
+        header.leafCount = (uint32)level.size();
+        header.height = 1;
+    }
+
+    // inner levels up to a single root
+    while (level.size() > 1) {
+        std::vector<child_page> parents;
+        count = 0;
+        for (const child_page& child : level) {
+            size_t size = kInnerEntryHeader + child.key.size();
+            if (page.size() + size > INDEX_TREE_PAGE_SIZE) {
+                finish_page(data, page, INDEX_NODE_INNER, count, 0);
+                count = 0;
+            }
+            if (count == 0) {
+                parents.push_back(child_page{ (uint32)(data.size() / INDEX_TREE_PAGE_SIZE),
+                    child.key });
+            }
+
+            uint16 length = (uint16)child.key.size();
+            page.append((const char*)&child.page, sizeof(child.page));
+            page.append((const char*)&length, sizeof(length));
+            page += child.key;
+            count++;
+        }
+        finish_page(data, page, INDEX_NODE_INNER, count, 0);
+        level.swap(parents);
+        header.height++;
+    }
+    if (!level.empty())
+        header.rootPage = level.front().page;
+
+    memcpy(&data[0], &header, sizeof(header));
+    return ReplaceFile(path, data.data(), data.size());
+}
+
+IndexTree::IndexTree()
+    :
+    fHeader(NULL)
+{
+}
+
+status_t
+IndexTree::SetTo(const char* path)
+{
+    fHeader = NULL;
+    status_t result = fFile.SetTo(path);
+    if (result != B_OK)
+        return result;
+
+    const index_tree_header* header = (const index_tree_header*)fFile.Data();
+    if (fFile.Size() < 2 * sizeof(uint32) || header->magic != INDEX_FILE_MAGIC)
+        return B_BAD_DATA;
+    if (fFile.Size() == 2 * sizeof(uint32))
+        return B_NO_INIT;
+    if (fFile.Size() < sizeof(index_tree_header) || header->treeMagic != INDEX_TREE_MAGIC
+        || header->pageSize != INDEX_TREE_PAGE_SIZE
+        || fFile.Size() % INDEX_TREE_PAGE_SIZE != 0)
+        return B_BAD_DATA;
+
+    fHeader = header;
+    return B_OK;
+}
+
+status_t
+IndexTree::EstimateCount(const index_range& range, uint64& count) const
+{
+    count = 0;
+    if (fHeader->rootPage == 0
+        || (range.hasLower && range.hasUpper
+            && CompareIndexKeys(range.lower, range.upper) > 0))
+        return B_OK;
+
+    uint32 first = fHeader->firstLeaf;
+    uint32 last = fHeader->firstLeaf + fHeader->leafCount - 1;
+    status_t result = B_OK;
+    if (range.hasLower)
+        result = _FindLeaf(range.lower, false, first);
+    if (result == B_OK && range.hasUpper)
+        result = _FindLeaf(range.upper, true, last);
+    if (result != B_OK || last < first)
+        return result;
+
+    result = _CountInLeaf(first, range, count);
+    if (result != B_OK || last == first)
+        return result;
+
+    uint64 lastCount;
+    result = _CountInLeaf(last, range, lastCount);
+    count += lastCount + (uint64)(last - first - 1) * fHeader->entryCount / fHeader->leafCount;
+    return result;
+}
+
+status_t
+IndexTree::Read(const index_range& range, const entry_callback& callback) const
+{
+    if (fHeader->rootPage == 0)
+        return B_OK;
+
+    uint32 leaf = fHeader->firstLeaf;
+    if (range.hasLower) {
+        status_t result = _FindLeaf(range.lower, false, leaf);
+        if (result != B_OK)
+            return result;
+    }
+
+    std::string key;
+    std::string path;
+    while (leaf != 0) {
+        const uint8* page = _Page(leaf);
+        if (page == NULL)
+            return B_BAD_DATA;
+        index_tree_node node;
+        memcpy(&node, page, sizeof(node));
+        if (node.kind != INDEX_NODE_LEAF)
+            return B_BAD_DATA;
+
+        size_t offset = sizeof(node);
+        for (uint16 i = 0; i < node.count; i++) {
+            if (!read_leaf_entry(page, INDEX_TREE_PAGE_SIZE, offset, key, path))
+                return B_BAD_DATA;
+            if (range.hasLower && CompareIndexKeys(key, range.lower) < 0)
+                continue;
+            if (range.hasUpper && CompareIndexKeys(key, range.upper) > 0)
+                return B_OK;
+            if (!callback(key, path))
+                return B_OK;
+        }
+        // leaves are written in order, a loop would be damage
+        if (node.next != 0 && node.next <= leaf)
+            return B_BAD_DATA;
+        leaf = node.next;
+    }
+    return B_OK;
+}
+
+const uint8*
+IndexTree::_Page(uint32 page) const
+{
+    if (page == 0 || page >= fFile.Size() / INDEX_TREE_PAGE_SIZE)
+        return NULL;
+    return fFile.Data() + (size_t)page * INDEX_TREE_PAGE_SIZE;
+}
+
+// The leaf the first key not less than the given one is in (or would be),
+// or with last, the leaf of the last key not greater than it.
+status_t
+IndexTree::_FindLeaf(const std::string& key, bool last, uint32& leaf) const
+{
+    uint32 pageNumber = fHeader->rootPage;
+    std::string separator;
+    for (uint32 level = 1; level < fHeader->height; level++) {
+        const uint8* page = _Page(pageNumber);
+        if (page == NULL)
+            return B_BAD_DATA;
+        index_tree_node node;
+        memcpy(&node, page, sizeof(node));
+        if (node.kind != INDEX_NODE_INNER || node.count == 0)
+            return B_BAD_DATA;
+
+        // equal keys may continue from the child before
+        size_t offset = sizeof(node);
+        uint32 next = 0;
+        for (uint16 i = 0; i < node.count; i++) {
+            uint32 child;
+            if (!read_inner_entry(page, INDEX_TREE_PAGE_SIZE, offset, child, separator))
+                return B_BAD_DATA;
+            int compare = CompareIndexKeys(separator, key);
+            if (i > 0 && (last ? compare > 0 : compare >= 0))
+                break;
+            next = child;
+        }
+        pageNumber = next;
+    }
+
+    if (pageNumber < fHeader->firstLeaf
+        || pageNumber >= fHeader->firstLeaf + fHeader->leafCount)
+        return B_BAD_DATA;
+    leaf = pageNumber;
+    return B_OK;
+}
+
+status_t
+IndexTree::_CountInLeaf(uint32 leaf, const index_range& range, uint64& count) const
+{
+    count = 0;
+    const uint8* page = _Page(leaf);
+    if (page == NULL)
+        return B_BAD_DATA;
+    index_tree_node node;
+    memcpy(&node, page, sizeof(node));
+    if (node.kind != INDEX_NODE_LEAF)
+        return B_BAD_DATA;
+
+    std::string key;
+    std::string path;
+    size_t offset = sizeof(node);
+    for (uint16 i = 0; i < node.count; i++) {
+        if (!read_leaf_entry(page, INDEX_TREE_PAGE_SIZE, offset, key, path))
+            return B_BAD_DATA;
+        if ((!range.hasLower || CompareIndexKeys(key, range.lower) >= 0)
+            && (!range.hasUpper || CompareIndexKeys(key, range.upper) <= 0))
+            count++;
+    }
+    return B_OK;
+}
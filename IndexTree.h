@@ -0,0 +1,81 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _INDEX_TREE_H
+#define _INDEX_TREE_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "IndexKey.h"
+#include "MappedFile.h"
+
+#define INDEX_FILE_MAGIC    'MIDX'
+#define INDEX_TREE_MAGIC    'BTRE'
+#define INDEX_TREE_PAGE_SIZE 4096
+
+// All values are in host byte order. An index file starts with magic and
+// type; one that was created but never filled ends there. Otherwise this
+// header takes the first page, followed by the leaves in key order, then
+// the inner pages, level by level up to the root.
+struct index_tree_header {
+    uint32          magic;
+    type_code       type;
+    uint32          treeMagic;
+    uint32          pageSize;
+    uint32          rootPage;       // 0 for an empty tree
+    uint32          firstLeaf;
+    uint32          leafCount;
+    uint32          height;         // levels including the leaves
+    uint64          entryCount;
+};
+
+struct index_tree_entry {
+    std::string     key;
+    std::string     path;
+};
+
+// Writes all entries, sorted by key, as the index file of the type.
+status_t WriteIndexTree(const char* path, type_code type,
+    std::vector<index_tree_entry>& entries);
+
+// A B+tree of the keys of one attribute and the paths of the files with
+// them, the stand-in for a BFS index. It is written in one go from all keys
+// and read through a mapping of the file.
+class IndexTree {
+public:
+            // returns false to stop
+            typedef std::function<bool(const std::string& key,
+                const std::string& path)> entry_callback;
+
+                            IndexTree();
+
+            // B_NO_INIT if the index was never filled
+            status_t        SetTo(const char* path);
+
+            type_code       Type() const { return fHeader->type; }
+            uint64          CountEntries() const
+                                { return fHeader->entryCount; }
+
+            // Counts the entries of the leaves at both ends of the range,
+            // and assumes the average for those in between, without reading
+            // them.
+            status_t        EstimateCount(const index_range& range,
+                                uint64& count) const;
+            status_t        Read(const index_range& range,
+                                const entry_callback& callback) const;
+
+private:
+            const uint8*    _Page(uint32 page) const;
+            status_t        _FindLeaf(const std::string& key, bool last,
+                                uint32& leaf) const;
+            status_t        _CountInLeaf(uint32 leaf, const index_range& range,
+                                uint64& count) const;
+
+            MappedFile      fFile;
+            const index_tree_header* fHeader;
+};
+
+#endif // _INDEX_TREE_H
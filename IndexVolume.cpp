@@ -0,0 +1,443 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "IndexVolume.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+
+#ifdef __HAIKU__
+#include <fs_index.h>
+#include <fs_info.h>
+#include <fs_query.h>
+#else
+#include "FileAttributes.h"
+#include "IndexTree.h"
+#endif
+
+IndexVolume::IndexVolume(const char* name)
+    :
+    fName(name)
+{
+}
+
+IndexVolume::~IndexVolume()
+{
+}
+
+status_t
+IndexVolume::UpdateIndices(int64& /*files*/, int64& /*keys*/)
+{
+    return B_NOT_SUPPORTED;
+}
+
+status_t
+IndexVolume::EstimateRange(const char* /*name*/, const index_range& /*range*/,
+    int64& /*count*/)
+{
+    return B_NOT_SUPPORTED;
+}
+
+status_t
+IndexVolume::ReadRange(const char* /*name*/, const index_range& /*range*/,
+    const path_callback& /*callback*/)
+{
+    return B_NOT_SUPPORTED;
+}
+
+status_t
+IndexVolume::ReadFiles(const path_callback& /*callback*/)
+{
+    return B_NOT_SUPPORTED;
+}
+
+status_t
+IndexVolume::RunQuery(const char* /*predicate*/, const path_callback& /*callback*/)
+{
+    return B_NOT_SUPPORTED;
+}
+
+/*static*/ IndexVolume*
+IndexVolume::Create(const char* path)
+{
+    if (path == NULL)
+        path = DefaultPath();
+    if (path == NULL)
+        return NULL;
+
+#ifdef __HAIKU__
+    return new(std::nothrow) FsIndexVolume(path);
+#else
+    return new(std::nothrow) DirectoryIndexVolume(path);
+#endif
+}
+
+/*static*/ const char*
+IndexVolume::DefaultPath()
+{
+#ifdef __HAIKU__
+    return "/boot";
+#else
+    return NULL;
+#endif
+}
+
+/*static*/ std::vector<std::string>
+IndexVolume::PathsOrDefault(const std::vector<std::string>& paths)
+{
+    if (!paths.empty() || DefaultPath() == NULL)
+        return paths;
+    return std::vector<std::string>(1, DefaultPath());
+}
+
+#ifdef __HAIKU__
+
+FsIndexVolume::FsIndexVolume(const char* path)
+    :
+    IndexVolume(path),
+    fDevice(dev_for_path(path))
+{
+    fs_info info;
+    if (fDevice >= 0 && fs_stat_dev(fDevice, &info) == 0 && info.volume_name[0] != '\0')
+        fName = info.volume_name;
+}
+
+status_t
+FsIndexVolume::InitCheck() const
+{
+    return fDevice < 0 ? (status_t)fDevice : B_OK;
+}
+
+status_t
+FsIndexVolume::GetIndices(std::vector<index_entry>& indices)
+{
+    indices.clear();
+    if (fDevice < 0)
+        return fDevice;
+
+    DIR* dir = fs_open_index_dir(fDevice);
+    if (dir == NULL)
+        return errno;
+
+    while (struct dirent* entry = fs_read_index_dir(dir)) {
+        index_info info;
+        index_entry index;
+        index.name = entry->d_name;
+        index.type = fs_stat_index(fDevice, entry->d_name, &info) == 0 ? info.type : 0;
+        indices.push_back(index);
+    }
+
+    fs_close_index_dir(dir);
+    return B_OK;
+}
+
+status_t
+FsIndexVolume::CreateIndex(const char* name, type_code type)
+{
+    if (fDevice < 0)
+        return fDevice;
+    return fs_create_index(fDevice, name, type, 0) != 0 ? errno : B_OK;
+}
+
+status_t
+FsIndexVolume::RemoveIndex(const char* name)
+{
+    if (fDevice < 0)
+        return fDevice;
+    return fs_remove_index(fDevice, name) != 0 ? errno : B_OK;
+}
+
+status_t
+FsIndexVolume::RunQuery(const char* predicate, const path_callback& callback)
+{
+    if (fDevice < 0)
+        return fDevice;
+
+    DIR* query = fs_open_query(fDevice, predicate, 0);
+    if (query == NULL)
+        return errno;
+
+    char path[B_PATH_NAME_LENGTH];
+    while (struct dirent* entry = fs_read_query(query)) {
+        // the entry may be gone again by now
+        if (get_path_for_dirent(entry, path, sizeof(path)) != B_OK)
+            continue;
+        if (!callback(path))
+            break;
+    }
+
+    fs_close_query(query);
+    return B_OK;
+}
+
+#else // !__HAIKU__
+
+// header of an index file in the stand-in index directory, see IndexTree.h
+// for the keys that follow once the index was updated
+struct index_file_header {
+    uint32          magic;
+    type_code       type;
+};
+
+// index names may contain '/', keep them to a single file name
+static std::string
+escape_index_name(const char* name)
+{
+    static const char kHex[] = "0123456789ABCDEF";
+
+    std::string escaped;
+    for (const char* c = name; *c != '\0'; c++) {
+        if (*c == '/' || *c == '%' || (c == name && *c == '.')) {
+            escaped += '%';
+            escaped += kHex[(uint8)*c >> 4];
+            escaped += kHex[(uint8)*c & 0xf];
+        } else
+            escaped += *c;
+    }
+    return escaped;
+}
+
+static std::string
+unescape_index_name(const char* name)
+{
+    std::string unescaped;
+    for (const char* c = name; *c != '\0'; c++) {
+        if (*c == '%' && c[1] != '\0' && c[2] != '\0') {
+            char hex[3] = { c[1], c[2], '\0' };
+            unescaped += (char)strtoul(hex, NULL, 16);
+            c += 2;
+        } else
+            unescaped += *c;
+    }
+    return unescaped;
+}
+
+// Calls back with the path of every regular file below the directory,
+// relative to the root, leaving out the index directory and not following
+// symlinks. Subdirectories that cannot be read are skipped.
+static status_t
+walk_files(const std::string& root, const std::string& relative,
+    const std::function<bool(const std::string& relative)>& callback, bool& stop)
+{
+    std::string path = relative.empty() ? root : root + "/" + relative;
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL)
+        return errno;
+
+    while (struct dirent* entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0
+            || strcmp(entry->d_name, INDEX_DIRECTORY) == 0)
+            continue;
+
+        std::string child = relative.empty() ? entry->d_name
+            : relative + "/" + entry->d_name;
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat((root + "/" + child).c_str(), &st) != 0)
+                continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_LNK);
+        }
+
+        if (type == DT_DIR)
+            walk_files(root, child, callback, stop);
+        else if (type == DT_REG)
+            stop = !callback(child);
+        if (stop)
+            break;
+    }
+
+    closedir(dir);
+    return B_OK;
+}
+
+DirectoryIndexVolume::DirectoryIndexVolume(const char* path)
+    :
+    IndexVolume(path),
+    fRoot(path)
+{
+    while (fRoot.size() > 1 && fRoot.back() == '/')
+        fRoot.pop_back();
+    fDirectory = fRoot + "/" INDEX_DIRECTORY;
+}
+
+status_t
+DirectoryIndexVolume::InitCheck() const
+{
+    struct stat st;
+    if (stat(fRoot.c_str(), &st) != 0)
+        return errno;
+    return S_ISDIR(st.st_mode) ? B_OK : B_NOT_A_DIRECTORY;
+}
+
+std::string
+DirectoryIndexVolume::IndexPath(const char* name) const
+{
+    return fDirectory + "/" + escape_index_name(name);
+}
+
+status_t
+DirectoryIndexVolume::GetIndices(std::vector<index_entry>& indices)
+{
+    indices.clear();
+    status_t result = InitCheck();
+    if (result != B_OK)
+        return result;
+
+    DIR* dir = opendir(fDirectory.c_str());
+    if (dir == NULL) {
+        // no index created yet
+        return errno == ENOENT ? B_OK : errno;
+    }
+
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        std::string path = fDirectory + "/" + entry->d_name;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            continue;
+
+        index_file_header header;
+        ssize_t bytesRead = read(fd, &header, sizeof(header));
+        close(fd);
+        if (bytesRead != (ssize_t)sizeof(header) || header.magic != INDEX_FILE_MAGIC)
+            continue;
+
+        index_entry index;
+        index.name = unescape_index_name(entry->d_name);
+        index.type = header.type;
+        indices.push_back(index);
+    }
+
+    closedir(dir);
+    return B_OK;
+}
+
+status_t
+DirectoryIndexVolume::CreateIndex(const char* name, type_code type)
+{
+    status_t result = InitCheck();
+    if (result != B_OK)
+        return result;
+
+    if (mkdir(fDirectory.c_str(), 0755) != 0 && errno != EEXIST)
+        return errno;
+
+    int fd = open(IndexPath(name).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        return errno;
+
+    index_file_header header = { INDEX_FILE_MAGIC, type };
+    result = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) ? B_OK : errno;
+    close(fd);
+
+    if (result != B_OK)
+        unlink(IndexPath(name).c_str());
+    return result;
+}
+
+status_t
+DirectoryIndexVolume::RemoveIndex(const char* name)
+{
+    if (unlink(IndexPath(name).c_str()) != 0)
+        return errno;
+    return B_OK;
+}
+
+// Rewrites every index from the attributes the files have now; paths are
+// kept relative to the root.
+status_t
+DirectoryIndexVolume::UpdateIndices(int64& files, int64& keys)
+{
+    files = 0;
+    keys = 0;
+    std::vector<index_entry> indices;
+    status_t result = GetIndices(indices);
+    if (result != B_OK || indices.empty())
+        return result;
+
+    std::vector<std::vector<index_tree_entry>> entries(indices.size());
+    std::string data;
+    std::string key;
+    bool stop = false;
+    result = walk_files(fRoot, "", [&](const std::string& relative) {
+        if (relative.size() >= B_PATH_NAME_LENGTH)
+            return true;
+        std::string path = fRoot + "/" + relative;
+        files++;
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (ReadAttribute(path.c_str(), indices[i].name.c_str(), data) != B_OK
+                || MakeIndexKey(indices[i].type, data.data(), data.size(), key) != B_OK)
+                continue;
+            entries[i].push_back(index_tree_entry{ key, relative });
+            keys++;
+        }
+        return true;
+    }, stop);
+    if (result != B_OK)
+        return result;
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (!IsIndexKeyType(indices[i].type))
+            continue;
+        result = WriteIndexTree(IndexPath(indices[i].name.c_str()).c_str(), indices[i].type,
+            entries[i]);
+        if (result != B_OK)
+            return result;
+    }
+    return B_OK;
+}
+
+status_t
+DirectoryIndexVolume::EstimateRange(const char* name, const index_range& range, int64& count)
+{
+    IndexTree tree;
+    status_t result = tree.SetTo(IndexPath(name).c_str());
+    if (result != B_OK)
+        return result;
+
+    uint64 estimate;
+    result = tree.EstimateCount(range, estimate);
+    count = (int64)estimate;
+    return result;
+}
+
+status_t
+DirectoryIndexVolume::ReadRange(const char* name, const index_range& range,
+    const path_callback& callback)
+{
+    IndexTree tree;
+    status_t result = tree.SetTo(IndexPath(name).c_str());
+    if (result != B_OK)
+        return result;
+
+    std::string path;
+    return tree.Read(range, [&](const std::string& /*key*/, const std::string& relative) {
+        path = fRoot + "/" + relative;
+        return callback(path.c_str());
+    });
+}
+
+status_t
+DirectoryIndexVolume::ReadFiles(const path_callback& callback)
+{
+    std::string path;
+    bool stop = false;
+    return walk_files(fRoot, "", [&](const std::string& relative) {
+        path = fRoot + "/" + relative;
+        return callback(path.c_str());
+    }, stop);
+}
+
+#endif // !__HAIKU__
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _INDEX_VOLUME_H
+#define _INDEX_VOLUME_H
+
+#include "Platform.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "IndexKey.h"
+
+struct index_entry {
+    std::string     name;
+    type_code       type;
+};
+
+// gets the path of a file, returns false to stop
+typedef std::function<bool(const char* path)> path_callback;
+
+// The attribute indices of one volume. On Haiku this is the fs_index API of
+// the volume a path lives on; elsewhere a stand-in keeps one file per index
+// in a hidden directory below the path, so index handling can be tested.
+class IndexVolume {
+public:
+    virtual                 ~IndexVolume();
+
+    virtual status_t        InitCheck() const = 0;
+            const char*     Name() const { return fName.c_str(); }
+
+    virtual status_t        GetIndices(std::vector<index_entry>& indices) = 0;
+    // returns B_FILE_EXISTS if there already is an index with that name
+    virtual status_t        CreateIndex(const char* name, type_code type) = 0;
+    virtual status_t        RemoveIndex(const char* name) = 0;
+
+    // The rest is for queries. A file system keeps its indices current and
+    // runs queries itself; the stand-in reads the attributes of all files
+    // into its indices on UpdateIndices(), and leaves evaluating a query to
+    // the caller. What a volume can't do returns B_NOT_SUPPORTED.
+    virtual status_t        UpdateIndices(int64& files, int64& keys);
+    // how many files have a key of the index in the range, roughly
+    virtual status_t        EstimateRange(const char* name,
+                                const index_range& range, int64& count);
+    // the files with a key of the index in the range, in key order
+    virtual status_t        ReadRange(const char* name,
+                                const index_range& range,
+                                const path_callback& callback);
+    // all files of the volume, when no index helps
+    virtual status_t        ReadFiles(const path_callback& callback);
+    // a query in the syntax of the file system
+    virtual status_t        RunQuery(const char* predicate,
+                                const path_callback& callback);
+
+    static  IndexVolume*    Create(const char* path);
+    // the boot volume on Haiku; elsewhere there is no default, and NULL
+    // is returned, so the stand-in is never created without being asked for
+    static  const char*     DefaultPath();
+    // the given volume paths, or the default volume if there is one
+    static  std::vector<std::string> PathsOrDefault(
+                                const std::vector<std::string>& paths);
+
+protected:
+                            IndexVolume(const char* name);
+
+            std::string     fName;
+};
+
+#ifdef __HAIKU__
+
+class FsIndexVolume : public IndexVolume {
+public:
+                            FsIndexVolume(const char* path);
+
+    virtual status_t        InitCheck() const;
+
+    virtual status_t        GetIndices(std::vector<index_entry>& indices);
+    virtual status_t        CreateIndex(const char* name, type_code type);
+    virtual status_t        RemoveIndex(const char* name);
+
+    virtual status_t        RunQuery(const char* predicate,
+                                const path_callback& callback);
+
+private:
+            dev_t           fDevice;
+};
+
+#else // !__HAIKU__
+
+#define INDEX_DIRECTORY ".mime_index"
+
+class DirectoryIndexVolume : public IndexVolume {
+public:
+                            DirectoryIndexVolume(const char* path);
+
+    virtual status_t        InitCheck() const;
+
+    virtual status_t        GetIndices(std::vector<index_entry>& indices);
+    virtual status_t        CreateIndex(const char* name, type_code type);
+    virtual status_t        RemoveIndex(const char* name);
+
+    virtual status_t        UpdateIndices(int64& files, int64& keys);
+    virtual status_t        EstimateRange(const char* name,
+                                const index_range& range, int64& count);
+    virtual status_t        ReadRange(const char* name,
+                                const index_range& range,
+                                const path_callback& callback);
+    virtual status_t        ReadFiles(const path_callback& callback);
+
+            std::string     IndexPath(const char* name) const;
+
+private:
+            std::string     fRoot;
+            std::string     fDirectory;
+};
+
+#endif // !__HAIKU__
+
+#endif // _INDEX_VOLUME_H
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "InstallCache.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "ContentHash.h"
+#include "MappedFile.h"
+#include "Stats.h"
+
+#define INSTALL_CACHE_MAGIC     'MICA'
+#define INSTALL_CACHE_VERSION   1
+
+// All values are in host byte order; a cache from another host is not
+// recognized and starts empty. The header is followed by the entries, each
+// an install_cache_record, then its path and type without terminating NUL.
+struct install_cache_header {
+    uint32      magic;
+    uint32      version;
+    uint32      entryCount;
+    uint32      reserved;
+};
+
+struct install_cache_record {
+    uint64      contentHash;
+    uint64      size;
+    uint64      fieldsHash;
+    uint64      volumesHash;
+    uint32      pathLength;
+    uint32      typeLength;
+};
+
+install_cache_entry::install_cache_entry()
+    :
+    contentHash(0),
+    size(0),
+    fieldsHash(0),
+    volumesHash(0)
+{
+}
+
+InstallCache::InstallCache(MimeDatabase& database, const std::vector<std::string>& volumes)
+    :
+    fDatabase(database),
+    fChanged(false),
+    fHits(0),
+    fMisses(0)
+{
+    // indices are only created on these, installing for others is a change
+    std::vector<std::string> sortedVolumes(volumes);
+    std::sort(sortedVolumes.begin(), sortedVolumes.end());
+    std::string key;
+    for (const std::string& volume : sortedVolumes)
+        key.append(volume.c_str(), volume.size() + 1);
+    fVolumesHash = HashData(key.data(), key.size());
+}
+
+status_t
+InstallCache::Load()
+{
+    fEntries.clear();
+    fChanged = false;
+
+    MappedFile file;
+    status_t result = file.SetTo(PathFor(fDatabase).c_str());
+    if (result != B_OK)
+        return result == B_ENTRY_NOT_FOUND ? B_OK : result;
+
+    const uint8* data = file.Data();
+    size_t size = file.Size();
+    const install_cache_header* header = (const install_cache_header*)data;
+    if (size < sizeof(install_cache_header) || header->magic != INSTALL_CACHE_MAGIC
+        || header->version != INSTALL_CACHE_VERSION)
+        return B_BAD_DATA;
+
+    size_t offset = sizeof(install_cache_header);
+    for (uint32 i = 0; i < header->entryCount; i++) {
+        install_cache_record record;
+        if (size - offset < sizeof(record)) {
+            fEntries.clear();
+            return B_BAD_DATA;
+        }
+        memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+        if ((uint64)record.pathLength + record.typeLength > size - offset) {
+            fEntries.clear();
+            return B_BAD_DATA;
+        }
+
+        install_cache_entry entry;
+        entry.path.assign((const char*)data + offset, record.pathLength);
+        entry.type.assign((const char*)data + offset + record.pathLength, record.typeLength);
+        entry.contentHash = record.contentHash;
+        entry.size = record.size;
+        entry.fieldsHash = record.fieldsHash;
+        entry.volumesHash = record.volumesHash;
+        offset += record.pathLength + record.typeLength;
+        fEntries[entry.path] = entry;
+    }
+    return B_OK;
+}
+
+status_t
+InstallCache::Save()
+{
+    if (!fChanged)
+        return B_OK;
+
+    struct stat st;
+    for (auto entry = fEntries.begin(); entry != fEntries.end();) {
+        if (stat(entry->first.c_str(), &st) != 0)
+            entry = fEntries.erase(entry);
+        else
+            entry++;
+    }
+
+    install_cache_header header;
+    header.magic = INSTALL_CACHE_MAGIC;
+    header.version = INSTALL_CACHE_VERSION;
+    header.entryCount = (uint32)fEntries.size();
+    header.reserved = 0;
+
+    std::string data((const char*)&header, sizeof(header));
+    for (const auto& item : fEntries) {
+        const install_cache_entry& entry = item.second;
+        install_cache_record record;
+        record.contentHash = entry.contentHash;
+        record.size = entry.size;
+        record.fieldsHash = entry.fieldsHash;
+        record.volumesHash = entry.volumesHash;
+        record.pathLength = (uint32)entry.path.size();
+        record.typeLength = (uint32)entry.type.size();
+        data.append((const char*)&record, sizeof(record));
+        data += entry.path;
+        data += entry.type;
+    }
+
+    status_t result = ReplaceFile(PathFor(fDatabase).c_str(), data.data(), data.size());
+    if (result == B_OK)
+        fChanged = false;
+    return result;
+}
+
+status_t
+InstallCache::Hash(const char* path, install_cache_entry& entry) const
+{
+    STATS_TIMER(STATS_PHASE_HASH);
+    char absolutePath[PATH_MAX];
+    if (realpath(path, absolutePath) == NULL)
+        return errno;
+
+    off_t size;
+    status_t result = HashFile(absolutePath, entry.contentHash, &size);
+    if (result != B_OK)
+        return result;
+
+    STATS_ADD(STATS_BYTES_READ, size);
+    entry.path = absolutePath;
+    entry.size = (uint64)size;
+    return B_OK;
+}
+
+bool
+InstallCache::IsUnchanged(const install_cache_entry& entry)
+{
+    auto found = fEntries.find(entry.path);
+    uint64 fieldsHash;
+    bool unchanged = found != fEntries.end()
+        && found->second.contentHash == entry.contentHash
+        && found->second.size == entry.size
+        && found->second.volumesHash == fVolumesHash
+        && _HashFields(found->second.type.c_str(), fieldsHash) == B_OK
+        && found->second.fieldsHash == fieldsHash;
+
+    if (unchanged)
+        fHits++;
+    else
+        fMisses++;
+    return unchanged;
+}
+
+status_t
+InstallCache::Store(install_cache_entry& entry, const char* type)
+{
+    status_t result = _HashFields(type, entry.fieldsHash);
+    if (result != B_OK)
+        return result;
+
+    entry.type = type;
+    entry.volumesHash = fVolumesHash;
+    fEntries[entry.path] = entry;
+    fChanged = true;
+    return B_OK;
+}
+
+/*static*/ std::string
+InstallCache::PathFor(const MimeDatabase& database)
+{
+    return database.SidecarPath(INSTALL_CACHE_NAME);
+}
+
+// Hashes which fields the type has and their values, as one record per field
+// of index, presence, size and data.
+status_t
+InstallCache::_HashFields(const char* type, uint64& hash) const
+{
+    if (!fDatabase.IsInstalled(type))
+        return B_ENTRY_NOT_FOUND;
+
+    std::string fields;
+    std::string data;
+    for (int32 i = 0; i < MIME_FIELD_COUNT; i++) {
+        status_t result = fDatabase.GetField(type, (mime_field)i, data);
+        if (result == B_ENTRY_NOT_FOUND)
+            data.clear();
+        else if (result != B_OK)
+            return result;
+
+        uint32 record[3] = { (uint32)i, result == B_OK, (uint32)data.size() };
+        fields.append((const char*)record, sizeof(record));
+        fields += data;
+    }
+
+    hash = HashData(fields.data(), fields.size());
+    return B_OK;
+}
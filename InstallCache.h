@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _INSTALL_CACHE_H
+#define _INSTALL_CACHE_H
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "MimeDatabase.h"
+
+#define INSTALL_CACHE_NAME "install-cache"
+
+// What a resource file looked like when it was installed, and what the type
+// it produced looked like in the DB right after.
+struct install_cache_entry {
+                    install_cache_entry();
+
+    std::string     path;           // absolute
+    uint64          contentHash;
+    uint64          size;
+    std::string     type;
+    uint64          fieldsHash;     // of all fields of the type in the DB
+    uint64          volumesHash;    // of the volumes indices were created on
+};
+
+// Remembers the resource files installed into a MIME DB, in a file next to
+// it, so installing them again can be skipped as long as neither the file
+// nor its type in the DB changed. Both are compared by content: the file by
+// its xxHash64, the type by a hash of its fields, so touching a file or
+// changing a type through another tool is noticed as well.
+//
+// Hash() and IsUnchanged() may be called from several threads, as long as
+// no Store() or Save() runs at the same time; the hit and miss counters
+// fHits and fMisses are atomic for that.
+class InstallCache {
+public:
+                            InstallCache(MimeDatabase& database,
+                                const std::vector<std::string>& volumes);
+
+            // a missing or unreadable cache file starts an empty cache
+            status_t        Load();
+            // writes the cache if it changed; files that no longer exist
+            // are dropped
+            status_t        Save();
+
+            // hashes the file into the entry
+            status_t        Hash(const char* path,
+                                install_cache_entry& entry) const;
+            // true if the hashed file was installed before and its type is
+            // unchanged since; counts a hit or a miss
+            bool            IsUnchanged(const install_cache_entry& entry);
+            // records the installed file with the current state of its type
+            status_t        Store(install_cache_entry& entry,
+                                const char* type);
+
+            int32           CountHits() const { return fHits; }
+            int32           CountMisses() const { return fMisses; }
+
+    static  std::string     PathFor(const MimeDatabase& database);
+
+private:
+            status_t        _HashFields(const char* type,
+                                uint64& hash) const;
+
+            MimeDatabase&   fDatabase;
+            uint64          fVolumesHash;
+            std::map<std::string, install_cache_entry> fEntries;
+            bool            fChanged;
+            std::atomic<int32> fHits;
+            std::atomic<int32> fMisses;
+};
+
+#endif // _INSTALL_CACHE_H
@@ -0,0 +1,378 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Manifest.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+
+#include "IndexVolume.h"
+#include "WorkerPool.h"
+
+static std::string
+lower_case(const std::string& type)
+{
+    std::string lower(type);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    return lower;
+}
+
+static std::string
+join(const std::vector<std::string>& strings)
+{
+    std::string joined;
+    for (const std::string& string : strings) {
+        if (!joined.empty())
+            joined += ",";
+        joined += string;
+    }
+    return joined;
+}
+
+Manifest::Manifest()
+{
+}
+
+status_t
+Manifest::SetTo(const char* path)
+{
+    fBundles.clear();
+    fVolumes.clear();
+    fManaged.clear();
+    fError.clear();
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fError = std::string("cannot open manifest ") + path + ": " + strerror(errno);
+        return B_BAD_VALUE;
+    }
+
+    // relative paths are relative to the manifest, not the working directory
+    std::string directory;
+    const char* slash = strrchr(path, '/');
+    if (slash != NULL)
+        directory.assign(path, slash + 1 - path);
+
+    status_t result = B_OK;
+    char buffer[B_PATH_NAME_LENGTH + 64];
+    int32 line = 0;
+    while (result == B_OK && fgets(buffer, sizeof(buffer), file) != NULL) {
+        line++;
+        std::string text(buffer);
+        size_t start = text.find_first_not_of(" \t\r\n");
+        if (start == std::string::npos || text[start] == '#')
+            continue;
+        text = text.substr(start, text.find_last_not_of(" \t\r\n") - start + 1);
+
+        size_t space = text.find_first_of(" \t");
+        std::string directive = text.substr(0, space);
+        std::string argument;
+        if (space != std::string::npos)
+            argument = text.substr(text.find_first_not_of(" \t", space));
+        if (argument.empty()) {
+            result = _Fail(path, line, "%s needs an argument", directive.c_str());
+            break;
+        }
+
+        if (directive == "bundle" || directive == "volume") {
+            if (argument[0] != '/')
+                argument = directory + argument;
+            (directive == "bundle" ? fBundles : fVolumes).push_back(argument);
+        } else if (directive == "manage") {
+            if (!IsValidMimeType(argument.c_str()) || argument.find('/') != std::string::npos)
+                result = _Fail(path, line, "%s is not a supertype", argument.c_str());
+            else if (std::find(fManaged.begin(), fManaged.end(), argument) == fManaged.end())
+                fManaged.push_back(argument);
+        } else
+            result = _Fail(path, line, "unknown directive %s", directive.c_str());
+    }
+    fclose(file);
+
+    if (result == B_OK && fBundles.empty() && fManaged.empty()) {
+        fError = std::string(path) + ": no bundle or manage directive";
+        result = B_BAD_VALUE;
+    }
+    return result;
+}
+
+status_t
+Manifest::_Fail(const char* path, int32 line, const char* format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    fError = std::string(path) + ":" + std::to_string(line) + ": " + buffer;
+    return B_BAD_VALUE;
+}
+
+const char*
+plan_action_name(plan_action action)
+{
+    switch (action) {
+        case PLAN_INSTALL:
+            return "install";
+        case PLAN_UPDATE:
+            return "update";
+        case PLAN_DELETE:
+            return "delete";
+        case PLAN_CREATE_INDEX:
+            return "create_index";
+        case PLAN_REMOVE_INDEX:
+            return "remove_index";
+        case PLAN_INDEX_CONFLICT:
+            return "index_conflict";
+        default:
+            return "unknown";
+    }
+}
+
+ManifestPlan::ManifestPlan(MimeDatabase& database)
+    :
+    fDatabase(database),
+    fCounts(),
+    fUnchanged(0)
+{
+}
+
+status_t
+ManifestPlan::SetTo(const std::vector<std::string>& paths,
+    const std::vector<std::string>& volumes, const std::vector<std::string>& managed,
+    int32 jobs)
+{
+    fDeleted.clear();
+    fSteps.clear();
+    std::fill(fCounts, fCounts + PLAN_ACTION_COUNT, 0);
+    fUnchanged = 0;
+
+    // parsing and comparing only read, every bundle can have a worker
+    int32 count = (int32)paths.size();
+    fBundles = std::vector<MimeTypeBundle>(count);
+    std::vector<MimeTypeChanges> changes(count);
+    WorkerPool pool(jobs);
+    pool.ForEach(count, [&](int32 index) {
+        MimeTypeBundle& bundle = fBundles[index];
+        if (ParseMimeTypeBundle(paths[index].c_str(), bundle) != B_OK)
+            return;
+        bundle.status = DiffMimeTypeBundle(fDatabase, bundle, changes[index]);
+        if (bundle.status != B_OK) {
+            bundle.error = "cannot compare " + bundle.path + " with the MIME DB: "
+                + strerror(bundle.status);
+        }
+    });
+
+    int32 failed = 0;
+    std::map<std::string, int32> provided;
+    for (int32 i = 0; i < count; i++) {
+        const MimeTypeBundle& bundle = fBundles[i];
+        if (bundle.status != B_OK) {
+            fprintf(stderr, "%s\n", bundle.error.c_str());
+            failed++;
+            continue;
+        }
+
+        auto inserted = provided.insert(std::make_pair(lower_case(bundle.type), i));
+        if (!inserted.second) {
+            fprintf(stderr, "%s and %s both provide MIME type %s\n",
+                fBundles[inserted.first->second].path.c_str(), bundle.path.c_str(),
+                bundle.type);
+            failed++;
+            continue;
+        }
+
+        if (changes[i].install)
+            _AddStep(PLAN_INSTALL, bundle.type, "", "", bundle.path);
+        else if (changes[i].fields != 0) {
+            std::string fields;
+            for (int32 field = 0; field < MIME_FIELD_COUNT; field++) {
+                if ((changes[i].fields & (1 << field)) == 0)
+                    continue;
+                if (!fields.empty())
+                    fields += ",";
+                fields += kMimeFields[field].name;
+            }
+            _AddStep(PLAN_UPDATE, bundle.type, "", fields, bundle.path);
+        } else
+            fUnchanged++;
+    }
+    if (failed > 0) {
+        fprintf(stderr, "%" B_PRId32 " of %" B_PRId32 " resource files cannot be planned.\n",
+            failed, count);
+        return B_ERROR;
+    }
+
+    // only the subtypes of managed supertypes are the manifest's to delete
+    std::vector<std::string> installed;
+    for (const std::string& supertype : managed) {
+        status_t result = fDatabase.GetInstalledTypes(supertype.c_str(), installed);
+        if (result != B_OK) {
+            fprintf(stderr, "cannot list the subtypes of %s: %s\n", supertype.c_str(),
+                strerror(result));
+            return result;
+        }
+        for (const std::string& type : installed) {
+            if (provided.find(lower_case(type)) != provided.end())
+                continue;
+            fDeleted.push_back(type);
+            _AddStep(PLAN_DELETE, type, "", "", "");
+        }
+    }
+
+    return _PlanIndices(volumes, jobs);
+}
+
+bool
+ManifestPlan::HasChanges() const
+{
+    for (int32 i = 0; i < PLAN_ACTION_COUNT; i++) {
+        if (i != PLAN_INDEX_CONFLICT && fCounts[i] > 0)
+            return true;
+    }
+    return false;
+}
+
+// The indices are checked against the declarations and registry records the
+// DB would have after applying: the bundles replace what their types declared,
+// deleted types declare nothing. Apply only creates the indices the bundles
+// declare, and removes all orphans.
+status_t
+ManifestPlan::_PlanIndices(const std::vector<std::string>& volumes, int32 jobs)
+{
+    index_declarations declarations;
+    status_t result = IndexManager::GetDeclarations(fDatabase, declarations);
+    if (result != B_OK) {
+        fprintf(stderr, "failed to read the declared indices: %s\n", strerror(result));
+        return result;
+    }
+
+    std::set<std::string> replaced;
+    for (const MimeTypeBundle& bundle : fBundles)
+        replaced.insert(lower_case(bundle.type));
+    for (const std::string& type : fDeleted)
+        replaced.insert(lower_case(type));
+
+    for (auto iterator = declarations.begin(); iterator != declarations.end();) {
+        index_declaration& declaration = iterator->second;
+        for (size_t i = declaration.mimeTypes.size(); i-- > 0;) {
+            if (replaced.find(lower_case(declaration.mimeTypes[i])) == replaced.end())
+                continue;
+            declaration.mimeTypes.erase(declaration.mimeTypes.begin() + i);
+            declaration.types.erase(declaration.types.begin() + i);
+        }
+        if (declaration.mimeTypes.empty())
+            iterator = declarations.erase(iterator);
+        else {
+            declaration.type = declaration.types[0];
+            ++iterator;
+        }
+    }
+
+    std::vector<std::vector<index_entry> > attributes(fBundles.size());
+    std::set<std::string> created;
+    for (size_t i = 0; i < fBundles.size(); i++) {
+        const MimeTypeBundle& bundle = fBundles[i];
+        if (bundle.attrInfo.InitCheck() == B_OK)
+            IndexManager::GetSearchableAttributes(bundle.attrInfo, attributes[i]);
+        for (const index_entry& attribute : attributes[i]) {
+            auto inserted = declarations.insert(std::make_pair(attribute.name,
+                index_declaration()));
+            index_declaration& declaration = inserted.first->second;
+            if (inserted.second)
+                declaration.type = attribute.type;
+            declaration.mimeTypes.push_back(bundle.type);
+            declaration.types.push_back(attribute.type);
+            created.insert(attribute.name);
+        }
+    }
+
+    IndexRegistry registry(fDatabase);
+    result = registry.Load();
+    if (result == B_BAD_DATA) {
+        fprintf(stderr, "ignoring damaged index registry %s, apply replaces it\n",
+            IndexRegistry::PathFor(fDatabase).c_str());
+        result = B_OK;
+    }
+    if (result != B_OK) {
+        fprintf(stderr, "cannot read index registry %s: %s\n",
+            IndexRegistry::PathFor(fDatabase).c_str(), strerror(result));
+        return result;
+    }
+
+    std::vector<std::string> paths = IndexVolume::PathsOrDefault(volumes);
+    std::vector<std::unique_ptr<IndexVolume> > indexVolumes;
+    for (const std::string& path : paths) {
+        std::unique_ptr<IndexVolume> volume(IndexVolume::Create(path.c_str()));
+        result = volume.get() != NULL ? volume->InitCheck() : B_NO_MEMORY;
+        if (result != B_OK) {
+            fprintf(stderr, "cannot use volume %s for indices: %s\n", path.c_str(),
+                strerror(result));
+            return result;
+        }
+        for (size_t i = 0; i < fBundles.size(); i++)
+            registry.SetDeclarations(volume->Name(), fBundles[i].type, attributes[i]);
+        indexVolumes.push_back(std::move(volume));
+    }
+    registry.RemoveTypes(fDeleted);
+
+    // the registry is only read from here on, the volumes are independent
+    int32 count = (int32)indexVolumes.size();
+    std::vector<std::vector<index_check> > checks(count);
+    std::vector<status_t> results(count);
+    WorkerPool pool(jobs);
+    pool.ForEach(count, [&](int32 index) {
+        results[index] = registry.Check(*indexVolumes[index], declarations, checks[index]);
+    });
+
+    for (int32 i = 0; i < count; i++) {
+        const char* volume = indexVolumes[i]->Name();
+        if (results[i] != B_OK) {
+            fprintf(stderr, "failed to read indices of volume %s: %s\n", volume,
+                strerror(results[i]));
+            return results[i];
+        }
+
+        for (const index_check& check : checks[i]) {
+            switch (check.state) {
+                case INDEX_STATE_MISSING:
+                    if (created.find(check.name) != created.end()) {
+                        _AddStep(PLAN_CREATE_INDEX, check.name, volume,
+                            type_code_string(check.declaredType), join(check.mimeTypes));
+                    }
+                    break;
+                case INDEX_STATE_ORPHANED:
+                    _AddStep(PLAN_REMOVE_INDEX, check.name, volume,
+                        type_code_string(check.type), join(check.mimeTypes));
+                    break;
+                case INDEX_STATE_WRONG_TYPE:
+                    _AddStep(PLAN_INDEX_CONFLICT, check.name, volume,
+                        type_code_string(check.type) + ", declared "
+                            + type_code_string(check.declaredType),
+                        join(check.mimeTypes));
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    return B_OK;
+}
+
+void
+ManifestPlan::_AddStep(plan_action action, const std::string& name, const std::string& volume,
+    const std::string& detail, const std::string& source)
+{
+    fSteps.push_back({ action, name, volume, detail, source });
+    fCounts[action]++;
+}
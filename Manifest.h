@@ -0,0 +1,115 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _MANIFEST_H
+#define _MANIFEST_H
+
+#include <string>
+#include <vector>
+
+#include "IndexRegistry.h"
+#include "MimeDatabase.h"
+#include "MimeTypeBundle.h"
+
+// The desired set of types, one directive per line, '#' starts a comment:
+//
+//   bundle <resource file|dir>   types to install, a directory for all files
+//                                below it
+//   volume <path>                volume to keep the indices of, may repeat;
+//                                without any, the --volume ones are used
+//   manage <supertype>           installed subtypes that no bundle provides
+//                                are deleted
+//
+// Relative paths are relative to the directory of the manifest.
+class Manifest {
+public:
+                            Manifest();
+
+            // B_BAD_VALUE for a malformed manifest, see Error()
+            status_t        SetTo(const char* path);
+            const std::string& Error() const { return fError; }
+
+            const std::vector<std::string>& Bundles() const
+                                { return fBundles; }
+            const std::vector<std::string>& Volumes() const
+                                { return fVolumes; }
+            const std::vector<std::string>& ManagedSupertypes() const
+                                { return fManaged; }
+
+private:
+            status_t        _Fail(const char* path, int32 line,
+                                const char* format, ...);
+
+            std::vector<std::string> fBundles;
+            std::vector<std::string> fVolumes;
+            std::vector<std::string> fManaged;
+            std::string     fError;
+};
+
+enum plan_action {
+    PLAN_INSTALL = 0,
+    PLAN_UPDATE,
+    PLAN_DELETE,
+    PLAN_CREATE_INDEX,
+    PLAN_REMOVE_INDEX,
+    PLAN_INDEX_CONFLICT,    // reported, apply leaves it as it is
+    PLAN_ACTION_COUNT
+};
+
+const char* plan_action_name(plan_action action);
+
+struct plan_step {
+    plan_action     action;
+    std::string     name;       // MIME type or index
+    std::string     volume;     // for indices
+    std::string     detail;     // fields to write, or type of the index
+    std::string     source;     // resource file, or types declaring the index
+};
+
+// What it takes to get from the MIME DB and the indices of the volumes to the
+// state the bundles describe, without changing either. Bundles are parsed
+// and compared with the DB in parallel; the indices are compared by the
+// index registry, with the declarations and records the DB would have.
+class ManifestPlan {
+public:
+                            ManifestPlan(MimeDatabase& database);
+
+            // prints why a bundle cannot be planned, and fails
+            status_t        SetTo(const std::vector<std::string>& paths,
+                                const std::vector<std::string>& volumes,
+                                const std::vector<std::string>& managed,
+                                int32 jobs);
+
+            const std::vector<plan_step>& Steps() const { return fSteps; }
+            int32           CountSteps(plan_action action) const
+                                { return fCounts[action]; }
+            // whether apply has anything to do; conflicts don't count
+            bool            HasChanges() const;
+            int32           CountUnchanged() const { return fUnchanged; }
+
+            // what apply works with
+            int32           CountBundles() const
+                                { return (int32)fBundles.size(); }
+            MimeTypeBundle* Bundles() { return fBundles.data(); }
+            const std::vector<std::string>& DeletedTypes() const
+                                { return fDeleted; }
+
+private:
+            status_t        _PlanIndices(const std::vector<std::string>& volumes,
+                                int32 jobs);
+            void            _AddStep(plan_action action,
+                                const std::string& name,
+                                const std::string& volume,
+                                const std::string& detail,
+                                const std::string& source);
+
+            MimeDatabase&   fDatabase;
+            std::vector<MimeTypeBundle> fBundles;
+            std::vector<std::string> fDeleted;
+            std::vector<plan_step> fSteps;
+            int32           fCounts[PLAN_ACTION_COUNT];
+            int32           fUnchanged;
+};
+
+#endif // _MANIFEST_H
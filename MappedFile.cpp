@@ -0,0 +1,120 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "MappedFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+MappedFile::MappedFile()
+    :
+    fData(NULL),
+    fSize(0),
+    fStatus(B_NO_INIT)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Unset();
+}
+
+status_t
+MappedFile::SetTo(const char* path)
+{
+    Unset();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return fStatus = errno;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return fStatus = B_BAD_DATA;
+    }
+
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return fStatus = errno;
+
+    fData = (const uint8*)mapping;
+    fSize = st.st_size;
+    return fStatus = B_OK;
+}
+
+void
+MappedFile::Unset()
+{
+    if (fData != NULL)
+        munmap((void*)fData, fSize);
+
+    fData = NULL;
+    fSize = 0;
+    fStatus = B_NO_INIT;
+}
+
+status_t
+ReplaceFile(const char* path, const void* data, size_t size)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+    std::string temporary = std::string(path) + suffix;
+
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return errno;
+
+    const uint8* bytes = (const uint8*)data;
+    status_t result = B_OK;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0) {
+            result = errno;
+            break;
+        }
+        bytes += written;
+        size -= written;
+    }
+
+    if (result == B_OK && fsync(fd) != 0)
+        result = errno;
+    close(fd);
+
+    if (result == B_OK && rename(temporary.c_str(), path) != 0)
+        result = errno;
+    if (result != B_OK)
+        unlink(temporary.c_str());
+    return result;
+}
+
+status_t
+CreateDirectories(const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) == 0)
+        return S_ISDIR(st.st_mode) ? B_OK : B_NOT_A_DIRECTORY;
+
+    std::string directory(path);
+    size_t slash = directory.find_last_of('/');
+    if (slash != std::string::npos && slash > 0) {
+        status_t result = CreateDirectories(directory.substr(0, slash).c_str());
+        if (result != B_OK)
+            return result;
+    }
+
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+        return errno;
+    return B_OK;
+}
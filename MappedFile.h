@@ -0,0 +1,47 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include "Platform.h"
+
+// A whole file mapped read-only, for the files mime keeps next to the DB.
+class MappedFile {
+public:
+                            MappedFile();
+                            ~MappedFile();
+
+            status_t        SetTo(const char* path);
+            void            Unset();
+            status_t        InitCheck() const { return fStatus; }
+
+            const uint8*    Data() const { return fData; }
+            size_t          Size() const { return fSize; }
+
+private:
+                            MappedFile(const MappedFile&);
+            MappedFile&     operator=(const MappedFile&);
+
+            const uint8*    fData;
+            size_t          fSize;
+            status_t        fStatus;
+};
+
+// Writes the data to a temporary file and renames it over the path, so
+// readers that have the old file mapped, or open the path, never see a
+// partially written file.
+status_t ReplaceFile(const char* path, const void* data, size_t size);
+// creates the directory and its missing parents
+status_t CreateDirectories(const char* path);
+
+// whether count bytes or entries from start are within total, for checking
+// the offsets read from a file without overflowing
+static inline bool
+range_fits(uint64 start, uint64 count, uint64 total)
+{
+    return start <= total && count <= total - start;
+}
+
+#endif // _MAPPED_FILE_H
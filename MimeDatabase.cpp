@@ -0,0 +1,103 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "MimeDatabase.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include "DirectoryMimeDatabase.h"
+#ifdef __HAIKU__
+#include "RegistrarMimeDatabase.h"
+#endif
+
+const mime_field_info kMimeFields[MIME_FIELD_COUNT] = {
+    { "short_description",  "META:S:DESC",      B_STRING_TYPE,      'MSDC' },
+    { "long_description",   "META:L:DESC",      B_STRING_TYPE,      'MLDC' },
+    { "preferred_app",      "META:PREF_APP",    B_STRING_TYPE,      'MSIG' },
+    { "sniffer_rule",       "META:SNIFF_RULE",  B_STRING_TYPE,      B_STRING_TYPE },
+    { "extensions",         "META:EXTENS",      B_MESSAGE_TYPE,     B_MESSAGE_TYPE },
+    { "attr_info",          "META:ATTR_INFO",   B_MESSAGE_TYPE,     B_MESSAGE_TYPE },
+    { "icon",               "META:ICON",        B_VECTOR_ICON_TYPE, B_VECTOR_ICON_TYPE }
+};
+
+MimeDatabase::~MimeDatabase()
+{
+}
+
+status_t
+MimeDatabase::SetFields(const char* type, const mime_field_value* values, int32 count)
+{
+    for (int32 i = 0; i < count; i++) {
+        status_t result = SetField(type, values[i].field, values[i].data, values[i].size);
+        if (result != B_OK)
+            return result;
+    }
+    return B_OK;
+}
+
+// e.g. ~/config/settings/mime_db.extensions
+std::string
+MimeDatabase::SidecarPath(const char* name) const
+{
+    return Location() + "." + name;
+}
+
+/*static*/ MimeDatabase*
+MimeDatabase::Create(const char* directory)
+{
+#ifdef __HAIKU__
+    if (directory == NULL)
+        return new(std::nothrow) RegistrarMimeDatabase();
+#endif
+    if (directory == NULL)
+        directory = DefaultDirectory();
+
+    return new(std::nothrow) DirectoryMimeDatabase(directory);
+}
+
+/*static*/ const char*
+MimeDatabase::DefaultDirectory()
+{
+    // mirrors the location of the user MIME DB on Haiku
+    static std::string directory;
+    if (directory.empty()) {
+        const char* home = getenv("HOME");
+        directory = std::string(home != NULL ? home : ".") + "/config/settings/mime_db";
+    }
+    return directory.c_str();
+}
+
+static inline bool
+is_valid_mime_char(char ch)
+{
+    return ch > ' ' && ch < 127 && strchr("()<>@,;:\\\"[]?=", ch) == NULL;
+}
+
+// same rules as BMimeType::IsValid()
+bool
+IsValidMimeType(const char* type)
+{
+    if (type == NULL)
+        return false;
+
+    size_t length = strlen(type);
+    if (length == 0 || length >= B_MIME_TYPE_LENGTH)
+        return false;
+
+    bool foundSlash = false;
+    for (size_t i = 0; i < length; i++) {
+        if (type[i] == '/') {
+            if (foundSlash || i == 0 || i == length - 1)
+                return false;
+            foundSlash = true;
+        } else if (!is_valid_mime_char(type[i])) {
+            return false;
+        }
+    }
+    return true;
+}
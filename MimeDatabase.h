@@ -0,0 +1,82 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _MIME_DATABASE_H
+#define _MIME_DATABASE_H
+
+#include "Platform.h"
+
+#include <string>
+#include <vector>
+
+// The per type fields mime manages, stored as the META:* attributes of the
+// MIME DB. Field values are passed as raw attribute data: strings include the
+// terminating NUL, messages are flattened.
+enum mime_field {
+    MIME_FIELD_SHORT_DESCRIPTION = 0,
+    MIME_FIELD_LONG_DESCRIPTION,
+    MIME_FIELD_PREFERRED_APP,
+    MIME_FIELD_SNIFFER_RULE,
+    MIME_FIELD_EXTENSIONS,
+    MIME_FIELD_ATTR_INFO,
+    MIME_FIELD_ICON,
+
+    MIME_FIELD_COUNT
+};
+
+struct mime_field_info {
+    const char*     name;       // short name, used in output
+    const char*     attribute;  // attribute and resource name
+    type_code       attributeType;
+    type_code       resourceType;
+};
+
+extern const mime_field_info kMimeFields[MIME_FIELD_COUNT];
+
+#define MIME_TYPE_ATTR "META:TYPE"
+
+struct mime_field_value {
+    mime_field      field;
+    const void*     data;       // NULL to remove the field
+    size_t          size;
+};
+
+// Backend for all MIME DB access, so the tool is not tied to the registrar.
+class MimeDatabase {
+public:
+    virtual                 ~MimeDatabase();
+
+    virtual const char*     Name() const = 0;
+    // the directory of the DB; mime keeps its own files about it next to it
+    virtual std::string     Location() const = 0;
+            std::string     SidecarPath(const char* name) const;
+
+    virtual bool            IsInstalled(const char* type) = 0;
+    virtual status_t        Install(const char* type) = 0;
+    virtual status_t        Delete(const char* type) = 0;
+
+    // a NULL data pointer removes the field
+    virtual status_t        SetField(const char* type, mime_field field,
+                                const void* data, size_t size) = 0;
+    // writes several fields of one type at once; stops at the first error
+    virtual status_t        SetFields(const char* type,
+                                const mime_field_value* values, int32 count);
+    // returns B_ENTRY_NOT_FOUND if the field is not set
+    virtual status_t        GetField(const char* type, mime_field field,
+                                std::string& data) = 0;
+
+    virtual status_t        GetInstalledSupertypes(
+                                std::vector<std::string>& supertypes) = 0;
+    virtual status_t        GetInstalledTypes(const char* supertype,
+                                std::vector<std::string>& types) = 0;
+
+    // Returns the registrar backed DB on Haiku, or a directory backed DB at
+    // the given path (or the default location where there is no registrar).
+    static  MimeDatabase*   Create(const char* directory = NULL);
+    static  const char*     DefaultDirectory();
+};
+
+bool IsValidMimeType(const char* type);
+
+#endif // _MIME_DATABASE_H
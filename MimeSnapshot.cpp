@@ -0,0 +1,464 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "MimeSnapshot.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+#include "ExtensionIndex.h"
+#include "FlatMessage.h"
+#include "IndexManager.h"
+
+#define MIME_SNAPSHOT_MAGIC     'MSNP'
+#define MIME_SNAPSHOT_VERSION   1
+
+static const uint32 kNoString = UINT32_MAX;
+
+// All offsets are relative to the start of the file, all values are in host
+// byte order; a snapshot from another host is not recognized.
+struct mime_snapshot_header {
+    uint32      magic;
+    uint32      version;
+    uint32      typeCount;
+    uint32      typesOffset;        // mime_snapshot_type, sorted by type
+    uint32      extensionCount;
+    uint32      extensionsOffset;   // mime_snapshot_extension, sorted
+    uint32      attributeCount;
+    uint32      attributesOffset;   // mime_snapshot_attribute
+    uint32      referenceCount;
+    uint32      referencesOffset;   // uint32 string offsets or type indices
+    uint32      rulesOffset;        // flattened SnifferRules
+    uint32      rulesSize;
+    uint32      stringsOffset;      // NUL terminated strings
+    uint32      stringsSize;
+};
+
+struct mime_snapshot_type {
+    uint32      type;               // string offsets, kNoString if not set
+    uint32      shortDescription;
+    uint32      longDescription;
+    uint32      preferredApp;
+    uint32      snifferRule;
+    uint32      firstExtension;     // references to the extension strings
+    uint32      extensionCount;
+    uint32      firstAttribute;
+    uint32      attributeCount;
+    uint32      ruleOffset;         // into the rules, size 0 if there is none
+    uint32      ruleSize;
+};
+
+struct mime_snapshot_extension {
+    uint32      extension;          // string offset
+    uint32      firstType;          // references to the type indices
+    uint32      typeCount;
+};
+
+struct mime_snapshot_attribute {
+    uint32      name;               // string offsets
+    uint32      publicName;
+    uint32      type;
+    int32       width;
+    int32       alignment;
+    uint32      flags;
+};
+
+MimeSnapshot::MimeSnapshot()
+{
+    Unset();
+}
+
+status_t
+MimeSnapshot::SetTo(const char* path)
+{
+    Unset();
+
+    status_t result = fFile.SetTo(path);
+    if (result != B_OK)
+        return fStatus = result;
+
+    const uint8* data = fFile.Data();
+    size_t size = fFile.Size();
+    if (size < sizeof(mime_snapshot_header))
+        return fStatus = B_BAD_DATA;
+
+    const mime_snapshot_header* header = (const mime_snapshot_header*)data;
+    if (header->magic != MIME_SNAPSHOT_MAGIC || header->version != MIME_SNAPSHOT_VERSION)
+        return fStatus = B_BAD_DATA;
+
+    if (!range_fits(header->typesOffset,
+            (uint64)header->typeCount * sizeof(mime_snapshot_type), size)
+        || !range_fits(header->extensionsOffset,
+            (uint64)header->extensionCount * sizeof(mime_snapshot_extension), size)
+        || !range_fits(header->attributesOffset,
+            (uint64)header->attributeCount * sizeof(mime_snapshot_attribute), size)
+        || !range_fits(header->referencesOffset,
+            (uint64)header->referenceCount * sizeof(uint32), size)
+        || !range_fits(header->rulesOffset, header->rulesSize, size)
+        || !range_fits(header->stringsOffset, header->stringsSize, size)
+        || (header->stringsSize > 0 && data[header->stringsOffset + header->stringsSize - 1] != '\0')
+        || header->typesOffset % 4 != 0 || header->extensionsOffset % 4 != 0
+        || header->attributesOffset % 4 != 0 || header->referencesOffset % 4 != 0)
+        return fStatus = B_BAD_DATA;
+
+    fHeader = header;
+    fTypes = (const mime_snapshot_type*)(data + header->typesOffset);
+    fExtensions = (const mime_snapshot_extension*)(data + header->extensionsOffset);
+    fAttributes = (const mime_snapshot_attribute*)(data + header->attributesOffset);
+    fReferences = (const uint32*)(data + header->referencesOffset);
+    fRules = data + header->rulesOffset;
+    fStrings = (const char*)(data + header->stringsOffset);
+
+    // checked once here, so the accessors can trust every offset
+    result = _Validate();
+    if (result != B_OK) {
+        Unset();
+        return fStatus = result;
+    }
+    return fStatus = B_OK;
+}
+
+void
+MimeSnapshot::Unset()
+{
+    fFile.Unset();
+    fStatus = B_NO_INIT;
+    fHeader = NULL;
+    fTypes = NULL;
+    fExtensions = NULL;
+    fAttributes = NULL;
+    fReferences = NULL;
+    fRules = NULL;
+    fStrings = NULL;
+}
+
+int32
+MimeSnapshot::CountTypes() const
+{
+    return fStatus == B_OK ? (int32)fHeader->typeCount : 0;
+}
+
+int32
+MimeSnapshot::FindType(const char* type) const
+{
+    if (fStatus != B_OK)
+        return -1;
+
+    const mime_snapshot_type* end = fTypes + fHeader->typeCount;
+    const mime_snapshot_type* found = std::lower_bound(fTypes, end, type,
+        [this](const mime_snapshot_type& entry, const char* type) {
+            return strcasecmp(fStrings + entry.type, type) < 0;
+        });
+    if (found == end || strcasecmp(fStrings + found->type, type) != 0)
+        return -1;
+    return (int32)(found - fTypes);
+}
+
+const char*
+MimeSnapshot::TypeAt(int32 index) const
+{
+    if (index < 0 || index >= CountTypes())
+        return NULL;
+    return fStrings + fTypes[index].type;
+}
+
+const char*
+MimeSnapshot::StringFieldAt(int32 index, mime_field field) const
+{
+    if (index < 0 || index >= CountTypes())
+        return NULL;
+
+    const mime_snapshot_type& type = fTypes[index];
+    switch (field) {
+        case MIME_FIELD_SHORT_DESCRIPTION:
+            return _StringAt(type.shortDescription);
+        case MIME_FIELD_LONG_DESCRIPTION:
+            return _StringAt(type.longDescription);
+        case MIME_FIELD_PREFERRED_APP:
+            return _StringAt(type.preferredApp);
+        case MIME_FIELD_SNIFFER_RULE:
+            return _StringAt(type.snifferRule);
+        default:
+            return NULL;
+    }
+}
+
+int32
+MimeSnapshot::CountExtensions(int32 index) const
+{
+    if (index < 0 || index >= CountTypes())
+        return 0;
+    return (int32)fTypes[index].extensionCount;
+}
+
+const char*
+MimeSnapshot::ExtensionAt(int32 index, int32 extension) const
+{
+    if (extension < 0 || extension >= CountExtensions(index))
+        return NULL;
+    return fStrings + fReferences[fTypes[index].firstExtension + extension];
+}
+
+int32
+MimeSnapshot::CountAttributes(int32 index) const
+{
+    if (index < 0 || index >= CountTypes())
+        return 0;
+    return (int32)fTypes[index].attributeCount;
+}
+
+bool
+MimeSnapshot::GetAttributeAt(int32 index, int32 attribute, snapshot_attribute& info) const
+{
+    if (attribute < 0 || attribute >= CountAttributes(index))
+        return false;
+
+    const mime_snapshot_attribute& entry = fAttributes[fTypes[index].firstAttribute + attribute];
+    info.name = fStrings + entry.name;
+    info.publicName = fStrings + entry.publicName;
+    info.type = entry.type;
+    info.width = entry.width;
+    info.alignment = entry.alignment;
+    info.flags = entry.flags;
+    return true;
+}
+
+status_t
+MimeSnapshot::GetSnifferRuleAt(int32 index, SnifferRule& rule) const
+{
+    rule.Unset();
+    if (fStatus != B_OK)
+        return fStatus;
+    if (index < 0 || index >= CountTypes())
+        return B_BAD_VALUE;
+
+    const mime_snapshot_type& type = fTypes[index];
+    if (type.ruleSize == 0)
+        return B_ENTRY_NOT_FOUND;
+    return rule.Unflatten(fRules + type.ruleOffset, type.ruleSize);
+}
+
+status_t
+MimeSnapshot::LookupExtension(const char* _extension, std::vector<int32>& types) const
+{
+    types.clear();
+    if (fStatus != B_OK)
+        return fStatus;
+
+    std::string extension = ExtensionIndex::NormalizeExtension(_extension);
+    const mime_snapshot_extension* end = fExtensions + fHeader->extensionCount;
+    const mime_snapshot_extension* found = std::lower_bound(fExtensions, end, extension,
+        [this](const mime_snapshot_extension& entry, const std::string& extension) {
+            return extension.compare(fStrings + entry.extension) > 0;
+        });
+    if (found == end || extension != fStrings + found->extension)
+        return B_ENTRY_NOT_FOUND;
+
+    for (uint32 i = 0; i < found->typeCount; i++)
+        types.push_back((int32)fReferences[found->firstType + i]);
+    return B_OK;
+}
+
+const char*
+MimeSnapshot::_StringAt(uint32 offset) const
+{
+    return offset != kNoString ? fStrings + offset : NULL;
+}
+
+status_t
+MimeSnapshot::_Validate() const
+{
+    const mime_snapshot_header& header = *fHeader;
+    auto validString = [&](uint32 offset, bool optional) {
+        return offset < header.stringsSize || (optional && offset == kNoString);
+    };
+
+    for (uint32 i = 0; i < header.typeCount; i++) {
+        const mime_snapshot_type& type = fTypes[i];
+        if (!validString(type.type, false) || !validString(type.shortDescription, true)
+            || !validString(type.longDescription, true) || !validString(type.preferredApp, true)
+            || !validString(type.snifferRule, true)
+            || !range_fits(type.firstExtension, type.extensionCount, header.referenceCount)
+            || !range_fits(type.firstAttribute, type.attributeCount, header.attributeCount)
+            || !range_fits(type.ruleOffset, type.ruleSize, header.rulesSize))
+            return B_BAD_DATA;
+
+        for (uint32 j = 0; j < type.extensionCount; j++) {
+            if (!validString(fReferences[type.firstExtension + j], false))
+                return B_BAD_DATA;
+        }
+    }
+
+    for (uint32 i = 0; i < header.extensionCount; i++) {
+        const mime_snapshot_extension& extension = fExtensions[i];
+        if (!validString(extension.extension, false)
+            || !range_fits(extension.firstType, extension.typeCount, header.referenceCount))
+            return B_BAD_DATA;
+
+        for (uint32 j = 0; j < extension.typeCount; j++) {
+            if (fReferences[extension.firstType + j] >= header.typeCount)
+                return B_BAD_DATA;
+        }
+    }
+
+    for (uint32 i = 0; i < header.attributeCount; i++) {
+        if (!validString(fAttributes[i].name, false)
+            || !validString(fAttributes[i].publicName, false))
+            return B_BAD_DATA;
+    }
+    return B_OK;
+}
+
+/*static*/ std::string
+MimeSnapshot::PathFor(const MimeDatabase& database)
+{
+    return database.SidecarPath(MIME_SNAPSHOT_NAME);
+}
+
+/*static*/ status_t
+MimeSnapshot::Build(MimeDatabase& database, const char* path)
+{
+    std::vector<std::string> typeNames;
+    status_t result = database.GetInstalledTypes(NULL, typeNames);
+    if (result != B_OK)
+        return result;
+
+    // sorted the way FindType() searches
+    std::sort(typeNames.begin(), typeNames.end(),
+        [](const std::string& a, const std::string& b) {
+            return strcasecmp(a.c_str(), b.c_str()) < 0;
+        });
+
+    std::string strings;
+    std::unordered_map<std::string, uint32> stringOffsets;
+    auto add_string = [&](std::string_view string) {
+        std::string key(string);
+        auto found = stringOffsets.find(key);
+        if (found != stringOffsets.end())
+            return found->second;
+        uint32 offset = (uint32)strings.size();
+        strings.append(key.c_str(), key.size() + 1);
+        stringOffsets[key] = offset;
+        return offset;
+    };
+
+    std::vector<mime_snapshot_type> types(typeNames.size());
+    std::vector<mime_snapshot_attribute> attributes;
+    std::vector<uint32> references;
+    std::string rules;
+    std::map<std::string, std::vector<uint32> > extensionTypes;
+
+    std::string data;
+    std::vector<std::string> extensions;
+    for (uint32 i = 0; i < typeNames.size(); i++) {
+        const char* name = typeNames[i].c_str();
+        mime_snapshot_type& type = types[i];
+        type.type = add_string(name);
+
+        uint32* stringFields[] = { &type.shortDescription, &type.longDescription,
+            &type.preferredApp, &type.snifferRule };
+        mime_field fields[] = { MIME_FIELD_SHORT_DESCRIPTION, MIME_FIELD_LONG_DESCRIPTION,
+            MIME_FIELD_PREFERRED_APP, MIME_FIELD_SNIFFER_RULE };
+        for (size_t j = 0; j < sizeof(fields) / sizeof(fields[0]); j++) {
+            *stringFields[j] = kNoString;
+            if (database.GetField(name, fields[j], data) == B_OK)
+                *stringFields[j] = add_string(data.c_str());
+        }
+
+        type.firstExtension = (uint32)references.size();
+        extensions.clear();
+        if (database.GetField(name, MIME_FIELD_EXTENSIONS, data) == B_OK)
+            ExtensionIndex::GetExtensions(FlatMessage(data.data(), data.size()), extensions);
+        for (const std::string& extension : extensions) {
+            references.push_back(add_string(extension));
+            extensionTypes[extension].push_back(i);
+        }
+        type.extensionCount = (uint32)extensions.size();
+
+        type.firstAttribute = (uint32)attributes.size();
+        if (database.GetField(name, MIME_FIELD_ATTR_INFO, data) == B_OK) {
+            FlatMessage attrInfo(data.data(), data.size());
+            FlatMessageField names = attrInfo.FindField("attr:name", B_STRING_TYPE);
+            FlatMessageField publicNames = attrInfo.FindField("attr:public_name");
+            FlatMessageField attrTypes = attrInfo.FindField("attr:type");
+            FlatMessageField widths = attrInfo.FindField("attr:width");
+            FlatMessageField alignments = attrInfo.FindField("attr:alignment");
+            FlatMessageField viewable = attrInfo.FindField("attr:viewable");
+            FlatMessageField editable = attrInfo.FindField("attr:editable");
+            FlatMessageField extra = attrInfo.FindField("attr:extra");
+            FlatMessageField searchable = attrInfo.FindField(ATTR_INDEX);
+
+            for (int32 j = 0; j < names.CountItems(); j++) {
+                mime_snapshot_attribute attribute;
+                attribute.name = add_string(names.StringAt(j));
+                attribute.publicName = add_string(publicNames.StringAt(j));
+                attribute.type = attrTypes.UInt32At(j, B_STRING_TYPE);
+                attribute.width = widths.Int32At(j, 0);
+                attribute.alignment = alignments.Int32At(j, 0);
+                attribute.flags = (viewable.BoolAt(j, true) ? SNAPSHOT_ATTR_VIEWABLE : 0)
+                    | (editable.BoolAt(j, false) ? SNAPSHOT_ATTR_EDITABLE : 0)
+                    | (extra.BoolAt(j, false) ? SNAPSHOT_ATTR_EXTRA : 0)
+                    | (searchable.BoolAt(j, false) ? SNAPSHOT_ATTR_SEARCHABLE : 0);
+                attributes.push_back(attribute);
+            }
+        }
+        type.attributeCount = (uint32)attributes.size() - type.firstAttribute;
+
+        // a rule that does not compile is kept as string only
+        type.ruleOffset = 0;
+        type.ruleSize = 0;
+        SnifferRule rule;
+        if (type.snifferRule != kNoString && rule.SetTo(strings.c_str() + type.snifferRule) == B_OK) {
+            rules.resize((rules.size() + 3) & ~(size_t)3, '\0');
+            type.ruleOffset = (uint32)rules.size();
+            rule.Flatten(rules);
+            type.ruleSize = (uint32)rules.size() - type.ruleOffset;
+        }
+    }
+
+    std::vector<mime_snapshot_extension> extensionEntries;
+    for (const auto& entry : extensionTypes) {
+        mime_snapshot_extension extension;
+        extension.extension = add_string(entry.first);
+        extension.firstType = (uint32)references.size();
+        extension.typeCount = (uint32)entry.second.size();
+        references.insert(references.end(), entry.second.begin(), entry.second.end());
+        extensionEntries.push_back(extension);
+    }
+
+    mime_snapshot_header header;
+    header.magic = MIME_SNAPSHOT_MAGIC;
+    header.version = MIME_SNAPSHOT_VERSION;
+    header.typeCount = (uint32)types.size();
+    header.typesOffset = sizeof(header);
+    header.extensionCount = (uint32)extensionEntries.size();
+    header.extensionsOffset = header.typesOffset + header.typeCount * sizeof(mime_snapshot_type);
+    header.attributeCount = (uint32)attributes.size();
+    header.attributesOffset = header.extensionsOffset
+        + header.extensionCount * sizeof(mime_snapshot_extension);
+    header.referenceCount = (uint32)references.size();
+    header.referencesOffset = header.attributesOffset
+        + header.attributeCount * sizeof(mime_snapshot_attribute);
+    header.rulesOffset = header.referencesOffset + header.referenceCount * sizeof(uint32);
+    header.rulesSize = (uint32)rules.size();
+    header.stringsOffset = header.rulesOffset + header.rulesSize;
+    header.stringsSize = (uint32)strings.size();
+
+    std::string file((const char*)&header, sizeof(header));
+    file.append((const char*)types.data(), types.size() * sizeof(mime_snapshot_type));
+    file.append((const char*)extensionEntries.data(),
+        extensionEntries.size() * sizeof(mime_snapshot_extension));
+    file.append((const char*)attributes.data(),
+        attributes.size() * sizeof(mime_snapshot_attribute));
+    file.append((const char*)references.data(), references.size() * sizeof(uint32));
+    file.append(rules);
+    file.append(strings);
+
+    return ReplaceFile(path, file.data(), file.size());
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _MIME_SNAPSHOT_H
+#define _MIME_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "MimeDatabase.h"
+#include "SnifferRule.h"
+
+#define MIME_SNAPSHOT_NAME "snapshot"
+
+struct mime_snapshot_header;
+struct mime_snapshot_type;
+struct mime_snapshot_extension;
+struct mime_snapshot_attribute;
+
+enum {
+    SNAPSHOT_ATTR_VIEWABLE      = 0x01,
+    SNAPSHOT_ATTR_EDITABLE      = 0x02,
+    SNAPSHOT_ATTR_EXTRA         = 0x04,
+    SNAPSHOT_ATTR_SEARCHABLE    = 0x08
+};
+
+// one entry of the META:ATTR_INFO of a type
+struct snapshot_attribute {
+    const char*     name;
+    const char*     publicName;
+    type_code       type;
+    int32           width;
+    int32           alignment;
+    uint32          flags;
+};
+
+// Read-only copy of all installed types in one file, built by Build() and
+// mapped by SetTo(). The file only holds offsets, so it is used in place:
+// after SetTo() validated it, no lookup reads the DB, allocates or makes a
+// system call (apart from the vectors of LookupExtension()). Types are
+// addressed by their index; strings point into the mapping and are valid
+// until Unset(). A snapshot is not updated, it has to be built again.
+class MimeSnapshot {
+public:
+                            MimeSnapshot();
+
+            status_t        SetTo(const char* path);
+            void            Unset();
+            status_t        InitCheck() const { return fStatus; }
+
+            int32           CountTypes() const;
+            // case insensitive, returns -1 if the type is not in the snapshot
+            int32           FindType(const char* type) const;
+
+            const char*     TypeAt(int32 index) const;
+            // for the string fields only, NULL if the field is not set
+            const char*     StringFieldAt(int32 index, mime_field field) const;
+
+            int32           CountExtensions(int32 index) const;
+            const char*     ExtensionAt(int32 index, int32 extension) const;
+
+            int32           CountAttributes(int32 index) const;
+            bool            GetAttributeAt(int32 index, int32 attribute,
+                                snapshot_attribute& info) const;
+
+            // the compiled rule, B_ENTRY_NOT_FOUND if the type has none
+            status_t        GetSnifferRuleAt(int32 index,
+                                SnifferRule& rule) const;
+
+            // the indices of the types claiming the extension
+            status_t        LookupExtension(const char* extension,
+                                std::vector<int32>& types) const;
+
+    static  std::string     PathFor(const MimeDatabase& database);
+    static  status_t        Build(MimeDatabase& database, const char* path);
+
+private:
+            const char*     _StringAt(uint32 offset) const;
+            status_t        _Validate() const;
+
+            MappedFile      fFile;
+            status_t        fStatus;
+            const mime_snapshot_header* fHeader;
+            const mime_snapshot_type* fTypes;
+            const mime_snapshot_extension* fExtensions;
+            const mime_snapshot_attribute* fAttributes;
+            const uint32*   fReferences;
+            const uint8*    fRules;
+            const char*     fStrings;
+};
+
+#endif // _MIME_SNAPSHOT_H
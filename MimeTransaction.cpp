@@ -0,0 +1,300 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "MimeTransaction.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <unordered_map>
+
+#include "Stats.h"
+#include "WorkerPool.h"
+
+MimeTransaction::MimeTransaction(MimeDatabase& database)
+    :
+    fDatabase(database)
+{
+}
+
+void
+MimeTransaction::Install(const char* type)
+{
+    fOperations.push_back({ OPERATION_INSTALL, type, MIME_FIELD_COUNT, NULL, 0 });
+}
+
+void
+MimeTransaction::SetField(const char* type, mime_field field, const void* data, size_t size)
+{
+    fOperations.push_back({ OPERATION_SET_FIELD, type, field, data, size });
+}
+
+void
+MimeTransaction::Delete(const char* type)
+{
+    fOperations.push_back({ OPERATION_DELETE, type, MIME_FIELD_COUNT, NULL, 0 });
+}
+
+status_t
+MimeTransaction::Commit(int32 jobs)
+{
+    STATS_TIMER(STATS_PHASE_COMMIT);
+    fJournal.clear();
+
+    status_t result;
+    if (jobs == 1) {
+        std::vector<size_t> operations(fOperations.size());
+        for (size_t i = 0; i < operations.size(); i++)
+            operations[i] = i;
+        result = _Apply(operations, fJournal);
+    } else
+        result = _ApplyParallel(jobs);
+
+    if (result != B_OK) {
+        fprintf(stderr, "rolling back %zu change(s)...\n", fJournal.size());
+        _Rollback();
+    }
+
+    fOperations.clear();
+    fJournal.clear();
+    return result;
+}
+
+// Applies the operations in order, until one fails.
+status_t
+MimeTransaction::_Apply(const std::vector<size_t>& operations,
+    std::vector<JournalEntry>& journal)
+{
+    status_t result = B_OK;
+    size_t index = 0;
+    while (index < operations.size() && result == B_OK) {
+        const Operation& operation = fOperations[operations[index]];
+        switch (operation.kind) {
+            case OPERATION_INSTALL:
+            {
+                index++;
+                if (fDatabase.IsInstalled(operation.type.c_str()))
+                    break;
+
+                // the DB creates a missing supertype along with the subtype;
+                // install it here, so the rollback removes it as well
+                size_t slash = operation.type.find('/');
+                if (slash != std::string::npos) {
+                    std::string supertype = operation.type.substr(0, slash);
+                    if (!fDatabase.IsInstalled(supertype.c_str())) {
+                        result = fDatabase.Install(supertype.c_str());
+                        if (result != B_OK)
+                            break;
+                        journal.push_back({ OPERATION_INSTALL, supertype, MIME_FIELD_COUNT,
+                            false, std::string(), {} });
+                    }
+                }
+
+                result = fDatabase.Install(operation.type.c_str());
+                if (result == B_OK) {
+                    journal.push_back({ OPERATION_INSTALL, operation.type, MIME_FIELD_COUNT,
+                        false, std::string(), {} });
+                }
+                break;
+            }
+
+            case OPERATION_SET_FIELD:
+            {
+                // consecutive writes to the same type go to the DB in one call
+                size_t end = index + 1;
+                while (end < operations.size()
+                    && fOperations[operations[end]].kind == OPERATION_SET_FIELD
+                    && fOperations[operations[end]].type == operation.type)
+                    end++;
+                result = _ApplyFields(operations, index, end, journal);
+                index = end;
+                break;
+            }
+
+            case OPERATION_DELETE:
+                index++;
+                result = _ApplyDelete(operation, journal);
+                break;
+        }
+
+        if (result != B_OK) {
+            fprintf(stderr, "error committing changes to MIME type %s: %s\n",
+                operation.type.c_str(), strerror(result));
+        }
+    }
+    return result;
+}
+
+// Types don't share state in the DB, except that a subtype needs its
+// supertype, and a supertype can only be deleted without subtypes. So the
+// supertypes are installed and written first, then all subtypes, then the
+// supertypes are deleted; within each stage, every type has one worker that
+// applies its operations in order. The journals are kept per type and
+// appended stage by stage, so the rollback still undoes the stages backwards.
+status_t
+MimeTransaction::_ApplyParallel(int32 jobs)
+{
+    struct type_group {
+        int32               stage;
+        std::vector<size_t> operations;
+    };
+    std::vector<type_group> groups;
+    std::unordered_map<std::string, size_t> groupIndices;
+    auto groupFor = [&](const std::string& type) -> type_group& {
+        std::string key(type);
+        std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+        auto found = groupIndices.find(key);
+        if (found != groupIndices.end())
+            return groups[found->second];
+        groupIndices[key] = groups.size();
+        groups.push_back({ type.find('/') == std::string::npos ? 0 : 1, {} });
+        return groups.back();
+    };
+
+    // the supertypes of new subtypes are installed up front, not by each
+    // worker on its own
+    std::set<std::string> supertypes;
+    for (const Operation& operation : fOperations) {
+        size_t slash = operation.type.find('/');
+        if (operation.kind == OPERATION_INSTALL && slash != std::string::npos)
+            supertypes.insert(operation.type.substr(0, slash));
+    }
+    for (const std::string& supertype : supertypes)
+        Install(supertype.c_str());
+
+    for (size_t i = 0; i < fOperations.size(); i++) {
+        type_group& group = groupFor(fOperations[i].type);
+        group.operations.push_back(i);
+        if (fOperations[i].kind == OPERATION_DELETE && group.stage == 0)
+            group.stage = 2;
+    }
+
+    std::vector<std::vector<JournalEntry>> journals(groups.size());
+    std::vector<status_t> results(groups.size(), B_OK);
+    WorkerPool pool(jobs);
+    status_t result = B_OK;
+    for (int32 stage = 0; stage < 3 && result == B_OK; stage++) {
+        std::vector<size_t> staged;
+        for (size_t i = 0; i < groups.size(); i++) {
+            if (groups[i].stage == stage)
+                staged.push_back(i);
+        }
+
+        std::atomic<bool> failed(false);
+        pool.ForEach((int32)staged.size(), [&](int32 index) {
+            if (failed)
+                return;
+            size_t group = staged[index];
+            results[group] = _Apply(groups[group].operations, journals[group]);
+            if (results[group] != B_OK)
+                failed = true;
+        });
+
+        for (size_t group : staged) {
+            fJournal.insert(fJournal.end(), journals[group].begin(), journals[group].end());
+            if (result == B_OK)
+                result = results[group];
+        }
+    }
+    return result;
+}
+
+status_t
+MimeTransaction::_ApplyFields(const std::vector<size_t>& operations, size_t first, size_t end,
+    std::vector<JournalEntry>& journal)
+{
+    const char* type = fOperations[operations[first]].type.c_str();
+    std::vector<mime_field_value> values;
+    values.reserve(end - first);
+
+    for (size_t i = first; i < end; i++) {
+        const Operation& operation = fOperations[operations[i]];
+
+        JournalEntry entry;
+        status_t result = _Record(operation.type, operation.field, entry);
+        if (result != B_OK)
+            return result;
+        journal.push_back(entry);
+
+        values.push_back({ operation.field, operation.data, operation.size });
+    }
+
+    return fDatabase.SetFields(type, values.data(), (int32)values.size());
+}
+
+status_t
+MimeTransaction::_ApplyDelete(const Operation& operation, std::vector<JournalEntry>& journal)
+{
+    const char* type = operation.type.c_str();
+    if (!fDatabase.IsInstalled(type))
+        return B_OK;
+
+    JournalEntry entry = { OPERATION_DELETE, operation.type, MIME_FIELD_COUNT, false,
+        std::string(), {} };
+    for (int32 i = 0; i < MIME_FIELD_COUNT; i++) {
+        JournalEntry field;
+        status_t result = _Record(operation.type, (mime_field)i, field);
+        if (result != B_OK)
+            return result;
+        if (field.hadValue)
+            entry.fields.push_back(field);
+    }
+
+    status_t result = fDatabase.Delete(type);
+    if (result == B_OK)
+        journal.push_back(entry);
+    return result;
+}
+
+status_t
+MimeTransaction::_Record(const std::string& type, mime_field field, JournalEntry& entry)
+{
+    entry.kind = OPERATION_SET_FIELD;
+    entry.type = type;
+    entry.field = field;
+
+    status_t result = fDatabase.GetField(type.c_str(), field, entry.value);
+    entry.hadValue = result == B_OK;
+    if (result == B_ENTRY_NOT_FOUND)
+        result = B_OK;
+    return result;
+}
+
+void
+MimeTransaction::_Rollback()
+{
+    for (auto entry = fJournal.rbegin(); entry != fJournal.rend(); entry++) {
+        const char* type = entry->type.c_str();
+        status_t result = B_OK;
+        switch (entry->kind) {
+            case OPERATION_INSTALL:
+                result = fDatabase.Delete(type);
+                break;
+
+            case OPERATION_SET_FIELD:
+                result = fDatabase.SetField(type, entry->field,
+                    entry->hadValue ? entry->value.data() : NULL, entry->value.size());
+                break;
+
+            case OPERATION_DELETE:
+                result = fDatabase.Install(type);
+                for (size_t i = 0; i < entry->fields.size() && result == B_OK; i++) {
+                    const JournalEntry& field = entry->fields[i];
+                    result = fDatabase.SetField(type, field.field, field.value.data(),
+                        field.value.size());
+                }
+                break;
+        }
+
+        if (result != B_OK) {
+            fprintf(stderr, "error rolling back changes to MIME type %s: %s\n", type,
+                strerror(result));
+        }
+    }
+}
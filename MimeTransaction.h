@@ -0,0 +1,80 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _MIME_TRANSACTION_H
+#define _MIME_TRANSACTION_H
+
+#include "MimeDatabase.h"
+
+#include <string>
+#include <vector>
+
+// Stages MIME DB writes and applies them as one unit in Commit(). Before each
+// write, the previous state is recorded in a journal; if a write fails, the
+// journal is replayed backwards so the DB ends up as it was before Commit().
+// Staged field data is not copied and must stay valid until Commit().
+class MimeTransaction {
+public:
+                            MimeTransaction(MimeDatabase& database);
+
+            MimeDatabase&   Database() const { return fDatabase; }
+
+            void            Install(const char* type);
+            void            SetField(const char* type, mime_field field,
+                                const void* data, size_t size);
+            void            Delete(const char* type);
+
+            int32           CountOperations() const
+                                { return (int32)fOperations.size(); }
+            bool            IsEmpty() const { return fOperations.empty(); }
+
+            // On failure, the error is printed and the DB rolled back. With
+            // more than one job (0 for one per CPU), different types are
+            // written in parallel; the operations of each type stay in order.
+            status_t        Commit(int32 jobs = 1);
+
+private:
+            enum operation_kind {
+                OPERATION_INSTALL,
+                OPERATION_SET_FIELD,
+                OPERATION_DELETE
+            };
+
+            struct Operation {
+                operation_kind  kind;
+                std::string     type;
+                mime_field      field;
+                const void*     data;
+                size_t          size;
+            };
+
+            // undo information for one applied change
+            struct JournalEntry {
+                operation_kind  kind;
+                std::string     type;
+                mime_field      field;
+                bool            hadValue;
+                std::string     value;
+                // for deleted types, all fields they had
+                std::vector<JournalEntry> fields;
+            };
+
+            status_t        _Apply(const std::vector<size_t>& operations,
+                                std::vector<JournalEntry>& journal);
+            status_t        _ApplyParallel(int32 jobs);
+            status_t        _ApplyFields(const std::vector<size_t>& operations,
+                                size_t first, size_t end,
+                                std::vector<JournalEntry>& journal);
+            status_t        _ApplyDelete(const Operation& operation,
+                                std::vector<JournalEntry>& journal);
+            status_t        _Record(const std::string& type, mime_field field,
+                                JournalEntry& entry);
+            void            _Rollback();
+
+            MimeDatabase&   fDatabase;
+            std::vector<Operation> fOperations;
+            std::vector<JournalEntry> fJournal;
+};
+
+#endif // _MIME_TRANSACTION_H
@@ -0,0 +1,287 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "MimeTypeBundle.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BufferedWriter.h"
+#include "SnifferRule.h"
+#include "Stats.h"
+
+static status_t
+set_error(MimeTypeBundle& bundle, status_t status, const char* format, ...)
+{
+    char buffer[B_PATH_NAME_LENGTH + 256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    bundle.error = buffer;
+    return bundle.status = status;
+}
+
+static bool
+field_differs(const MimeTypeBundle& bundle, mime_field field, const std::string& current)
+{
+    switch (field) {
+        case MIME_FIELD_EXTENSIONS:
+        {
+            // the DB may add other fields (like "type"), only the list matters
+            FlatMessage message(current.data(), current.size());
+            return !bundle.extensions.FindField("extensions").HasSameData(
+                message.FindField("extensions"));
+        }
+        case MIME_FIELD_ATTR_INFO:
+        {
+            FlatMessage message(current.data(), current.size());
+            return !bundle.attrInfo.HasSameData(message);
+        }
+        default:
+            return current.size() != bundle.fieldSizes[field]
+                || memcmp(current.data(), bundle.fields[field], current.size()) != 0;
+    }
+}
+
+MimeTypeChanges::MimeTypeChanges()
+    :
+    install(false),
+    fields(0)
+{
+}
+
+std::string
+MimeTypeChanges::Describe() const
+{
+    if (install)
+        return "installed";
+    if (fields == 0)
+        return "unchanged";
+
+    std::string description = "updated(";
+    bool first = true;
+    for (int32 i = 0; i < MIME_FIELD_COUNT; i++) {
+        if ((fields & (1 << i)) == 0)
+            continue;
+        if (!first)
+            description += ",";
+        description += kMimeFields[i].name;
+        first = false;
+    }
+    return description + ")";
+}
+
+MimeTypeBundle::MimeTypeBundle()
+    :
+    status(B_NO_INIT),
+    type(NULL)
+{
+    for (int32 i = 0; i < MIME_FIELD_COUNT; i++) {
+        fields[i] = NULL;
+        fieldSizes[i] = 0;
+    }
+}
+
+status_t
+ParseMimeTypeBundle(const char* path, MimeTypeBundle& bundle)
+{
+    bundle.path = path;
+
+    status_t result;
+    {
+        STATS_TIMER(STATS_PHASE_LOAD_RESOURCES);
+        result = bundle.resources.SetTo(path);
+    }
+    if (result != B_OK) {
+        return set_error(bundle, result, "error initializing resources from path %s: %s",
+            path, strerror(result));
+    }
+
+    const ResourceFile& resources = bundle.resources;
+    STATS_ADD(STATS_BYTES_READ, resources.MappedSize());
+    STATS_ADD(STATS_RESOURCES_LOADED, resources.CountResources());
+
+    // get Type
+    bundle.type = resources.FindString(B_STRING_TYPE, MIME_TYPE_ATTR);
+    if (bundle.type == NULL)
+        return set_error(bundle, B_ERROR, "missing %s resource in %s", MIME_TYPE_ATTR, path);
+
+    for (int32 i = 0; i < MIME_FIELD_COUNT; i++) {
+        const mime_field_info& info = kMimeFields[i];
+        size_t size = 0;
+        const void* data;
+        if (info.attributeType == B_STRING_TYPE) {
+            data = resources.FindString(info.resourceType, info.attribute);
+            if (data != NULL)
+                size = strlen(reinterpret_cast<const char*>(data)) + 1;
+        } else
+            data = resources.FindResource(info.resourceType, info.attribute, &size);
+
+        if (data != NULL && size > 0) {
+            bundle.fields[i] = data;
+            bundle.fieldSizes[i] = size;
+        }
+    }
+
+    // short description is used as type name in prefs
+    if (bundle.fields[MIME_FIELD_SHORT_DESCRIPTION] == NULL) {
+        return set_error(bundle, B_ERROR, "missing %s resource in %s",
+            kMimeFields[MIME_FIELD_SHORT_DESCRIPTION].attribute, path);
+    }
+
+    STATS_TIMER(STATS_PHASE_DECODE);
+
+    // the registrar rejects invalid rules, check them for every backend
+    if (bundle.fields[MIME_FIELD_SNIFFER_RULE] != NULL) {
+        std::string parseError;
+        const char* rule = (const char*)bundle.fields[MIME_FIELD_SNIFFER_RULE];
+        if (SnifferRule::Check(rule, &parseError) != B_OK) {
+            return set_error(bundle, B_BAD_VALUE, "invalid sniffer rule '%s' in %s: %s", rule,
+                path, parseError.c_str());
+        }
+    }
+
+    if (bundle.fields[MIME_FIELD_EXTENSIONS] != NULL) {
+        bundle.extensions.SetTo(bundle.fields[MIME_FIELD_EXTENSIONS],
+            bundle.fieldSizes[MIME_FIELD_EXTENSIONS]);
+    }
+    if (bundle.fields[MIME_FIELD_ATTR_INFO] != NULL) {
+        bundle.attrInfo.SetTo(bundle.fields[MIME_FIELD_ATTR_INFO],
+            bundle.fieldSizes[MIME_FIELD_ATTR_INFO]);
+    }
+
+    return bundle.status = B_OK;
+}
+
+status_t
+DiffMimeTypeBundle(MimeDatabase& database, const MimeTypeBundle& bundle,
+    MimeTypeChanges& changes)
+{
+    changes = MimeTypeChanges();
+    if (bundle.status != B_OK)
+        return bundle.status;
+
+    STATS_TIMER(STATS_PHASE_DIFF);
+    changes.install = !database.IsInstalled(bundle.type);
+
+    std::string current;
+    for (int32 i = 0; i < MIME_FIELD_COUNT; i++) {
+        if (bundle.fields[i] == NULL)
+            continue;
+
+        // only write messages we could decode, like Unflatten() did before
+        if ((i == MIME_FIELD_EXTENSIONS && bundle.extensions.InitCheck() != B_OK)
+            || (i == MIME_FIELD_ATTR_INFO && bundle.attrInfo.InitCheck() != B_OK))
+            continue;
+
+        if (!changes.install) {
+            status_t result = database.GetField(bundle.type, (mime_field)i, current);
+            if (result == B_OK && !field_differs(bundle, (mime_field)i, current))
+                continue;
+            if (result != B_OK && result != B_ENTRY_NOT_FOUND)
+                return result;
+        }
+        changes.fields |= 1 << i;
+    }
+
+    return B_OK;
+}
+
+status_t
+StageMimeTypeBundle(MimeTransaction& transaction, const MimeTypeBundle& bundle,
+    MimeTypeChanges& changes)
+{
+    if (bundle.status != B_OK)
+        return bundle.status;
+
+    const char* mime = bundle.type;
+    if (!IsValidMimeType(mime)) {
+        fprintf(stderr, "error initializing MIME type %s from resource %s: %s\n", mime,
+            bundle.path.c_str(), strerror(B_BAD_VALUE));
+        return B_BAD_VALUE;
+    }
+
+    status_t result = DiffMimeTypeBundle(transaction.Database(), bundle, changes);
+    if (result != B_OK) {
+        fprintf(stderr, "error reading MIME type %s from MIME DB: %s\n", mime,
+            strerror(result));
+        return result;
+    }
+
+    // we need to install as first step, since all other MimeType operations act on the MIME DB directly:(
+    if (changes.install)
+        transaction.Install(mime);
+
+    for (int32 i = 0; i < MIME_FIELD_COUNT; i++) {
+        if ((changes.fields & (1 << i)) != 0)
+            transaction.SetField(mime, (mime_field)i, bundle.fields[i], bundle.fieldSizes[i]);
+    }
+
+    return B_OK;
+}
+
+void
+FinishMimeTypeBundle(const MimeTypeBundle& bundle, const MimeTypeChanges& changes)
+{
+    printf("MIME type %s: %s\n", bundle.type, changes.Describe().c_str());
+}
+
+status_t
+ApplyMimeTypeBundle(MimeDatabase& database, const MimeTypeBundle& bundle,
+    MimeTypeChanges* _changes)
+{
+    MimeTransaction transaction(database);
+    MimeTypeChanges changes;
+    status_t result = StageMimeTypeBundle(transaction, bundle, changes);
+    if (result == B_OK)
+        result = transaction.Commit();
+    if (result != B_OK)
+        return result;
+
+    FinishMimeTypeBundle(bundle, changes);
+    if (_changes != NULL)
+        *_changes = changes;
+    return B_OK;
+}
+
+status_t
+WriteMimeTypeBundle(MimeDatabase& database, const char* type, const char* path)
+{
+    ResourceWriter resources;
+    int32 id = 1;
+    resources.AddResource(B_STRING_TYPE, id++, MIME_TYPE_ATTR, type, strlen(type) + 1);
+
+    std::string data;
+    for (int32 i = 0; i < MIME_FIELD_COUNT; i++) {
+        const mime_field_info& info = kMimeFields[i];
+        status_t result = database.GetField(type, (mime_field)i, data);
+        if (result == B_ENTRY_NOT_FOUND) {
+            if (i == MIME_FIELD_SHORT_DESCRIPTION)
+                return B_NAME_NOT_FOUND;
+            continue;
+        }
+        if (result != B_OK)
+            return result;
+
+        // the reader only accepts NUL terminated strings
+        if (info.attributeType == B_STRING_TYPE && (data.empty() || data.back() != '\0'))
+            data += '\0';
+        resources.AddResource(info.resourceType, id++, info.attribute, data.data(),
+            data.size());
+    }
+
+    BufferedWriter writer;
+    status_t result = writer.SetTo(path);
+    if (result == B_OK)
+        resources.WriteTo(writer);
+    result = writer.Close();
+    if (result != B_OK)
+        unlink(path);
+    return result;
+}
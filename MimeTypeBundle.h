@@ -0,0 +1,67 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _MIME_TYPE_BUNDLE_H
+#define _MIME_TYPE_BUNDLE_H
+
+#include <string>
+
+#include "FlatMessage.h"
+#include "MimeDatabase.h"
+#include "MimeTransaction.h"
+#include "ResourceFile.h"
+
+// All META:* resources of one resource file, loaded and decoded but not yet
+// written to the MIME DB. Parsing a bundle touches no shared state, so many
+// bundles can be parsed in parallel; applying them must be serialized.
+struct MimeTypeBundle {
+                    MimeTypeBundle();
+
+    std::string     path;
+    status_t        status;
+    std::string     error;
+
+    ResourceFile    resources;
+
+    // these point into the resource file mapping, NULL if not present
+    const char*     type;
+    const void*     fields[MIME_FIELD_COUNT];
+    size_t          fieldSizes[MIME_FIELD_COUNT];
+
+    // flattened META:EXTENS and META:ATTR_INFO messages, decoded in place
+    FlatMessage     extensions;
+    FlatMessage     attrInfo;
+};
+
+// What applying a bundle changes in the MIME DB.
+struct MimeTypeChanges {
+                    MimeTypeChanges();
+
+    bool            install;
+    uint32          fields;     // (1 << mime_field) for every field to write
+
+    bool            IsEmpty() const { return !install && fields == 0; }
+    // "installed", "unchanged" or "updated(field,...)"
+    std::string     Describe() const;
+};
+
+status_t ParseMimeTypeBundle(const char* path, MimeTypeBundle& bundle);
+// reads the current state of the type once and compares it field by field
+status_t DiffMimeTypeBundle(MimeDatabase& database, const MimeTypeBundle& bundle,
+    MimeTypeChanges& changes);
+// diffs the bundle against the DB and stages the resulting writes
+status_t StageMimeTypeBundle(MimeTransaction& transaction, const MimeTypeBundle& bundle,
+    MimeTypeChanges& changes);
+// reports the changes after a successful commit; indices are left to the
+// IndexManager, so they can be created for all bundles at once
+void FinishMimeTypeBundle(const MimeTypeBundle& bundle, const MimeTypeChanges& changes);
+// stage, commit and finish a single bundle
+status_t ApplyMimeTypeBundle(MimeDatabase& database, const MimeTypeBundle& bundle,
+    MimeTypeChanges* _changes = NULL);
+// Writes the type and its fields as a resource file that ParseMimeTypeBundle()
+// reads back unchanged. Returns B_NAME_NOT_FOUND, and writes nothing, if the
+// type has no short description, as such a bundle could not be installed.
+status_t WriteMimeTypeBundle(MimeDatabase& database, const char* type, const char* path);
+
+#endif // _MIME_TYPE_BUNDLE_H
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "OutputFormat.h"
+
+#include <stdio.h>
+#include <string.h>
+
+status_t
+ParseOutputFormat(const char* name, output_format& format)
+{
+    if (strcmp(name, "tsv") == 0)
+        format = OUTPUT_FORMAT_TSV;
+    else if (strcmp(name, "json") == 0)
+        format = OUTPUT_FORMAT_JSON;
+    else
+        return B_BAD_VALUE;
+    return B_OK;
+}
+
+void
+AppendTsvField(std::string& output, std::string_view value)
+{
+    for (char c : value) {
+        switch (c) {
+            case '\t':  output += "\\t"; break;
+            case '\n':  output += "\\n"; break;
+            case '\r':  output += "\\r"; break;
+            case '\\':  output += "\\\\"; break;
+            default:    output += c; break;
+        }
+    }
+}
+
+void
+AppendJsonString(std::string& output, std::string_view value)
+{
+    output += '"';
+    for (char c : value) {
+        switch (c) {
+            case '"':   output += "\\\""; break;
+            case '\\':  output += "\\\\"; break;
+            case '\n':  output += "\\n"; break;
+            case '\r':  output += "\\r"; break;
+            case '\t':  output += "\\t"; break;
+            default:
+                if ((uint8)c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", (uint8)c);
+                    output += escaped;
+                } else
+                    output += c;
+                break;
+        }
+    }
+    output += '"';
+}
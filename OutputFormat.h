@@ -0,0 +1,28 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _OUTPUT_FORMAT_H
+#define _OUTPUT_FORMAT_H
+
+#include "Platform.h"
+
+#include <string>
+#include <string_view>
+
+// Machine readable output of the commands that report one record per line:
+// tab separated values, or JSON with one object per line (JSON Lines), so
+// both can be streamed and processed while the command is still running.
+enum output_format {
+    OUTPUT_FORMAT_TSV = 0,
+    OUTPUT_FORMAT_JSON
+};
+
+status_t ParseOutputFormat(const char* name, output_format& format);
+
+// escapes tabs, newlines and backslashes, so every record stays one line
+void AppendTsvField(std::string& output, std::string_view value);
+// appends the value as quoted JSON string
+void AppendJsonString(std::string& output, std::string_view value);
+
+#endif // _OUTPUT_FORMAT_H
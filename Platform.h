@@ -0,0 +1,97 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _PLATFORM_H
+#define _PLATFORM_H
+
+// Basic Haiku types and error codes for the parts of mime that also build
+// and run on other systems (e.g. Linux, for testing and benchmarking).
+
+#ifdef __HAIKU__
+
+#include <Errors.h>
+#include <Mime.h>
+#include <StorageDefs.h>
+#include <SupportDefs.h>
+#include <TypeConstants.h>
+
+#else
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef int8_t      int8;
+typedef uint8_t     uint8;
+typedef int16_t     int16;
+typedef uint16_t    uint16;
+typedef int32_t     int32;
+typedef uint32_t    uint32;
+typedef int64_t     int64;
+typedef uint64_t    uint64;
+
+typedef int32       status_t;
+typedef uint32      type_code;
+typedef int64       bigtime_t;
+
+#define B_PRId32    PRId32
+#define B_PRIu32    PRIu32
+#define B_PRIx32    PRIx32
+#define B_PRId64    PRId64
+#define B_PRIu64    PRIu64
+#define B_PRIuSIZE  "zu"
+
+// map to errno values, so strerror() keeps working on error codes
+enum {
+    B_OK                = 0,
+    B_ERROR             = -1,
+    B_NO_MEMORY         = ENOMEM,
+    B_BAD_VALUE         = EINVAL,
+    B_NO_INIT           = ENXIO,
+    B_ENTRY_NOT_FOUND   = ENOENT,
+    B_NAME_NOT_FOUND    = ENODATA,
+    B_NOT_SUPPORTED     = ENOTSUP,
+    B_BAD_DATA          = EBADMSG,
+    B_BAD_TYPE          = EPROTOTYPE,
+    B_IO_ERROR          = EIO,
+    B_FILE_EXISTS       = EEXIST,
+    B_NOT_A_DIRECTORY   = ENOTDIR,
+    B_BUSY              = EBUSY,
+    B_PERMISSION_DENIED = EACCES,
+    B_TIMED_OUT         = ETIMEDOUT,
+    B_INTERRUPTED       = EINTR,
+    B_BUFFER_OVERFLOW   = EOVERFLOW,
+    B_MISMATCHED_VALUES = EDOM
+};
+
+enum {
+    B_BOOL_TYPE         = 'BOOL',
+    B_DOUBLE_TYPE       = 'DBLE',
+    B_FLOAT_TYPE        = 'FLOT',
+    B_INT8_TYPE         = 'BYTE',
+    B_INT16_TYPE        = 'SHRT',
+    B_INT32_TYPE        = 'LONG',
+    B_INT64_TYPE        = 'LLNG',
+    B_MESSAGE_TYPE      = 'MSGG',
+    B_MIME_STRING_TYPE  = 'MIMS',
+    B_RAW_TYPE          = 'RAWT',
+    B_STRING_TYPE       = 'CSTR',
+    B_TIME_TYPE         = 'TIME',
+    B_UINT8_TYPE        = 'UBYT',
+    B_UINT16_TYPE       = 'USHT',
+    B_UINT32_TYPE       = 'ULNG',
+    B_UINT64_TYPE       = 'ULLG',
+    B_VECTOR_ICON_TYPE  = 'VICN'
+};
+
+#define B_PATH_NAME_LENGTH  1024
+#define B_FILE_NAME_LENGTH  256
+#define B_MIME_TYPE_LENGTH  (B_ATTR_NAME_LENGTH - 15)
+#define B_ATTR_NAME_LENGTH  256
+
+#endif // __HAIKU__
+
+#endif // _PLATFORM_H
@@ -0,0 +1,425 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Query.h"
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "FileAttributes.h"
+#include "IndexManager.h"
+#include "TypeIdentifier.h"
+
+static const char* const kWildcards = "*?[";
+
+static const struct {
+    const char*     name;
+    query_op        op;
+} kOperators[] = {
+    // two character operators first
+    { "==", QUERY_OP_EQUAL },
+    { "!=", QUERY_OP_NOT_EQUAL },
+    { "<=", QUERY_OP_LESS_EQUAL },
+    { ">=", QUERY_OP_GREATER_EQUAL },
+    { "<", QUERY_OP_LESS },
+    { ">", QUERY_OP_GREATER }
+};
+
+const char*
+query_op_name(query_op op)
+{
+    for (const auto& entry : kOperators) {
+        if (entry.op == op)
+            return entry.name;
+    }
+    return "?";
+}
+
+static void
+skip_spaces(const char*& text)
+{
+    while (isspace((unsigned char)*text))
+        text++;
+}
+
+static bool
+is_string_type(type_code type)
+{
+    return type == B_STRING_TYPE || type == B_MIME_STRING_TYPE;
+}
+
+// without terminating NUL, like MakeIndexKey() but not cut
+static std::string
+string_value(const std::string& data)
+{
+    return std::string(data.c_str(), strnlen(data.c_str(), data.size()));
+}
+
+// without estimates: equality narrows down the most, patterns only by their
+// prefix, and != not at all
+static int32
+op_rank(const query_term& term)
+{
+    if (term.op == QUERY_OP_NOT_EQUAL)
+        return 3;
+    if (term.pattern)
+        return 2;
+    return term.op == QUERY_OP_EQUAL ? 0 : 1;
+}
+
+Query::Query()
+{
+}
+
+status_t
+Query::SetTo(const char* mimeType, const FlatMessage& attrInfo, const char* predicate)
+{
+    fMimeType = mimeType;
+    fTerms.clear();
+    fError.clear();
+
+    const char* text = predicate;
+    skip_spaces(text);
+    while (*text != '\0') {
+        status_t result = _ParseTerm(attrInfo, text);
+        if (result != B_OK)
+            return result;
+
+        skip_spaces(text);
+        if (*text == '\0')
+            break;
+        if (strncmp(text, "&&", 2) != 0)
+            return _Fail("expected && before \"%s\"", text);
+        text += 2;
+        skip_spaces(text);
+        if (*text == '\0')
+            return _Fail("expected a term after &&");
+    }
+    return B_OK;
+}
+
+status_t
+Query::Plan(IndexVolume& volume)
+{
+    std::vector<index_entry> indices;
+    status_t result = volume.GetIndices(indices);
+    if (result != B_OK)
+        return result;
+
+    for (query_term& term : fTerms) {
+        term.indexed = false;
+        term.estimate = -1;
+        term.access = "no index";
+
+        auto index = std::find_if(indices.begin(), indices.end(),
+            [&term](const index_entry& entry) { return entry.name == term.attribute; });
+        if (index == indices.end())
+            continue;
+        if (index->type != term.type) {
+            term.access = "index of another type";
+            continue;
+        }
+        if (term.op == QUERY_OP_NOT_EQUAL) {
+            term.access = "index, not used for !=";
+            continue;
+        }
+        if (term.pattern && term.key.empty()) {
+            term.access = "index, not used for a leading wildcard";
+            continue;
+        }
+
+        int64 count;
+        status_t estimateResult = volume.EstimateRange(term.attribute.c_str(), _RangeFor(term),
+            count);
+        if (estimateResult == B_OK)
+            term.estimate = count;
+        else if (estimateResult == B_NO_INIT) {
+            term.access = "index, empty until index update";
+            continue;
+        } else if (estimateResult != B_NOT_SUPPORTED) {
+            term.access = "index, unreadable";
+            continue;
+        }
+        term.indexed = true;
+        term.access = "index";
+    }
+
+    std::stable_sort(fTerms.begin(), fTerms.end(),
+        [](const query_term& a, const query_term& b) {
+            if (a.indexed != b.indexed)
+                return a.indexed;
+            if (a.estimate >= 0 && b.estimate >= 0 && a.estimate != b.estimate)
+                return a.estimate < b.estimate;
+            return op_rank(a) < op_rank(b);
+        });
+    return B_OK;
+}
+
+std::string
+Query::Describe() const
+{
+    std::string description;
+    char line[64];
+    for (size_t i = 0; i < fTerms.size(); i++) {
+        const query_term& term = fTerms[i];
+        snprintf(line, sizeof(line), "%zu. ", i + 1);
+        description += line;
+        description += term.attribute + " " + query_op_name(term.op) + " " + term.value;
+        description += "  [";
+        description += term.access;
+        if (term.estimate >= 0) {
+            snprintf(line, sizeof(line), ", ~%" B_PRId64 " file(s)", term.estimate);
+            description += line;
+        }
+        if (i == 0 && term.indexed)
+            description += ", selects";
+        description += "]\n";
+    }
+    if (fTerms.empty() || !fTerms[0].indexed)
+        description += "no term selects from an index, all files are checked\n";
+    return description;
+}
+
+std::string
+Query::FsPredicate() const
+{
+    auto appendString = [](std::string& predicate, const std::string& value) {
+        predicate += '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\')
+                predicate += '\\';
+            predicate += c;
+        }
+        predicate += '"';
+    };
+
+    std::string predicate;
+    for (const query_term& term : fTerms) {
+        predicate += "(" + term.attribute + query_op_name(term.op);
+        if (is_string_type(term.type))
+            appendString(predicate, term.value);
+        else
+            predicate += term.value;
+        predicate += ")&&";
+    }
+    predicate += "(" FILE_TYPE_ATTR "==";
+    appendString(predicate, fMimeType);
+    predicate += ")";
+    return predicate;
+}
+
+status_t
+Query::Run(IndexVolume& volume, const path_callback& callback, int64& checked) const
+{
+    checked = 0;
+    status_t result = volume.RunQuery(FsPredicate().c_str(), callback);
+    if (result != B_NOT_SUPPORTED)
+        return result;
+
+    path_callback check = [&](const char* path) {
+        checked++;
+        return !Matches(path) || callback(path);
+    };
+    if (!fTerms.empty() && fTerms[0].indexed)
+        return volume.ReadRange(fTerms[0].attribute.c_str(), _RangeFor(fTerms[0]), check);
+    return volume.ReadFiles(check);
+}
+
+bool
+Query::Matches(const char* path) const
+{
+    std::string data;
+    if (ReadAttribute(path, FILE_TYPE_ATTR, data) != B_OK
+        || strcasecmp(string_value(data).c_str(), fMimeType.c_str()) != 0)
+        return false;
+
+    for (const query_term& term : fTerms) {
+        if (ReadAttribute(path, term.attribute.c_str(), data) != B_OK
+            || !_MatchesTerm(term, data))
+            return false;
+    }
+    return true;
+}
+
+status_t
+Query::_ParseTerm(const FlatMessage& attrInfo, const char*& text)
+{
+    query_term term;
+    term.indexed = false;
+    term.estimate = -1;
+    term.access = "not planned";
+
+    const char* start = text;
+    while (*text != '\0' && !isspace((unsigned char)*text) && strchr("=!<>", *text) == NULL)
+        text++;
+    term.attribute.assign(start, text - start);
+    if (term.attribute.empty())
+        return _Fail("expected an attribute name at \"%s\"", start);
+
+    skip_spaces(text);
+    bool found = false;
+    for (const auto& entry : kOperators) {
+        if (strncmp(text, entry.name, strlen(entry.name)) == 0) {
+            term.op = entry.op;
+            text += strlen(entry.name);
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        return _Fail("expected ==, !=, <, <=, > or >= after %s", term.attribute.c_str());
+    }
+
+    skip_spaces(text);
+    if (*text == '"' || *text == '\'') {
+        char quote = *text++;
+        while (*text != '\0' && *text != quote) {
+            if (*text == '\\' && text[1] != '\0')
+                text++;
+            term.value += *text++;
+        }
+        if (*text != quote)
+            return _Fail("unterminated string after %s", term.attribute.c_str());
+        text++;
+    } else {
+        while (*text != '\0' && !isspace((unsigned char)*text) && strncmp(text, "&&", 2) != 0)
+            term.value += *text++;
+        if (term.value.empty()) {
+            return _Fail("expected a value after %s %s", term.attribute.c_str(),
+                query_op_name(term.op));
+        }
+    }
+
+    // the attribute has to be one the type declares, values have its type
+    FlatMessageField names = attrInfo.FindField("attr:name");
+    FlatMessageField types = attrInfo.FindField("attr:type");
+    int32 index = -1;
+    std::string declared;
+    for (int32 i = 0; i < names.CountItems(); i++) {
+        std::string name(names.StringAt(i));
+        if (name == term.attribute)
+            index = i;
+        if (!declared.empty())
+            declared += ", ";
+        declared += name;
+    }
+    if (index < 0) {
+        if (declared.empty()) {
+            return _Fail("%s declares no attributes to query", fMimeType.c_str());
+        }
+        return _Fail("%s has no attribute %s, it has %s", fMimeType.c_str(),
+            term.attribute.c_str(), declared.c_str());
+    }
+
+    term.type = types.UInt32At(index, B_STRING_TYPE);
+    if (!IsIndexKeyType(term.type)) {
+        return _Fail("attribute %s of %s has type %s, which cannot be queried",
+            term.attribute.c_str(), fMimeType.c_str(), type_code_string(term.type).c_str());
+    }
+
+    size_t wildcard = term.value.find_first_of(kWildcards);
+    term.pattern = is_string_type(term.type) && wildcard != std::string::npos
+        && (term.op == QUERY_OP_EQUAL || term.op == QUERY_OP_NOT_EQUAL);
+    status_t result;
+    if (term.pattern) {
+        result = MakeIndexKey(term.type, term.value.data(), wildcard, term.key);
+    } else
+        result = ParseIndexKey(term.type, term.value.c_str(), term.key);
+    if (result != B_OK) {
+        return _Fail("\"%s\" is not a value of type %s, as attribute %s of %s needs",
+            term.value.c_str(), type_code_string(term.type).c_str(), term.attribute.c_str(),
+            fMimeType.c_str());
+    }
+
+    fTerms.push_back(term);
+    return B_OK;
+}
+
+status_t
+Query::_Fail(const char* format, ...)
+{
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    fError = buffer;
+    return B_BAD_VALUE;
+}
+
+bool
+Query::_MatchesTerm(const query_term& term, const std::string& data) const
+{
+    int compare;
+    if (is_string_type(term.type)) {
+        std::string value = string_value(data);
+        if (term.pattern) {
+            bool match = fnmatch(term.value.c_str(), value.c_str(), 0) == 0;
+            return term.op == QUERY_OP_EQUAL ? match : !match;
+        }
+        compare = CompareIndexKeys(value, term.value);
+    } else {
+        std::string key;
+        if (MakeIndexKey(term.type, data.data(), data.size(), key) != B_OK)
+            return false;
+        compare = CompareIndexKeys(key, term.key);
+    }
+
+    switch (term.op) {
+        case QUERY_OP_EQUAL:
+            return compare == 0;
+        case QUERY_OP_NOT_EQUAL:
+            return compare != 0;
+        case QUERY_OP_LESS:
+            return compare < 0;
+        case QUERY_OP_LESS_EQUAL:
+            return compare <= 0;
+        case QUERY_OP_GREATER:
+            return compare > 0;
+        case QUERY_OP_GREATER_EQUAL:
+            return compare >= 0;
+    }
+    return false;
+}
+
+// Index keys of strings are cut, so the range of a term may hold more files
+// than match, never less.
+/*static*/ index_range
+Query::_RangeFor(const query_term& term)
+{
+    index_range range;
+    switch (term.op) {
+        case QUERY_OP_EQUAL:
+            range.lower = term.key;
+            range.hasLower = true;
+            range.upper = term.key;
+            if (term.pattern) {
+                // anything starting with the prefix
+                range.upper.append(MAX_INDEX_KEY_LENGTH + 1 - term.key.size(), '\xff');
+            }
+            range.hasUpper = true;
+            break;
+        case QUERY_OP_LESS:
+        case QUERY_OP_LESS_EQUAL:
+            range.upper = term.key;
+            range.hasUpper = true;
+            break;
+        case QUERY_OP_GREATER:
+        case QUERY_OP_GREATER_EQUAL:
+            range.lower = term.key;
+            range.hasLower = true;
+            break;
+        case QUERY_OP_NOT_EQUAL:
+            break;
+    }
+    return range;
+}
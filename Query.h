@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _QUERY_H
+#define _QUERY_H
+
+#include <string>
+#include <vector>
+
+#include "FlatMessage.h"
+#include "IndexVolume.h"
+
+enum query_op {
+    QUERY_OP_EQUAL = 0,
+    QUERY_OP_NOT_EQUAL,
+    QUERY_OP_LESS,
+    QUERY_OP_LESS_EQUAL,
+    QUERY_OP_GREATER,
+    QUERY_OP_GREATER_EQUAL
+};
+
+const char* query_op_name(query_op op);
+
+struct query_term {
+    std::string     attribute;
+    type_code       type;           // from META:ATTR_INFO
+    query_op        op;
+    std::string     value;          // as written
+    std::string     key;            // of the value, for a pattern its prefix
+    bool            pattern;        // a string with wildcards, for == and !=
+
+    // set by Plan()
+    bool            indexed;        // can select files from an index
+    int64           estimate;       // files in the index range, -1 unknown
+    const char*     access;         // why it is, or is not, indexed
+};
+
+// Files of one MIME type whose attributes match a predicate, like a BFS
+// query: terms "<attribute> <op> <value>" joined by "&&", where op is one of
+// == != < <= > >=, and a string value may be quoted and use the wildcards
+// * ? and [...] with == and !=. A file without one of the attributes never
+// matches.
+class Query {
+public:
+                            Query();
+
+            // Checks the predicate against the attributes the type declares
+            // in its META:ATTR_INFO; Error() says what is wrong with it.
+            status_t        SetTo(const char* mimeType,
+                                const FlatMessage& attrInfo,
+                                const char* predicate);
+            const std::string& Error() const { return fError; }
+
+            const char*     MimeType() const { return fMimeType.c_str(); }
+            int32           CountTerms() const
+                                { return (int32)fTerms.size(); }
+            const query_term& TermAt(int32 index) const
+                                { return fTerms[index]; }
+
+            // Orders the terms most selective first, for the indices of the
+            // volume: by the files an index holds for the term where the
+            // volume can tell, else equality before ranges before the rest.
+            // Terms without an index come last.
+            status_t        Plan(IndexVolume& volume);
+            // one line per term, and how files are selected
+            std::string     Describe() const;
+
+            // the query in BFS syntax, restricted to the type
+            std::string     FsPredicate() const;
+
+            // Calls back with every file that matches; where the volume
+            // can't run the query itself, the files of the first term's index
+            // range, or all files, are checked by reading their attributes.
+            status_t        Run(IndexVolume& volume,
+                                const path_callback& callback,
+                                int64& checked) const;
+            bool            Matches(const char* path) const;
+
+private:
+            status_t        _ParseTerm(const FlatMessage& attrInfo,
+                                const char*& predicate);
+            status_t        _Fail(const char* format, ...);
+            bool            _MatchesTerm(const query_term& term,
+                                const std::string& data) const;
+
+    static  index_range     _RangeFor(const query_term& term);
+
+            std::string     fMimeType;
+            std::vector<query_term> fTerms;
+            std::string     fError;
+};
+
+#endif // _QUERY_H
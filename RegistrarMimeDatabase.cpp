@@ -0,0 +1,214 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifdef __HAIKU__
+
+#include "RegistrarMimeDatabase.h"
+
+#include <FindDirectory.h>
+#include <Message.h>
+#include <MimeType.h>
+#include <string.h>
+
+#include "Stats.h"
+
+static status_t
+get_message_field(const BMessage& message, std::string& data)
+{
+    if (message.CountNames(B_ANY_TYPE) == 0)
+        return B_ENTRY_NOT_FOUND;
+
+    ssize_t size = message.FlattenedSize();
+    if (size < 0)
+        return size;
+
+    data.resize(size);
+    return message.Flatten(&data[0], size);
+}
+
+static status_t
+get_installed_types(const BMessage& message, const char* field,
+    std::vector<std::string>& types)
+{
+    const char* type;
+    for (int32 i = 0; message.FindString(field, i, &type) == B_OK; i++)
+        types.push_back(type);
+    return B_OK;
+}
+
+const char*
+RegistrarMimeDatabase::Name() const
+{
+    return "registrar";
+}
+
+// where the registrar keeps the user MIME DB
+std::string
+RegistrarMimeDatabase::Location() const
+{
+    char path[B_PATH_NAME_LENGTH];
+    if (find_directory(B_USER_SETTINGS_DIRECTORY, -1, false, path, sizeof(path)) != B_OK)
+        return "/boot/home/config/settings/mime_db";
+    return std::string(path) + "/mime_db";
+}
+
+bool
+RegistrarMimeDatabase::IsInstalled(const char* type)
+{
+    BMimeType mimeType(type);
+    return mimeType.IsValid() && mimeType.IsInstalled();
+}
+
+status_t
+RegistrarMimeDatabase::Install(const char* type)
+{
+    BMimeType mimeType(type);
+    status_t result = mimeType.InitCheck();
+    if (result != B_OK)
+        return result;
+    return mimeType.Install();
+}
+
+status_t
+RegistrarMimeDatabase::Delete(const char* type)
+{
+    BMimeType mimeType(type);
+    status_t result = mimeType.InitCheck();
+    if (result != B_OK)
+        return result;
+    return mimeType.Delete();
+}
+
+status_t
+RegistrarMimeDatabase::SetField(const char* type, mime_field field, const void* data,
+    size_t size)
+{
+    BMimeType mimeType(type);
+    status_t result = mimeType.InitCheck();
+    if (result != B_OK)
+        return result;
+
+    const char* string = reinterpret_cast<const char*>(data);
+    BMessage message;
+    if (data != NULL && kMimeFields[field].attributeType == B_MESSAGE_TYPE) {
+        result = message.Unflatten(string);
+        if (result != B_OK)
+            return result;
+    }
+    const BMessage* messageOrNull = data != NULL ? &message : NULL;
+
+    STATS_ADD(STATS_DB_WRITES, 1);
+    if (data != NULL)
+        STATS_ADD(STATS_BYTES_WRITTEN, size);
+
+    switch (field) {
+        case MIME_FIELD_SHORT_DESCRIPTION:
+            return mimeType.SetShortDescription(string);
+        case MIME_FIELD_LONG_DESCRIPTION:
+            return mimeType.SetLongDescription(string);
+        case MIME_FIELD_PREFERRED_APP:
+            return mimeType.SetPreferredApp(string);
+        case MIME_FIELD_SNIFFER_RULE:
+            return mimeType.SetSnifferRule(string);
+        case MIME_FIELD_EXTENSIONS:
+            return mimeType.SetFileExtensions(messageOrNull);
+        case MIME_FIELD_ATTR_INFO:
+            return mimeType.SetAttrInfo(messageOrNull);
+        case MIME_FIELD_ICON:
+        {
+            STATS_TIMER(STATS_PHASE_ICONS);
+            if (data != NULL)
+                STATS_ADD(STATS_ICONS_WRITTEN, 1);
+            return mimeType.SetIcon(reinterpret_cast<const uint8*>(data), size);
+        }
+        default:
+            return B_BAD_VALUE;
+    }
+}
+
+status_t
+RegistrarMimeDatabase::GetField(const char* type, mime_field field, std::string& data)
+{
+    BMimeType mimeType(type);
+    status_t result = mimeType.InitCheck();
+    if (result != B_OK)
+        return result;
+
+    STATS_ADD(STATS_DB_READS, 1);
+    char buffer[B_MIME_TYPE_LENGTH];
+    BMessage message;
+    switch (field) {
+        case MIME_FIELD_SHORT_DESCRIPTION:
+            result = mimeType.GetShortDescription(buffer);
+            break;
+        case MIME_FIELD_LONG_DESCRIPTION:
+            result = mimeType.GetLongDescription(buffer);
+            break;
+        case MIME_FIELD_PREFERRED_APP:
+            result = mimeType.GetPreferredApp(buffer);
+            break;
+        case MIME_FIELD_SNIFFER_RULE:
+        {
+            BString rule;
+            result = mimeType.GetSnifferRule(&rule);
+            if (result == B_OK)
+                data.assign(rule.String(), rule.Length() + 1);
+            return result;
+        }
+        case MIME_FIELD_EXTENSIONS:
+            result = mimeType.GetFileExtensions(&message);
+            return result == B_OK ? get_message_field(message, data) : result;
+        case MIME_FIELD_ATTR_INFO:
+            result = mimeType.GetAttrInfo(&message);
+            return result == B_OK ? get_message_field(message, data) : result;
+        case MIME_FIELD_ICON:
+        {
+            uint8* icon;
+            size_t size;
+            result = mimeType.GetIcon(&icon, &size);
+            if (result == B_OK) {
+                data.assign(reinterpret_cast<const char*>(icon), size);
+                delete[] icon;
+            }
+            return result;
+        }
+        default:
+            return B_BAD_VALUE;
+    }
+
+    if (result == B_OK)
+        data.assign(buffer, strlen(buffer) + 1);
+    return result;
+}
+
+status_t
+RegistrarMimeDatabase::GetInstalledSupertypes(std::vector<std::string>& supertypes)
+{
+    supertypes.clear();
+    BMessage message;
+    status_t result = BMimeType::GetInstalledSupertypes(&message);
+    if (result != B_OK)
+        return result;
+    return get_installed_types(message, "super_types", supertypes);
+}
+
+status_t
+RegistrarMimeDatabase::GetInstalledTypes(const char* supertype,
+    std::vector<std::string>& types)
+{
+    STATS_TIMER(STATS_PHASE_LIST_TYPES);
+    types.clear();
+    BMessage message;
+    status_t result = supertype != NULL
+        ? BMimeType::GetInstalledTypes(supertype, &message)
+        : BMimeType::GetInstalledTypes(&message);
+    if (result != B_OK)
+        return result;
+    result = get_installed_types(message, "types", types);
+    STATS_ADD(STATS_TYPES_LISTED, types.size());
+    return result;
+}
+
+#endif // __HAIKU__
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _REGISTRAR_MIME_DATABASE_H
+#define _REGISTRAR_MIME_DATABASE_H
+
+#include "MimeDatabase.h"
+
+// The system MIME DB, accessed through BMimeType and the registrar.
+class RegistrarMimeDatabase : public MimeDatabase {
+public:
+    virtual const char*     Name() const;
+    virtual std::string     Location() const;
+
+    virtual bool            IsInstalled(const char* type);
+    virtual status_t        Install(const char* type);
+    virtual status_t        Delete(const char* type);
+
+    virtual status_t        SetField(const char* type, mime_field field,
+                                const void* data, size_t size);
+    virtual status_t        GetField(const char* type, mime_field field,
+                                std::string& data);
+
+    virtual status_t        GetInstalledSupertypes(
+                                std::vector<std::string>& supertypes);
+    virtual status_t        GetInstalledTypes(const char* supertype,
+                                std::vector<std::string>& types);
+};
+
+#endif // _REGISTRAR_MIME_DATABASE_H
@@ -0,0 +1,467 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "ResourceFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "BufferedWriter.h"
+#include "MappedFile.h"
+
+// on-disk layout of Haiku resources, see ResourcesDefs.h in the Haiku sources
+static const uint32 kResourcesHeaderMagic = 0x444f1000;
+static const size_t kResourcesHeaderSize = 68;
+static const size_t kIndexSectionHeaderSize = 132;
+static const size_t kIndexEntrySize = 12;
+static const size_t kInfoTableEndSize = 8;
+static const uint32 kInfoSeparator = 0xffffffff;
+static const size_t kELFMinResourceAlignment = 32;
+static const size_t kIndexSectionAlignment = 0x600;
+static const size_t kUnknownSectionSize = 1536;
+
+static inline uint16
+read_uint16(const uint8* data, bool swapped)
+{
+    uint16 value;
+    memcpy(&value, data, sizeof(value));
+    return swapped ? __builtin_bswap16(value) : value;
+}
+
+static inline uint32
+read_uint32(const uint8* data, bool swapped)
+{
+    uint32 value;
+    memcpy(&value, data, sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+static inline uint64
+read_uint64(const uint8* data, bool swapped)
+{
+    uint64 value;
+    memcpy(&value, data, sizeof(value));
+    return swapped ? __builtin_bswap64(value) : value;
+}
+
+static inline bool
+compare_entries(const ResourceEntry& a, type_code type, std::string_view name)
+{
+    if (a.type != type)
+        return a.type < type;
+    return a.name < name;
+}
+
+ResourceFile::ResourceFile()
+    :
+    fMapping(NULL),
+    fMappingSize(0),
+    fResourcesSize(0),
+    fResources(NULL),
+    fSwapped(false),
+    fStatus(B_NO_INIT)
+{
+}
+
+ResourceFile::~ResourceFile()
+{
+    Unset();
+}
+
+status_t
+ResourceFile::SetTo(const char* path)
+{
+    Unset();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return fStatus = errno;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return fStatus = B_BAD_DATA;
+    }
+
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return fStatus = errno;
+
+    fMapping = reinterpret_cast<uint8*>(mapping);
+    fMappingSize = st.st_size;
+
+    size_t offset = 0;
+    if (fMappingSize >= 4 && memcmp(fMapping, "\x7f" "ELF", 4) == 0) {
+        fStatus = _FindELFResources(&offset);
+        if (fStatus != B_OK)
+            return fStatus;
+    }
+
+    return fStatus = _ReadResources(offset);
+}
+
+void
+ResourceFile::Unset()
+{
+    if (fMapping != NULL)
+        munmap(fMapping, fMappingSize);
+
+    fMapping = NULL;
+    fMappingSize = 0;
+    fResources = NULL;
+    fResourcesSize = 0;
+    fSwapped = false;
+    fEntries.clear();
+    fStatus = B_NO_INIT;
+}
+
+const void*
+ResourceFile::FindResource(type_code type, const char* name, size_t* _size) const
+{
+    std::string_view key(name);
+    auto entry = std::lower_bound(fEntries.begin(), fEntries.end(), key,
+        [type](const ResourceEntry& a, std::string_view name) {
+            return compare_entries(a, type, name);
+        });
+    if (entry == fEntries.end() || entry->type != type || entry->name != key)
+        return NULL;
+
+    if (_size != NULL)
+        *_size = entry->size;
+    return entry->data;
+}
+
+const char*
+ResourceFile::FindString(type_code type, const char* name) const
+{
+    size_t size;
+    const char* data = reinterpret_cast<const char*>(FindResource(type, name, &size));
+    if (data == NULL || size == 0 || data[size - 1] != '\0')
+        return NULL;
+    return data;
+}
+
+// resources are appended to the ELF image, behind the last segment or section
+// and aligned to the largest segment alignment
+status_t
+ResourceFile::_FindELFResources(size_t* _offset) const
+{
+    const uint8* elf = fMapping;
+    if (fMappingSize < 6)
+        return B_BAD_DATA;
+    bool is64 = elf[4] == 2;
+    bool swapped = (elf[5] == 2) != (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+    size_t headerSize = is64 ? 64 : 52;
+    if (fMappingSize < headerSize)
+        return B_BAD_DATA;
+
+    uint64 programHeaderOffset, sectionHeaderOffset;
+    uint16 programHeaderSize, programHeaderCount, sectionHeaderSize, sectionHeaderCount;
+    if (is64) {
+        programHeaderOffset = read_uint64(elf + 32, swapped);
+        sectionHeaderOffset = read_uint64(elf + 40, swapped);
+        programHeaderSize = read_uint16(elf + 54, swapped);
+        programHeaderCount = read_uint16(elf + 56, swapped);
+        sectionHeaderSize = read_uint16(elf + 58, swapped);
+        sectionHeaderCount = read_uint16(elf + 60, swapped);
+    } else {
+        programHeaderOffset = read_uint32(elf + 28, swapped);
+        sectionHeaderOffset = read_uint32(elf + 32, swapped);
+        programHeaderSize = read_uint16(elf + 42, swapped);
+        programHeaderCount = read_uint16(elf + 44, swapped);
+        sectionHeaderSize = read_uint16(elf + 46, swapped);
+        sectionHeaderCount = read_uint16(elf + 48, swapped);
+    }
+
+    // the headers must at least hold the fields read below
+    if ((programHeaderCount > 0 && programHeaderSize < (is64 ? 56 : 32))
+        || (sectionHeaderCount > 0 && sectionHeaderSize < (is64 ? 64 : 40)))
+        return B_BAD_DATA;
+
+    uint64 programHeadersSize = (uint64)programHeaderSize * programHeaderCount;
+    uint64 sectionHeadersSize = (uint64)sectionHeaderSize * sectionHeaderCount;
+    if (!range_fits(programHeaderOffset, programHeadersSize, fMappingSize)
+        || !range_fits(sectionHeaderOffset, sectionHeadersSize, fMappingSize))
+        return B_BAD_DATA;
+    uint64 end = std::max<uint64>(headerSize, programHeaderOffset + programHeadersSize);
+    end = std::max<uint64>(end, sectionHeaderOffset + sectionHeadersSize);
+
+    uint64 alignment = kELFMinResourceAlignment;
+    for (uint16 i = 0; i < programHeaderCount; i++) {
+        const uint8* header = elf + programHeaderOffset + (uint64)i * programHeaderSize;
+        uint64 offset, fileSize, align;
+        if (is64) {
+            offset = read_uint64(header + 8, swapped);
+            fileSize = read_uint64(header + 32, swapped);
+            align = read_uint64(header + 48, swapped);
+        } else {
+            offset = read_uint32(header + 4, swapped);
+            fileSize = read_uint32(header + 16, swapped);
+            align = read_uint32(header + 28, swapped);
+        }
+        // a segment reaching past the file, or an alignment that is no power
+        // of two, would wrap the offsets computed from them
+        if (!range_fits(offset, fileSize, fMappingSize) || (align & (align - 1)) != 0
+            || align > fMappingSize)
+            return B_BAD_DATA;
+        end = std::max(end, offset + fileSize);
+        alignment = std::max(alignment, align);
+    }
+
+    for (uint16 i = 0; i < sectionHeaderCount; i++) {
+        const uint8* header = elf + sectionHeaderOffset + (uint64)i * sectionHeaderSize;
+        uint32 type = read_uint32(header + 4, swapped);
+        if (type == 8 /* SHT_NOBITS */)
+            continue;
+        uint64 offset, size;
+        if (is64) {
+            offset = read_uint64(header + 24, swapped);
+            size = read_uint64(header + 32, swapped);
+        } else {
+            offset = read_uint32(header + 16, swapped);
+            size = read_uint32(header + 20, swapped);
+        }
+        if (!range_fits(offset, size, fMappingSize))
+            return B_BAD_DATA;
+        end = std::max(end, offset + size);
+    }
+
+    // be lenient about the alignment the resource writer used
+    uint64 candidates[2] = {
+        (end + alignment - 1) / alignment * alignment,
+        (end + kELFMinResourceAlignment - 1) / kELFMinResourceAlignment * kELFMinResourceAlignment
+    };
+    for (uint64 offset : candidates) {
+        if (fMappingSize < kResourcesHeaderSize || offset > fMappingSize - kResourcesHeaderSize)
+            continue;
+        uint32 magic = read_uint32(fMapping + offset, false);
+        if (magic == kResourcesHeaderMagic || __builtin_bswap32(magic) == kResourcesHeaderMagic) {
+            *_offset = offset;
+            return B_OK;
+        }
+    }
+
+    return B_ENTRY_NOT_FOUND;
+}
+
+status_t
+ResourceFile::_ReadResources(size_t offset)
+{
+    fResources = fMapping + offset;
+    fResourcesSize = fMappingSize - offset;
+    if (fResourcesSize < kResourcesHeaderSize + kIndexSectionHeaderSize)
+        return B_BAD_DATA;
+
+    uint32 magic = read_uint32(fResources, false);
+    if (magic == kResourcesHeaderMagic)
+        fSwapped = false;
+    else if (__builtin_bswap32(magic) == kResourcesHeaderMagic)
+        fSwapped = true;
+    else
+        return B_BAD_DATA;
+
+    uint32 count = _ReadUInt32(4);
+    uint32 indexSectionOffset = _ReadUInt32(8);
+    uint64 indexOffset = (uint64)indexSectionOffset + kIndexSectionHeaderSize;
+    if (indexOffset + (uint64)count * kIndexEntrySize > fResourcesSize)
+        return B_BAD_DATA;
+
+    uint32 tableOffset = _ReadUInt32(indexSectionOffset + 120);
+    uint32 tableSize = _ReadUInt32(indexSectionOffset + 124);
+    if ((uint64)tableOffset + tableSize > fResourcesSize || tableSize < kInfoTableEndSize)
+        return B_BAD_DATA;
+
+    fEntries.reserve(count);
+
+    // the info table is a sequence of per type blocks: the type code, followed
+    // by the resource infos of that type and a separator
+    size_t position = tableOffset;
+    size_t tableEnd = tableOffset + tableSize - kInfoTableEndSize;
+    while (position + 4 <= tableEnd) {
+        type_code type = _ReadUInt32(position);
+        position += 4;
+
+        while (true) {
+            if (position + 8 > tableEnd)
+                return B_BAD_DATA;
+            if (_ReadUInt32(position) == kInfoSeparator
+                && _ReadUInt32(position + 4) == kInfoSeparator) {
+                position += 8;
+                break;
+            }
+            if (position + 10 > tableEnd)
+                return B_BAD_DATA;
+
+            int32 id = (int32)_ReadUInt32(position);
+            uint32 index = _ReadUInt32(position + 4);
+            uint16 nameSize = _ReadUInt16(position + 8);
+            position += 10;
+            if (position + nameSize > tableEnd || index < 1 || index > count)
+                return B_BAD_DATA;
+
+            const char* name = reinterpret_cast<const char*>(fResources + position);
+            position += nameSize;
+
+            size_t entryOffset = indexOffset + (index - 1) * kIndexEntrySize;
+            uint32 dataOffset = _ReadUInt32(entryOffset);
+            uint32 dataSize = _ReadUInt32(entryOffset + 4);
+            if ((uint64)dataOffset + dataSize > fResourcesSize)
+                return B_BAD_DATA;
+
+            ResourceEntry entry;
+            entry.type = type;
+            entry.id = id;
+            entry.name = std::string_view(name, strnlen(name, nameSize));
+            entry.data = fResources + dataOffset;
+            entry.size = dataSize;
+            fEntries.push_back(entry);
+        }
+    }
+
+    std::sort(fEntries.begin(), fEntries.end(),
+        [](const ResourceEntry& a, const ResourceEntry& b) {
+            return compare_entries(a, b.type, b.name);
+        });
+
+    return B_OK;
+}
+
+uint32
+ResourceFile::_ReadUInt32(size_t offset) const
+{
+    if (offset + 4 > fResourcesSize)
+        return 0;
+    return read_uint32(fResources + offset, fSwapped);
+}
+
+uint16
+ResourceFile::_ReadUInt16(size_t offset) const
+{
+    if (offset + 2 > fResourcesSize)
+        return 0;
+    return read_uint16(fResources + offset, fSwapped);
+}
+
+// #pragma mark - ResourceWriter
+
+// like the Haiku resource writer, summing up the bytes in big endian words
+static uint32
+info_table_checksum(const uint8* data, size_t size)
+{
+    uint32 checksum = 0;
+    for (size_t offset = 0; offset < size; offset += 4) {
+        uint32 word = 0;
+        for (size_t i = offset; i < offset + 4 && i < size; i++)
+            word = (word << 8) + data[i];
+        checksum += word;
+    }
+    return checksum;
+}
+
+static inline void
+append_uint32(std::string& data, uint32 value)
+{
+    data.append((const char*)&value, sizeof(value));
+}
+
+void
+ResourceWriter::AddResource(type_code type, int32 id, const char* name, const void* data,
+    size_t size)
+{
+    resource entry;
+    entry.type = type;
+    entry.id = id;
+    entry.name = name;
+    entry.data.assign((const char*)data, size);
+    fResources.push_back(std::move(entry));
+}
+
+// The file is written front to back in host byte order: the header, the
+// index section with the data offsets, an empty unknown section, the data
+// and the info table with the types, ids and names.
+status_t
+ResourceWriter::WriteTo(BufferedWriter& writer) const
+{
+    uint32 count = (uint32)fResources.size();
+    size_t indexSectionSize = kIndexSectionHeaderSize + count * kIndexEntrySize;
+    indexSectionSize = (indexSectionSize + kIndexSectionAlignment - 1)
+        / kIndexSectionAlignment * kIndexSectionAlignment;
+    size_t indexSectionOffset = kResourcesHeaderSize;
+    size_t unknownSectionOffset = indexSectionOffset + indexSectionSize;
+    size_t dataOffset = unknownSectionOffset + kUnknownSectionSize;
+
+    // the info table lists the resources grouped by type
+    std::vector<uint32> order(count);
+    for (uint32 i = 0; i < count; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](uint32 a, uint32 b) {
+        return fResources[a].type < fResources[b].type;
+    });
+
+    std::string infoTable;
+    for (uint32 i = 0; i < count; i++) {
+        const resource& entry = fResources[order[i]];
+        if (i == 0 || fResources[order[i - 1]].type != entry.type)
+            append_uint32(infoTable, entry.type);
+
+        uint16 nameSize = (uint16)std::min<size_t>(entry.name.size() + 1, UINT16_MAX);
+        append_uint32(infoTable, (uint32)entry.id);
+        append_uint32(infoTable, order[i] + 1);
+        infoTable.append((const char*)&nameSize, sizeof(nameSize));
+        infoTable.append(entry.name.c_str(), nameSize - 1);
+        infoTable += '\0';
+
+        if (i + 1 == count || fResources[order[i + 1]].type != entry.type) {
+            append_uint32(infoTable, kInfoSeparator);
+            append_uint32(infoTable, kInfoSeparator);
+        }
+    }
+    append_uint32(infoTable, info_table_checksum((const uint8*)infoTable.data(),
+        infoTable.size()));
+    append_uint32(infoTable, 0);
+
+    size_t dataSize = 0;
+    for (const resource& entry : fResources)
+        dataSize += entry.data.size();
+    size_t infoTableOffset = dataOffset + dataSize;
+    if (infoTableOffset + infoTable.size() > UINT32_MAX)
+        return B_BUFFER_OVERFLOW;
+
+    uint32 header[kResourcesHeaderSize / 4] = {};
+    header[0] = kResourcesHeaderMagic;
+    header[1] = count;
+    header[2] = (uint32)indexSectionOffset;
+    header[3] = (uint32)(indexSectionOffset + indexSectionSize);
+    writer.Write(header, sizeof(header));
+
+    uint32 indexHeader[kIndexSectionHeaderSize / 4] = {};
+    indexHeader[0] = (uint32)indexSectionOffset;
+    indexHeader[1] = (uint32)indexSectionSize;
+    indexHeader[3] = (uint32)unknownSectionOffset;
+    indexHeader[4] = (uint32)kUnknownSectionSize;
+    indexHeader[30] = (uint32)infoTableOffset;
+    indexHeader[31] = (uint32)infoTable.size();
+    writer.Write(indexHeader, sizeof(indexHeader));
+
+    size_t offset = dataOffset;
+    for (const resource& entry : fResources) {
+        uint32 indexEntry[3] = { (uint32)offset, (uint32)entry.data.size(), 0 };
+        writer.Write(indexEntry, sizeof(indexEntry));
+        offset += entry.data.size();
+    }
+    writer.WriteZeros(indexSectionSize - kIndexSectionHeaderSize - count * kIndexEntrySize
+        + kUnknownSectionSize);
+
+    for (const resource& entry : fResources)
+        writer.Write(entry.data.data(), entry.data.size());
+    return writer.Write(infoTable.data(), infoTable.size());
+}
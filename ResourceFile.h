@@ -0,0 +1,92 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _RESOURCE_FILE_H
+#define _RESOURCE_FILE_H
+
+#include "Platform.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+class BufferedWriter;
+
+struct ResourceEntry {
+    type_code           type;
+    int32               id;
+    std::string_view    name;
+    const void*         data;
+    size_t              size;
+};
+
+// Read-only view of the resources in a standalone resource file or an ELF
+// executable with attached resources. The file is memory mapped and the
+// resource table is indexed once in SetTo(); lookups return pointers into the
+// mapping, which stay valid until the ResourceFile is unset or destroyed.
+// Unlike BResources this works without libbe and does not copy data.
+class ResourceFile {
+public:
+                            ResourceFile();
+                            ~ResourceFile();
+
+            status_t        SetTo(const char* path);
+            void            Unset();
+            status_t        InitCheck() const { return fStatus; }
+
+            const void*     FindResource(type_code type, const char* name,
+                                size_t* _size) const;
+            // returns NULL unless the data is a NUL terminated string
+            const char*     FindString(type_code type, const char* name) const;
+
+            int32           CountResources() const
+                                { return (int32)fEntries.size(); }
+            const ResourceEntry& ResourceAt(int32 index) const
+                                { return fEntries[index]; }
+
+            const uint8*    MappedData() const { return fMapping; }
+            size_t          MappedSize() const { return fMappingSize; }
+
+private:
+                            ResourceFile(const ResourceFile&);
+            ResourceFile&   operator=(const ResourceFile&);
+
+            status_t        _FindELFResources(size_t* _offset) const;
+            status_t        _ReadResources(size_t offset);
+            uint32          _ReadUInt32(size_t offset) const;
+            uint16          _ReadUInt16(size_t offset) const;
+
+            uint8*          fMapping;
+            size_t          fMappingSize;
+            size_t          fResourcesSize;
+            const uint8*    fResources;
+            bool            fSwapped;
+            status_t        fStatus;
+            std::vector<ResourceEntry> fEntries;
+};
+
+// Builds a standalone resource file in the same format, for example to write
+// MIME types back into bundles ResourceFile can read. The data is copied.
+class ResourceWriter {
+public:
+            void            AddResource(type_code type, int32 id,
+                                const char* name, const void* data,
+                                size_t size);
+            int32           CountResources() const
+                                { return (int32)fResources.size(); }
+
+            status_t        WriteTo(BufferedWriter& writer) const;
+
+private:
+            struct resource {
+                type_code   type;
+                int32       id;
+                std::string name;
+                std::string data;
+            };
+
+            std::vector<resource> fResources;
+};
+
+#endif // _RESOURCE_FILE_H
@@ -0,0 +1,584 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "SharedMimeInfo.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "ExtensionIndex.h"
+#include "FlatMessage.h"
+#include "SnifferRule.h"
+
+typedef std::vector<std::vector<int32> > clause_list;
+
+// limits for converting nested magic, beyond them only the top level is used
+static const size_t kMaxExpressions = 32;
+static const size_t kMaxPatterns = 64;
+static const int32 kDefaultPriority = 50;
+static const int32 kMaxParentDepth = 16;
+
+static const char*
+find_attribute(const xml_attribute* attributes, int32 count, const char* name)
+{
+    for (int32 i = 0; i < count; i++) {
+        if (strcmp(attributes[i].name, name) == 0)
+            return attributes[i].value;
+    }
+    return NULL;
+}
+
+static std::string
+lower_case(std::string string)
+{
+    std::transform(string.begin(), string.end(), string.begin(), ::tolower);
+    return string;
+}
+
+static std::string
+trim(const std::string& string)
+{
+    size_t start = string.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos)
+        return std::string();
+    return string.substr(start, string.find_last_not_of(" \t\r\n") - start + 1);
+}
+
+static void
+append_hex(std::string& string, const std::string& bytes)
+{
+    static const char kDigits[] = "0123456789abcdef";
+    string += "0x";
+    for (size_t i = 0; i < bytes.size(); i++) {
+        string += kDigits[(uint8)bytes[i] >> 4];
+        string += kDigits[(uint8)bytes[i] & 0xf];
+    }
+}
+
+// string values use C escapes: \n, \xHH, \NNN (octal), \\ and so on
+static void
+unescape(const char* value, std::string& bytes)
+{
+    bytes.clear();
+    while (*value != '\0') {
+        if (*value != '\\' || value[1] == '\0') {
+            bytes += *value++;
+            continue;
+        }
+
+        value++;
+        if (*value == 'x' && isxdigit((uint8)value[1])) {
+            char hex[3] = { value[1], '\0', '\0' };
+            value += 2;
+            if (isxdigit((uint8)*value))
+                hex[1] = *value++;
+            bytes += (char)strtoul(hex, NULL, 16);
+        } else if (*value >= '0' && *value <= '7') {
+            uint32 c = 0;
+            for (int32 i = 0; i < 3 && *value >= '0' && *value <= '7'; i++)
+                c = c * 8 + (*value++ - '0');
+            bytes += (char)c;
+        } else {
+            switch (*value) {
+                case 'n':   bytes += '\n'; break;
+                case 'r':   bytes += '\r'; break;
+                case 't':   bytes += '\t'; break;
+                case 'a':   bytes += '\a'; break;
+                case 'b':   bytes += '\b'; break;
+                case 'f':   bytes += '\f'; break;
+                case 'v':   bytes += '\v'; break;
+                default:    bytes += *value; break;
+            }
+            value++;
+        }
+    }
+}
+
+// "0x" followed by pairs of hex digits
+static bool
+parse_hex(const char* value, std::string& bytes)
+{
+    bytes.clear();
+    if (value[0] != '0' || (value[1] != 'x' && value[1] != 'X'))
+        return false;
+    value += 2;
+
+    size_t length = strlen(value);
+    if (length == 0 || length % 2 != 0)
+        return false;
+    for (size_t i = 0; i < length; i += 2) {
+        if (!isxdigit((uint8)value[i]) || !isxdigit((uint8)value[i + 1]))
+            return false;
+        char hex[3] = { value[i], value[i + 1], '\0' };
+        bytes += (char)strtoul(hex, NULL, 16);
+    }
+    return true;
+}
+
+// Numbers are C literals (decimal, 0x hex or 0 octal), stored with the width
+// and byte order of the match type.
+static bool
+parse_number(const char* type, const char* value, std::string& bytes)
+{
+    size_t width;
+    bool bigEndian;
+    if (strcmp(type, "byte") == 0) {
+        width = 1;
+        bigEndian = true;
+    } else if (strcmp(type + strlen(type) - 2, "16") == 0) {
+        width = 2;
+    } else
+        width = 4;
+
+    if (width > 1) {
+        if (strncmp(type, "big", 3) == 0)
+            bigEndian = true;
+        else if (strncmp(type, "little", 6) == 0)
+            bigEndian = false;
+        else
+            bigEndian = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+    }
+
+    char* end;
+    long long number = strtoll(value, &end, 0);
+    if (end == value || *end != '\0')
+        return false;
+    uint64 bits = (uint64)number;
+    if (width < 8 && number >= 0 && (bits >> (width * 8)) != 0)
+        return false;
+
+    bytes.clear();
+    for (size_t i = 0; i < width; i++) {
+        size_t shift = bigEndian ? (width - 1 - i) * 8 : i * 8;
+        bytes += (char)((bits >> shift) & 0xff);
+    }
+    return true;
+}
+
+static bool
+is_number_type(const char* type)
+{
+    static const char* const kNumberTypes[] = {
+        "byte", "big16", "big32", "little16", "little32", "host16", "host32"
+    };
+    for (size_t i = 0; i < sizeof(kNumberTypes) / sizeof(kNumberTypes[0]); i++) {
+        if (strcmp(type, kNumberTypes[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Converts (m1 & (c11 | c12 ...)) | (m2 & ...) | ... into a conjunction of
+// disjunctions, the form of a sniffer rule, by distributing the OR.
+static bool
+or_to_cnf(const std::vector<int32>& alternatives,
+    const std::vector<std::vector<int32> >& children, clause_list& clauses)
+{
+    clauses.assign(1, std::vector<int32>());
+    for (int32 alternative : alternatives) {
+        clause_list alternativeClauses(1, std::vector<int32>(1, alternative));
+        if (!children[alternative].empty()) {
+            clause_list childClauses;
+            if (!or_to_cnf(children[alternative], children, childClauses))
+                return false;
+            alternativeClauses.insert(alternativeClauses.end(), childClauses.begin(),
+                childClauses.end());
+        }
+
+        clause_list product;
+        for (const std::vector<int32>& clause : clauses) {
+            for (const std::vector<int32>& alternativeClause : alternativeClauses) {
+                std::vector<int32> merged(clause);
+                merged.insert(merged.end(), alternativeClause.begin(),
+                    alternativeClause.end());
+                std::sort(merged.begin(), merged.end());
+                merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+                if (merged.size() > kMaxPatterns)
+                    return false;
+                product.push_back(merged);
+            }
+        }
+        std::sort(product.begin(), product.end());
+        product.erase(std::unique(product.begin(), product.end()), product.end());
+        if (product.size() > kMaxExpressions)
+            return false;
+        clauses.swap(product);
+    }
+    return true;
+}
+
+SharedMimeInfo::SharedMimeInfo()
+    :
+    fReader(*this),
+    fDepth(0),
+    fInType(false),
+    fInMagic(false),
+    fMagicPriority(kDefaultPriority),
+    fCapture(NULL),
+    fCaptureDepth(0),
+    fSkippedGlobs(0),
+    fSimplifiedRules(0)
+{
+}
+
+SharedMimeInfo::~SharedMimeInfo()
+{
+}
+
+status_t
+SharedMimeInfo::SetTo(const char* path)
+{
+    fPath = path;
+    fError.clear();
+    fTypes.clear();
+    fDepth = 0;
+    fInType = false;
+    fInMagic = false;
+    fCapture = NULL;
+    fSkippedGlobs = 0;
+    fSimplifiedRules = 0;
+
+    status_t result = fReader.Parse(path);
+    if (result != B_OK) {
+        // errors of the handler are set before the reader returns them
+        char line[32];
+        snprintf(line, sizeof(line), ":%" B_PRId32 ": ", fReader.Line());
+        fError = fPath + line + (fError.empty() ? fReader.Error() : fError);
+        fTypes.clear();
+        return result;
+    }
+
+    // priorities depend on the parents, which may come later in the file;
+    // types are case insensitive
+    type_index types;
+    for (int32 i = 0; i < CountTypes(); i++)
+        types.insert(std::make_pair(lower_case(fTypes[i].type), i));
+
+    for (int32 i = 0; i < CountTypes(); i++) {
+        mime_type& type = fTypes[i];
+        if (type.expressions.empty() || !type.error.empty())
+            continue;
+
+        char priority[16];
+        snprintf(priority, sizeof(priority), "%.2f ", _EffectivePriority(types, i, 0) / 100.0);
+        type.snifferRule = priority + type.expressions;
+
+        std::string parseError;
+        if (SnifferRule::Check(type.snifferRule.c_str(), &parseError) != B_OK) {
+            type.error = "converted magic '" + type.snifferRule + "' is invalid: "
+                + parseError;
+        }
+    }
+    return B_OK;
+}
+
+void
+SharedMimeInfo::GetBundle(int32 index, MimeTypeBundle& bundle) const
+{
+    const mime_type& type = fTypes[index];
+    bundle.path = type.source;
+    bundle.type = type.type.c_str();
+    if (!type.error.empty()) {
+        bundle.error = type.source + ": " + type.error;
+        bundle.status = B_BAD_VALUE;
+        return;
+    }
+
+    const std::string* fields[MIME_FIELD_COUNT] = {};
+    fields[MIME_FIELD_SHORT_DESCRIPTION] = &type.shortDescription;
+    fields[MIME_FIELD_LONG_DESCRIPTION] = &type.longDescription;
+    fields[MIME_FIELD_SNIFFER_RULE] = &type.snifferRule;
+    for (int32 i = 0; i < MIME_FIELD_COUNT; i++) {
+        // strings are stored with their terminating NUL, like in resources
+        if (fields[i] != NULL && !fields[i]->empty()) {
+            bundle.fields[i] = fields[i]->c_str();
+            bundle.fieldSizes[i] = fields[i]->size() + 1;
+        }
+    }
+
+    if (!type.flatExtensions.empty()) {
+        bundle.fields[MIME_FIELD_EXTENSIONS] = type.flatExtensions.data();
+        bundle.fieldSizes[MIME_FIELD_EXTENSIONS] = type.flatExtensions.size();
+        bundle.extensions.SetTo(type.flatExtensions.data(), type.flatExtensions.size());
+    }
+    bundle.status = B_OK;
+}
+
+status_t
+SharedMimeInfo::StartElement(const char* name, const xml_attribute* attributes, int32 count)
+{
+    fDepth++;
+    if (fDepth == 1) {
+        if (strcmp(name, "mime-info") != 0) {
+            fError = std::string("not a shared-mime-info file, root element is <") + name
+                + ">";
+            return B_BAD_DATA;
+        }
+        return B_OK;
+    }
+
+    if (fDepth == 2 && strcmp(name, "mime-type") == 0) {
+        const char* typeName = find_attribute(attributes, count, "type");
+        char line[32];
+        snprintf(line, sizeof(line), ":%" B_PRId32, fReader.Line());
+
+        fTypes.push_back(mime_type());
+        mime_type& type = fTypes.back();
+        type.type = typeName != NULL ? typeName : "";
+        type.source = fPath + line;
+        type.priority = -1;
+        if (typeName == NULL)
+            type.error = "<mime-type> without type";
+        fInType = true;
+        return B_OK;
+    }
+
+    if (!fInType)
+        return B_OK;
+    mime_type& type = fTypes.back();
+
+    if (fDepth == 3) {
+        // only the untranslated texts are used
+        bool translated = find_attribute(attributes, count, "xml:lang") != NULL;
+        if (strcmp(name, "comment") == 0 && !translated) {
+            fCapture = &type.shortDescription;
+        } else if (strcmp(name, "expanded-acronym") == 0 && !translated) {
+            fCapture = &type.longDescription;
+        } else if (strcmp(name, "glob") == 0) {
+            const char* pattern = find_attribute(attributes, count, "pattern");
+            if (pattern != NULL)
+                _AddGlob(pattern);
+        } else if (strcmp(name, "sub-class-of") == 0) {
+            const char* parent = find_attribute(attributes, count, "type");
+            if (parent != NULL)
+                type.parents.push_back(parent);
+        } else if (strcmp(name, "magic") == 0) {
+            const char* priority = find_attribute(attributes, count, "priority");
+            fMagicPriority = priority != NULL ? atoi(priority) : kDefaultPriority;
+            fMagicPriority = std::min(std::max(fMagicPriority, (int32)0), (int32)100);
+            fInMagic = true;
+            fOpenMatches.clear();
+        }
+        if (fCapture != NULL) {
+            fCapture->clear();
+            fCaptureDepth = fDepth;
+        }
+        return B_OK;
+    }
+
+    if (fInMagic && strcmp(name, "match") == 0)
+        return _AddMatch(attributes, count);
+    return B_OK;
+}
+
+status_t
+SharedMimeInfo::EndElement(const char* name)
+{
+    if (fCapture != NULL && fDepth == fCaptureDepth)
+        fCapture = NULL;
+
+    if (fInMagic && fDepth > 3 && strcmp(name, "match") == 0 && !fOpenMatches.empty()) {
+        fOpenMatches.pop_back();
+    } else if (fInMagic && fDepth == 3) {
+        fInMagic = false;
+    } else if (fInType && fDepth == 2) {
+        _FinishType(fTypes.back());
+        fInType = false;
+    }
+
+    fDepth--;
+    return B_OK;
+}
+
+status_t
+SharedMimeInfo::Characters(const char* text, size_t length)
+{
+    if (fCapture != NULL)
+        fCapture->append(text, length);
+    return B_OK;
+}
+
+status_t
+SharedMimeInfo::_AddMatch(const xml_attribute* attributes, int32 count)
+{
+    mime_type& type = fTypes.back();
+    const char* matchType = find_attribute(attributes, count, "type");
+    const char* value = find_attribute(attributes, count, "value");
+    const char* offset = find_attribute(attributes, count, "offset");
+    const char* mask = find_attribute(attributes, count, "mask");
+
+    magic_match match;
+    match.parent = fOpenMatches.empty() ? -1 : fOpenMatches.back();
+    match.rangeStart = 0;
+    match.rangeEnd = 0;
+    fOpenMatches.push_back((int32)fMatches.size());
+
+    std::string error;
+    if (matchType == NULL || value == NULL || offset == NULL)
+        error = "<match> needs type, value and offset";
+    else {
+        char* end;
+        match.rangeStart = strtoul(offset, &end, 10);
+        match.rangeEnd = match.rangeStart;
+        if (*end == ':')
+            match.rangeEnd = strtoul(end + 1, &end, 10);
+        if (end == offset || *end != '\0' || match.rangeEnd < match.rangeStart
+            || match.rangeEnd > INT32_MAX)
+            error = std::string("invalid offset ") + offset;
+    }
+
+    if (error.empty()) {
+        bool valid;
+        if (strcmp(matchType, "string") == 0) {
+            unescape(value, match.bytes);
+            valid = !match.bytes.empty() && (mask == NULL || parse_hex(mask, match.mask));
+        } else if (is_number_type(matchType)) {
+            valid = parse_number(matchType, value, match.bytes)
+                && (mask == NULL || parse_number(matchType, mask, match.mask));
+        } else {
+            // e.g. "regex" or types added after this was written
+            valid = false;
+        }
+
+        if (!valid) {
+            error = std::string("cannot convert ") + matchType + " match '" + value + "'"
+                + (mask != NULL ? std::string(" & ") + mask : std::string());
+        } else if (!match.mask.empty() && match.mask.size() != match.bytes.size()) {
+            error = std::string("mask length of ") + matchType + " match '" + value
+                + "' differs from its value";
+        } else if (match.mask.find_first_not_of('\xff') == std::string::npos) {
+            match.mask.clear();
+        }
+    }
+
+    // the type fails, but the rest of the file is still read
+    if (!error.empty() && type.error.empty())
+        type.error = error;
+
+    fMatches.push_back(match);
+    type.priority = std::max(type.priority, fMagicPriority);
+    return B_OK;
+}
+
+// Only "*.ext" patterns have a counterpart in the MIME DB.
+void
+SharedMimeInfo::_AddGlob(const char* pattern)
+{
+    mime_type& type = fTypes.back();
+    if (pattern[0] != '*' || pattern[1] != '.' || pattern[2] == '\0'
+        || strpbrk(pattern + 2, "*?[]\\/") != NULL) {
+        fSkippedGlobs++;
+        return;
+    }
+
+    // extensions are case insensitive, "*.foo" and "*.FOO" are the same
+    std::string extension = ExtensionIndex::NormalizeExtension(pattern + 2);
+    if (extension.empty()) {
+        fSkippedGlobs++;
+        return;
+    }
+    if (std::find(type.extensions.begin(), type.extensions.end(), extension)
+            == type.extensions.end())
+        type.extensions.push_back(extension);
+}
+
+// The matches of a magic form a tree: siblings are alternatives, a nested
+// match must match as well as the enclosing one. Sniffer rules are a list
+// of expressions that all have to match, each a list of alternative
+// patterns, so the tree is converted to this form. If that gets too large,
+// only the top level matches are used, which makes the rule less specific.
+void
+SharedMimeInfo::_ConvertMagic(mime_type& type)
+{
+    if (fMatches.empty())
+        return;
+
+    std::vector<std::vector<int32> > children(fMatches.size());
+    std::vector<int32> topLevel;
+    for (size_t i = 0; i < fMatches.size(); i++) {
+        if (fMatches[i].parent < 0)
+            topLevel.push_back((int32)i);
+        else
+            children[fMatches[i].parent].push_back((int32)i);
+    }
+
+    clause_list clauses;
+    if (!or_to_cnf(topLevel, children, clauses)) {
+        clauses.assign(1, topLevel);
+        fSimplifiedRules++;
+    }
+
+    std::string& expressions = type.expressions;
+    for (const std::vector<int32>& clause : clauses) {
+        if (!expressions.empty())
+            expressions += ' ';
+        expressions += '(';
+        for (size_t i = 0; i < clause.size(); i++) {
+            const magic_match& match = fMatches[clause[i]];
+            char range[32];
+            if (match.rangeStart == match.rangeEnd)
+                snprintf(range, sizeof(range), "[%" B_PRIu32 "] ", match.rangeStart);
+            else {
+                snprintf(range, sizeof(range), "[%" B_PRIu32 ":%" B_PRIu32 "] ",
+                    match.rangeStart, match.rangeEnd);
+            }
+
+            if (i > 0)
+                expressions += " | ";
+            expressions += range;
+            append_hex(expressions, match.bytes);
+            if (!match.mask.empty()) {
+                expressions += " & ";
+                append_hex(expressions, match.mask);
+            }
+        }
+        expressions += ')';
+    }
+}
+
+void
+SharedMimeInfo::_FinishType(mime_type& type)
+{
+    type.shortDescription = trim(type.shortDescription);
+    type.longDescription = trim(type.longDescription);
+    if (type.shortDescription.empty() && type.error.empty())
+        type.error = "no untranslated <comment> for the short description";
+
+    if (!type.extensions.empty()) {
+        FlatMessageWriter message;
+        for (const std::string& extension : type.extensions)
+            message.AddString("extensions", extension.c_str());
+        message.Flatten(type.flatExtensions);
+    }
+
+    if (type.error.empty())
+        _ConvertMagic(type);
+    fMatches.clear();
+}
+
+// A subclass is more specific than its parents, so its rule has to win where
+// both match: its priority is raised above theirs if needed. Parents without
+// a rule of their own pass on the priority of their ancestors.
+int32
+SharedMimeInfo::_EffectivePriority(const type_index& types, int32 index, int32 depth) const
+{
+    const mime_type& type = fTypes[index];
+    int32 parentPriority = -1;
+    for (size_t i = 0; i < type.parents.size() && depth < kMaxParentDepth; i++) {
+        type_index::const_iterator found = types.find(lower_case(type.parents[i]));
+        if (found != types.end() && found->second != index) {
+            parentPriority = std::max(parentPriority,
+                _EffectivePriority(types, found->second, depth + 1));
+        }
+    }
+
+    if (type.expressions.empty())
+        return parentPriority;
+    return std::min(std::max(type.priority, parentPriority + 1), (int32)100);
+}
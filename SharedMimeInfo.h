@@ -0,0 +1,110 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _SHARED_MIME_INFO_H
+#define _SHARED_MIME_INFO_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "MimeTypeBundle.h"
+#include "XmlReader.h"
+
+// Reads a freedesktop.org shared-mime-info XML file, like the upstream
+// freedesktop.org.xml, and converts its types to the fields of the MIME DB:
+//   comment (untranslated)     short description
+//   expanded-acronym           long description
+//   glob "*.ext"               extensions
+//   magic                      sniffer rule, see _ConvertMagic()
+//   sub-class-of               raises the sniffer rule priority above the
+//                              parent type's, which is what makes the more
+//                              specific type win in both systems
+// Other globs, aliases, icons and XML root elements have no counterpart and
+// are skipped. The file is parsed in a single streaming pass; only the
+// converted types are kept.
+class SharedMimeInfo : private XmlHandler {
+public:
+                            SharedMimeInfo();
+    virtual                 ~SharedMimeInfo();
+
+            status_t        SetTo(const char* path);
+            // "path:line: message" if SetTo() failed
+            const std::string& Error() const { return fError; }
+
+            int32           CountTypes() const
+                                { return (int32)fTypes.size(); }
+            // The bundle points into this object, and can be staged like one
+            // parsed from a resource file. Types that could not be converted
+            // are returned as failed bundles.
+            void            GetBundle(int32 index,
+                                MimeTypeBundle& bundle) const;
+
+            int32           CountSkippedGlobs() const
+                                { return fSkippedGlobs; }
+            // magic too complex for one rule, reduced to its top level
+            int32           CountSimplifiedRules() const
+                                { return fSimplifiedRules; }
+
+private:
+            // lower case type name to index
+            typedef std::map<std::string, int32> type_index;
+
+            struct magic_match {
+                uint32      rangeStart;
+                uint32      rangeEnd;
+                std::string bytes;
+                std::string mask;       // empty if all bits count
+                int32       parent;     // enclosing match, -1 at top level
+            };
+
+            struct mime_type {
+                std::string type;
+                std::string source;     // path:line
+                std::string error;
+                std::string shortDescription;
+                std::string longDescription;
+                std::vector<std::string> extensions;
+                std::string flatExtensions;
+                std::vector<std::string> parents;
+                // priority (0-100) and expressions of the sniffer rule
+                int32       priority;
+                std::string expressions;
+                std::string snifferRule;
+            };
+
+    virtual status_t        StartElement(const char* name,
+                                const xml_attribute* attributes,
+                                int32 count);
+    virtual status_t        EndElement(const char* name);
+    virtual status_t        Characters(const char* text, size_t length);
+
+            status_t        _AddMatch(const xml_attribute* attributes,
+                                int32 count);
+            void            _AddGlob(const char* pattern);
+            void            _ConvertMagic(mime_type& type);
+            void            _FinishType(mime_type& type);
+            int32           _EffectivePriority(const type_index& types,
+                                int32 index, int32 depth) const;
+
+            std::string     fPath;
+            std::string     fError;
+            XmlReader       fReader;
+            std::vector<mime_type> fTypes;
+
+            // parser state
+            int32           fDepth;
+            bool            fInType;
+            bool            fInMagic;
+            int32           fMagicPriority;
+            std::vector<magic_match> fMatches;
+            std::vector<int32> fOpenMatches;
+            std::string*    fCapture;   // text of the current element
+            int32           fCaptureDepth;
+
+            int32           fSkippedGlobs;
+            int32           fSimplifiedRules;
+};
+
+#endif // _SHARED_MIME_INFO_H
@@ -0,0 +1,654 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "SnifferRule.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static inline uint8
+fold_case(uint8 c)
+{
+    // sniffer rules only fold ASCII, like Haiku's sniffer
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+#ifdef __SSE2__
+static inline __m128i
+fold_case(__m128i bytes)
+{
+    // signed compares, bytes >= 0x80 are never in range
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('A' - 1)),
+        _mm_cmplt_epi8(bytes, _mm_set1_epi8('Z' + 1)));
+    return _mm_add_epi8(bytes, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+#endif
+
+static inline uint32
+padded_length(uint32 length)
+{
+    return (length + 15) & ~(uint32)15;
+}
+
+// The flattened rule: the header, the expressions, the patterns, and then
+// the pattern bytes and masks, all in host byte order.
+struct flat_rule_header {
+    float       priority;
+    uint32      expressionCount;
+    uint32      patternCount;
+    uint32      byteCount;          // of the bytes and of the masks each
+};
+
+struct flat_rule_expression {
+    uint32      firstPattern;
+    uint32      patternCount;
+    uint32      width;
+};
+
+struct flat_rule_pattern {
+    uint32      rangeStart;
+    uint32      rangeEnd;
+    uint32      offset;
+    uint32      length;
+    uint32      caseInsensitive;
+};
+
+// #pragma mark - Parser
+
+class SnifferRule::Parser {
+public:
+                            Parser(const char* rule, SnifferRule& target);
+
+            status_t        Parse();
+            const std::string& Error() const { return fError; }
+
+private:
+            void            _SkipSpace();
+            bool            _Accept(char c);
+            bool            _AtEnd() const { return *fPos == '\0'; }
+            status_t        _Error(const char* format, ...);
+
+            status_t        _ParsePriority();
+            status_t        _ParseExpression();
+            status_t        _ParseRange(uint32& start, uint32& end);
+            status_t        _ParseNumber(uint32& value);
+            status_t        _ParsePattern(uint32 rangeStart, uint32 rangeEnd);
+            status_t        _ParseString(std::string& string);
+            status_t        _ParseEscape(std::string& string);
+
+            const char*     fRule;
+            const char*     fPos;
+            SnifferRule&    fTarget;
+            std::string     fError;
+};
+
+SnifferRule::Parser::Parser(const char* rule, SnifferRule& target)
+    :
+    fRule(rule),
+    fPos(rule),
+    fTarget(target)
+{
+}
+
+status_t
+SnifferRule::Parser::Parse()
+{
+    _SkipSpace();
+    status_t result = _ParsePriority();
+    if (result != B_OK)
+        return result;
+
+    _SkipSpace();
+    if (_AtEnd())
+        return _Error("expected an expression");
+
+    while (!_AtEnd()) {
+        result = _ParseExpression();
+        if (result != B_OK)
+            return result;
+        _SkipSpace();
+    }
+    return B_OK;
+}
+
+void
+SnifferRule::Parser::_SkipSpace()
+{
+    while (isspace((uint8)*fPos))
+        fPos++;
+}
+
+bool
+SnifferRule::Parser::_Accept(char c)
+{
+    if (*fPos != c)
+        return false;
+    fPos++;
+    return true;
+}
+
+status_t
+SnifferRule::Parser::_Error(const char* format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    char position[32];
+    snprintf(position, sizeof(position), " at position %d", (int)(fPos - fRule));
+    fError = std::string(buffer) + position;
+    return B_BAD_VALUE;
+}
+
+status_t
+SnifferRule::Parser::_ParsePriority()
+{
+    if (!isdigit((uint8)*fPos) && *fPos != '.')
+        return _Error("expected a priority");
+
+    char* end;
+    double priority = strtod(fPos, &end);
+    if (end == fPos)
+        return _Error("expected a priority");
+    if (priority < 0.0 || priority > 1.0)
+        return _Error("priority %g is not within [0.0, 1.0]", priority);
+
+    fPos = end;
+    fTarget.fPriority = (float)priority;
+    return B_OK;
+}
+
+// Expression := [Range] "(" Pattern ("|" Pattern)* ")"
+// where the patterns may have their own range if the list has none.
+status_t
+SnifferRule::Parser::_ParseExpression()
+{
+    uint32 start = 0;
+    uint32 end = 0;
+    bool listRange = *fPos == '[';
+    if (listRange) {
+        status_t result = _ParseRange(start, end);
+        if (result != B_OK)
+            return result;
+        _SkipSpace();
+    }
+
+    if (!_Accept('('))
+        return _Error("expected '('");
+
+    expression expression;
+    expression.firstPattern = (uint32)fTarget.fPatterns.size();
+    expression.width = 0;
+
+    do {
+        _SkipSpace();
+        uint32 patternStart = start;
+        uint32 patternEnd = end;
+        if (*fPos == '[') {
+            if (listRange)
+                return _Error("pattern range within a ranged pattern list");
+            status_t result = _ParseRange(patternStart, patternEnd);
+            if (result != B_OK)
+                return result;
+            _SkipSpace();
+        }
+
+        status_t result = _ParsePattern(patternStart, patternEnd);
+        if (result != B_OK)
+            return result;
+
+        expression.width = std::max(expression.width, patternEnd - patternStart);
+        _SkipSpace();
+    } while (_Accept('|'));
+
+    if (!_Accept(')'))
+        return _Error("expected ')' or '|'");
+
+    expression.patternCount = (uint32)fTarget.fPatterns.size() - expression.firstPattern;
+    fTarget.fExpressions.push_back(expression);
+    return B_OK;
+}
+
+// Range := "[" Number [":" Number] "]"
+status_t
+SnifferRule::Parser::_ParseRange(uint32& start, uint32& end)
+{
+    _Accept('[');
+    _SkipSpace();
+    status_t result = _ParseNumber(start);
+    if (result != B_OK)
+        return result;
+
+    _SkipSpace();
+    end = start;
+    if (_Accept(':')) {
+        _SkipSpace();
+        result = _ParseNumber(end);
+        if (result != B_OK)
+            return result;
+        _SkipSpace();
+    }
+
+    if (!_Accept(']'))
+        return _Error("expected ']'");
+    if (end < start)
+        return _Error("range end %" B_PRIu32 " is before its start %" B_PRIu32, end, start);
+    return B_OK;
+}
+
+status_t
+SnifferRule::Parser::_ParseNumber(uint32& value)
+{
+    if (!isdigit((uint8)*fPos))
+        return _Error("expected a number");
+
+    uint64 number = 0;
+    while (isdigit((uint8)*fPos)) {
+        number = number * 10 + (*fPos++ - '0');
+        if (number > INT32_MAX)
+            return _Error("offset too large");
+    }
+    value = (uint32)number;
+    return B_OK;
+}
+
+// Pattern := ["-i"] String ["&" String]
+status_t
+SnifferRule::Parser::_ParsePattern(uint32 rangeStart, uint32 rangeEnd)
+{
+    bool caseInsensitive = false;
+    if (fPos[0] == '-' && fPos[1] == 'i'
+        && (isspace((uint8)fPos[2]) || fPos[2] == '"' || fPos[2] == '\'')) {
+        caseInsensitive = true;
+        fPos += 2;
+        _SkipSpace();
+    }
+
+    std::string bytes;
+    status_t result = _ParseString(bytes);
+    if (result != B_OK)
+        return result;
+    if (bytes.empty())
+        return _Error("empty pattern");
+
+    _SkipSpace();
+    std::string mask;
+    if (_Accept('&')) {
+        _SkipSpace();
+        result = _ParseString(mask);
+        if (result != B_OK)
+            return result;
+        if (mask.size() != bytes.size())
+            return _Error("mask length differs from pattern length");
+    }
+
+    pattern pattern;
+    pattern.rangeStart = rangeStart;
+    pattern.rangeEnd = rangeEnd;
+    pattern.offset = (uint32)fTarget.fBytes.size();
+    pattern.length = (uint32)bytes.size();
+    pattern.caseInsensitive = caseInsensitive;
+
+    uint32 padded = padded_length(pattern.length);
+    fTarget.fBytes.resize(pattern.offset + padded, 0);
+    fTarget.fMasks.resize(pattern.offset + padded, 0);
+    for (uint32 i = 0; i < pattern.length; i++) {
+        uint8 byteMask = mask.empty() ? 0xff : (uint8)mask[i];
+        uint8 byte = caseInsensitive ? fold_case((uint8)bytes[i]) : (uint8)bytes[i];
+        fTarget.fBytes[pattern.offset + i] = byte & byteMask;
+        fTarget.fMasks[pattern.offset + i] = byteMask;
+    }
+
+    fTarget.fPatterns.push_back(pattern);
+    fTarget.fMaxLength = std::max(fTarget.fMaxLength,
+        (size_t)pattern.rangeEnd + pattern.length);
+    return B_OK;
+}
+
+// String := '"' ... '"' | "'" ... "'" | "0x" HexDigits | unquoted characters,
+// all but hex strings with backslash escapes
+status_t
+SnifferRule::Parser::_ParseString(std::string& string)
+{
+    string.clear();
+
+    if (*fPos == '"' || *fPos == '\'') {
+        char quote = *fPos++;
+        while (*fPos != quote) {
+            if (_AtEnd())
+                return _Error("unterminated string");
+            if (*fPos == '\\') {
+                status_t result = _ParseEscape(string);
+                if (result != B_OK)
+                    return result;
+            } else
+                string += *fPos++;
+        }
+        fPos++;
+        return B_OK;
+    }
+
+    if (fPos[0] == '0' && (fPos[1] == 'x' || fPos[1] == 'X')) {
+        fPos += 2;
+        const char* start = fPos;
+        while (isxdigit((uint8)*fPos))
+            fPos++;
+        size_t digits = fPos - start;
+        if (digits == 0 || digits % 2 != 0)
+            return _Error("hex string needs an even number of digits");
+
+        for (size_t i = 0; i < digits; i += 2) {
+            char hex[3] = { start[i], start[i + 1], '\0' };
+            string += (char)strtoul(hex, NULL, 16);
+        }
+        return B_OK;
+    }
+
+    while (!_AtEnd() && !isspace((uint8)*fPos) && strchr("()[]|&:", *fPos) == NULL) {
+        if (*fPos == '\\') {
+            status_t result = _ParseEscape(string);
+            if (result != B_OK)
+                return result;
+        } else
+            string += *fPos++;
+    }
+    if (string.empty())
+        return _Error("expected a pattern string");
+    return B_OK;
+}
+
+status_t
+SnifferRule::Parser::_ParseEscape(std::string& string)
+{
+    fPos++;
+    char c = *fPos;
+    if (c == '\0')
+        return _Error("unterminated escape sequence");
+
+    if (c == 'x') {
+        fPos++;
+        const char* start = fPos;
+        while (fPos - start < 2 && isxdigit((uint8)*fPos))
+            fPos++;
+        if (fPos == start)
+            return _Error("expected hex digits");
+        string += (char)strtoul(std::string(start, fPos - start).c_str(), NULL, 16);
+        return B_OK;
+    }
+
+    if (c >= '0' && c <= '7') {
+        const char* start = fPos;
+        while (fPos - start < 3 && *fPos >= '0' && *fPos <= '7')
+            fPos++;
+        uint32 value = strtoul(std::string(start, fPos - start).c_str(), NULL, 8);
+        if (value > 0xff)
+            return _Error("octal escape out of range");
+        string += (char)value;
+        return B_OK;
+    }
+
+    switch (c) {
+        case 'a':   string += '\a'; break;
+        case 'b':   string += '\b'; break;
+        case 'f':   string += '\f'; break;
+        case 'n':   string += '\n'; break;
+        case 'r':   string += '\r'; break;
+        case 't':   string += '\t'; break;
+        case 'v':   string += '\v'; break;
+        default:    string += c; break;
+    }
+    fPos++;
+    return B_OK;
+}
+
+// #pragma mark - SnifferRule
+
+SnifferRule::SnifferRule()
+{
+    Unset();
+}
+
+SnifferRule::SnifferRule(const char* rule)
+{
+    SetTo(rule);
+}
+
+status_t
+SnifferRule::SetTo(const char* rule, std::string* _parseError)
+{
+    Unset();
+    if (rule == NULL)
+        return fStatus = B_BAD_VALUE;
+
+    Parser parser(rule, *this);
+    status_t result = parser.Parse();
+    if (result != B_OK) {
+        if (_parseError != NULL)
+            *_parseError = parser.Error();
+        Unset();
+        return fStatus = result;
+    }
+
+    // all expressions must match, try the cheap fixed offset ones first
+    std::stable_sort(fExpressions.begin(), fExpressions.end(),
+        [](const expression& a, const expression& b) { return a.width < b.width; });
+
+    return fStatus = B_OK;
+}
+
+void
+SnifferRule::Unset()
+{
+    fStatus = B_NO_INIT;
+    fPriority = 0.0f;
+    fMaxLength = 0;
+    fExpressions.clear();
+    fPatterns.clear();
+    fBytes.clear();
+    fMasks.clear();
+}
+
+status_t
+SnifferRule::Flatten(std::string& data) const
+{
+    if (fStatus != B_OK)
+        return fStatus;
+
+    flat_rule_header header;
+    header.priority = fPriority;
+    header.expressionCount = (uint32)fExpressions.size();
+    header.patternCount = (uint32)fPatterns.size();
+    header.byteCount = (uint32)fBytes.size();
+    data.append((const char*)&header, sizeof(header));
+
+    for (const expression& expression : fExpressions) {
+        flat_rule_expression flat = { expression.firstPattern, expression.patternCount,
+            expression.width };
+        data.append((const char*)&flat, sizeof(flat));
+    }
+    for (const pattern& pattern : fPatterns) {
+        flat_rule_pattern flat = { pattern.rangeStart, pattern.rangeEnd, pattern.offset,
+            pattern.length, pattern.caseInsensitive ? 1U : 0U };
+        data.append((const char*)&flat, sizeof(flat));
+    }
+    data.append((const char*)fBytes.data(), fBytes.size());
+    data.append((const char*)fMasks.data(), fMasks.size());
+    return B_OK;
+}
+
+// The data may come from a file, everything is checked before it is used.
+status_t
+SnifferRule::Unflatten(const void* _data, size_t size)
+{
+    Unset();
+
+    const uint8* data = (const uint8*)_data;
+    flat_rule_header header;
+    if (size < sizeof(header))
+        return fStatus = B_BAD_DATA;
+    memcpy(&header, data, sizeof(header));
+
+    uint64 expected = sizeof(header)
+        + (uint64)header.expressionCount * sizeof(flat_rule_expression)
+        + (uint64)header.patternCount * sizeof(flat_rule_pattern)
+        + (uint64)header.byteCount * 2;
+    if (expected != size || header.expressionCount == 0 || header.byteCount % 16 != 0
+        || !(header.priority >= 0.0f && header.priority <= 1.0f))
+        return fStatus = B_BAD_DATA;
+
+    const uint8* position = data + sizeof(header);
+    for (uint32 i = 0; i < header.expressionCount; i++) {
+        flat_rule_expression flat;
+        memcpy(&flat, position, sizeof(flat));
+        position += sizeof(flat);
+        if (flat.patternCount == 0 || flat.firstPattern > header.patternCount
+            || flat.patternCount > header.patternCount - flat.firstPattern) {
+            Unset();
+            return fStatus = B_BAD_DATA;
+        }
+        fExpressions.push_back(expression{ flat.firstPattern, flat.patternCount, flat.width });
+    }
+    for (uint32 i = 0; i < header.patternCount; i++) {
+        flat_rule_pattern flat;
+        memcpy(&flat, position, sizeof(flat));
+        position += sizeof(flat);
+        if (flat.length == 0 || flat.rangeStart > flat.rangeEnd || flat.offset % 16 != 0
+            || flat.offset > header.byteCount
+            || padded_length(flat.length) > header.byteCount - flat.offset) {
+            Unset();
+            return fStatus = B_BAD_DATA;
+        }
+        fPatterns.push_back(pattern{ flat.rangeStart, flat.rangeEnd, flat.offset, flat.length,
+            flat.caseInsensitive != 0 });
+        fMaxLength = std::max(fMaxLength, (size_t)flat.rangeEnd + flat.length);
+    }
+    fBytes.assign(position, position + header.byteCount);
+    fMasks.assign(position + header.byteCount, position + 2 * header.byteCount);
+    fPriority = header.priority;
+    return fStatus = B_OK;
+}
+
+/*static*/ status_t
+SnifferRule::Check(const char* rule, std::string* _parseError)
+{
+    SnifferRule sniffer;
+    return sniffer.SetTo(rule, _parseError);
+}
+
+bool
+SnifferRule::Matches(const void* data, size_t size) const
+{
+    if (fStatus != B_OK)
+        return false;
+
+    const uint8* bytes = (const uint8*)data;
+    for (const expression& expression : fExpressions) {
+        bool found = false;
+        for (uint32 i = 0; i < expression.patternCount && !found; i++)
+            found = _Matches(fPatterns[expression.firstPattern + i], bytes, size);
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+bool
+SnifferRule::_Matches(const pattern& pattern, const uint8* data, size_t size) const
+{
+    if (size < pattern.length || pattern.rangeStart > size - pattern.length)
+        return false;
+
+    size_t last = std::min((size_t)pattern.rangeEnd, size - pattern.length);
+    size_t offset = pattern.rangeStart;
+
+    uint8 firstByte = fBytes[pattern.offset];
+    uint8 firstMask = fMasks[pattern.offset];
+#ifdef __SSE2__
+    // find candidates for 16 offsets at once by their first byte
+    if (firstMask != 0) {
+        __m128i first = _mm_set1_epi8((char)firstByte);
+        __m128i mask = _mm_set1_epi8((char)firstMask);
+        while (offset + 16 <= last + 1 && offset + 16 <= size) {
+            __m128i block = _mm_loadu_si128((const __m128i*)(data + offset));
+            if (pattern.caseInsensitive)
+                block = fold_case(block);
+            uint32 candidates = _mm_movemask_epi8(
+                _mm_cmpeq_epi8(_mm_and_si128(block, mask), first));
+            while (candidates != 0) {
+                if (_MatchesAt(pattern, data, size, offset + __builtin_ctz(candidates)))
+                    return true;
+                candidates &= candidates - 1;
+            }
+            offset += 16;
+        }
+    }
+#else
+    if (firstMask == 0xff && !pattern.caseInsensitive) {
+        while (offset <= last) {
+            const uint8* found = (const uint8*)memchr(data + offset, firstByte,
+                last - offset + 1);
+            if (found == NULL)
+                return false;
+            offset = found - data;
+            if (_MatchesAt(pattern, data, size, offset))
+                return true;
+            offset++;
+        }
+        return false;
+    }
+#endif
+
+    for (; offset <= last; offset++) {
+        if (_MatchesAt(pattern, data, size, offset))
+            return true;
+    }
+    return false;
+}
+
+bool
+SnifferRule::_MatchesAt(const pattern& pattern, const uint8* data, size_t size,
+    size_t offset) const
+{
+    const uint8* bytes = &fBytes[pattern.offset];
+    const uint8* masks = &fMasks[pattern.offset];
+    data += offset;
+
+#ifdef __SSE2__
+    // the zero masks of the padding make whole blocks safe to compare
+    uint32 padded = padded_length(pattern.length);
+    if (size - offset >= padded) {
+        for (uint32 i = 0; i < padded; i += 16) {
+            __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+            if (pattern.caseInsensitive)
+                block = fold_case(block);
+            block = _mm_and_si128(block, _mm_loadu_si128((const __m128i*)(masks + i)));
+            __m128i equal = _mm_cmpeq_epi8(block,
+                _mm_loadu_si128((const __m128i*)(bytes + i)));
+            if (_mm_movemask_epi8(equal) != 0xffff)
+                return false;
+        }
+        return true;
+    }
+#endif
+
+    for (uint32 i = 0; i < pattern.length; i++) {
+        uint8 c = pattern.caseInsensitive ? fold_case(data[i]) : data[i];
+        if ((c & masks[i]) != bytes[i])
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _SNIFFER_RULE_H
+#define _SNIFFER_RULE_H
+
+#include "Platform.h"
+
+#include <string>
+#include <vector>
+
+// A compiled Haiku sniffer rule (META:SNIFF_RULE), e.g.
+//   0.50 [0:32] ("<HTML" | -i "<!doctype html") ("<" & 0xff)
+// SetTo() parses the rule once into flat pattern tables, Matches() then only
+// compares bytes. A rule matches if every expression matches, an expression
+// if any of its patterns is found at an offset within its range.
+class SnifferRule {
+public:
+                            SnifferRule();
+                            SnifferRule(const char* rule);
+
+            status_t        SetTo(const char* rule,
+                                std::string* _parseError = NULL);
+            void            Unset();
+            status_t        InitCheck() const { return fStatus; }
+
+            float           Priority() const { return fPriority; }
+            // number of bytes at the start of a file the rule looks at
+            size_t          MaxLength() const { return fMaxLength; }
+
+            bool            Matches(const void* data, size_t size) const;
+
+            // The compiled tables, so a rule can be stored and restored
+            // without parsing it again. Flatten() appends to the data.
+            status_t        Flatten(std::string& data) const;
+            status_t        Unflatten(const void* data, size_t size);
+
+    // like BMimeType::CheckSnifferRule()
+    static  status_t        Check(const char* rule, std::string* _parseError);
+
+private:
+            struct pattern {
+                uint32      rangeStart;
+                uint32      rangeEnd;
+                uint32      offset;         // into fBytes and fMasks
+                uint32      length;
+                bool        caseInsensitive;
+            };
+
+            struct expression {
+                uint32      firstPattern;
+                uint32      patternCount;
+                uint32      width;          // widest range, for ordering
+            };
+
+            class Parser;
+            friend class SnifferSet;
+
+            bool            _Matches(const pattern& pattern,
+                                const uint8* data, size_t size) const;
+            bool            _MatchesAt(const pattern& pattern,
+                                const uint8* data, size_t size,
+                                size_t offset) const;
+
+            status_t        fStatus;
+            float           fPriority;
+            size_t          fMaxLength;
+            std::vector<expression> fExpressions;
+            std::vector<pattern> fPatterns;
+            // pattern bytes (folded to lower case and masked) and masks, each
+            // pattern padded with zero masks to a multiple of 16 bytes
+            std::vector<uint8> fBytes;
+            std::vector<uint8> fMasks;
+};
+
+#endif // _SNIFFER_RULE_H
@@ -0,0 +1,298 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "SnifferSet.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+// Longer anchors filter better, but every byte is a state with a row of
+// transitions; the full pattern is verified on every hit anyway.
+static const uint32 kMaxAnchorLength = 8;
+// below this, checking the rules one by one is cheaper than a scan
+static const size_t kMinScanRuleCount = 16;
+
+static inline uint8
+fold_case(uint8 c)
+{
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// Per thread bookkeeping of a scan. Entries are only valid if their stamp is
+// the one of the current scan, so nothing needs to be cleared between scans.
+struct SnifferSet::scan_state {
+    std::vector<uint32> expressionStamps;
+    std::vector<uint32> ruleStamps;
+    std::vector<uint32> ruleMatches;
+    uint32          stamp;
+    uint32          best;       // rank of the best matching rule so far
+
+    void Prepare(size_t expressionCount, size_t ruleCount)
+    {
+        if (expressionStamps.size() < expressionCount)
+            expressionStamps.resize(expressionCount, 0);
+        if (ruleStamps.size() < ruleCount) {
+            ruleStamps.resize(ruleCount, 0);
+            ruleMatches.resize(ruleCount, 0);
+        }
+        if (++stamp == 0) {
+            std::fill(expressionStamps.begin(), expressionStamps.end(), 0);
+            std::fill(ruleStamps.begin(), ruleStamps.end(), 0);
+            stamp = 1;
+        }
+        best = UINT32_MAX;
+    }
+};
+
+SnifferSet::SnifferSet()
+{
+    Unset();
+}
+
+void
+SnifferSet::Unset()
+{
+    fRules.clear();
+    fPatterns.clear();
+    fUnanchored.clear();
+    fExpressionCount = 0;
+    fMaxLength = 0;
+    fCompiled = false;
+
+    memset(fClasses, 0, sizeof(fClasses));
+    fClassCount = 1;
+    fTransitions.clear();
+    fOutputStarts.clear();
+    fOutputLinks.clear();
+    fDictionaryLinks.clear();
+    fOutputs.clear();
+}
+
+void
+SnifferSet::AddRule(SnifferRule rule, int32 id)
+{
+    if (rule.InitCheck() != B_OK)
+        return;
+
+    rule_entry entry;
+    entry.rule = std::move(rule);
+    entry.id = id;
+    entry.expressionCount = (uint32)entry.rule.fExpressions.size();
+    fRules.push_back(std::move(entry));
+    fCompiled = false;
+}
+
+status_t
+SnifferSet::Compile()
+{
+    std::stable_sort(fRules.begin(), fRules.end(),
+        [](const rule_entry& a, const rule_entry& b) {
+            return a.rule.Priority() > b.rule.Priority();
+        });
+
+    fPatterns.clear();
+    fUnanchored.clear();
+    fExpressionCount = 0;
+    fMaxLength = 0;
+
+    // pick the anchor of every pattern: the longest run of fully masked bytes
+    struct anchor {
+        uint32      pattern;
+        uint32      start;
+        uint32      length;
+    };
+    std::vector<anchor> anchors;
+
+    for (uint32 rank = 0; rank < fRules.size(); rank++) {
+        const SnifferRule& rule = fRules[rank].rule;
+        fMaxLength = std::max(fMaxLength, rule.MaxLength());
+
+        for (const SnifferRule::expression& expression : rule.fExpressions) {
+            for (uint32 i = 0; i < expression.patternCount; i++) {
+                pattern_entry entry;
+                entry.rule = rank;
+                entry.expression = fExpressionCount;
+                entry.index = expression.firstPattern + i;
+
+                const SnifferRule::pattern& pattern = rule.fPatterns[entry.index];
+                const uint8* masks = &rule.fMasks[pattern.offset];
+                anchor best = { (uint32)fPatterns.size(), 0, 0 };
+                uint32 runStart = 0;
+                for (uint32 j = 0; j <= pattern.length; j++) {
+                    if (j < pattern.length && masks[j] == 0xff)
+                        continue;
+                    if (j - runStart > best.length) {
+                        best.start = runStart;
+                        best.length = j - runStart;
+                    }
+                    runStart = j + 1;
+                }
+
+                if (best.length == 0)
+                    fUnanchored.push_back(best.pattern);
+                else {
+                    best.length = std::min(best.length, kMaxAnchorLength);
+                    anchors.push_back(best);
+                }
+                fPatterns.push_back(entry);
+            }
+            fExpressionCount++;
+        }
+    }
+
+    // byte classes: every byte used by an anchor gets its own class
+    memset(fClasses, 0, sizeof(fClasses));
+    fClassCount = 1;
+    uint8 folded[256] = {};
+    for (const anchor& anchor : anchors) {
+        const pattern_entry& entry = fPatterns[anchor.pattern];
+        const SnifferRule& rule = fRules[entry.rule].rule;
+        const uint8* bytes = &rule.fBytes[rule.fPatterns[entry.index].offset];
+        for (uint32 i = 0; i < anchor.length; i++) {
+            uint8 byte = fold_case(bytes[anchor.start + i]);
+            if (folded[byte] == 0)
+                folded[byte] = (uint8)fClassCount++;
+        }
+    }
+    for (int32 byte = 0; byte < 256; byte++)
+        fClasses[byte] = folded[fold_case((uint8)byte)];
+
+    // the trie of all anchors
+    fTransitions.assign(fClassCount, 0);
+    std::vector<std::vector<output> > outputs(1);
+    for (const anchor& anchor : anchors) {
+        const pattern_entry& entry = fPatterns[anchor.pattern];
+        const SnifferRule& rule = fRules[entry.rule].rule;
+        const uint8* bytes = &rule.fBytes[rule.fPatterns[entry.index].offset];
+
+        uint32 state = 0;
+        for (uint32 i = 0; i < anchor.length; i++) {
+            uint32 byteClass = fClasses[bytes[anchor.start + i]];
+            uint32& next = fTransitions[state * fClassCount + byteClass];
+            if (next == 0) {
+                next = (uint32)outputs.size();
+                outputs.resize(outputs.size() + 1);
+                fTransitions.resize(fTransitions.size() + fClassCount, 0);
+            }
+            state = fTransitions[state * fClassCount + byteClass];
+        }
+        outputs[state].push_back(output{ anchor.pattern, anchor.start + anchor.length });
+    }
+
+    // breadth first: failure links, and the transitions of the full automaton
+    uint32 stateCount = (uint32)outputs.size();
+    std::vector<uint32> failures(stateCount, 0);
+    fDictionaryLinks.assign(stateCount, 0);
+    std::vector<uint32> queue;
+    queue.reserve(stateCount);
+    for (uint32 c = 0; c < fClassCount; c++) {
+        if (fTransitions[c] != 0)
+            queue.push_back(fTransitions[c]);
+    }
+    for (size_t i = 0; i < queue.size(); i++) {
+        uint32 state = queue[i];
+        uint32 failure = failures[state];
+        fDictionaryLinks[state] = !outputs[failure].empty()
+            ? failure : fDictionaryLinks[failure];
+
+        for (uint32 c = 0; c < fClassCount; c++) {
+            uint32& next = fTransitions[state * fClassCount + c];
+            uint32 fallback = fTransitions[failure * fClassCount + c];
+            if (next != 0) {
+                failures[next] = fallback;
+                queue.push_back(next);
+            } else
+                next = fallback;
+        }
+    }
+
+    fOutputStarts.resize(stateCount + 1);
+    fOutputLinks.resize(stateCount);
+    fOutputs.clear();
+    for (uint32 state = 0; state < stateCount; state++) {
+        fOutputStarts[state] = (uint32)fOutputs.size();
+        fOutputs.insert(fOutputs.end(), outputs[state].begin(), outputs[state].end());
+        fOutputLinks[state] = !outputs[state].empty() ? state : fDictionaryLinks[state];
+    }
+    fOutputStarts[stateCount] = (uint32)fOutputs.size();
+
+    fCompiled = true;
+    return B_OK;
+}
+
+int32
+SnifferSet::Match(const void* _data, size_t size) const
+{
+    if (!fCompiled || fRules.empty())
+        return -1;
+
+    if (fRules.size() < kMinScanRuleCount) {
+        for (const rule_entry& entry : fRules) {
+            if (entry.rule.Matches(_data, size))
+                return entry.id;
+        }
+        return -1;
+    }
+
+    static thread_local scan_state state = {};
+    state.Prepare(fExpressionCount, fRules.size());
+
+    const uint8* data = (const uint8*)_data;
+
+    for (uint32 index : fUnanchored) {
+        const pattern_entry& entry = fPatterns[index];
+        if (entry.rule >= state.best || state.expressionStamps[entry.expression] == state.stamp)
+            continue;
+
+        const SnifferRule& rule = fRules[entry.rule].rule;
+        if (rule._Matches(rule.fPatterns[entry.index], data, size))
+            _PatternMatched(entry, state);
+    }
+
+    size_t length = std::min(size, fMaxLength);
+    uint32 current = 0;
+    for (size_t i = 0; i < length && state.best != 0; i++) {
+        current = fTransitions[current * fClassCount + fClasses[data[i]]];
+
+        for (uint32 hit = fOutputLinks[current]; hit != 0; hit = fDictionaryLinks[hit]) {
+            for (uint32 j = fOutputStarts[hit]; j < fOutputStarts[hit + 1]; j++) {
+                const output& output = fOutputs[j];
+                const pattern_entry& entry = fPatterns[output.pattern];
+                if (entry.rule >= state.best
+                    || state.expressionStamps[entry.expression] == state.stamp)
+                    continue;
+
+                // the offset range is checked before the pattern itself
+                const SnifferRule& rule = fRules[entry.rule].rule;
+                const SnifferRule::pattern& pattern = rule.fPatterns[entry.index];
+                if (i + 1 < output.anchorEnd)
+                    continue;
+                size_t start = i + 1 - output.anchorEnd;
+                if (start < pattern.rangeStart || start > pattern.rangeEnd
+                    || start + pattern.length > size)
+                    continue;
+
+                if (rule._MatchesAt(pattern, data, size, start))
+                    _PatternMatched(entry, state);
+            }
+        }
+    }
+
+    return state.best != UINT32_MAX ? fRules[state.best].id : -1;
+}
+
+void
+SnifferSet::_PatternMatched(const pattern_entry& pattern, scan_state& state) const
+{
+    state.expressionStamps[pattern.expression] = state.stamp;
+
+    if (state.ruleStamps[pattern.rule] != state.stamp) {
+        state.ruleStamps[pattern.rule] = state.stamp;
+        state.ruleMatches[pattern.rule] = 0;
+    }
+    if (++state.ruleMatches[pattern.rule] == fRules[pattern.rule].expressionCount)
+        state.best = std::min(state.best, pattern.rule);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _SNIFFER_SET_H
+#define _SNIFFER_SET_H
+
+#include <vector>
+
+#include "SnifferRule.h"
+
+// Evaluates many sniffer rules in a single pass over the data. The patterns
+// of all rules are anchored by a run of their fully masked bytes, and the
+// anchors are compiled into one Aho-Corasick automaton. Every anchor hit is
+// checked against the offset range of its pattern and then verified against
+// the whole pattern, so the cost of a scan hardly depends on the rule count.
+// Patterns without any fully masked byte are checked one by one, and so are
+// all rules of a small set.
+class SnifferSet {
+public:
+                            SnifferSet();
+
+            void            Unset();
+            // the id is returned by Match(), e.g. the index of a MIME type
+            void            AddRule(SnifferRule rule, int32 id);
+            status_t        Compile();
+
+            int32           CountRules() const
+                                { return (int32)fRules.size(); }
+            size_t          MaxLength() const { return fMaxLength; }
+            size_t          CountStates() const
+                                { return fOutputLinks.size(); }
+
+    // returns the id of the matching rule with the highest priority (the
+    // first one added on ties), or -1 if none matches
+            int32           Match(const void* data, size_t size) const;
+
+private:
+            struct rule_entry {
+                SnifferRule rule;
+                int32       id;
+                uint32      expressionCount;
+            };
+
+            struct pattern_entry {
+                uint32      rule;           // rank in fRules
+                uint32      expression;     // global expression index
+                uint32      index;          // into the patterns of the rule
+            };
+
+            struct output {
+                uint32      pattern;        // index into fPatterns
+                uint32      anchorEnd;      // end of the anchor in the pattern
+            };
+
+            struct scan_state;
+
+            void            _PatternMatched(const pattern_entry& pattern,
+                                scan_state& state) const;
+
+            std::vector<rule_entry> fRules;     // by descending priority
+            std::vector<pattern_entry> fPatterns;
+            std::vector<uint32> fUnanchored;    // pattern indices
+            uint32          fExpressionCount;
+            size_t          fMaxLength;
+            bool            fCompiled;
+
+            // the automaton, with the input folded to lower case and bytes
+            // mapped to classes, so a state only has a row of class count
+            uint8           fClasses[256];
+            uint32          fClassCount;
+            std::vector<uint32> fTransitions;
+            std::vector<uint32> fOutputStarts;  // per state, into fOutputs
+            std::vector<uint32> fOutputLinks;   // first state with outputs
+            std::vector<uint32> fDictionaryLinks;
+            std::vector<output> fOutputs;
+};
+
+#endif // _SNIFFER_SET_H
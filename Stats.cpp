@@ -0,0 +1,176 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Stats.h"
+
+#include <time.h>
+
+#include <string>
+
+#include "OutputFormat.h"
+
+// names for humans and JSON keys, in the order of the enums
+static const char* const kPhaseNames[STATS_PHASE_COUNT][2] = {
+    { "hash resources", "hash" },
+    { "load resources", "load_resources" },
+    { "decode", "decode" },
+    { "diff", "diff" },
+    { "commit", "commit" },
+    { "  icons", "icons" },
+    { "delete", "delete" },
+    { "list types", "list_types" },
+    { "extension index", "extension_index" },
+    { "create indices", "create_indices" },
+    { "query plan", "query_plan" },
+    { "query", "query" }
+};
+
+static const char* const kCounterNames[STATS_COUNTER_COUNT][2] = {
+    { "bytes read", "bytes_read" },
+    { "resources loaded", "resources_loaded" },
+    { "DB reads", "db_reads" },
+    { "DB writes", "db_writes" },
+    { "bytes written", "bytes_written" },
+    { "icons written", "icons_written" },
+    { "types deleted", "types_deleted" },
+    { "types listed", "types_listed" },
+    { "indices created", "indices_created" },
+    { "files checked", "files_checked" },
+    { "files matched", "files_matched" }
+};
+
+std::atomic<bool> Stats::sEnabled(false);
+Stats::phase_times Stats::sPhases[STATS_PHASE_COUNT];
+std::atomic<int64> Stats::sCounters[STATS_COUNTER_COUNT];
+bigtime_t Stats::sStartWallTime = 0;
+bigtime_t Stats::sStartProcessTime = 0;
+
+static bigtime_t
+clock_time(clockid_t clock)
+{
+    struct timespec time;
+    if (clock_gettime(clock, &time) != 0)
+        return 0;
+    return (bigtime_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+static void
+append_int64(std::string& output, int64 value)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%" B_PRId64, value);
+    output += buffer;
+}
+
+/*static*/ void
+Stats::Start()
+{
+    for (int32 i = 0; i < STATS_PHASE_COUNT; i++) {
+        sPhases[i].calls = 0;
+        sPhases[i].wallTime = 0;
+        sPhases[i].cpuTime = 0;
+    }
+    for (int32 i = 0; i < STATS_COUNTER_COUNT; i++)
+        sCounters[i] = 0;
+
+    sStartWallTime = WallTime();
+    sStartProcessTime = ProcessTime();
+    sEnabled = true;
+}
+
+/*static*/ void
+Stats::Stop()
+{
+    sEnabled = false;
+}
+
+/*static*/ void
+Stats::AddTime(stats_phase phase, bigtime_t wallTime, bigtime_t cpuTime)
+{
+    phase_times& times = sPhases[phase];
+    times.calls.fetch_add(1, std::memory_order_relaxed);
+    times.wallTime.fetch_add(wallTime, std::memory_order_relaxed);
+    times.cpuTime.fetch_add(cpuTime, std::memory_order_relaxed);
+}
+
+// Only phases and counters that saw any activity are listed for humans, JSON
+// has all of them, so consumers don't need to know which can be missing.
+/*static*/ void
+Stats::Print(FILE* output, bool json)
+{
+    bigtime_t wallTime = WallTime() - sStartWallTime;
+    bigtime_t cpuTime = ProcessTime() - sStartProcessTime;
+
+    if (json) {
+        std::string line = "{\"phases\":{";
+        for (int32 i = 0; i < STATS_PHASE_COUNT; i++) {
+            if (i > 0)
+                line += ',';
+            AppendJsonString(line, kPhaseNames[i][1]);
+            line += ":{\"calls\":";
+            append_int64(line, sPhases[i].calls);
+            line += ",\"wall_us\":";
+            append_int64(line, sPhases[i].wallTime);
+            line += ",\"cpu_us\":";
+            append_int64(line, sPhases[i].cpuTime);
+            line += '}';
+        }
+        line += "},\"counters\":{";
+        for (int32 i = 0; i < STATS_COUNTER_COUNT; i++) {
+            if (i > 0)
+                line += ',';
+            AppendJsonString(line, kCounterNames[i][1]);
+            line += ':';
+            append_int64(line, sCounters[i]);
+        }
+        line += "},\"wall_us\":";
+        append_int64(line, wallTime);
+        line += ",\"cpu_us\":";
+        append_int64(line, cpuTime);
+        line += "}\n";
+        fputs(line.c_str(), output);
+        return;
+    }
+
+    fprintf(output, "\n%-20s %10s %12s %12s\n", "PHASE", "CALLS", "WALL MS", "CPU MS");
+    for (int32 i = 0; i < STATS_PHASE_COUNT; i++) {
+        const phase_times& times = sPhases[i];
+        if (times.calls == 0)
+            continue;
+        fprintf(output, "%-20s %10" B_PRId64 " %12.3f %12.3f\n", kPhaseNames[i][0],
+            (int64)times.calls, times.wallTime / 1000.0, times.cpuTime / 1000.0);
+    }
+    fprintf(output, "%-20s %10s %12.3f %12.3f\n", "total", "", wallTime / 1000.0,
+        cpuTime / 1000.0);
+
+    bool header = false;
+    for (int32 i = 0; i < STATS_COUNTER_COUNT; i++) {
+        if (sCounters[i] == 0)
+            continue;
+        if (!header) {
+            fprintf(output, "\n%-20s %10s\n", "COUNTER", "VALUE");
+            header = true;
+        }
+        fprintf(output, "%-20s %10" B_PRId64 "\n", kCounterNames[i][0], (int64)sCounters[i]);
+    }
+}
+
+/*static*/ bigtime_t
+Stats::WallTime()
+{
+    return clock_time(CLOCK_MONOTONIC);
+}
+
+/*static*/ bigtime_t
+Stats::ThreadTime()
+{
+    return clock_time(CLOCK_THREAD_CPUTIME_ID);
+}
+
+/*static*/ bigtime_t
+Stats::ProcessTime()
+{
+    return clock_time(CLOCK_PROCESS_CPUTIME_ID);
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdio.h>
+
+#include <atomic>
+
+#include "Platform.h"
+
+// Where the time of a command goes, reported with --stats. Phases may nest
+// (icons are written as part of the commit), so their times don't add up to
+// the total.
+enum stats_phase {
+    STATS_PHASE_HASH = 0,           // install cache: hashing resource files
+    STATS_PHASE_LOAD_RESOURCES,     // mapping and indexing resource files
+    STATS_PHASE_DECODE,             // checking rules, decoding messages
+    STATS_PHASE_DIFF,               // comparing bundles with the DB
+    STATS_PHASE_COMMIT,             // writing a transaction to the DB
+    STATS_PHASE_ICONS,              // writing icons
+    STATS_PHASE_DELETE,
+    STATS_PHASE_LIST_TYPES,
+    STATS_PHASE_EXTENSION_INDEX,
+    STATS_PHASE_CREATE_INDICES,
+    STATS_PHASE_QUERY_PLAN,         // reading indices for estimates
+    STATS_PHASE_QUERY,              // reading indices, checking files
+    STATS_PHASE_COUNT
+};
+
+enum stats_counter {
+    STATS_BYTES_READ = 0,           // resource files and DB fields
+    STATS_RESOURCES_LOADED,
+    STATS_DB_READS,                 // fields
+    STATS_DB_WRITES,                // fields set or removed
+    STATS_BYTES_WRITTEN,
+    STATS_ICONS_WRITTEN,
+    STATS_TYPES_DELETED,
+    STATS_TYPES_LISTED,
+    STATS_INDICES_CREATED,
+    STATS_FILES_CHECKED,            // by a query, reading attributes
+    STATS_FILES_MATCHED,
+    STATS_COUNTER_COUNT
+};
+
+// Process wide phase times and counters. They are only collected between
+// Start() and Stop(), otherwise a timer costs a branch; building with
+// MIME_NO_STATS removes the STATS_* macros altogether. Everything is atomic,
+// workers report from their own threads.
+class Stats {
+public:
+    static  void            Start();
+    static  void            Stop();
+    static  bool            IsEnabled()
+                                { return sEnabled.load(
+                                    std::memory_order_relaxed); }
+
+    static  void            Add(stats_counter counter, int64 value)
+                                {
+                                    if (IsEnabled()) {
+                                        sCounters[counter].fetch_add(value,
+                                            std::memory_order_relaxed);
+                                    }
+                                }
+    static  void            AddTime(stats_phase phase, bigtime_t wallTime,
+                                bigtime_t cpuTime);
+
+    // a table for humans, or one JSON object
+    static  void            Print(FILE* output, bool json);
+
+    // microseconds
+    static  bigtime_t       WallTime();
+    static  bigtime_t       ThreadTime();
+    static  bigtime_t       ProcessTime();
+
+private:
+    struct phase_times {
+        std::atomic<int64>  calls;
+        std::atomic<int64>  wallTime;
+        std::atomic<int64>  cpuTime;
+    };
+
+    static  std::atomic<bool> sEnabled;
+    static  phase_times     sPhases[STATS_PHASE_COUNT];
+    static  std::atomic<int64> sCounters[STATS_COUNTER_COUNT];
+    static  bigtime_t       sStartWallTime;
+    static  bigtime_t       sStartProcessTime;
+};
+
+// Times the rest of the enclosing scope as the phase, in wall clock and
+// thread CPU time.
+class StatsTimer {
+public:
+                            StatsTimer(stats_phase phase)
+                                :
+                                fPhase(phase),
+                                fEnabled(Stats::IsEnabled())
+                            {
+                                if (fEnabled) {
+                                    fWallTime = Stats::WallTime();
+                                    fCpuTime = Stats::ThreadTime();
+                                }
+                            }
+                            ~StatsTimer()
+                            {
+                                if (fEnabled) {
+                                    Stats::AddTime(fPhase,
+                                        Stats::WallTime() - fWallTime,
+                                        Stats::ThreadTime() - fCpuTime);
+                                }
+                            }
+
+private:
+                            StatsTimer(const StatsTimer&);
+            StatsTimer&     operator=(const StatsTimer&);
+
+            stats_phase     fPhase;
+            bool            fEnabled;
+            bigtime_t       fWallTime;
+            bigtime_t       fCpuTime;
+};
+
+#ifndef MIME_NO_STATS
+#   define STATS_NAME2(name, line)  name##line
+#   define STATS_NAME(name, line)   STATS_NAME2(name, line)
+#   define STATS_TIMER(phase) \
+        StatsTimer STATS_NAME(_statsTimer, __LINE__)(phase)
+#   define STATS_ADD(counter, value) \
+        Stats::Add(counter, (int64)(value))
+#else
+#   define STATS_TIMER(phase)        do {} while (false)
+#   define STATS_ADD(counter, value) do {} while (false)
+#endif
+
+#endif // _STATS_H
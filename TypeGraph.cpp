@@ -0,0 +1,236 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "TypeGraph.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "FlatMessage.h"
+#include "IndexManager.h"
+
+static std::string
+lower_case(const char* type)
+{
+    std::string lower(type);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    return lower;
+}
+
+TypeGraph::TypeGraph()
+    :
+    fNodes(NULL),
+    fCount(0),
+    fEntity(NULL),
+    fRelation(NULL)
+{
+}
+
+// Reads the types in two passes: the names first, to allocate all nodes at
+// once, then their fields. Endpoints are resolved when all names are known.
+status_t
+TypeGraph::Load(MimeDatabase& database, const char* onlySupertype)
+{
+    fTypes.clear();
+    fArena.Clear();
+    fNodes = NULL;
+    fCount = 0;
+    fEntity = NULL;
+    fRelation = NULL;
+
+    std::vector<std::string> supertypes;
+    status_t result = database.GetInstalledSupertypes(supertypes);
+    if (result != B_OK)
+        return result;
+    if (onlySupertype != NULL) {
+        // keeps the name as installed
+        supertypes.erase(std::remove_if(supertypes.begin(), supertypes.end(),
+            [onlySupertype](const std::string& name) {
+                return strcasecmp(name.c_str(), onlySupertype) != 0;
+            }), supertypes.end());
+    }
+
+    std::vector<std::vector<std::string>> subtypes(supertypes.size());
+    size_t count = supertypes.size();
+    for (size_t i = 0; i < supertypes.size(); i++) {
+        result = database.GetInstalledTypes(supertypes[i].c_str(), subtypes[i]);
+        if (result != B_OK)
+            return result;
+        count += subtypes[i].size();
+    }
+
+    type_node* nodes = fArena.AllocateArray<type_node>(count);
+    if (nodes == NULL && count > 0)
+        return B_NO_MEMORY;
+    memset((void*)nodes, 0, count * sizeof(type_node));
+
+    std::vector<std::vector<std::string>> sources(count);
+    std::vector<std::vector<std::string>> targets(count);
+    int32 index = 0;
+    for (size_t i = 0; i < supertypes.size(); i++) {
+        type_node& supertype = nodes[index];
+        supertype.first = index;
+        result = _LoadType(database, supertypes[i], supertype, sources[index], targets[index]);
+        if (result != B_OK)
+            return result;
+        index++;
+
+        supertype.subtypeCount = (int32)subtypes[i].size();
+        supertype.subtypes = fArena.AllocateArray<const type_node*>(subtypes[i].size());
+        if (supertype.subtypes == NULL)
+            return B_NO_MEMORY;
+        for (size_t j = 0; j < subtypes[i].size(); j++) {
+            type_node& node = nodes[index];
+            node.first = index;
+            node.last = index;
+            node.depth = 1;
+            node.supertype = &supertype;
+            result = _LoadType(database, subtypes[i][j], node, sources[index], targets[index]);
+            if (result != B_OK)
+                return result;
+            supertype.subtypes[j] = &node;
+            index++;
+        }
+        supertype.last = index - 1;
+    }
+    fNodes = nodes;
+    fCount = index;
+
+    for (int32 i = 0; i < fCount; i++) {
+        std::string lower = lower_case(fNodes[i].name);
+        const char* key = fArena.CopyString(lower.c_str(), lower.size());
+        if (key == NULL)
+            return B_NO_MEMORY;
+        fTypes[std::string_view(key, lower.size())] = &fNodes[i];
+    }
+
+    for (int32 i = 0; i < fCount; i++) {
+        fNodes[i].sources = _ResolveEndpoints(sources[i], fNodes[i].sourceCount);
+        fNodes[i].targets = _ResolveEndpoints(targets[i], fNodes[i].targetCount);
+    }
+    fEntity = Find(ENTITY_SUPERTYPE);
+    fRelation = Find(RELATION_SUPERTYPE);
+    return B_OK;
+}
+
+const type_node*
+TypeGraph::Find(const char* type) const
+{
+    auto found = fTypes.find(lower_case(type));
+    return found != fTypes.end() ? found->second : NULL;
+}
+
+void
+TypeGraph::GetDescendants(const type_node* type, std::vector<const type_node*>& descendants) const
+{
+    for (int32 i = type->first + 1; i <= type->last; i++)
+        descendants.push_back(&fNodes[i]);
+}
+
+bool
+TypeGraph::IsRelation(const type_node* type) const
+{
+    return fRelation != NULL && IsAncestor(fRelation, type);
+}
+
+bool
+TypeGraph::CanRelate(const type_node* relation, const type_node* source,
+    const type_node* target) const
+{
+    return IsRelation(relation)
+        && _MatchesEndpoints(source, relation->sources, relation->sourceCount)
+        && _MatchesEndpoints(target, relation->targets, relation->targetCount);
+}
+
+// a field that cannot be read fails loading, a missing one is left out
+status_t
+TypeGraph::_LoadType(MimeDatabase& database, const std::string& name, type_node& node,
+    std::vector<std::string>& sources, std::vector<std::string>& targets)
+{
+    node.name = fArena.CopyString(name.c_str(), name.size());
+    if (node.name == NULL)
+        return B_NO_MEMORY;
+
+    std::string data;
+    status_t result = database.GetField(name.c_str(), MIME_FIELD_PREFERRED_APP, data);
+    if (result == B_OK) {
+        node.preferredApp = fArena.CopyString(data.c_str(), strnlen(data.c_str(), data.size()));
+        if (node.preferredApp == NULL)
+            return B_NO_MEMORY;
+    } else if (result != B_ENTRY_NOT_FOUND)
+        return result;
+
+    result = database.GetField(name.c_str(), MIME_FIELD_ATTR_INFO, data);
+    if (result == B_ENTRY_NOT_FOUND)
+        return B_OK;
+    if (result != B_OK)
+        return result;
+
+    FlatMessage attrInfo(data.data(), data.size());
+    if (attrInfo.InitCheck() != B_OK)
+        return B_OK;
+
+    FlatMessageField names = attrInfo.FindField("attr:name", B_STRING_TYPE);
+    FlatMessageField types = attrInfo.FindField("attr:type");
+    FlatMessageField searchable = attrInfo.FindField(ATTR_INDEX);
+    type_attribute* attributes = fArena.AllocateArray<type_attribute>(names.CountItems());
+    if (attributes == NULL)
+        return B_NO_MEMORY;
+    for (int32 i = 0; i < names.CountItems(); i++) {
+        std::string_view attribute = names.StringAt(i);
+        attributes[i].name = fArena.CopyString(attribute.data(), attribute.size());
+        if (attributes[i].name == NULL)
+            return B_NO_MEMORY;
+        attributes[i].type = types.UInt32At(i, B_STRING_TYPE);
+        attributes[i].searchable = searchable.BoolAt(i, false);
+    }
+    node.attributes = attributes;
+    node.attributeCount = names.CountItems();
+
+    FlatMessageField field = attrInfo.FindField(RELATION_SOURCES_FIELD, B_STRING_TYPE);
+    for (int32 i = 0; i < field.CountItems(); i++)
+        sources.push_back(std::string(field.StringAt(i)));
+    field = attrInfo.FindField(RELATION_TARGETS_FIELD, B_STRING_TYPE);
+    for (int32 i = 0; i < field.CountItems(); i++)
+        targets.push_back(std::string(field.StringAt(i)));
+    return B_OK;
+}
+
+// Endpoints that are not installed are left out, but a relation that only
+// names such types still connects nothing, rather than anything.
+const type_node**
+TypeGraph::_ResolveEndpoints(const std::vector<std::string>& names, int32& count)
+{
+    count = 0;
+    if (names.empty())
+        return NULL;
+
+    const type_node** endpoints = fArena.AllocateArray<const type_node*>(names.size());
+    if (endpoints == NULL)
+        return NULL;
+    for (const std::string& name : names) {
+        const type_node* endpoint = Find(name.c_str());
+        if (endpoint != NULL)
+            endpoints[count++] = endpoint;
+    }
+    return endpoints;
+}
+
+bool
+TypeGraph::_MatchesEndpoints(const type_node* type, const type_node** endpoints,
+    int32 count) const
+{
+    if (endpoints == NULL)
+        return fEntity != NULL && IsA(type, fEntity);
+
+    for (int32 i = 0; i < count; i++) {
+        if (IsA(type, endpoints[i]))
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _TYPE_GRAPH_H
+#define _TYPE_GRAPH_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Arena.h"
+#include "MimeDatabase.h"
+
+#define ENTITY_SUPERTYPE    "entity"
+#define RELATION_SUPERTYPE  "relation"
+
+// A relation type may name the types it connects, as string fields of its
+// META:ATTR_INFO; a supertype stands for all of its subtypes. Without them,
+// it connects any entity types.
+#define RELATION_SOURCES_FIELD "relation:sources"
+#define RELATION_TARGETS_FIELD "relation:targets"
+
+struct type_attribute {
+    const char*         name;
+    type_code           type;
+    bool                searchable;
+};
+
+struct type_node {
+    const char*         name;           // as installed
+    const char*         preferredApp;   // NULL if there is none
+    const type_node*    supertype;      // NULL for supertypes
+    const type_node**   subtypes;
+    int32               subtypeCount;
+    const type_attribute* attributes;   // from META:ATTR_INFO
+    int32               attributeCount;
+    // the installed relation endpoints, NULL if the type declares none
+    const type_node**   sources;
+    int32               sourceCount;
+    const type_node**   targets;
+    int32               targetCount;
+    int32               depth;          // 0 for supertypes
+
+    // Preorder number of the node and of its last descendant: the
+    // descendants of a type are the ones numbered right after it.
+    int32               first;
+    int32               last;
+};
+
+// All installed types, their hierarchy, declared attributes, relation
+// endpoints and preferred apps, read from the MIME DB once and kept in an
+// arena. Ancestry is a comparison of preorder numbers; the graph is not
+// changed after loading, so it can be shared by threads and kept by the
+// server until the DB changes.
+class TypeGraph {
+public:
+                            TypeGraph();
+
+            // With onlySupertype, just that one and its subtypes are loaded,
+            // and relation endpoints outside of it are left out.
+            status_t        Load(MimeDatabase& database,
+                                const char* onlySupertype = NULL);
+
+            int32           CountTypes() const { return fCount; }
+            // in preorder: each supertype is followed by its subtypes
+            const type_node* TypeAt(int32 index) const
+                                { return &fNodes[index]; }
+            // case insensitive, like MIME types; NULL if not installed
+            const type_node* Find(const char* type) const;
+
+            // the type itself does not count
+            bool            IsAncestor(const type_node* ancestor,
+                                const type_node* type) const
+                                { return type->first > ancestor->first
+                                    && type->first <= ancestor->last; }
+            bool            IsA(const type_node* type,
+                                const type_node* ancestor) const
+                                { return type == ancestor
+                                    || IsAncestor(ancestor, type); }
+            void            GetDescendants(const type_node* type,
+                                std::vector<const type_node*>& descendants)
+                                const;
+
+            bool            IsRelation(const type_node* type) const;
+            // whether the relation can lead from a file of the source type
+            // to one of the target type
+            bool            CanRelate(const type_node* relation,
+                                const type_node* source,
+                                const type_node* target) const;
+
+            size_t          MemoryUsage() const
+                                { return fArena.Capacity(); }
+
+private:
+            status_t        _LoadType(MimeDatabase& database,
+                                const std::string& name, type_node& node,
+                                std::vector<std::string>& sources,
+                                std::vector<std::string>& targets);
+            const type_node** _ResolveEndpoints(
+                                const std::vector<std::string>& names,
+                                int32& count);
+            bool            _MatchesEndpoints(const type_node* type,
+                                const type_node** endpoints, int32 count)
+                                const;
+
+            Arena           fArena;
+            type_node*      fNodes;
+            int32           fCount;
+            // by lower case name
+            std::unordered_map<std::string_view, const type_node*> fTypes;
+            const type_node* fEntity;
+            const type_node* fRelation;
+};
+
+#endif // _TYPE_GRAPH_H
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "TypeIdentifier.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "ExtensionIndex.h"
+#include "FlatMessage.h"
+
+// a rule with a huge range must not make us read whole files
+static const size_t kMaxSniffLength = 1024 * 1024;
+
+const char*
+identify_source_name(identify_source source)
+{
+    switch (source) {
+        case IDENTIFY_SOURCE_SNIFFER:
+            return "sniffer";
+        case IDENTIFY_SOURCE_EXTENSION:
+            return "extension";
+        default:
+            return "default";
+    }
+}
+
+TypeIdentifier::TypeIdentifier()
+    :
+    fMaxLength(0)
+{
+}
+
+status_t
+TypeIdentifier::SetTo(MimeDatabase& database)
+{
+    fTypes.clear();
+    fSniffers.Unset();
+    fExtensions.clear();
+    fMaxLength = 0;
+
+    status_t result = database.GetInstalledTypes(NULL, fTypes);
+    if (result != B_OK)
+        return result;
+
+    std::string data;
+    std::vector<std::string> extensions;
+    for (int32 i = 0; i < (int32)fTypes.size(); i++) {
+        const char* type = fTypes[i].c_str();
+
+        if (database.GetField(type, MIME_FIELD_SNIFFER_RULE, data) == B_OK) {
+            data.resize(strnlen(data.c_str(), data.size()));
+            SnifferRule rule;
+            std::string parseError;
+            if (rule.SetTo(data.c_str(), &parseError) == B_OK)
+                fSniffers.AddRule(std::move(rule), i);
+            else {
+                fprintf(stderr, "ignoring invalid sniffer rule of %s: %s\n", type,
+                    parseError.c_str());
+            }
+        }
+
+        if (database.GetField(type, MIME_FIELD_EXTENSIONS, data) == B_OK) {
+            ExtensionIndex::GetExtensions(FlatMessage(data.data(), data.size()), extensions);
+            // the types are sorted, the first one claiming it wins
+            for (const std::string& extension : extensions)
+                fExtensions.emplace(extension, i);
+        }
+    }
+
+    result = fSniffers.Compile();
+    if (result != B_OK)
+        return result;
+
+    fMaxLength = std::min(fSniffers.MaxLength(), kMaxSniffLength);
+    return B_OK;
+}
+
+const char*
+TypeIdentifier::IdentifyData(const void* data, size_t size) const
+{
+    int32 type = fSniffers.Match(data, size);
+    return type >= 0 ? fTypes[type].c_str() : NULL;
+}
+
+const char*
+TypeIdentifier::IdentifyExtension(const char* path) const
+{
+    const char* name = strrchr(path, '/');
+    name = name != NULL ? name + 1 : path;
+
+    // a leading dot marks a hidden file, not an extension
+    const char* dot = strrchr(name, '.');
+    if (dot == NULL || dot == name || dot[1] == '\0')
+        return NULL;
+
+    auto found = fExtensions.find(ExtensionIndex::NormalizeExtension(dot + 1));
+    return found != fExtensions.end() ? fTypes[found->second].c_str() : NULL;
+}
+
+identify_result
+TypeIdentifier::Identify(const char* path, const void* data, size_t size) const
+{
+    identify_result result;
+    result.type = IdentifyData(data, size);
+    result.source = IDENTIFY_SOURCE_SNIFFER;
+    if (result.type == NULL) {
+        result.type = IdentifyExtension(path);
+        result.source = IDENTIFY_SOURCE_EXTENSION;
+    }
+    if (result.type == NULL) {
+        result.type = DEFAULT_FILE_TYPE;
+        result.source = IDENTIFY_SOURCE_DEFAULT;
+    }
+    return result;
+}
+
+status_t
+TypeIdentifier::IdentifyFile(const char* path, std::vector<uint8>& buffer,
+    identify_result& result) const
+{
+    size_t size = 0;
+    if (fMaxLength > 0) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return errno;
+
+        buffer.resize(fMaxLength);
+        while (size < fMaxLength) {
+            ssize_t bytesRead = read(fd, buffer.data() + size, fMaxLength - size);
+            if (bytesRead < 0 && errno == EINTR)
+                continue;
+            if (bytesRead < 0) {
+                status_t error = errno;
+                close(fd);
+                return error;
+            }
+            if (bytesRead == 0)
+                break;
+            size += bytesRead;
+        }
+        close(fd);
+    }
+
+    result = Identify(path, buffer.data(), size);
+    return B_OK;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _TYPE_IDENTIFIER_H
+#define _TYPE_IDENTIFIER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MimeDatabase.h"
+#include "SnifferSet.h"
+
+#define FILE_TYPE_ATTR "BEOS:TYPE"
+#define DEFAULT_FILE_TYPE "application/octet-stream"
+
+enum identify_source {
+    IDENTIFY_SOURCE_SNIFFER = 0,
+    IDENTIFY_SOURCE_EXTENSION,
+    IDENTIFY_SOURCE_DEFAULT
+};
+
+struct identify_result {
+    const char*     type;       // owned by the TypeIdentifier
+    identify_source source;
+};
+
+const char* identify_source_name(identify_source source);
+
+// Guesses file types from the sniffer rules and extensions installed in a
+// MIME DB, like the registrar does: the matching rule with the highest
+// priority wins, then the file name extension is looked up. Everything is
+// loaded once by SetTo(), afterwards the identifier is read-only and can be
+// shared by any number of threads.
+class TypeIdentifier {
+public:
+                            TypeIdentifier();
+
+            status_t        SetTo(MimeDatabase& database);
+
+            int32           CountTypes() const
+                                { return (int32)fTypes.size(); }
+            int32           CountRules() const
+                                { return fSniffers.CountRules(); }
+            // bytes at the start of a file needed to evaluate all rules
+            size_t          MaxLength() const { return fMaxLength; }
+
+            const char*     IdentifyData(const void* data, size_t size) const;
+            const char*     IdentifyExtension(const char* path) const;
+            identify_result Identify(const char* path, const void* data,
+                                size_t size) const;
+
+    // reads MaxLength() bytes of the file into the buffer and identifies it
+            status_t        IdentifyFile(const char* path,
+                                std::vector<uint8>& buffer,
+                                identify_result& result) const;
+
+private:
+            std::vector<std::string> fTypes;
+            SnifferSet      fSniffers;  // ids are indices into fTypes
+            std::unordered_map<std::string, int32> fExtensions;
+            size_t          fMaxLength;
+};
+
+#endif // _TYPE_IDENTIFIER_H
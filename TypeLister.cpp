@@ -0,0 +1,379 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "TypeLister.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "FlatMessage.h"
+#include "IndexVolume.h"
+
+static const char* kListFieldNames[LIST_FIELD_COUNT] = {
+    "type",
+    "short_description",
+    "long_description",
+    "preferred_app",
+    "sniffer_rule",
+    "extensions",
+    "attributes",
+    "indices",
+    "icon"
+};
+
+// the MIME DB field behind a list field, if it is stored as string
+static const mime_field kStringFields[LIST_FIELD_COUNT] = {
+    MIME_FIELD_COUNT,
+    MIME_FIELD_SHORT_DESCRIPTION,
+    MIME_FIELD_LONG_DESCRIPTION,
+    MIME_FIELD_PREFERRED_APP,
+    MIME_FIELD_SNIFFER_RULE,
+    MIME_FIELD_COUNT,
+    MIME_FIELD_COUNT,
+    MIME_FIELD_COUNT,
+    MIME_FIELD_COUNT
+};
+
+const char*
+list_field_name(list_field field)
+{
+    return field >= 0 && field < LIST_FIELD_COUNT ? kListFieldNames[field] : "unknown";
+}
+
+// TSV has no lists, items are joined by commas
+static void
+append_list(std::string& output, output_format format,
+    const std::vector<std::string>& items)
+{
+    if (format == OUTPUT_FORMAT_JSON)
+        output += '[';
+    for (size_t i = 0; i < items.size(); i++) {
+        if (i > 0)
+            output += ',';
+        if (format == OUTPUT_FORMAT_JSON)
+            AppendJsonString(output, items[i]);
+        else
+            AppendTsvField(output, items[i]);
+    }
+    if (format == OUTPUT_FORMAT_JSON)
+        output += ']';
+}
+
+// reads a field, a missing or unreadable one is left empty
+static bool
+read_field(MimeDatabase& database, const char* type, mime_field field, std::string& data)
+{
+    status_t result = database.GetField(type, field, data);
+    if (result == B_OK)
+        return true;
+
+    if (result != B_ENTRY_NOT_FOUND) {
+        fprintf(stderr, "failed to read %s of %s: %s\n", kMimeFields[field].name, type,
+            strerror(result));
+    }
+    data.clear();
+    return false;
+}
+
+TypeLister::TypeLister(MimeDatabase& database, const TypeGraph* graph, output_format format)
+    :
+    fDatabase(database),
+    fGraph(graph),
+    fFormat(format)
+{
+    fFields.push_back(LIST_FIELD_TYPE);
+    fFields.push_back(LIST_FIELD_SHORT_DESCRIPTION);
+}
+
+status_t
+TypeLister::SetFields(const char* fields)
+{
+    std::vector<list_field> parsed;
+    if (strcmp(fields, "all") == 0) {
+        for (int32 i = 0; i < LIST_FIELD_COUNT; i++)
+            parsed.push_back((list_field)i);
+    } else {
+        const char* start = fields;
+        while (true) {
+            const char* end = strchr(start, ',');
+            size_t length = end != NULL ? end - start : strlen(start);
+
+            int32 field = 0;
+            while (field < LIST_FIELD_COUNT
+                && (strlen(kListFieldNames[field]) != length
+                    || strncmp(kListFieldNames[field], start, length) != 0))
+                field++;
+            if (field == LIST_FIELD_COUNT) {
+                fprintf(stderr, "unknown field %.*s, known fields are:", (int)length, start);
+                for (int32 i = 0; i < LIST_FIELD_COUNT; i++)
+                    fprintf(stderr, " %s", kListFieldNames[i]);
+                fprintf(stderr, "\n");
+                return B_BAD_VALUE;
+            }
+            parsed.push_back((list_field)field);
+
+            if (end == NULL)
+                break;
+            start = end + 1;
+        }
+    }
+
+    fFields.swap(parsed);
+    return B_OK;
+}
+
+void
+TypeLister::SetVolumes(const std::vector<std::string>& volumes)
+{
+    fVolumePaths = volumes;
+}
+
+status_t
+TypeLister::List(const std::vector<std::string>& types, FILE* output)
+{
+    if (_HasField(LIST_FIELD_INDICES)) {
+        status_t result = _LoadIndices();
+        if (result != B_OK)
+            return result;
+    }
+
+    if (fFormat == OUTPUT_FORMAT_TSV) {
+        std::string header;
+        for (size_t i = 0; i < fFields.size(); i++) {
+            if (i > 0)
+                header += '\t';
+            header += kListFieldNames[fFields[i]];
+        }
+        header += '\n';
+        fwrite(header.data(), 1, header.size(), output);
+    }
+
+    if (types.empty() && fGraph != NULL) {
+        _WriteRecords(*fGraph, 0, fGraph->CountTypes() - 1, output);
+        return B_OK;
+    }
+
+    std::vector<std::string> names(types);
+    if (types.empty()) {
+        status_t result = fDatabase.GetInstalledSupertypes(names);
+        if (result != B_OK) {
+            fprintf(stderr, "failed to read installed supertypes: %s\n", strerror(result));
+            return result;
+        }
+    }
+
+    status_t result = B_OK;
+    for (const std::string& type : names) {
+        TypeGraph loaded;
+        const TypeGraph* graph = fGraph;
+        if (graph == NULL) {
+            status_t loadResult = loaded.Load(fDatabase, type.substr(0, type.find('/')).c_str());
+            if (loadResult != B_OK) {
+                fprintf(stderr, "failed to load MIME types of %s: %s\n", type.c_str(),
+                    strerror(loadResult));
+                result = loadResult;
+                continue;
+            }
+            graph = &loaded;
+        }
+
+        const type_node* node = graph->Find(type.c_str());
+        if (node == NULL) {
+            fprintf(stderr, "failed to list %s: %s\n", type.c_str(),
+                strerror(B_ENTRY_NOT_FOUND));
+            result = B_ENTRY_NOT_FOUND;
+            continue;
+        }
+
+        // A subtype is listed on its own. For a supertype, its subtypes are
+        // listed; listing all types includes the supertypes themselves.
+        if (node->supertype != NULL)
+            _WriteRecords(*graph, node->first, node->first, output);
+        else {
+            int32 first = types.empty() ? node->first : node->first + 1;
+            _WriteRecords(*graph, first, node->last, output);
+        }
+    }
+    return result;
+}
+
+// the indices of every volume are listed once, not per type
+status_t
+TypeLister::_LoadIndices()
+{
+    std::vector<std::string> paths = IndexVolume::PathsOrDefault(fVolumePaths);
+
+    fVolumes.clear();
+    for (const std::string& path : paths) {
+        std::unique_ptr<IndexVolume> volume(IndexVolume::Create(path.c_str()));
+        status_t result = volume.get() != NULL ? volume->InitCheck() : B_NO_MEMORY;
+
+        std::vector<index_entry> indices;
+        if (result == B_OK)
+            result = volume->GetIndices(indices);
+        if (result != B_OK) {
+            fprintf(stderr, "failed to list indices of volume %s: %s\n", path.c_str(),
+                strerror(result));
+            return result;
+        }
+
+        volume_indices entry;
+        entry.name = volume->Name();
+        for (const index_entry& index : indices)
+            entry.indices[index.name] = index.type;
+        fVolumes.push_back(std::move(entry));
+    }
+    return B_OK;
+}
+
+bool
+TypeLister::_HasField(list_field field) const
+{
+    return std::find(fFields.begin(), fFields.end(), field) != fFields.end();
+}
+
+// the types with preorder numbers from first to last
+void
+TypeLister::_WriteRecords(const TypeGraph& graph, int32 first, int32 last, FILE* output)
+{
+    std::string record;
+    for (int32 i = first; i <= last; i++) {
+        record.clear();
+        _AppendRecord(graph.TypeAt(i), record);
+        fwrite(record.data(), 1, record.size(), output);
+    }
+}
+
+void
+TypeLister::_AppendRecord(const type_node* type, std::string& output)
+{
+    std::string extensionData;
+    FlatMessage extensions;
+    if (_HasField(LIST_FIELD_EXTENSIONS)
+        && read_field(fDatabase, type->name, MIME_FIELD_EXTENSIONS, extensionData))
+        extensions.SetTo(extensionData.data(), extensionData.size());
+
+    bool json = fFormat == OUTPUT_FORMAT_JSON;
+    if (json)
+        output += '{';
+
+    std::string data;
+    std::vector<std::string> items;
+    for (size_t i = 0; i < fFields.size(); i++) {
+        list_field field = fFields[i];
+        if (i > 0)
+            output += json ? ',' : '\t';
+        if (json) {
+            AppendJsonString(output, kListFieldNames[field]);
+            output += ':';
+        }
+
+        items.clear();
+        switch (field) {
+            case LIST_FIELD_TYPE:
+                if (json)
+                    AppendJsonString(output, type->name);
+                else
+                    AppendTsvField(output, type->name);
+                break;
+
+            case LIST_FIELD_SHORT_DESCRIPTION:
+            case LIST_FIELD_LONG_DESCRIPTION:
+            case LIST_FIELD_SNIFFER_RULE:
+                if (!read_field(fDatabase, type->name, kStringFields[field], data)) {
+                    if (json)
+                        output += "null";
+                    break;
+                }
+                data.resize(strnlen(data.c_str(), data.size()));
+                if (json)
+                    AppendJsonString(output, data);
+                else
+                    AppendTsvField(output, data);
+                break;
+
+            case LIST_FIELD_PREFERRED_APP:
+                if (type->preferredApp == NULL) {
+                    if (json)
+                        output += "null";
+                } else if (json)
+                    AppendJsonString(output, type->preferredApp);
+                else
+                    AppendTsvField(output, type->preferredApp);
+                break;
+
+            case LIST_FIELD_EXTENSIONS:
+            {
+                FlatMessageField names = extensions.FindField("extensions", B_STRING_TYPE);
+                for (int32 j = 0; j < names.CountItems(); j++)
+                    items.push_back(std::string(names.StringAt(j)));
+                append_list(output, fFormat, items);
+                break;
+            }
+
+            case LIST_FIELD_ATTRIBUTES:
+            {
+                for (int32 j = 0; j < type->attributeCount; j++)
+                    items.push_back(type->attributes[j].name);
+                append_list(output, fFormat, items);
+                break;
+            }
+
+            case LIST_FIELD_INDICES:
+            {
+                // "indexed" only if every volume has the index with the right
+                // type, "unchecked" without any volume
+                for (int32 j = 0; j < type->attributeCount; j++) {
+                    const type_attribute& attribute = type->attributes[j];
+                    std::string name(attribute.name);
+                    if (!attribute.searchable || name.empty())
+                        continue;
+
+                    const char* status = fVolumes.empty() ? "unchecked" : "indexed";
+                    for (const volume_indices& volume : fVolumes) {
+                        auto found = volume.indices.find(name);
+                        if (found == volume.indices.end()) {
+                            status = "missing";
+                            break;
+                        }
+                        if (found->second != attribute.type)
+                            status = "wrong_type";
+                    }
+
+                    if (json) {
+                        output += items.empty() ? "{" : ",";
+                        AppendJsonString(output, name);
+                        output += ':';
+                        AppendJsonString(output, status);
+                    } else {
+                        if (!items.empty())
+                            output += ',';
+                        AppendTsvField(output, name);
+                        output += '=';
+                        output += status;
+                    }
+                    items.push_back(name);
+                }
+                if (json)
+                    output += items.empty() ? "{}" : "}";
+                break;
+            }
+
+            case LIST_FIELD_ICON:
+                if (read_field(fDatabase, type->name, MIME_FIELD_ICON, data))
+                    output += std::to_string(data.size());
+                else if (json)
+                    output += "null";
+                break;
+
+            case LIST_FIELD_COUNT:
+                break;
+        }
+    }
+
+    output += json ? "}\n" : "\n";
+}
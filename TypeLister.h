@@ -0,0 +1,76 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _TYPE_LISTER_H
+#define _TYPE_LISTER_H
+
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "MimeDatabase.h"
+#include "OutputFormat.h"
+#include "TypeGraph.h"
+
+enum list_field {
+    LIST_FIELD_TYPE = 0,
+    LIST_FIELD_SHORT_DESCRIPTION,
+    LIST_FIELD_LONG_DESCRIPTION,
+    LIST_FIELD_PREFERRED_APP,
+    LIST_FIELD_SNIFFER_RULE,
+    LIST_FIELD_EXTENSIONS,
+    LIST_FIELD_ATTRIBUTES,      // names from META:ATTR_INFO
+    LIST_FIELD_INDICES,         // index status of the searchable attributes
+    LIST_FIELD_ICON,            // size of the vector icon
+
+    LIST_FIELD_COUNT
+};
+
+const char* list_field_name(list_field field);
+
+// Writes one record per installed type, in the order of the type graph:
+// each supertype is followed by its subtypes. What the graph holds is taken
+// from it, the other fields are read as each record is written. Without a
+// graph, one supertype at a time is loaded as it is listed, so the first
+// records are out before the rest of the DB is read.
+class TypeLister {
+public:
+                            TypeLister(MimeDatabase& database,
+                                const TypeGraph* graph,
+                                output_format format);
+
+            // comma separated field names, or "all"
+            status_t        SetFields(const char* fields);
+            // volumes checked for the "indices" field, the default if none
+            void            SetVolumes(const std::vector<std::string>& volumes);
+
+            // The given types, and the subtypes of given supertypes, or all
+            // types if none are given; a TSV header comes first.
+            status_t        List(const std::vector<std::string>& types,
+                                FILE* output);
+
+private:
+            struct volume_indices {
+                std::string name;
+                std::map<std::string, type_code> indices;
+            };
+
+            status_t        _LoadIndices();
+            bool            _HasField(list_field field) const;
+            void            _WriteRecords(const TypeGraph& graph,
+                                int32 first, int32 last, FILE* output);
+            void            _AppendRecord(const type_node* type,
+                                std::string& output);
+
+            MimeDatabase&   fDatabase;
+            const TypeGraph* fGraph;
+            output_format   fFormat;
+            std::vector<list_field> fFields;
+            std::vector<std::string> fVolumePaths;
+            std::vector<volume_indices> fVolumes;
+};
+
+#endif // _TYPE_LISTER_H
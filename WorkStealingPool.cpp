@@ -0,0 +1,116 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "WorkStealingPool.h"
+
+#include <thread>
+#include <vector>
+
+#include "WorkerPool.h"
+
+static thread_local WorkStealingPool* sCurrentPool = NULL;
+static thread_local int32 sCurrentWorker = -1;
+
+WorkStealingPool::WorkStealingPool(int32 threadCount)
+    :
+    fThreadCount(threadCount > 0 ? threadCount : WorkerPool::DefaultThreadCount()),
+    fQueues(new queue[fThreadCount]),
+    fPending(0),
+    fQueued(0),
+    fNextQueue(0)
+{
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+}
+
+void
+WorkStealingPool::Submit(Task task)
+{
+    int32 index = sCurrentPool == this
+        ? sCurrentWorker : (int32)(fNextQueue.fetch_add(1) % fThreadCount);
+
+    fPending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> locker(fQueues[index].lock);
+        fQueues[index].tasks.push_back(std::move(task));
+    }
+    fQueued.fetch_add(1);
+
+    // take the lock, so a worker about to sleep can't miss the wakeup
+    std::lock_guard<std::mutex> locker(fIdleLock);
+    fIdle.notify_one();
+}
+
+void
+WorkStealingPool::Run()
+{
+    std::vector<std::thread> threads;
+    threads.reserve(fThreadCount - 1);
+    for (int32 i = 1; i < fThreadCount; i++)
+        threads.emplace_back(&WorkStealingPool::_Work, this, i);
+
+    _Work(0);
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+bool
+WorkStealingPool::_Next(int32 worker, Task& task)
+{
+    {
+        queue& own = fQueues[worker];
+        std::lock_guard<std::mutex> locker(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            fQueued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    for (int32 i = 1; i < fThreadCount; i++) {
+        queue& victim = fQueues[(worker + i) % fThreadCount];
+        std::lock_guard<std::mutex> locker(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            fQueued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+WorkStealingPool::_Work(int32 worker)
+{
+    WorkStealingPool* previousPool = sCurrentPool;
+    int32 previousWorker = sCurrentWorker;
+    sCurrentPool = this;
+    sCurrentWorker = worker;
+
+    while (true) {
+        Task task;
+        if (_Next(worker, task)) {
+            task(worker);
+            if (fPending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> locker(fIdleLock);
+                fIdle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> locker(fIdleLock);
+        fIdle.wait(locker, [this]() { return fPending == 0 || fQueued > 0; });
+        if (fPending == 0)
+            break;
+    }
+
+    sCurrentPool = previousPool;
+    sCurrentWorker = previousWorker;
+}
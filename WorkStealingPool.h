@@ -0,0 +1,52 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _WORK_STEALING_POOL_H
+#define _WORK_STEALING_POOL_H
+
+#include "Platform.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Runs tasks that may submit more tasks, like the directories of a tree walk.
+// Every worker has its own queue: it takes its newest task first, and an idle
+// worker steals the oldest task of another one, so big subtrees get spread.
+class WorkStealingPool {
+public:
+            typedef std::function<void(int32 worker)> Task;
+
+                            WorkStealingPool(int32 threadCount = 0);
+                            ~WorkStealingPool();
+
+            int32           ThreadCount() const { return fThreadCount; }
+
+    // from within a task, the new task goes to the queue of its worker
+            void            Submit(Task task);
+    // returns when all tasks, including the ones they submitted, are done
+            void            Run();
+
+private:
+            struct queue {
+                std::mutex  lock;
+                std::deque<Task> tasks;
+            };
+
+            bool            _Next(int32 worker, Task& task);
+            void            _Work(int32 worker);
+
+            int32           fThreadCount;
+            std::unique_ptr<queue[]> fQueues;
+            std::atomic<int64> fPending;    // queued or running
+            std::atomic<int64> fQueued;
+            std::atomic<uint32> fNextQueue;
+            std::mutex      fIdleLock;
+            std::condition_variable fIdle;
+};
+
+#endif // _WORK_STEALING_POOL_H
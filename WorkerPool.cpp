@@ -0,0 +1,55 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+WorkerPool::WorkerPool(int32 threadCount)
+    :
+    fThreadCount(threadCount > 0 ? threadCount : DefaultThreadCount())
+{
+}
+
+void
+WorkerPool::ForEach(int32 count, std::function<void(int32 index)> function)
+{
+    if (count <= 0)
+        return;
+
+    int32 threadCount = fThreadCount < count ? fThreadCount : count;
+    if (threadCount <= 1) {
+        for (int32 i = 0; i < count; i++)
+            function(i);
+        return;
+    }
+
+    // workers pull the next index until all are taken, so slow items don't stall a fixed slice
+    std::atomic<int32> next(0);
+    auto worker = [&]() {
+        int32 index;
+        while ((index = next.fetch_add(1)) < count)
+            function(index);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (int32 i = 1; i < threadCount; i++)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+int32
+WorkerPool::DefaultThreadCount()
+{
+    unsigned int cpus = std::thread::hardware_concurrency();
+    return cpus > 0 ? (int32)cpus : 1;
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _WORKER_POOL_H
+#define _WORKER_POOL_H
+
+#include "Platform.h"
+
+#include <functional>
+
+// Runs a function for every index in [0, count) on a fixed number of threads.
+class WorkerPool {
+public:
+                            WorkerPool(int32 threadCount = 0);
+
+            int32           ThreadCount() const { return fThreadCount; }
+
+            void            ForEach(int32 count,
+                                std::function<void(int32 index)> function);
+
+    static  int32           DefaultThreadCount();
+
+private:
+            int32           fThreadCount;
+};
+
+#endif // _WORKER_POOL_H
@@ -0,0 +1,423 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "XmlReader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static const size_t kReadBufferSize = 64 * 1024;
+// character data is reported in pieces of about this size
+static const size_t kTextChunkSize = 16 * 1024;
+static const size_t kMaxTagLength = 64 * 1024;
+
+static inline bool
+is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool
+ends_with(const std::string& string, const char* suffix)
+{
+    size_t length = strlen(suffix);
+    return string.size() >= length
+        && memcmp(string.data() + string.size() - length, suffix, length) == 0;
+}
+
+static void
+append_utf8(std::string& string, uint32 c)
+{
+    if (c < 0x80) {
+        string += (char)c;
+    } else if (c < 0x800) {
+        string += (char)(0xc0 | (c >> 6));
+        string += (char)(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+        string += (char)(0xe0 | (c >> 12));
+        string += (char)(0x80 | ((c >> 6) & 0x3f));
+        string += (char)(0x80 | (c & 0x3f));
+    } else {
+        string += (char)(0xf0 | (c >> 18));
+        string += (char)(0x80 | ((c >> 12) & 0x3f));
+        string += (char)(0x80 | ((c >> 6) & 0x3f));
+        string += (char)(0x80 | (c & 0x3f));
+    }
+}
+
+XmlHandler::~XmlHandler()
+{
+}
+
+XmlReader::XmlReader(XmlHandler& handler)
+    :
+    fHandler(handler),
+    fState(STATE_TEXT),
+    fLine(1),
+    fQuote(0),
+    fDepth(0),
+    fRootClosed(false)
+{
+}
+
+status_t
+XmlReader::Parse(const char* path)
+{
+    fState = STATE_TEXT;
+    fLine = 1;
+    fError.clear();
+    fText.clear();
+    fToken.clear();
+    fElements.clear();
+    fRootClosed = false;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return _SetError("cannot open file: %s", strerror(errno));
+
+    std::vector<char> buffer(kReadBufferSize);
+    status_t result = B_OK;
+    while (result == B_OK) {
+        ssize_t bytesRead = read(fd, buffer.data(), buffer.size());
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead < 0) {
+            result = _SetError("read error: %s", strerror(errno));
+            break;
+        }
+        if (bytesRead == 0)
+            break;
+        result = _Feed(buffer.data(), bytesRead);
+    }
+    close(fd);
+
+    if (result == B_OK)
+        result = _FlushText(true);
+    if (result != B_OK)
+        return result;
+
+    if (fState != STATE_TEXT)
+        return _SetError("unexpected end of file within markup");
+    if (!fElements.empty())
+        return _SetError("unexpected end of file, <%s> is not closed", fElements.back().c_str());
+    if (!fRootClosed)
+        return _SetError("no root element");
+    return B_OK;
+}
+
+status_t
+XmlReader::_Feed(const char* data, size_t size)
+{
+    const char* end = data + size;
+    while (data < end) {
+        if (fState == STATE_TEXT) {
+            const char* markup = (const char*)memchr(data, '<', end - data);
+            const char* textEnd = markup != NULL ? markup : end;
+            fLine += std::count(data, textEnd, '\n');
+            fText.append(data, textEnd - data);
+            data = textEnd;
+
+            status_t result = B_OK;
+            if (markup != NULL) {
+                result = _FlushText(true);
+                fState = STATE_MARKUP;
+                fToken.clear();
+                data++;
+            } else if (fText.size() >= kTextChunkSize)
+                result = _FlushText(false);
+            if (result != B_OK)
+                return result;
+            continue;
+        }
+
+        char c = *data++;
+        if (c == '\n')
+            fLine++;
+
+        switch (fState) {
+            case STATE_MARKUP:
+                fToken += c;
+                if (fToken[0] == '?') {
+                    fState = STATE_PROCESSING_INSTRUCTION;
+                } else if (fToken[0] != '!') {
+                    fState = STATE_TAG;
+                    fQuote = 0;
+                    if (c == '>')
+                        return _SetError("empty tag");
+                } else if (fToken == "!--") {
+                    fState = STATE_COMMENT;
+                    fToken.clear();
+                } else if (fToken == "![CDATA[") {
+                    fState = STATE_CDATA;
+                    fToken.clear();
+                } else if (fToken == "!DOCTYPE") {
+                    fState = STATE_DOCTYPE;
+                    fDepth = 0;
+                } else if (fToken.size() >= strlen("![CDATA[")) {
+                    return _SetError("unsupported markup <%s", fToken.c_str());
+                }
+                break;
+
+            case STATE_TAG:
+                if (fQuote != 0) {
+                    if (c == fQuote)
+                        fQuote = 0;
+                } else if (c == '"' || c == '\'') {
+                    fQuote = c;
+                } else if (c == '>') {
+                    status_t result = _HandleTag();
+                    if (result != B_OK)
+                        return result;
+                    fState = STATE_TEXT;
+                    break;
+                }
+                fToken += c;
+                if (fToken.size() > kMaxTagLength)
+                    return _SetError("tag longer than %zu bytes", kMaxTagLength);
+                break;
+
+            case STATE_COMMENT:
+            case STATE_PROCESSING_INSTRUCTION:
+            {
+                // only the end marker matters
+                fToken += c;
+                if (fToken.size() > 3)
+                    fToken.erase(0, fToken.size() - 3);
+                if (fState == STATE_COMMENT ? ends_with(fToken, "-->") : ends_with(fToken, "?>"))
+                    fState = STATE_TEXT;
+                break;
+            }
+
+            case STATE_CDATA:
+            {
+                fToken += c;
+                status_t result = B_OK;
+                if (ends_with(fToken, "]]>")) {
+                    result = fHandler.Characters(fToken.data(), fToken.size() - 3);
+                    fState = STATE_TEXT;
+                } else if (fToken.size() >= kTextChunkSize) {
+                    // keep what could be the start of the end marker
+                    result = fHandler.Characters(fToken.data(), fToken.size() - 2);
+                    fToken.erase(0, fToken.size() - 2);
+                }
+                if (result != B_OK)
+                    return result;
+                break;
+            }
+
+            case STATE_DOCTYPE:
+                // the internal subset is skipped along with the rest
+                if (c == '[')
+                    fDepth++;
+                else if (c == ']')
+                    fDepth--;
+                else if (c == '>' && fDepth <= 0)
+                    fState = STATE_TEXT;
+                break;
+
+            case STATE_TEXT:
+                break;
+        }
+    }
+    return B_OK;
+}
+
+// Reports the collected character data. Unless all of it is requested, an
+// entity reference that may continue in the next chunk is kept.
+status_t
+XmlReader::_FlushText(bool all)
+{
+    if (fText.empty())
+        return B_OK;
+
+    size_t length = fText.size();
+    if (!all) {
+        size_t ampersand = fText.rfind('&');
+        if (ampersand != std::string::npos && fText.find(';', ampersand) == std::string::npos)
+            length = ampersand;
+    }
+
+    if (fElements.empty()) {
+        for (size_t i = 0; i < length; i++) {
+            if (!is_space(fText[i]))
+                return _SetError("text outside of the root element");
+        }
+        fText.erase(0, length);
+        return B_OK;
+    }
+
+    status_t result = _Decode(fText.data(), length, fDecoded);
+    if (result == B_OK)
+        result = fHandler.Characters(fDecoded.data(), fDecoded.size());
+    fText.erase(0, length);
+    return result;
+}
+
+status_t
+XmlReader::_HandleTag()
+{
+    if (fToken[0] == '/') {
+        size_t end = fToken.size();
+        while (end > 1 && is_space(fToken[end - 1]))
+            end--;
+        std::string name = fToken.substr(1, end - 1);
+        if (fElements.empty() || fElements.back() != name) {
+            return _SetError("unexpected </%s>, expected %s", name.c_str(),
+                fElements.empty() ? "no end tag" : ("</" + fElements.back() + ">").c_str());
+        }
+
+        status_t result = fHandler.EndElement(name.c_str());
+        fElements.pop_back();
+        if (fElements.empty())
+            fRootClosed = true;
+        return result;
+    }
+
+    bool empty = fToken.back() == '/';
+    if (empty)
+        fToken.pop_back();
+
+    char* pos = &fToken[0];
+    char* nameEnd = pos;
+    while (*nameEnd != '\0' && !is_space(*nameEnd))
+        nameEnd++;
+    if (nameEnd == pos)
+        return _SetError("tag without a name");
+    if (fElements.empty() && fRootClosed)
+        return _SetError("more than one root element");
+
+    std::string name(pos, nameEnd);
+    status_t result = _ParseAttributes(nameEnd);
+    if (result != B_OK)
+        return result;
+
+    fElements.push_back(name);
+    result = fHandler.StartElement(name.c_str(), fAttributes.data(),
+        (int32)fAttributes.size());
+    if (result != B_OK || !empty)
+        return result;
+
+    result = fHandler.EndElement(name.c_str());
+    fElements.pop_back();
+    if (fElements.empty())
+        fRootClosed = true;
+    return result;
+}
+
+// Splits the attributes in place: names and values are terminated within
+// the tag, and values are decoded there, since they never get longer.
+status_t
+XmlReader::_ParseAttributes(char* pos)
+{
+    fAttributes.clear();
+    while (true) {
+        bool separated = false;
+        while (is_space(*pos)) {
+            *pos++ = '\0';
+            separated = true;
+        }
+        if (*pos == '\0')
+            return B_OK;
+        if (!separated)
+            return _SetError("expected a space before attribute");
+
+        char* name = pos;
+        while (*pos != '\0' && *pos != '=' && !is_space(*pos))
+            pos++;
+        char* nameEnd = pos;
+        while (is_space(*pos))
+            pos++;
+        if (nameEnd == name || *pos != '=')
+            return _SetError("expected name=\"value\" in tag");
+        *nameEnd = '\0';
+        pos++;
+        while (is_space(*pos))
+            pos++;
+
+        char quote = *pos;
+        if (quote != '"' && quote != '\'')
+            return _SetError("attribute value of %s is not quoted", name);
+        char* value = ++pos;
+        char* valueEnd = strchr(value, quote);
+        if (valueEnd == NULL)
+            return _SetError("unterminated attribute value of %s", name);
+
+        status_t result = _Decode(value, valueEnd - value, fDecoded);
+        if (result != B_OK)
+            return result;
+        // terminated at the closing quote at the latest
+        memcpy(value, fDecoded.c_str(), fDecoded.size() + 1);
+
+        xml_attribute attribute = { name, value };
+        fAttributes.push_back(attribute);
+        pos = valueEnd + 1;
+        if (*pos != '\0' && !is_space(*pos))
+            return _SetError("expected a space after attribute %s", name);
+    }
+}
+
+status_t
+XmlReader::_Decode(const char* text, size_t length, std::string& decoded)
+{
+    decoded.clear();
+    const char* end = text + length;
+    while (text < end) {
+        const char* ampersand = (const char*)memchr(text, '&', end - text);
+        if (ampersand == NULL) {
+            decoded.append(text, end - text);
+            break;
+        }
+        decoded.append(text, ampersand - text);
+
+        const char* semicolon = (const char*)memchr(ampersand, ';', end - ampersand);
+        if (semicolon == NULL || semicolon - ampersand > 12)
+            return _SetError("unterminated entity reference");
+
+        std::string entity(ampersand + 1, semicolon);
+        if (entity == "lt")
+            decoded += '<';
+        else if (entity == "gt")
+            decoded += '>';
+        else if (entity == "amp")
+            decoded += '&';
+        else if (entity == "quot")
+            decoded += '"';
+        else if (entity == "apos")
+            decoded += '\'';
+        else if (entity.size() > 1 && entity[0] == '#') {
+            bool hex = entity[1] == 'x';
+            const char* digits = entity.c_str() + (hex ? 2 : 1);
+            char* digitsEnd;
+            unsigned long c = strtoul(digits, &digitsEnd, hex ? 16 : 10);
+            if (digitsEnd == digits || *digitsEnd != '\0' || c == 0 || c > 0x10ffff)
+                return _SetError("invalid character reference &%s;", entity.c_str());
+            append_utf8(decoded, (uint32)c);
+        } else
+            return _SetError("unknown entity &%s;", entity.c_str());
+
+        text = semicolon + 1;
+    }
+    return B_OK;
+}
+
+status_t
+XmlReader::_SetError(const char* format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    fError = buffer;
+    return B_BAD_DATA;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _XML_READER_H
+#define _XML_READER_H
+
+#include "Platform.h"
+
+#include <string>
+#include <vector>
+
+struct xml_attribute {
+    const char*     name;
+    const char*     value;      // entities already replaced
+};
+
+// Receives the events of an XmlReader. A non-B_OK result stops parsing and
+// is returned from XmlReader::Parse().
+class XmlHandler {
+public:
+    virtual                 ~XmlHandler();
+
+    virtual status_t        StartElement(const char* name,
+                                const xml_attribute* attributes,
+                                int32 count) = 0;
+    virtual status_t        EndElement(const char* name) = 0;
+    // character data may be split into any number of calls
+    virtual status_t        Characters(const char* text, size_t length) = 0;
+};
+
+// A SAX style XML parser reading a file in fixed size chunks, so memory use
+// does not depend on the size of the document, only on its longest tag and
+// its nesting depth. It checks that elements nest properly, replaces the
+// predefined and numeric entities, and skips comments, processing
+// instructions and the DOCTYPE. Namespaces and DTDs are not interpreted.
+class XmlReader {
+public:
+                            XmlReader(XmlHandler& handler);
+
+            status_t        Parse(const char* path);
+
+            // position and description of the last error
+            int32           Line() const { return fLine; }
+            const std::string& Error() const { return fError; }
+
+private:
+            enum state {
+                STATE_TEXT,
+                STATE_MARKUP,       // after '<', markup kind not yet known
+                STATE_TAG,
+                STATE_COMMENT,
+                STATE_CDATA,
+                STATE_PROCESSING_INSTRUCTION,
+                STATE_DOCTYPE
+            };
+
+            status_t        _Feed(const char* data, size_t size);
+            status_t        _FlushText(bool all);
+            status_t        _HandleTag();
+            status_t        _ParseAttributes(char* pos);
+            status_t        _Decode(const char* text, size_t length,
+                                std::string& decoded);
+            status_t        _SetError(const char* format, ...);
+
+            XmlHandler&     fHandler;
+            state           fState;
+            int32           fLine;
+            std::string     fError;
+
+            std::string     fText;      // character data not yet reported
+            std::string     fToken;     // current markup
+            std::string     fDecoded;
+            std::vector<std::string> fElements;
+            std::vector<xml_attribute> fAttributes;
+            char            fQuote;     // of the attribute value in a tag
+            int32           fDepth;     // of brackets in the DOCTYPE
+            bool            fRootClosed;
+};
+
+#endif // _XML_READER_H
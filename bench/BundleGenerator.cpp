@@ -0,0 +1,229 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "BundleGenerator.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <random>
+
+#include "BufferedWriter.h"
+#include "FlatMessage.h"
+#include "IndexManager.h"
+#include "MimeDatabase.h"
+#include "ResourceFile.h"
+
+// sniffer terms after the first are 16 bytes apart
+static const size_t kTermSpacing = 16;
+
+bundle_shape::bundle_shape()
+    :
+    types(1000),
+    attributes(8),
+    searchable(2),
+    extensions(4),
+    iconSize(2048),
+    snifferTerms(3),
+    seed(1)
+{
+}
+
+// every type draws from a generator of its own, so a type looks the same
+// whatever the type count
+static std::mt19937
+type_random(const bundle_shape& shape, int32 index)
+{
+    return std::mt19937(shape.seed * 1000003u + (uint32)index);
+}
+
+static std::string
+random_word(std::mt19937& random, int32 length)
+{
+    std::string word;
+    for (int32 i = 0; i < length; i++)
+        word += (char)('a' + random() % 26);
+    return word;
+}
+
+static std::string
+type_name(int32 index)
+{
+    char name[64];
+    snprintf(name, sizeof(name), BENCH_SUPERTYPE "/type-%05" B_PRId32, index);
+    return name;
+}
+
+// The first term is a magic unique to the type at offset 0, the others are
+// words at a fixed distance, found by searching a small range, with an
+// alternative that never occurs in the samples.
+static void
+make_terms(const bundle_shape& shape, int32 index, std::vector<std::string>& words)
+{
+    std::mt19937 random = type_random(shape, index);
+    char magic[32];
+    snprintf(magic, sizeof(magic), "XB%05" B_PRId32, index);
+    words.push_back(magic);
+    for (int32 i = 1; i < shape.snifferTerms; i++)
+        words.push_back(random_word(random, 4));
+}
+
+static std::string
+sniffer_rule(const bundle_shape& shape, int32 index)
+{
+    std::vector<std::string> words;
+    make_terms(shape, index, words);
+
+    std::string rule = "0.50 (\"" + words[0] + "\")";
+    for (size_t i = 1; i < words.size(); i++) {
+        char term[128];
+        snprintf(term, sizeof(term), " [%zu:%zu] (\"%s\" | \"%s\")", i * kTermSpacing,
+            i * kTermSpacing + 3, words[i].c_str(), "ZZZZ");
+        rule += term;
+    }
+    return rule;
+}
+
+static void
+make_extensions(const bundle_shape& shape, int32 index, std::string& data)
+{
+    FlatMessageWriter message;
+    for (int32 i = 0; i < shape.extensions; i++) {
+        char extension[32];
+        snprintf(extension, sizeof(extension), "b%05" B_PRId32 "e%" B_PRId32, index, i);
+        message.AddString("extensions", extension);
+    }
+    message.Flatten(data);
+}
+
+static void
+make_attr_info(const bundle_shape& shape, int32 /*index*/, std::string& data)
+{
+    FlatMessageWriter message;
+    for (int32 i = 0; i < shape.attributes; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "BENCH:attr%" B_PRId32, i);
+        message.AddString("attr:name", name);
+        snprintf(name, sizeof(name), "Attribute %" B_PRId32, i);
+        message.AddString("attr:public_name", name);
+
+        uint32 type = i % 2 == 0 ? B_STRING_TYPE : B_INT32_TYPE;
+        int32 width = 60 + i % 5 * 20;
+        int32 alignment = 0;
+        bool yes = true;
+        bool no = false;
+        bool searchable = i < shape.searchable;
+        message.AddData("attr:type", B_INT32_TYPE, &type, sizeof(type));
+        message.AddData("attr:width", B_INT32_TYPE, &width, sizeof(width));
+        message.AddData("attr:alignment", B_INT32_TYPE, &alignment, sizeof(alignment));
+        message.AddData("attr:viewable", B_BOOL_TYPE, &yes, sizeof(yes));
+        message.AddData("attr:editable", B_BOOL_TYPE, &yes, sizeof(yes));
+        message.AddData("attr:extra", B_BOOL_TYPE, &no, sizeof(no));
+        message.AddData(ATTR_INDEX, B_BOOL_TYPE, &searchable, sizeof(searchable));
+    }
+    message.Flatten(data);
+}
+
+static status_t
+write_bundle(const char* path, const bundle_shape& shape, int32 index)
+{
+    std::string type = type_name(index);
+    char shortDescription[64];
+    snprintf(shortDescription, sizeof(shortDescription), "Bench type %05" B_PRId32, index);
+    std::string longDescription = std::string("Synthetic MIME type ") + type
+        + " generated for benchmarking";
+    std::string rule = sniffer_rule(shape, index);
+    std::string extensions;
+    std::string attrInfo;
+    if (shape.extensions > 0)
+        make_extensions(shape, index, extensions);
+    if (shape.attributes > 0)
+        make_attr_info(shape, index, attrInfo);
+
+    std::string icon;
+    if (shape.iconSize > 0) {
+        std::mt19937 random = type_random(shape, index);
+        icon = "ncif";
+        while (icon.size() < shape.iconSize)
+            icon += (char)random();
+        icon.resize(shape.iconSize);
+    }
+
+    const void* fields[MIME_FIELD_COUNT] = {};
+    size_t sizes[MIME_FIELD_COUNT] = {};
+    fields[MIME_FIELD_SHORT_DESCRIPTION] = shortDescription;
+    sizes[MIME_FIELD_SHORT_DESCRIPTION] = strlen(shortDescription) + 1;
+    fields[MIME_FIELD_LONG_DESCRIPTION] = longDescription.c_str();
+    sizes[MIME_FIELD_LONG_DESCRIPTION] = longDescription.size() + 1;
+    if (shape.snifferTerms > 0) {
+        fields[MIME_FIELD_SNIFFER_RULE] = rule.c_str();
+        sizes[MIME_FIELD_SNIFFER_RULE] = rule.size() + 1;
+    }
+    if (!extensions.empty()) {
+        fields[MIME_FIELD_EXTENSIONS] = extensions.data();
+        sizes[MIME_FIELD_EXTENSIONS] = extensions.size();
+    }
+    if (!attrInfo.empty()) {
+        fields[MIME_FIELD_ATTR_INFO] = attrInfo.data();
+        sizes[MIME_FIELD_ATTR_INFO] = attrInfo.size();
+    }
+    if (!icon.empty()) {
+        fields[MIME_FIELD_ICON] = icon.data();
+        sizes[MIME_FIELD_ICON] = icon.size();
+    }
+
+    ResourceWriter resources;
+    int32 id = 1;
+    resources.AddResource(B_STRING_TYPE, id++, MIME_TYPE_ATTR, type.c_str(), type.size() + 1);
+    for (int32 i = 0; i < MIME_FIELD_COUNT; i++) {
+        if (fields[i] != NULL) {
+            resources.AddResource(kMimeFields[i].resourceType, id++, kMimeFields[i].attribute,
+                fields[i], sizes[i]);
+        }
+    }
+
+    BufferedWriter writer;
+    status_t result = writer.SetTo(path);
+    if (result == B_OK)
+        resources.WriteTo(writer);
+    result = writer.Close();
+    if (result != B_OK)
+        unlink(path);
+    return result;
+}
+
+status_t
+GenerateBundles(const char* directory, const bundle_shape& shape,
+    std::vector<std::string>& paths)
+{
+    if (shape.types < 0 || shape.attributes < 0 || shape.extensions < 0
+        || shape.snifferTerms < 0 || (shape.iconSize > 0 && shape.iconSize < 4))
+        return B_BAD_VALUE;
+
+    paths.clear();
+    for (int32 i = 0; i < shape.types; i++) {
+        char path[B_PATH_NAME_LENGTH];
+        snprintf(path, sizeof(path), "%s/type-%05" B_PRId32 ".rsrc", directory, i);
+        status_t result = write_bundle(path, shape, i);
+        if (result != B_OK)
+            return result;
+        paths.push_back(path);
+    }
+    return B_OK;
+}
+
+std::string
+SampleHeader(const bundle_shape& shape, int32 index)
+{
+    std::vector<std::string> words;
+    make_terms(shape, index, words);
+
+    std::string header((words.size() + 1) * kTermSpacing, '.');
+    header.replace(0, words[0].size(), words[0]);
+    for (size_t i = 1; i < words.size(); i++)
+        header.replace(i * kTermSpacing + i % 4, words[i].size(), words[i]);
+    return header;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _BUNDLE_GENERATOR_H
+#define _BUNDLE_GENERATOR_H
+
+#include <string>
+#include <vector>
+
+#include "Platform.h"
+
+#define BENCH_SUPERTYPE "x-bench"
+
+// What the synthetic MIME types look like. The same shape and seed always
+// give the same files, so results of different builds can be compared.
+struct bundle_shape {
+                    bundle_shape();
+
+    int32           types;
+    int32           attributes;     // per type, in META:ATTR_INFO
+    int32           searchable;     // how many of them are indexed
+    int32           extensions;     // per type, in META:EXTENS
+    size_t          iconSize;       // bytes of META:ICON, 0 for none
+    int32           snifferTerms;   // expressions of the sniffer rule
+    uint32          seed;
+};
+
+// Writes one resource file per type, like "mime export" does, as
+// <directory>/type-00000.rsrc and so on, and returns their paths. The types
+// are x-bench/type-00000 and so on, each with a sniffer rule matching only
+// its own sample header, and extensions no other type claims.
+status_t GenerateBundles(const char* directory, const bundle_shape& shape,
+    std::vector<std::string>& paths);
+
+// the start of a file the sniffer rule of the type matches
+std::string SampleHeader(const bundle_shape& shape, int32 index);
+
+#endif // _BUNDLE_GENERATOR_H
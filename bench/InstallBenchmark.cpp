@@ -0,0 +1,400 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+// Times the install path end to end on synthetic resource files: parsing
+// them, decoding their messages, installing into and uninstalling from a
+// directory backed MIME DB, listing it and sniffing sample files with its
+// rules. Each benchmark runs for a number of rounds and reports the median,
+// as a table or (with --json) as one JSON object whose keys don't change
+// between builds, so results can be diffed or compared by scripts.
+//
+// With --generate=<dir> only the resource files are written, e.g. to try
+// "mime install" on them.
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "BundleGenerator.h"
+#include "DirectoryMimeDatabase.h"
+#include "FlatMessage.h"
+#include "MappedFile.h"
+#include "MimeTransaction.h"
+#include "MimeTypeBundle.h"
+#include "OutputFormat.h"
+#include "TypeIdentifier.h"
+#include "TypeLister.h"
+
+struct bench_result {
+    const char*         name;
+    int64               operations;     // per round
+    int64               bytes;          // per round, 0 if not meaningful
+    std::vector<double> times;          // ns per round
+
+    double Median() const
+    {
+        std::vector<double> sorted(times);
+        std::sort(sorted.begin(), sorted.end());
+        return sorted.empty() ? 0 : sorted[sorted.size() / 2];
+    }
+};
+
+// keeps the decoding from being optimized away
+static volatile uint64 sChecksum;
+
+static double
+nanoseconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+static status_t
+remove_tree(const std::string& path)
+{
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0)
+        return errno;
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(path.c_str());
+        if (dir == NULL)
+            return errno;
+        while (dirent* entry = readdir(dir)) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+                remove_tree(path + "/" + entry->d_name);
+        }
+        closedir(dir);
+        return rmdir(path.c_str()) == 0 ? B_OK : errno;
+    }
+    return unlink(path.c_str()) == 0 ? B_OK : errno;
+}
+
+// sums up the sizes and first bytes of all items
+static uint64
+decode_message(const void* data, size_t size)
+{
+    FlatMessage message(data, size);
+    if (message.InitCheck() != B_OK)
+        return 0;
+
+    uint64 sum = 0;
+    for (int32 i = 0; i < message.CountFields(); i++) {
+        FlatMessageField field = message.FieldAt(i);
+        for (int32 j = 0; j < field.CountItems(); j++) {
+            const void* item;
+            size_t itemSize;
+            if (field.ItemAt(j, &item, &itemSize))
+                sum += itemSize + *(const uint8*)item;
+        }
+    }
+    return sum;
+}
+
+static status_t
+install(MimeDatabase& database, const std::vector<MimeTypeBundle>& bundles,
+    int32& unchanged)
+{
+    std::vector<MimeTypeChanges> changes(bundles.size());
+    MimeTransaction transaction(database);
+    for (size_t i = 0; i < bundles.size(); i++) {
+        status_t result = StageMimeTypeBundle(transaction, bundles[i], changes[i]);
+        if (result != B_OK)
+            return result;
+    }
+
+    unchanged = 0;
+    for (const MimeTypeChanges& change : changes) {
+        if (change.IsEmpty())
+            unchanged++;
+    }
+    return transaction.Commit();
+}
+
+static void
+print_usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [--types=N] [--attributes=N] [--searchable=N] [--extensions=N]\n"
+        "       [--icon-size=N] [--sniffer-terms=N] [--seed=N] [--rounds=N] [--dir=<dir>]\n"
+        "       [--json]\n"
+        "       %s [shape options] --generate=<dir>\n", name, name);
+}
+
+int
+main(int argc, char** argv)
+{
+    bundle_shape shape;
+    int32 rounds = 5;
+    const char* directory = NULL;
+    const char* generateDirectory = NULL;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = strchr(argv[i], '=');
+        value = value != NULL ? value + 1 : "";
+        if (strncmp(argv[i], "--types=", strlen("--types=")) == 0)
+            shape.types = atoi(value);
+        else if (strncmp(argv[i], "--attributes=", strlen("--attributes=")) == 0)
+            shape.attributes = atoi(value);
+        else if (strncmp(argv[i], "--searchable=", strlen("--searchable=")) == 0)
+            shape.searchable = atoi(value);
+        else if (strncmp(argv[i], "--extensions=", strlen("--extensions=")) == 0)
+            shape.extensions = atoi(value);
+        else if (strncmp(argv[i], "--icon-size=", strlen("--icon-size=")) == 0)
+            shape.iconSize = (size_t)atol(value);
+        else if (strncmp(argv[i], "--sniffer-terms=", strlen("--sniffer-terms=")) == 0)
+            shape.snifferTerms = atoi(value);
+        else if (strncmp(argv[i], "--seed=", strlen("--seed=")) == 0)
+            shape.seed = (uint32)strtoul(value, NULL, 10);
+        else if (strncmp(argv[i], "--rounds=", strlen("--rounds=")) == 0)
+            rounds = atoi(value);
+        else if (strncmp(argv[i], "--dir=", strlen("--dir=")) == 0)
+            directory = value;
+        else if (strncmp(argv[i], "--generate=", strlen("--generate=")) == 0)
+            generateDirectory = value;
+        else if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (shape.types < 1 || rounds < 1) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> paths;
+    if (generateDirectory != NULL) {
+        status_t result = CreateDirectories(generateDirectory);
+        if (result == B_OK)
+            result = GenerateBundles(generateDirectory, shape, paths);
+        if (result != B_OK) {
+            fprintf(stderr, "cannot generate resource files in %s: %s\n", generateDirectory,
+                strerror(result));
+            return EXIT_FAILURE;
+        }
+        printf("generated %" B_PRId32 " resource files in %s\n", shape.types,
+            generateDirectory);
+        return EXIT_SUCCESS;
+    }
+
+    // everything goes into a scratch directory that is removed afterwards
+    std::string scratch;
+    if (directory != NULL) {
+        scratch = std::string(directory) + "/mime-bench";
+        if (mkdir(scratch.c_str(), 0755) != 0) {
+            fprintf(stderr, "cannot create %s: %s\n", scratch.c_str(), strerror(errno));
+            return EXIT_FAILURE;
+        }
+    } else {
+        char path[] = "/tmp/mime-bench-XXXXXX";
+        if (mkdtemp(path) == NULL) {
+            fprintf(stderr, "cannot create a scratch directory: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        scratch = path;
+    }
+
+    std::string bundleDirectory = scratch + "/bundles";
+    std::string databaseDirectory = scratch + "/db";
+    status_t result = CreateDirectories(bundleDirectory.c_str());
+    if (result == B_OK)
+        result = CreateDirectories(databaseDirectory.c_str());
+    if (result == B_OK)
+        result = GenerateBundles(bundleDirectory.c_str(), shape, paths);
+    if (result != B_OK) {
+        fprintf(stderr, "cannot generate resource files: %s\n", strerror(result));
+        remove_tree(scratch);
+        return EXIT_FAILURE;
+    }
+
+    int32 count = shape.types;
+    std::vector<std::string> headers;
+    for (int32 i = 0; i < count; i++)
+        headers.push_back(SampleHeader(shape, i));
+
+    DirectoryMimeDatabase database(databaseDirectory.c_str());
+    std::vector<bench_result> results = {
+        { "parse", count, 0, {} },
+        { "decode_messages", 0, 0, {} },
+        { "install", count, 0, {} },
+        { "install_unchanged", count, 0, {} },
+        { "list", count + 1, 0, {} },     // with the supertype
+        { "sniff_load", 1, 0, {} },
+        { "sniff", count, 0, {} },
+        { "uninstall", count, 0, {} }
+    };
+    enum { PARSE, DECODE, INSTALL, INSTALL_UNCHANGED, LIST, SNIFF_LOAD, SNIFF, UNINSTALL };
+
+    FILE* listOutput = fopen("/dev/null", "w");
+    if (listOutput == NULL) {
+        fprintf(stderr, "cannot open /dev/null: %s\n", strerror(errno));
+        remove_tree(scratch);
+        return EXIT_FAILURE;
+    }
+
+    std::string error;
+    uint64 checksum = 0;
+    for (int32 round = 0; round < rounds && error.empty(); round++) {
+        std::vector<MimeTypeBundle> bundles(count);
+        int64 bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int32 i = 0; i < count; i++) {
+            if (ParseMimeTypeBundle(paths[i].c_str(), bundles[i]) != B_OK) {
+                error = bundles[i].error;
+                break;
+            }
+            bytes += bundles[i].resources.MappedSize();
+        }
+        results[PARSE].times.push_back(nanoseconds_since(start));
+        results[PARSE].bytes = bytes;
+        if (!error.empty())
+            break;
+
+        int64 messages = 0;
+        bytes = 0;
+        start = std::chrono::steady_clock::now();
+        for (const MimeTypeBundle& bundle : bundles) {
+            for (int32 field : { MIME_FIELD_EXTENSIONS, MIME_FIELD_ATTR_INFO }) {
+                if (bundle.fields[field] == NULL)
+                    continue;
+                checksum += decode_message(bundle.fields[field], bundle.fieldSizes[field]);
+                bytes += bundle.fieldSizes[field];
+                messages++;
+            }
+        }
+        results[DECODE].times.push_back(nanoseconds_since(start));
+        results[DECODE].operations = messages;
+        results[DECODE].bytes = bytes;
+
+        int32 unchanged;
+        start = std::chrono::steady_clock::now();
+        result = install(database, bundles, unchanged);
+        results[INSTALL].times.push_back(nanoseconds_since(start));
+        if (result != B_OK || unchanged != 0) {
+            error = std::string("install failed: ") + strerror(result);
+            break;
+        }
+
+        start = std::chrono::steady_clock::now();
+        result = install(database, bundles, unchanged);
+        results[INSTALL_UNCHANGED].times.push_back(nanoseconds_since(start));
+        if (result != B_OK || unchanged != count) {
+            error = "installing again changed the DB";
+            break;
+        }
+
+        // what "mime list" does with its default fields
+        start = std::chrono::steady_clock::now();
+        {
+            TypeLister lister(database, NULL, OUTPUT_FORMAT_TSV);
+            result = lister.List(std::vector<std::string>(), listOutput);
+            fflush(listOutput);
+        }
+        results[LIST].times.push_back(nanoseconds_since(start));
+        if (result != B_OK) {
+            error = std::string("listing types failed: ") + strerror(result);
+            break;
+        }
+
+        if (shape.snifferTerms > 0) {
+            TypeIdentifier identifier;
+            start = std::chrono::steady_clock::now();
+            result = identifier.SetTo(database);
+            results[SNIFF_LOAD].times.push_back(nanoseconds_since(start));
+            if (result != B_OK) {
+                error = std::string("loading sniffer rules failed: ") + strerror(result);
+                break;
+            }
+
+            int32 matches = 0;
+            bytes = 0;
+            start = std::chrono::steady_clock::now();
+            for (int32 i = 0; i < count; i++) {
+                const char* type = identifier.IdentifyData(headers[i].data(), headers[i].size());
+                if (type != NULL && strcmp(type, bundles[i].type) == 0)
+                    matches++;
+                bytes += headers[i].size();
+            }
+            results[SNIFF].times.push_back(nanoseconds_since(start));
+            results[SNIFF].bytes = bytes;
+            if (matches != count) {
+                error = "sniffing identified the wrong types";
+                break;
+            }
+        }
+
+        MimeTransaction transaction(database);
+        start = std::chrono::steady_clock::now();
+        for (int32 i = count - 1; i >= 0; i--)
+            transaction.Delete(bundles[i].type);
+        transaction.Delete(BENCH_SUPERTYPE);
+        result = transaction.Commit();
+        results[UNINSTALL].times.push_back(nanoseconds_since(start));
+        if (result != B_OK) {
+            error = std::string("uninstall failed: ") + strerror(result);
+            break;
+        }
+    }
+
+    fclose(listOutput);
+    remove_tree(scratch);
+    if (!error.empty()) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return EXIT_FAILURE;
+    }
+
+    if (json) {
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "{\"shape\":{\"types\":%" B_PRId32 ",\"attributes\":%"
+            B_PRId32 ",\"searchable\":%" B_PRId32 ",\"extensions\":%" B_PRId32
+            ",\"icon_size\":%zu,\"sniffer_terms\":%" B_PRId32 ",\"seed\":%" B_PRIu32
+            "},\"rounds\":%" B_PRId32 ",\"results\":{", shape.types, shape.attributes,
+            shape.searchable, shape.extensions, shape.iconSize, shape.snifferTerms, shape.seed,
+            rounds);
+        std::string output = buffer;
+        for (size_t i = 0; i < results.size(); i++) {
+            const bench_result& bench = results[i];
+            double median = bench.Median();
+            if (i > 0)
+                output += ',';
+            AppendJsonString(output, bench.name);
+            snprintf(buffer, sizeof(buffer), ":{\"operations\":%" B_PRId64 ",\"bytes\":%"
+                B_PRId64 ",\"median_ns\":%.0f,\"ns_per_op\":%.1f}", bench.operations,
+                bench.bytes, median, bench.operations > 0 ? median / bench.operations : 0);
+            output += buffer;
+        }
+        output += "}}";
+        printf("%s\n", output.c_str());
+    } else {
+        printf("%" B_PRId32 " types, %" B_PRId32 " attributes (%" B_PRId32 " searchable), %"
+            B_PRId32 " extensions, %zu byte icons, %" B_PRId32 " sniffer terms, median of %"
+            B_PRId32 " rounds\n\n", shape.types, shape.attributes, shape.searchable,
+            shape.extensions, shape.iconSize, shape.snifferTerms, rounds);
+        printf("%-20s %10s %12s %12s %10s\n", "BENCHMARK", "OPS", "TOTAL ms", "ns/op", "MB/s");
+        for (const bench_result& bench : results) {
+            if (bench.times.empty())
+                continue;
+            double median = bench.Median();
+            printf("%-20s %10" B_PRId64 " %12.3f %12.0f", bench.name, bench.operations,
+                median / 1000000, bench.operations > 0 ? median / bench.operations : 0);
+            if (bench.bytes > 0)
+                printf(" %10.1f", bench.bytes / median * 1000);
+            printf("\n");
+        }
+    }
+
+    sChecksum = checksum;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+// Compares checking sniffer rules one by one with the single pass SnifferSet
+// for growing rule counts, on synthetic rules and file headers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SnifferRule.h"
+#include "SnifferSet.h"
+
+static const int32 kFileCount = 2000;
+static const size_t kHeaderSize = 512;
+
+static std::string
+random_word(std::mt19937& random, int32 length)
+{
+    static const char kChars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    std::string word;
+    for (int32 i = 0; i < length; i++)
+        word += kChars[random() % (sizeof(kChars) - 1)];
+    return word;
+}
+
+static std::string
+hex_string(const std::string& bytes)
+{
+    std::string hex = "0x";
+    char digits[3];
+    for (char c : bytes) {
+        snprintf(digits, sizeof(digits), "%02x", (uint8)c);
+        hex += digits;
+    }
+    return hex;
+}
+
+// a mix of the kinds of rules found in real MIME DBs: binary magic at a
+// fixed offset, ranged text markers, case insensitive and masked patterns
+static void
+make_rules(std::mt19937& random, int32 count, std::vector<std::string>& rules,
+    std::vector<std::string>& markers)
+{
+    for (int32 i = 0; i < count; i++) {
+        std::string marker = random_word(random, 4 + random() % 8);
+        char rule[256];
+        switch (i % 4) {
+            case 0:
+                snprintf(rule, sizeof(rule), "0.%d (%s)", 20 + (int)(random() % 80),
+                    hex_string(marker).c_str());
+                break;
+            case 1:
+                snprintf(rule, sizeof(rule), "0.%d [0:64] (\"%s\" | \"%s\")",
+                    20 + (int)(random() % 80), marker.c_str(), random_word(random, 6).c_str());
+                break;
+            case 2:
+                snprintf(rule, sizeof(rule), "0.%d [0:128] (-i \"%s\")",
+                    20 + (int)(random() % 80), marker.c_str());
+                break;
+            default:
+                snprintf(rule, sizeof(rule), "0.%d (\"%s\" & %s) [8:32] (\"%s\")",
+                    20 + (int)(random() % 80), marker.substr(0, 4).c_str(),
+                    hex_string(std::string("\xff\xff\xdf\xff", 4)).c_str(), marker.c_str());
+                marker = marker.substr(0, 4) + "____" + marker;
+                break;
+        }
+        rules.push_back(rule);
+        markers.push_back(marker);
+    }
+}
+
+static void
+make_headers(std::mt19937& random, const std::vector<std::string>& markers,
+    std::vector<std::string>& headers)
+{
+    for (int32 i = 0; i < kFileCount; i++) {
+        std::string header = random_word(random, kHeaderSize);
+        // every other file matches some rule
+        if (i % 2 == 0) {
+            const std::string& marker = markers[random() % markers.size()];
+            header.replace(0, marker.size(), marker);
+        }
+        headers.push_back(header);
+    }
+}
+
+static double
+nanoseconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+int
+main()
+{
+    int32 counts[] = { 10, 100, 1000, 10000 };
+
+    printf("%8s %8s %14s %14s %10s %10s %8s\n", "RULES", "STATES", "LINEAR ns/file",
+        "SET ns/file", "LINEAR MB/s", "SET MB/s", "SPEEDUP");
+
+    for (int32 count : counts) {
+        std::mt19937 random(count);
+        std::vector<std::string> ruleStrings;
+        std::vector<std::string> markers;
+        make_rules(random, count, ruleStrings, markers);
+
+        std::vector<std::string> headers;
+        make_headers(random, markers, headers);
+
+        std::vector<SnifferRule> rules(count);
+        SnifferSet set;
+        for (int32 i = 0; i < count; i++) {
+            std::string parseError;
+            if (rules[i].SetTo(ruleStrings[i].c_str(), &parseError) != B_OK) {
+                fprintf(stderr, "invalid rule %s: %s\n", ruleStrings[i].c_str(),
+                    parseError.c_str());
+                return EXIT_FAILURE;
+            }
+            set.AddRule(rules[i], i);
+        }
+        set.Compile();
+
+        // the linear baseline checks the rules by priority, like the set does
+        std::vector<int32> order(count);
+        for (int32 i = 0; i < count; i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](int32 a, int32 b) {
+            return rules[a].Priority() > rules[b].Priority();
+        });
+
+        // fewer rounds for the slow cases, but at least one
+        int32 rounds = std::max(1, 10000 / count);
+        int64 linearMatches = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int32 round = 0; round < rounds; round++) {
+            for (const std::string& header : headers) {
+                for (int32 index : order) {
+                    if (rules[index].Matches(header.data(), header.size())) {
+                        linearMatches++;
+                        break;
+                    }
+                }
+            }
+        }
+        double linear = nanoseconds_since(start) / rounds / kFileCount;
+
+        int64 setMatches = 0;
+        start = std::chrono::steady_clock::now();
+        for (int32 round = 0; round < rounds; round++) {
+            for (const std::string& header : headers)
+                setMatches += set.Match(header.data(), header.size()) >= 0 ? 1 : 0;
+        }
+        double single = nanoseconds_since(start) / rounds / kFileCount;
+
+        if (setMatches != linearMatches) {
+            fprintf(stderr, "result mismatch: %" B_PRId64 " vs. %" B_PRId64 " matches\n",
+                setMatches, linearMatches);
+            return EXIT_FAILURE;
+        }
+
+        // throughput of the header bytes the rules need
+        double bytes = (double)std::min(kHeaderSize, set.MaxLength());
+        printf("%8" B_PRId32 " %8zu %14.0f %14.0f %10.1f %10.1f %7.1fx\n", count,
+            set.CountStates(), linear, single, bytes / linear * 1000, bytes / single * 1000,
+            linear / single);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <string.h>
+
+#include "ContentHash.h"
+
+static const uint64 kPrime32 = 2654435761U;
+
+// the data the xxHash sanity checks hash
+static std::string
+sanity_buffer(size_t size)
+{
+    std::string buffer(size, '\0');
+    uint64 generator = kPrime32;
+    for (size_t i = 0; i < size; i++) {
+        buffer[i] = (char)(generator >> 56);
+        generator *= 11400714785074694797ULL;
+    }
+    return buffer;
+}
+
+static uint64
+hash_string(const char* string, uint64 seed = 0)
+{
+    return HashData(string, strlen(string), seed);
+}
+
+TEST(content_hash_reference)
+{
+    CHECK_EQUAL(hash_string(""), 0xef46db3751d8e999ULL);
+    CHECK_EQUAL(hash_string("a"), 0xd24ec4f1a98c6e5bULL);
+    CHECK_EQUAL(hash_string("abc"), 0x44bc2cf5ad770999ULL);
+    CHECK_EQUAL(hash_string("message digest"), 0x066ed728fceeb3beULL);
+    CHECK_EQUAL(hash_string("abcdefghijklmnopqrstuvwxyz"), 0xcfe1f278fa89835cULL);
+
+    // below, at and above the 32 byte stripes, with and without a seed
+    const struct {
+        size_t  size;
+        uint64  hash;
+        uint64  seededHash;
+    } vectors[] = {
+        { 0, 0xef46db3751d8e999ULL, 0xac75fda2929b17efULL },
+        { 1, 0xe934a84adb052768ULL, 0x5014607643a9b4c3ULL },
+        { 3, 0xff7e1959cb50794aULL, 0xaa8584e83660f7d1ULL },
+        { 4, 0x9136a0dca57457eeULL, 0xcaab286bd8e9fdb5ULL },
+        { 8, 0xcdbcf538e71d1348ULL, 0xfe0c047a5353cdacULL },
+        { 14, 0x8282dcc4994e35c8ULL, 0xc3bd6bf63deb6df0ULL },
+        { 31, 0x299b39a290e6d783ULL, 0xda673d5feb5c1d79ULL },
+        { 32, 0x18b216492bb44b70ULL, 0xb3f33bdf93ade409ULL },
+        { 33, 0x55c8dc3e578f5b59ULL, 0xe92c292f64bc3071ULL },
+        { 222, 0xb641ae8cb691c174ULL, 0x20cb8ab7ae10c14aULL },
+        { 2367, 0xa82418ddec0ea581ULL, 0xa36a93c18052673aULL }
+    };
+    std::string buffer = sanity_buffer(2367);
+    for (const auto& vector : vectors) {
+        CHECK_EQUAL(HashData(buffer.data(), vector.size), vector.hash);
+        CHECK_EQUAL(HashData(buffer.data(), vector.size, kPrime32), vector.seededHash);
+
+        // the alignment of the data does not matter
+        std::string shifted = " " + buffer.substr(0, vector.size);
+        CHECK_EQUAL(HashData(shifted.data() + 1, vector.size), vector.hash);
+    }
+}
+
+TEST(content_hash_file)
+{
+    std::string data = sanity_buffer(100000);
+    uint64 hash;
+    off_t size;
+    CHECK_EQUAL(HashFile(test_write_file("data", data).c_str(), hash, &size), B_OK);
+    CHECK_EQUAL(hash, HashData(data.data(), data.size()));
+    CHECK_EQUAL(size, (off_t)data.size());
+
+    // files are mapped, and empty ones are not
+    CHECK_EQUAL(HashFile(test_write_file("empty", "").c_str(), hash), B_BAD_DATA);
+    CHECK_EQUAL(HashFile((test_directory() + "/missing").c_str(), hash), B_ENTRY_NOT_FOUND);
+}
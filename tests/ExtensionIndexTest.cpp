@@ -0,0 +1,221 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <string.h>
+
+#include "DirectoryMimeDatabase.h"
+#include "ExtensionIndex.h"
+
+// offsets within the header of the index file
+static const size_t kVersionOffset = 4;
+static const size_t kBucketCountOffset = 12;
+static const size_t kSlotsOffsetOffset = 20;
+static const size_t kStringsSizeOffset = 36;
+static const size_t kHeaderSize = 40;
+
+// enough extensions to need several buckets of the perfect hash
+static extension_map
+make_entries()
+{
+    extension_map entries;
+    for (int32 i = 0; i < 300; i++) {
+        std::string type = "application/x-test" + std::to_string(i % 40);
+        entries["ext" + std::to_string(i)].push_back(type);
+    }
+    entries["txt"] = { "text/plain", "text/x-other" };
+    entries["unused"];
+    return entries;
+}
+
+static std::string
+lookup(const ExtensionIndex& index, const char* extension)
+{
+    std::vector<std::string_view> types;
+    status_t result = index.Lookup(extension, types);
+    if (result != B_OK)
+        return result == B_ENTRY_NOT_FOUND ? "not found" : "error";
+
+    std::string joined;
+    for (std::string_view type : types) {
+        if (!joined.empty())
+            joined += ",";
+        joined += type;
+    }
+    return joined;
+}
+
+static std::string
+read_file(const std::string& path)
+{
+    MappedFile file;
+    if (file.SetTo(path.c_str()) != B_OK)
+        return std::string();
+    return std::string((const char*)file.Data(), file.Size());
+}
+
+static void
+set_uint32(std::string& data, size_t offset, uint32 value)
+{
+    memcpy(&data[offset], &value, sizeof(value));
+}
+
+static void
+set_extensions(MimeDatabase& database, const char* type,
+    const std::vector<std::string>& extensions)
+{
+    FlatMessageWriter message;
+    for (const std::string& extension : extensions)
+        message.AddString("extensions", extension.c_str());
+    std::string data;
+    message.Flatten(data);
+    CHECK_EQUAL(database.SetField(type, MIME_FIELD_EXTENSIONS, data.data(), data.size()), B_OK);
+}
+
+TEST(extension_index_round_trip)
+{
+    extension_map entries = make_entries();
+    std::string path = test_directory() + "/index";
+    CHECK_EQUAL(ExtensionIndex::Write(path.c_str(), entries), B_OK);
+
+    ExtensionIndex index;
+    CHECK_EQUAL(index.InitCheck(), B_NO_INIT);
+    CHECK_EQUAL(lookup(index, "txt"), "error");
+    CHECK_EQUAL(index.SetTo(path.c_str()), B_OK);
+    // extensions without types are left out
+    CHECK_EQUAL(index.CountExtensions(), 301);
+
+    for (int32 i = 0; i < 300; i++) {
+        std::string extension = "ext" + std::to_string(i);
+        CHECK_EQUAL(lookup(index, extension.c_str()),
+            "application/x-test" + std::to_string(i % 40));
+    }
+    // case and a leading dot don't matter
+    CHECK_EQUAL(lookup(index, "txt"), "text/plain,text/x-other");
+    CHECK_EQUAL(lookup(index, ".TXT"), "text/plain,text/x-other");
+    CHECK_EQUAL(lookup(index, "unused"), "not found");
+    CHECK_EQUAL(lookup(index, "ext300"), "not found");
+    CHECK_EQUAL(lookup(index, ""), "not found");
+
+    extension_map read;
+    CHECK_EQUAL(index.GetEntries(read), B_OK);
+    entries.erase("unused");
+    CHECK(read == entries);
+
+    CHECK_EQUAL(ExtensionIndex::Write(path.c_str(), extension_map()), B_OK);
+    CHECK_EQUAL(index.SetTo(path.c_str()), B_OK);
+    CHECK_EQUAL(index.CountExtensions(), 0);
+    CHECK_EQUAL(lookup(index, "txt"), "not found");
+    CHECK_EQUAL(index.GetEntries(read), B_OK);
+    CHECK(read.empty());
+
+    CHECK_EQUAL(index.SetTo((test_directory() + "/missing").c_str()), B_ENTRY_NOT_FOUND);
+    CHECK_EQUAL(index.CountExtensions(), 0);
+}
+
+TEST(extension_index_update)
+{
+    DirectoryMimeDatabase database((test_directory() + "/db").c_str());
+    CHECK_EQUAL(database.Install("text/plain"), B_OK);
+    CHECK_EQUAL(database.Install("text/x-log"), B_OK);
+    CHECK_EQUAL(database.Install("image/png"), B_OK);
+    set_extensions(database, "text/plain", { "txt", "TEXT" });
+    set_extensions(database, "text/x-log", { ".log", "txt" });
+    set_extensions(database, "image/png", { "png" });
+
+    // without an index, it is built from the DB
+    std::string path = ExtensionIndex::PathFor(database);
+    CHECK_EQUAL(ExtensionIndex::Update(database, { { "text/plain", { "txt", "text" } } }), B_OK);
+    ExtensionIndex index;
+    CHECK_EQUAL(index.SetTo(path.c_str()), B_OK);
+    CHECK_EQUAL(index.CountExtensions(), 4);
+    CHECK_EQUAL(lookup(index, "txt"), "text/plain,text/x-log");
+    CHECK_EQUAL(lookup(index, "log"), "text/x-log");
+
+    // only the changed types are updated, the others are kept from the index
+    // even where the DB differs
+    set_extensions(database, "image/png", { "png", "apng" });
+    CHECK_EQUAL(ExtensionIndex::Update(database, {
+        { "text/plain", { "TXT", "asc" } },
+        { "text/x-log", {} },
+        { "text/x-new", { "new", ".txt" } } }), B_OK);
+    CHECK_EQUAL(index.SetTo(path.c_str()), B_OK);
+    CHECK_EQUAL(lookup(index, "txt"), "text/plain,text/x-new");
+    CHECK_EQUAL(lookup(index, "asc"), "text/plain");
+    CHECK_EQUAL(lookup(index, "new"), "text/x-new");
+    CHECK_EQUAL(lookup(index, "text"), "not found");
+    CHECK_EQUAL(lookup(index, "log"), "not found");
+    CHECK_EQUAL(lookup(index, "apng"), "not found");
+    CHECK_EQUAL(index.CountExtensions(), 4);
+
+    // a damaged index is rebuilt from the DB
+    std::string data = read_file(path);
+    data.resize(data.size() / 2);
+    CHECK_EQUAL(ReplaceFile(path.c_str(), data.data(), data.size()), B_OK);
+    CHECK_EQUAL(ExtensionIndex::Update(database, { { "image/png", { "png" } } }), B_OK);
+    CHECK_EQUAL(index.SetTo(path.c_str()), B_OK);
+    CHECK_EQUAL(lookup(index, "apng"), "image/png");
+    CHECK_EQUAL(lookup(index, "log"), "text/x-log");
+    CHECK_EQUAL(lookup(index, "txt"), "text/plain,text/x-log");
+}
+
+TEST(extension_index_bad_files)
+{
+    std::string path = test_directory() + "/index";
+    CHECK_EQUAL(ExtensionIndex::Write(path.c_str(), make_entries()), B_OK);
+    const std::string data = read_file(path);
+    CHECK(data.size() > kHeaderSize);
+
+    // every table ends within the file, cutting any of it is noticed
+    ExtensionIndex index;
+    for (size_t size = 0; size < data.size(); size += size < kHeaderSize + 8 ? 1 : 97) {
+        CHECK_EQUAL(ReplaceFile(path.c_str(), data.data(), size), B_OK);
+        CHECK_EQUAL(index.SetTo(path.c_str()), B_BAD_DATA);
+    }
+    CHECK_EQUAL(ReplaceFile(path.c_str(), data.data(), data.size() - 1), B_OK);
+    CHECK_EQUAL(index.SetTo(path.c_str()), B_BAD_DATA);
+
+    struct {
+        size_t  offset;
+        uint32  value;
+    } headerChanges[] = {
+        { 0, 0 },
+        { kVersionOffset, 2 },
+        { kBucketCountOffset, 0 },
+        { kBucketCountOffset, 0x40000000 },
+        { kSlotsOffsetOffset, 0xfffffff0 },
+        { kSlotsOffsetOffset, (uint32)kHeaderSize + 2 },
+        { kStringsSizeOffset, 0xffffffff },
+        // the strings don't end with a NUL
+        { kStringsSizeOffset, 3 }
+    };
+    for (const auto& change : headerChanges) {
+        std::string bad = data;
+        set_uint32(bad, change.offset, change.value);
+        CHECK_EQUAL(ReplaceFile(path.c_str(), bad.data(), bad.size()), B_OK);
+        CHECK_EQUAL(index.SetTo(path.c_str()), B_BAD_DATA);
+        CHECK_EQUAL(lookup(index, "txt"), "error");
+    }
+
+    // Damage within the tables mostly can't be told from data, but never
+    // reads outside of them: lookups and listing fail or return something.
+    for (size_t offset = kHeaderSize; offset < data.size(); offset += 3) {
+        std::string bad = data;
+        bad[offset] = (char)0xff;
+        bad[offset - 1] ^= 0x55;
+        CHECK_EQUAL(ReplaceFile(path.c_str(), bad.data(), bad.size()), B_OK);
+        status_t result = index.SetTo(path.c_str());
+        CHECK(result == B_OK || result == B_BAD_DATA);
+        if (result != B_OK)
+            continue;
+
+        extension_map entries;
+        result = index.GetEntries(entries);
+        CHECK(result == B_OK || result == B_BAD_DATA);
+        lookup(index, "txt");
+        lookup(index, "ext17");
+    }
+}
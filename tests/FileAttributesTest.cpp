@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#ifndef __HAIKU__
+#include <sys/xattr.h>
+#endif
+
+#include "FileAttributes.h"
+
+TEST(file_attributes_round_trip)
+{
+    std::string path = test_write_file("node", "");
+    const char value[] = "application/x-vnd.test";
+    CHECK_EQUAL(WriteAttribute(path.c_str(), "test:string", B_MIME_STRING_TYPE, value,
+        sizeof(value)), B_OK);
+    const uint8 bytes[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    CHECK_EQUAL(WriteAttribute(path.c_str(), "test:raw", B_RAW_TYPE, bytes, sizeof(bytes)),
+        B_OK);
+
+    std::string data;
+    type_code type = 0;
+    CHECK_EQUAL(ReadAttribute(path.c_str(), "test:string", data, &type), B_OK);
+    CHECK_EQUAL(data, std::string(value, sizeof(value)));
+    CHECK_EQUAL(type, (type_code)B_MIME_STRING_TYPE);
+    CHECK_EQUAL(ReadAttribute(path.c_str(), "test:raw", data, &type), B_OK);
+    CHECK_EQUAL(data, std::string((const char*)bytes, sizeof(bytes)));
+    CHECK_EQUAL(type, (type_code)B_RAW_TYPE);
+
+    // a shorter value replaces a longer one
+    CHECK_EQUAL(WriteAttribute(path.c_str(), "test:string", 'TEST', "ab", 2), B_OK);
+    CHECK_EQUAL(ReadAttribute(path.c_str(), "test:string", data, &type), B_OK);
+    CHECK_EQUAL(data, "ab");
+    CHECK_EQUAL(type, (type_code)'TEST');
+
+    // empty values keep their type, too
+    CHECK_EQUAL(WriteAttribute(path.c_str(), "test:empty", B_INT32_TYPE, "", 0), B_OK);
+    CHECK_EQUAL(ReadAttribute(path.c_str(), "test:empty", data, &type), B_OK);
+    CHECK(data.empty());
+    CHECK_EQUAL(type, (type_code)B_INT32_TYPE);
+}
+
+TEST(file_attributes_remove)
+{
+    std::string path = test_write_file("node", "");
+    CHECK_EQUAL(WriteAttribute(path.c_str(), "test:gone", B_RAW_TYPE, "x", 1), B_OK);
+    CHECK_EQUAL(RemoveAttribute(path.c_str(), "test:gone"), B_OK);
+
+    std::string data;
+    CHECK(ReadAttribute(path.c_str(), "test:gone", data) != B_OK);
+    CHECK(ReadAttribute(path.c_str(), "test:missing", data) != B_OK);
+}
+
+TEST(file_attributes_large_value)
+{
+    std::string path = test_write_file("node", "");
+    std::string value(256 * 1024, 'v');
+
+    // too large for extended attributes, BFS takes it
+    status_t result = WriteAttribute(path.c_str(), "test:large", B_RAW_TYPE, value.data(),
+        value.size());
+#ifdef __HAIKU__
+    CHECK_EQUAL(result, B_OK);
+#else
+    CHECK_EQUAL(result, B_BUFFER_OVERFLOW);
+#endif
+
+    std::string data;
+    if (result == B_OK) {
+        CHECK_EQUAL(ReadAttribute(path.c_str(), "test:large", data), B_OK);
+        CHECK(data == value);
+    } else
+        CHECK(ReadAttribute(path.c_str(), "test:large", data) != B_OK);
+}
+
+#ifndef __HAIKU__
+
+TEST(file_attributes_untyped_xattr)
+{
+    // written by another tool, without the type header
+    std::string path = test_write_file("node", "");
+    CHECK_EQUAL(setxattr(path.c_str(), "user.test:foreign", "text/plain", 10, 0), 0);
+
+    std::string data;
+    type_code type = 0;
+    CHECK_EQUAL(ReadAttribute(path.c_str(), "test:foreign", data, &type), B_OK);
+    CHECK_EQUAL(data, "text/plain");
+    CHECK_EQUAL(type, (type_code)B_RAW_TYPE);
+}
+
+#endif // !__HAIKU__
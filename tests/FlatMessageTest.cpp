@@ -0,0 +1,380 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "FlatMessage.h"
+
+struct test_field {
+    const char*     name;
+    type_code       type;
+    bool            fixedSize;
+    std::vector<std::string> items;
+};
+
+// where the parts of a built message are, for corrupting them
+struct message_layout {
+    size_t          fields;     // first field header
+    size_t          data;
+};
+
+static const size_t kFieldHeaderSize = 24;
+
+static void
+append16(std::string& data, uint16 value, bool bigEndian)
+{
+    for (int32 i = 0; i < 2; i++)
+        data += (char)(value >> (bigEndian ? 8 * (1 - i) : 8 * i));
+}
+
+static void
+append32(std::string& data, uint32 value, bool bigEndian)
+{
+    for (int32 i = 0; i < 4; i++)
+        data += (char)(value >> (bigEndian ? 8 * (3 - i) : 8 * i));
+}
+
+static void
+patch16(std::string& data, size_t offset, uint16 value, bool bigEndian)
+{
+    std::string bytes;
+    append16(bytes, value, bigEndian);
+    data.replace(offset, 2, bytes);
+}
+
+static void
+patch32(std::string& data, size_t offset, uint32 value, bool bigEndian)
+{
+    std::string bytes;
+    append32(bytes, value, bigEndian);
+    data.replace(offset, 4, bytes);
+}
+
+static std::string
+int32_item(int32 value, bool bigEndian)
+{
+    std::string item;
+    append32(item, (uint32)value, bigEndian);
+    return item;
+}
+
+// Lays out a flattened message by hand, independent of FlatMessageWriter:
+// a hash table with a single chain through all fields, then the field
+// headers and the data.
+static std::string
+build_message(const std::vector<test_field>& fields, bool bigEndian,
+    message_layout* layout = NULL)
+{
+    std::string headers;
+    std::string data;
+    for (size_t i = 0; i < fields.size(); i++) {
+        const test_field& field = fields[i];
+        std::string items;
+        for (const std::string& item : field.items) {
+            if (!field.fixedSize)
+                append32(items, (uint32)item.size(), bigEndian);
+            items += item;
+        }
+        append16(headers, field.fixedSize ? 0x3 : 0x1, bigEndian);
+        append16(headers, (uint16)(strlen(field.name) + 1), bigEndian);
+        append32(headers, field.type, bigEndian);
+        append32(headers, (uint32)field.items.size(), bigEndian);
+        append32(headers, (uint32)items.size(), bigEndian);
+        append32(headers, (uint32)data.size(), bigEndian);
+        append32(headers, i + 1 < fields.size() ? (uint32)i + 1 : (uint32)-1, bigEndian);
+        data.append(field.name, strlen(field.name) + 1);
+        data += items;
+    }
+
+    std::string message;
+    append32(message, '1FMH', bigEndian);
+    append32(message, 'test', bigEndian);
+    append32(message, 1, bigEndian);
+    for (int32 i = 0; i < 6; i++)
+        append32(message, (uint32)-1, bigEndian);
+    append32(message, (uint32)data.size(), bigEndian);
+    append32(message, (uint32)fields.size(), bigEndian);
+    append32(message, 1, bigEndian);
+    append32(message, fields.empty() ? (uint32)-1 : 0, bigEndian);
+
+    if (layout != NULL) {
+        layout->fields = message.size();
+        layout->data = message.size() + headers.size();
+    }
+    return message + headers + data;
+}
+
+static std::vector<test_field>
+sample_fields(bool bigEndian)
+{
+    return {
+        { "extensions", B_STRING_TYPE, false,
+            { std::string("png", 4), std::string("jpeg", 5), std::string("x", 2) } },
+        { "attr:type", B_INT32_TYPE, true,
+            { int32_item(B_STRING_TYPE, bigEndian), int32_item(-7, bigEndian) } },
+        { "attr:viewable", B_BOOL_TYPE, true, { std::string("\x01", 1), std::string("\x00", 1) } }
+    };
+}
+
+static void
+check_sample(const FlatMessage& message)
+{
+    CHECK_EQUAL(message.InitCheck(), B_OK);
+    CHECK_EQUAL(message.What(), (uint32)'test');
+    CHECK_EQUAL(message.CountFields(), 3);
+
+    FlatMessageField extensions = message.FindField("extensions", B_STRING_TYPE);
+    CHECK(extensions.IsValid());
+    CHECK_EQUAL(extensions.CountItems(), 3);
+    CHECK(extensions.StringAt(0) == "png");
+    CHECK(extensions.StringAt(1) == "jpeg");
+    CHECK(extensions.StringAt(2) == "x");
+    CHECK(extensions.StringAt(3, "none") == "none");
+    CHECK(extensions.StringAt(-1, "none") == "none");
+    // strings are not numbers
+    CHECK_EQUAL(extensions.UInt32At(0, 42), 42u);
+
+    FlatMessageField types = message.FindField("attr:type");
+    CHECK(types.IsValid() && types.Type() == B_INT32_TYPE);
+    CHECK_EQUAL(types.UInt32At(0), (uint32)B_STRING_TYPE);
+    CHECK_EQUAL(types.Int32At(1), -7);
+    CHECK_EQUAL(types.Int32At(2, 5), 5);
+    CHECK(types.StringAt(0, "none") == "none");
+
+    CHECK(message.GetBool("attr:viewable", 0));
+    CHECK(!message.GetBool("attr:viewable", 1, true));
+    CHECK(message.GetBool("attr:viewable", 2, true));
+
+    CHECK(!message.FindField("attr:type", B_STRING_TYPE).IsValid());
+    CHECK(!message.FindField("missing").IsValid());
+    CHECK(message.GetString("missing", 0, "default") == "default");
+    CHECK(message.FieldAt(2).Name() == "attr:viewable");
+    CHECK(!message.FieldAt(3).IsValid());
+}
+
+TEST(flat_message_little_endian)
+{
+    std::string data = build_message(sample_fields(false), false);
+    check_sample(FlatMessage(data.data(), data.size()));
+}
+
+TEST(flat_message_big_endian)
+{
+    std::string data = build_message(sample_fields(true), true);
+    check_sample(FlatMessage(data.data(), data.size()));
+}
+
+TEST(flat_message_writer_round_trip)
+{
+    FlatMessageWriter writer('test');
+    CHECK_EQUAL(writer.AddString("extensions", "png"), B_OK);
+    CHECK_EQUAL(writer.AddString("extensions", "jpeg"), B_OK);
+    CHECK_EQUAL(writer.AddString("extensions", "x"), B_OK);
+    int32 type = B_STRING_TYPE;
+    CHECK_EQUAL(writer.AddData("attr:type", B_INT32_TYPE, &type, sizeof(type)), B_OK);
+    type = -7;
+    CHECK_EQUAL(writer.AddData("attr:type", B_INT32_TYPE, &type, sizeof(type)), B_OK);
+    bool viewable = true;
+    CHECK_EQUAL(writer.AddData("attr:viewable", B_BOOL_TYPE, &viewable, 1), B_OK);
+    viewable = false;
+    CHECK_EQUAL(writer.AddData("attr:viewable", B_BOOL_TYPE, &viewable, 1), B_OK);
+
+    // a field keeps its type, a fixed size field the size of its items
+    CHECK_EQUAL(writer.AddString("attr:type", "x"), B_BAD_TYPE);
+    CHECK_EQUAL(writer.AddData("attr:viewable", B_BOOL_TYPE, &type, sizeof(type)), B_BAD_VALUE);
+    CHECK_EQUAL(writer.AddData("", B_BOOL_TYPE, &viewable, 1), B_BAD_VALUE);
+
+    std::string data;
+    writer.Flatten(data);
+    FlatMessage message(data.data(), data.size());
+    check_sample(message);
+    CHECK_EQUAL(message.FlattenedSize(), data.size());
+}
+
+// variable sized items are found walking from the last one looked up, also
+// when going backwards
+TEST(flat_message_variable_size_items)
+{
+    std::vector<test_field> fields = {
+        { "data", B_RAW_TYPE, false, { "", std::string(300, 'a'), "bc", std::string(1, '\0') } }
+    };
+    std::string data = build_message(fields, false);
+    FlatMessage message(data.data(), data.size());
+    FlatMessageField field = message.FindField("data");
+
+    const void* item;
+    size_t size;
+    CHECK(field.ItemAt(2, &item, &size) && size == 2 && memcmp(item, "bc", 2) == 0);
+    CHECK(field.ItemAt(0, &item, &size) && size == 0);
+    CHECK(field.ItemAt(3, &item, &size) && size == 1);
+    CHECK(field.ItemAt(1, &item, &size) && size == 300);
+    CHECK(!field.ItemAt(4, &item, &size));
+}
+
+TEST(flat_message_fixed_size_items)
+{
+    std::vector<test_field> fields = {
+        { "points", 'BPNT', true, { std::string(8, '\x01'), std::string(8, '\x02') } }
+    };
+    std::string data = build_message(fields, true);
+    FlatMessage message(data.data(), data.size());
+    FlatMessageField field = message.FindField("points");
+
+    const void* item;
+    size_t size;
+    CHECK(field.ItemAt(1, &item, &size) && size == 8
+        && memcmp(item, std::string(8, '\x02').data(), 8) == 0);
+    CHECK(!field.ItemAt(2, &item, &size));
+}
+
+TEST(flat_message_has_same_data)
+{
+    std::string little = build_message(sample_fields(false), false);
+    std::string big = build_message(sample_fields(true), true);
+    FlatMessage littleMessage(little.data(), little.size());
+    FlatMessage bigMessage(big.data(), big.size());
+    CHECK(littleMessage.HasSameData(bigMessage));
+    CHECK(bigMessage.HasSameData(littleMessage));
+    CHECK(littleMessage.FindField("attr:type").HasSameData(bigMessage.FindField("attr:type")));
+
+    // the order of the fields does not matter
+    std::vector<test_field> fields = sample_fields(false);
+    std::swap(fields[0], fields[2]);
+    std::string reordered = build_message(fields, false);
+    CHECK(littleMessage.HasSameData(FlatMessage(reordered.data(), reordered.size())));
+
+    // another item, one item more, another type, a missing field
+    fields = sample_fields(false);
+    fields[0].items[1] = std::string("jpg", 4);
+    std::string changed = build_message(fields, false);
+    CHECK(!littleMessage.HasSameData(FlatMessage(changed.data(), changed.size())));
+
+    fields = sample_fields(false);
+    fields[1].items.push_back(int32_item(1, false));
+    changed = build_message(fields, false);
+    CHECK(!littleMessage.HasSameData(FlatMessage(changed.data(), changed.size())));
+
+    fields = sample_fields(false);
+    fields[1].type = B_UINT32_TYPE;
+    changed = build_message(fields, false);
+    CHECK(!littleMessage.HasSameData(FlatMessage(changed.data(), changed.size())));
+
+    fields = sample_fields(false);
+    fields.pop_back();
+    changed = build_message(fields, false);
+    CHECK(!littleMessage.HasSameData(FlatMessage(changed.data(), changed.size())));
+
+    // an invalid message equals nothing, not even itself
+    FlatMessage invalid;
+    CHECK(!invalid.HasSameData(invalid));
+    CHECK(!littleMessage.HasSameData(invalid));
+}
+
+TEST(flat_message_truncated)
+{
+    for (bool bigEndian : { false, true }) {
+        std::string data = build_message(sample_fields(bigEndian), bigEndian);
+        for (size_t size = 0; size < data.size(); size++) {
+            // copied, so reading past the end is caught by sanitizers
+            std::vector<uint8> truncated(data.begin(), data.begin() + size);
+            FlatMessage message(truncated.data(), size);
+            CHECK(message.InitCheck() != B_OK);
+            CHECK(!message.FindField("extensions").IsValid());
+        }
+    }
+
+    FlatMessage message(NULL, 100);
+    CHECK_EQUAL(message.InitCheck(), B_BAD_VALUE);
+    CHECK(!FlatMessage::IsFlatMessage("1FMH", 4));
+}
+
+TEST(flat_message_corrupt)
+{
+    message_layout layout;
+    const std::string valid = build_message(sample_fields(false), false, &layout);
+    CHECK(FlatMessage::IsFlatMessage(valid.data(), valid.size()));
+
+    auto status = [](const std::string& data) {
+        return FlatMessage(data.data(), data.size()).InitCheck();
+    };
+    CHECK_EQUAL(status(valid), B_OK);
+
+    std::string data = valid;
+    patch32(data, 0, 'abcd', false);
+    CHECK_EQUAL(status(data), B_NOT_SUPPORTED);
+    CHECK(!FlatMessage::IsFlatMessage(data.data(), data.size()));
+
+    // counts and sizes reaching past the end of the message
+    data = valid;
+    patch32(data, 36, 0xffffffff, false);
+    CHECK_EQUAL(status(data), B_BAD_DATA);
+    data = valid;
+    patch32(data, 40, 0x7fffffff, false);
+    CHECK_EQUAL(status(data), B_BAD_DATA);
+    data = valid;
+    patch32(data, 40, 0xffffffff, false);
+    CHECK_EQUAL(status(data), B_BAD_DATA);
+    data = valid;
+    patch32(data, 44, 0x40000000, false);
+    CHECK_EQUAL(status(data), B_BAD_DATA);
+
+    // a field without name, a name without NUL, data past the data section
+    data = valid;
+    patch16(data, layout.fields + 2, 0, false);
+    CHECK_EQUAL(status(data), B_BAD_DATA);
+    data = valid;
+    patch16(data, layout.fields + 2, 3, false);
+    CHECK_EQUAL(status(data), B_BAD_DATA);
+    data = valid;
+    patch32(data, layout.fields + 12, 0x10000, false);
+    CHECK_EQUAL(status(data), B_BAD_DATA);
+    data = valid;
+    patch32(data, layout.fields + 16, 0xfffffff0, false);
+    CHECK_EQUAL(status(data), B_BAD_DATA);
+
+    // fixed size items that don't divide the field size
+    data = valid;
+    patch32(data, layout.fields + kFieldHeaderSize + 8, 3, false);
+    CHECK_EQUAL(status(data), B_BAD_DATA);
+}
+
+// corruption within the field data is only found when the items are read
+TEST(flat_message_corrupt_items)
+{
+    message_layout layout;
+    const std::string valid = build_message(sample_fields(false), false, &layout);
+
+    // the size of the second string reaches past the field
+    std::string data = valid;
+    size_t firstItem = layout.data + strlen("extensions") + 1;
+    patch32(data, firstItem + 4 + 4, 0xfffffff0, false);
+    FlatMessage message(data.data(), data.size());
+    CHECK_EQUAL(message.InitCheck(), B_OK);
+    FlatMessageField field = message.FindField("extensions");
+    CHECK(field.StringAt(0) == "png");
+    CHECK(field.StringAt(1, "bad") == "bad");
+    CHECK(field.StringAt(2, "bad") == "bad");
+
+    // more items than the field holds
+    data = valid;
+    patch32(data, layout.fields + 8, 100, false);
+    message.SetTo(data.data(), data.size());
+    CHECK(message.FindField("extensions").StringAt(50, "bad") == "bad");
+
+    // a hash chain that loops, or leads out of the field directory
+    data = valid;
+    patch32(data, layout.fields + 2 * kFieldHeaderSize + 20, 0, false);
+    message.SetTo(data.data(), data.size());
+    CHECK(!message.FindField("missing").IsValid());
+    CHECK(message.FindField("attr:viewable").IsValid());
+    data = valid;
+    patch32(data, 48, 1000, false);
+    message.SetTo(data.data(), data.size());
+    CHECK(!message.FindField("extensions").IsValid());
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "IndexKey.h"
+
+template<typename Value>
+static std::string
+make_key(type_code type, Value value)
+{
+    std::string key;
+    CHECK_EQUAL(MakeIndexKey(type, &value, sizeof(value), key), B_OK);
+    return key;
+}
+
+static std::string
+parse_key(type_code type, const char* text)
+{
+    std::string key;
+    CHECK_EQUAL(ParseIndexKey(type, text, key), B_OK);
+    return key;
+}
+
+static status_t
+parse_result(type_code type, const char* text)
+{
+    std::string key;
+    return ParseIndexKey(type, text, key);
+}
+
+// every key sorts before the next one
+static void
+check_ascending(const std::vector<std::string>& keys)
+{
+    for (size_t i = 1; i < keys.size(); i++) {
+        CHECK_EQUAL(CompareIndexKeys(keys[i - 1], keys[i]), -1);
+        CHECK_EQUAL(CompareIndexKeys(keys[i], keys[i - 1]), 1);
+    }
+}
+
+TEST(index_key_integers)
+{
+    CHECK_EQUAL(make_key(B_INT32_TYPE, (int32)0), std::string("\x80\x00\x00\x00", 4));
+    CHECK_EQUAL(make_key(B_INT32_TYPE, (int32)-1), std::string("\x7f\xff\xff\xff", 4));
+    CHECK_EQUAL(make_key(B_INT32_TYPE, (int32)0x01020304),
+        std::string("\x81\x02\x03\x04", 4));
+    CHECK_EQUAL(make_key(B_UINT32_TYPE, (uint32)0x01020304),
+        std::string("\x01\x02\x03\x04", 4));
+    CHECK_EQUAL(make_key(B_INT64_TYPE, (int64)1),
+        std::string("\x80\x00\x00\x00\x00\x00\x00\x01", 8));
+    CHECK_EQUAL(make_key(B_UINT64_TYPE, (uint64)1),
+        std::string("\x00\x00\x00\x00\x00\x00\x00\x01", 8));
+
+    check_ascending({ make_key(B_INT32_TYPE, (int32)INT32_MIN),
+        make_key(B_INT32_TYPE, (int32)-300), make_key(B_INT32_TYPE, (int32)-1),
+        make_key(B_INT32_TYPE, (int32)0), make_key(B_INT32_TYPE, (int32)255),
+        make_key(B_INT32_TYPE, (int32)256), make_key(B_INT32_TYPE, (int32)INT32_MAX) });
+    check_ascending({ make_key(B_UINT32_TYPE, (uint32)0), make_key(B_UINT32_TYPE, (uint32)255),
+        make_key(B_UINT32_TYPE, (uint32)0x80000000), make_key(B_UINT32_TYPE, UINT32_MAX) });
+    check_ascending({ make_key(B_INT64_TYPE, (int64)INT64_MIN),
+        make_key(B_INT64_TYPE, (int64)-1), make_key(B_INT64_TYPE, (int64)0),
+        make_key(B_INT64_TYPE, (int64)1 << 40), make_key(B_INT64_TYPE, (int64)INT64_MAX) });
+    check_ascending({ make_key(B_UINT64_TYPE, (uint64)0), make_key(B_UINT64_TYPE, (uint64)1),
+        make_key(B_UINT64_TYPE, (uint64)1 << 63), make_key(B_UINT64_TYPE, UINT64_MAX) });
+
+    // times are 64 bit keys, also when stored in 32 bit
+    CHECK_EQUAL(make_key(B_TIME_TYPE, (int32)-5), make_key(B_TIME_TYPE, (int64)-5));
+    CHECK_EQUAL(make_key(B_TIME_TYPE, (int64)-5), make_key(B_INT64_TYPE, (int64)-5));
+
+    std::string key;
+    CHECK_EQUAL(MakeIndexKey(B_INT32_TYPE, "abc", 3, key), B_BAD_DATA);
+    CHECK_EQUAL(MakeIndexKey(B_INT64_TYPE, "abcd", 4, key), B_BAD_DATA);
+    CHECK_EQUAL(MakeIndexKey(B_RAW_TYPE, "abcd", 4, key), B_BAD_TYPE);
+    CHECK(!IsIndexKeyType(B_RAW_TYPE));
+    CHECK(!IsIndexKeyType(B_BOOL_TYPE));
+}
+
+TEST(index_key_floats)
+{
+    CHECK_EQUAL(make_key(B_FLOAT_TYPE, 0.0f), std::string("\x80\x00\x00\x00", 4));
+    CHECK_EQUAL(make_key(B_FLOAT_TYPE, 1.0f), std::string("\xbf\x80\x00\x00", 4));
+    CHECK_EQUAL(make_key(B_FLOAT_TYPE, -1.0f), std::string("\x40\x7f\xff\xff", 4));
+    CHECK_EQUAL(make_key(B_DOUBLE_TYPE, 1.0),
+        std::string("\xbf\xf0\x00\x00\x00\x00\x00\x00", 8));
+
+    // negative zero sorts just before zero
+    check_ascending({ make_key(B_FLOAT_TYPE, -INFINITY), make_key(B_FLOAT_TYPE, -2.5f),
+        make_key(B_FLOAT_TYPE, -1.0f), make_key(B_FLOAT_TYPE, -1e-30f),
+        make_key(B_FLOAT_TYPE, -0.0f), make_key(B_FLOAT_TYPE, 0.0f),
+        make_key(B_FLOAT_TYPE, 1e-30f), make_key(B_FLOAT_TYPE, 1.0f),
+        make_key(B_FLOAT_TYPE, 2.5f), make_key(B_FLOAT_TYPE, INFINITY) });
+    check_ascending({ make_key(B_DOUBLE_TYPE, -HUGE_VAL), make_key(B_DOUBLE_TYPE, -1e300),
+        make_key(B_DOUBLE_TYPE, -1.5), make_key(B_DOUBLE_TYPE, -0.0),
+        make_key(B_DOUBLE_TYPE, 0.0), make_key(B_DOUBLE_TYPE, 1.5),
+        make_key(B_DOUBLE_TYPE, 1e300), make_key(B_DOUBLE_TYPE, HUGE_VAL) });
+
+    std::string key;
+    CHECK_EQUAL(MakeIndexKey(B_FLOAT_TYPE, "abcdefgh", 8, key), B_BAD_DATA);
+    CHECK_EQUAL(MakeIndexKey(B_DOUBLE_TYPE, "abcd", 4, key), B_BAD_DATA);
+}
+
+TEST(index_key_strings)
+{
+    std::string key;
+    CHECK_EQUAL(MakeIndexKey(B_STRING_TYPE, "text/plain", 11, key), B_OK);
+    CHECK_EQUAL(key, "text/plain");
+    // up to the first NUL, or all of it without one
+    CHECK_EQUAL(MakeIndexKey(B_MIME_STRING_TYPE, "ab\0cd", 5, key), B_OK);
+    CHECK_EQUAL(key, "ab");
+    CHECK_EQUAL(MakeIndexKey(B_STRING_TYPE, "abcd", 2, key), B_OK);
+    CHECK_EQUAL(key, "ab");
+
+    // long values are cut like BFS does
+    std::string value(300, 'x');
+    CHECK_EQUAL(MakeIndexKey(B_STRING_TYPE, value.data(), value.size(), key), B_OK);
+    CHECK_EQUAL(key.size(), (size_t)MAX_INDEX_KEY_LENGTH);
+
+    // bytes compare unsigned, a prefix first
+    check_ascending({ "", "A", "a", "ab", "abc", "b", "z", "\xc3\xa4" });
+    CHECK_EQUAL(CompareIndexKeys("same", "same"), 0);
+}
+
+TEST(index_key_parse)
+{
+    CHECK_EQUAL(parse_key(B_INT32_TYPE, "42"), make_key(B_INT32_TYPE, (int32)42));
+    CHECK_EQUAL(parse_key(B_INT32_TYPE, "-2147483648"), make_key(B_INT32_TYPE, (int32)INT32_MIN));
+    CHECK_EQUAL(parse_key(B_INT32_TYPE, "2147483647"), make_key(B_INT32_TYPE, (int32)INT32_MAX));
+    CHECK_EQUAL(parse_key(B_UINT32_TYPE, "4294967295"), make_key(B_UINT32_TYPE, UINT32_MAX));
+    CHECK_EQUAL(parse_key(B_INT64_TYPE, "-9223372036854775808"),
+        make_key(B_INT64_TYPE, (int64)INT64_MIN));
+    CHECK_EQUAL(parse_key(B_UINT64_TYPE, "18446744073709551615"),
+        make_key(B_UINT64_TYPE, UINT64_MAX));
+    CHECK_EQUAL(parse_key(B_TIME_TYPE, "-1"), make_key(B_TIME_TYPE, (int64)-1));
+    CHECK_EQUAL(parse_key(B_FLOAT_TYPE, "1.5"), make_key(B_FLOAT_TYPE, 1.5f));
+    CHECK_EQUAL(parse_key(B_DOUBLE_TYPE, "-1e300"), make_key(B_DOUBLE_TYPE, -1e300));
+    CHECK_EQUAL(parse_key(B_STRING_TYPE, "text/plain"), "text/plain");
+    CHECK_EQUAL(parse_key(B_STRING_TYPE, ""), "");
+
+    // outside the range of the type, or no number at all
+    CHECK_EQUAL(parse_result(B_INT32_TYPE, "2147483648"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_INT32_TYPE, "-2147483649"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_UINT32_TYPE, "4294967296"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_UINT32_TYPE, "-1"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_INT64_TYPE, "9223372036854775808"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_UINT64_TYPE, "18446744073709551616"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_INT32_TYPE, ""), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_INT32_TYPE, "12x"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_INT32_TYPE, "1.5"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_FLOAT_TYPE, "nan"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_FLOAT_TYPE, "1e40"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_DOUBLE_TYPE, "1.5.2"), B_BAD_VALUE);
+    CHECK_EQUAL(parse_result(B_RAW_TYPE, "1"), B_BAD_TYPE);
+}
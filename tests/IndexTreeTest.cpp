@@ -0,0 +1,227 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "IndexTree.h"
+#include "MappedFile.h"
+
+static std::string
+int32_key(int32 value)
+{
+    std::string key;
+    MakeIndexKey(B_INT32_TYPE, &value, sizeof(value), key);
+    return key;
+}
+
+static std::string
+file_name(int32 index)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "file%04" B_PRId32, index);
+    return name;
+}
+
+static index_range
+int32_range(int32 lower, int32 upper)
+{
+    index_range range;
+    range.lower = int32_key(lower);
+    range.hasLower = true;
+    range.upper = int32_key(upper);
+    range.hasUpper = true;
+    return range;
+}
+
+static std::vector<index_tree_entry>
+read_entries(const IndexTree& tree, const index_range& range)
+{
+    std::vector<index_tree_entry> entries;
+    CHECK_EQUAL(tree.Read(range, [&entries](const std::string& key, const std::string& path) {
+            entries.push_back(index_tree_entry{ key, path });
+            return true;
+        }), B_OK);
+    return entries;
+}
+
+// Keys 0 to 9, a thousand files with key 50, and keys 100 to 109. All
+// entries have the same size, so 255 fit a leaf and the duplicates fill the
+// two leaves in the middle and most of the first and the last.
+static std::vector<index_tree_entry>
+duplicate_entries()
+{
+    std::vector<index_tree_entry> entries;
+    for (int32 i = 0; i < 10; i++)
+        entries.push_back(index_tree_entry{ int32_key(109 - i), file_name(i) });
+    for (int32 i = 999; i >= 0; i--)
+        entries.push_back(index_tree_entry{ int32_key(50), file_name(i) });
+    for (int32 i = 0; i < 10; i++)
+        entries.push_back(index_tree_entry{ int32_key(i), file_name(i) });
+    return entries;
+}
+
+TEST(index_tree_round_trip)
+{
+    std::vector<index_tree_entry> entries = duplicate_entries();
+    std::string path = test_directory() + "/index";
+    CHECK_EQUAL(WriteIndexTree(path.c_str(), B_INT32_TYPE, entries), B_OK);
+
+    IndexTree tree;
+    CHECK_EQUAL(tree.SetTo(path.c_str()), B_OK);
+    CHECK_EQUAL(tree.Type(), (type_code)B_INT32_TYPE);
+    CHECK_EQUAL(tree.CountEntries(), 1020u);
+
+    // everything, sorted by key and then path
+    std::vector<index_tree_entry> all = read_entries(tree, index_range());
+    CHECK_EQUAL(all.size(), 1020u);
+    for (size_t i = 1; i < all.size(); i++) {
+        int compare = CompareIndexKeys(all[i - 1].key, all[i].key);
+        CHECK(compare < 0 || (compare == 0 && all[i - 1].path < all[i].path));
+    }
+    CHECK(all.size() == 1020 && all.front().key == int32_key(0) && all[10].path == "file0000"
+        && all.back().key == int32_key(109));
+
+    uint64 count;
+    CHECK_EQUAL(tree.EstimateCount(index_range(), count), B_OK);
+    CHECK_EQUAL(count, 1020u);
+}
+
+TEST(index_tree_range_scans)
+{
+    std::vector<index_tree_entry> entries = duplicate_entries();
+    std::string path = test_directory() + "/index";
+    CHECK_EQUAL(WriteIndexTree(path.c_str(), B_INT32_TYPE, entries), B_OK);
+    IndexTree tree;
+    CHECK_EQUAL(tree.SetTo(path.c_str()), B_OK);
+
+    std::vector<index_tree_entry> found = read_entries(tree, int32_range(3, 5));
+    CHECK(found.size() == 3 && found[0].key == int32_key(3) && found[2].key == int32_key(5));
+    CHECK_EQUAL(read_entries(tree, int32_range(11, 49)).size(), 0u);
+    CHECK_EQUAL(read_entries(tree, int32_range(110, 200)).size(), 0u);
+    CHECK_EQUAL(read_entries(tree, int32_range(-10, -1)).size(), 0u);
+    // the wrong way round
+    CHECK_EQUAL(read_entries(tree, int32_range(9, 0)).size(), 0u);
+
+    // open at one end
+    index_range lower;
+    lower.lower = int32_key(100);
+    lower.hasLower = true;
+    CHECK_EQUAL(read_entries(tree, lower).size(), 10u);
+    index_range upper;
+    upper.upper = int32_key(9);
+    upper.hasUpper = true;
+    CHECK_EQUAL(read_entries(tree, upper).size(), 10u);
+
+    // the callback stops the scan
+    int32 calls = 0;
+    CHECK_EQUAL(tree.Read(index_range(), [&calls](const std::string&, const std::string&) {
+            return ++calls < 5;
+        }), B_OK);
+    CHECK_EQUAL(calls, 5);
+}
+
+TEST(index_tree_duplicates_across_leaves)
+{
+    std::vector<index_tree_entry> entries = duplicate_entries();
+    std::string path = test_directory() + "/index";
+    CHECK_EQUAL(WriteIndexTree(path.c_str(), B_INT32_TYPE, entries), B_OK);
+    IndexTree tree;
+    CHECK_EQUAL(tree.SetTo(path.c_str()), B_OK);
+
+    MappedFile file;
+    CHECK_EQUAL(file.SetTo(path.c_str()), B_OK);
+    const index_tree_header* header = (const index_tree_header*)file.Data();
+    CHECK_EQUAL(header->leafCount, 4u);
+    CHECK_EQUAL(header->height, 2u);
+
+    // found from the first leaf with the key on, not only from the leaf the
+    // inner page points to with it
+    std::vector<index_tree_entry> found = read_entries(tree, int32_range(50, 50));
+    CHECK_EQUAL(found.size(), 1000u);
+    CHECK(found.size() == 1000 && found.front().path == "file0000"
+        && found.back().path == "file0999");
+    CHECK_EQUAL(read_entries(tree, int32_range(9, 100)).size(), 1002u);
+
+    // the leaves are equally full, so the estimate is exact
+    uint64 count;
+    CHECK_EQUAL(tree.EstimateCount(int32_range(50, 50), count), B_OK);
+    CHECK_EQUAL(count, 1000u);
+    CHECK_EQUAL(tree.EstimateCount(int32_range(0, 50), count), B_OK);
+    CHECK_EQUAL(count, 1010u);
+    CHECK_EQUAL(tree.EstimateCount(int32_range(3, 5), count), B_OK);
+    CHECK_EQUAL(count, 3u);
+    CHECK_EQUAL(tree.EstimateCount(int32_range(11, 49), count), B_OK);
+    CHECK_EQUAL(count, 0u);
+    CHECK_EQUAL(tree.EstimateCount(int32_range(9, 0), count), B_OK);
+    CHECK_EQUAL(count, 0u);
+}
+
+TEST(index_tree_three_levels)
+{
+    // more leaves than fit an inner page
+    const int32 kCount = 300000;
+    std::vector<index_tree_entry> entries;
+    for (int32 i = 0; i < kCount; i++)
+        entries.push_back(index_tree_entry{ int32_key(i), "f" });
+    std::string path = test_directory() + "/index";
+    CHECK_EQUAL(WriteIndexTree(path.c_str(), B_INT32_TYPE, entries), B_OK);
+    IndexTree tree;
+    CHECK_EQUAL(tree.SetTo(path.c_str()), B_OK);
+
+    MappedFile file;
+    CHECK_EQUAL(file.SetTo(path.c_str()), B_OK);
+    CHECK_EQUAL(((const index_tree_header*)file.Data())->height, 3u);
+
+    std::vector<index_tree_entry> found = read_entries(tree, int32_range(70000, 70999));
+    CHECK(found.size() == 1000 && found.front().key == int32_key(70000)
+        && found.back().key == int32_key(70999));
+    uint64 count;
+    CHECK_EQUAL(tree.EstimateCount(int32_range(70000, 70999), count), B_OK);
+    CHECK(count >= 990 && count <= 1010);
+}
+
+TEST(index_tree_empty)
+{
+    std::vector<index_tree_entry> entries;
+    std::string path = test_directory() + "/index";
+    CHECK_EQUAL(WriteIndexTree(path.c_str(), B_STRING_TYPE, entries), B_OK);
+    IndexTree tree;
+    CHECK_EQUAL(tree.SetTo(path.c_str()), B_OK);
+    CHECK_EQUAL(tree.CountEntries(), 0u);
+    CHECK_EQUAL(read_entries(tree, index_range()).size(), 0u);
+    uint64 count = 1;
+    CHECK_EQUAL(tree.EstimateCount(index_range(), count), B_OK);
+    CHECK_EQUAL(count, 0u);
+
+    // created, but never filled
+    uint32 created[2] = { INDEX_FILE_MAGIC, B_STRING_TYPE };
+    path = test_write_file("created", std::string((const char*)created, sizeof(created)));
+    CHECK_EQUAL(tree.SetTo(path.c_str()), B_NO_INIT);
+}
+
+TEST(index_tree_bad_files)
+{
+    std::vector<index_tree_entry> entries = duplicate_entries();
+    std::string path = test_directory() + "/index";
+    CHECK_EQUAL(WriteIndexTree(path.c_str(), B_INT32_TYPE, entries), B_OK);
+    MappedFile file;
+    CHECK_EQUAL(file.SetTo(path.c_str()), B_OK);
+    const std::string valid((const char*)file.Data(), file.Size());
+
+    IndexTree tree;
+    CHECK_EQUAL(tree.SetTo(test_write_file("short", valid.substr(0, 4)).c_str()), B_BAD_DATA);
+    CHECK_EQUAL(tree.SetTo(test_write_file("cut", valid.substr(0, 5000)).c_str()), B_BAD_DATA);
+    std::string data = valid;
+    data[0] ^= 1;
+    CHECK_EQUAL(tree.SetTo(test_write_file("magic", data).c_str()), B_BAD_DATA);
+
+    // a key that does not fit a page
+    entries.push_back(index_tree_entry{ std::string(5000, 'k'), "file" });
+    CHECK_EQUAL(WriteIndexTree(path.c_str(), B_STRING_TYPE, entries), B_BAD_VALUE);
+}
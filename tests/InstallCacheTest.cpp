@@ -0,0 +1,160 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "DirectoryMimeDatabase.h"
+#include "InstallCache.h"
+#include "MappedFile.h"
+
+static const char kType[] = "application/x-test";
+static const char kDescription[] = "Test application";
+
+static void
+set_description(MimeDatabase& database, const char* description)
+{
+    CHECK_EQUAL(database.SetField(kType, MIME_FIELD_SHORT_DESCRIPTION, description,
+        strlen(description) + 1), B_OK);
+}
+
+// whether the cache has the file as installed, with its type unchanged
+static bool
+is_unchanged(InstallCache& cache, const std::string& path)
+{
+    install_cache_entry entry;
+    CHECK_EQUAL(cache.Hash(path.c_str(), entry), B_OK);
+    return cache.IsUnchanged(entry);
+}
+
+TEST(install_cache_hits)
+{
+    DirectoryMimeDatabase database((test_directory() + "/db").c_str());
+    CHECK_EQUAL(database.Install(kType), B_OK);
+    set_description(database, kDescription);
+    std::string path = test_write_file("app.rsrc", "resources of the app");
+
+    std::vector<std::string> volumes = { "/boot", "/data" };
+    InstallCache cache(database, volumes);
+    CHECK_EQUAL(cache.Load(), B_OK);
+    install_cache_entry entry;
+    CHECK_EQUAL(cache.Hash(path.c_str(), entry), B_OK);
+    CHECK_EQUAL(entry.size, 20u);
+    CHECK(!cache.IsUnchanged(entry));
+    CHECK_EQUAL(cache.Store(entry, kType), B_OK);
+    CHECK(cache.IsUnchanged(entry));
+    CHECK_EQUAL(cache.CountHits(), 1);
+    CHECK_EQUAL(cache.CountMisses(), 1);
+
+    // a type that is not installed can't be stored
+    install_cache_entry other;
+    CHECK_EQUAL(cache.Hash(path.c_str(), other), B_OK);
+    CHECK_EQUAL(cache.Store(other, "application/x-missing"), B_ENTRY_NOT_FOUND);
+
+    // the entries last, and don't depend on the order of the volumes
+    CHECK_EQUAL(cache.Save(), B_OK);
+    InstallCache reloaded(database, { "/data", "/boot" });
+    CHECK_EQUAL(reloaded.Load(), B_OK);
+    CHECK(is_unchanged(reloaded, path));
+    // relative paths are made absolute
+    std::string directory = test_directory();
+    char* cwd = getcwd(NULL, 0);
+    CHECK_EQUAL(chdir(directory.c_str()), 0);
+    CHECK(is_unchanged(reloaded, "app.rsrc"));
+    CHECK_EQUAL(chdir(cwd), 0);
+    free(cwd);
+
+    InstallCache otherVolumes(database, { "/boot" });
+    CHECK_EQUAL(otherVolumes.Load(), B_OK);
+    CHECK(!is_unchanged(otherVolumes, path));
+}
+
+TEST(install_cache_misses)
+{
+    DirectoryMimeDatabase database((test_directory() + "/db").c_str());
+    CHECK_EQUAL(database.Install(kType), B_OK);
+    set_description(database, kDescription);
+    std::string path = test_write_file("app.rsrc", "resources of the app");
+
+    InstallCache cache(database, {});
+    install_cache_entry entry;
+    CHECK_EQUAL(cache.Hash(path.c_str(), entry), B_OK);
+    CHECK_EQUAL(cache.Store(entry, kType), B_OK);
+    CHECK(is_unchanged(cache, path));
+
+    // the content changes, the size and so on don't
+    test_write_file("app.rsrc", "Resources of the app");
+    CHECK(!is_unchanged(cache, path));
+    test_write_file("app.rsrc", "resources of the app");
+    CHECK(is_unchanged(cache, path));
+
+    // a field of the type changes, or is removed; the same value again is
+    // no change
+    set_description(database, "Test application 2");
+    CHECK(!is_unchanged(cache, path));
+    set_description(database, kDescription);
+    CHECK(is_unchanged(cache, path));
+    const char rule[] = "0.5 ('test')";
+    CHECK_EQUAL(database.SetField(kType, MIME_FIELD_SNIFFER_RULE, rule, sizeof(rule)), B_OK);
+    CHECK(!is_unchanged(cache, path));
+    CHECK_EQUAL(database.SetField(kType, MIME_FIELD_SNIFFER_RULE, NULL, 0), B_OK);
+    CHECK(is_unchanged(cache, path));
+    CHECK_EQUAL(database.SetField(kType, MIME_FIELD_SHORT_DESCRIPTION, NULL, 0), B_OK);
+    CHECK(!is_unchanged(cache, path));
+
+    set_description(database, kDescription);
+    CHECK_EQUAL(database.Delete(kType), B_OK);
+    CHECK(!is_unchanged(cache, path));
+    CHECK_EQUAL(cache.CountHits(), 4);
+    CHECK_EQUAL(cache.CountMisses(), 5);
+}
+
+TEST(install_cache_bad_files)
+{
+    DirectoryMimeDatabase database((test_directory() + "/db").c_str());
+    CHECK_EQUAL(database.Install(kType), B_OK);
+    std::string path = test_write_file("app.rsrc", "resources");
+    std::string cachePath = InstallCache::PathFor(database);
+
+    InstallCache cache(database, {});
+    install_cache_entry entry;
+    CHECK_EQUAL(cache.Hash(path.c_str(), entry), B_OK);
+    CHECK_EQUAL(cache.Store(entry, kType), B_OK);
+    CHECK_EQUAL(cache.Save(), B_OK);
+
+    MappedFile file;
+    CHECK_EQUAL(file.SetTo(cachePath.c_str()), B_OK);
+    std::string data((const char*)file.Data(), file.Size());
+    file.Unset();
+
+    // cut anywhere, or with a wrong magic, nothing is loaded
+    for (size_t size = 1; size < data.size(); size++) {
+        CHECK_EQUAL(ReplaceFile(cachePath.c_str(), data.data(), size), B_OK);
+        CHECK_EQUAL(cache.Load(), B_BAD_DATA);
+        CHECK(!is_unchanged(cache, path));
+    }
+    std::string bad = data;
+    bad[0] ^= 1;
+    CHECK_EQUAL(ReplaceFile(cachePath.c_str(), bad.data(), bad.size()), B_OK);
+    CHECK_EQUAL(cache.Load(), B_BAD_DATA);
+
+    CHECK_EQUAL(ReplaceFile(cachePath.c_str(), data.data(), data.size()), B_OK);
+    CHECK_EQUAL(cache.Load(), B_OK);
+    CHECK(is_unchanged(cache, path));
+
+    // files that are gone are dropped when saving
+    CHECK_EQUAL(unlink(path.c_str()), 0);
+    std::string otherPath = test_write_file("other.rsrc", "other resources");
+    CHECK_EQUAL(cache.Hash(otherPath.c_str(), entry), B_OK);
+    CHECK_EQUAL(cache.Store(entry, kType), B_OK);
+    CHECK_EQUAL(cache.Save(), B_OK);
+    CHECK_EQUAL(file.SetTo(cachePath.c_str()), B_OK);
+    std::string saved((const char*)file.Data(), file.Size());
+    CHECK(saved.find(otherPath) != std::string::npos);
+    CHECK(saved.find(path) == std::string::npos);
+}
@@ -0,0 +1,287 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <string.h>
+
+#include "DirectoryMimeDatabase.h"
+#include "IndexManager.h"
+#include "MimeSnapshot.h"
+
+// offsets within the header of the snapshot file
+static const size_t kTypeCountOffset = 8;
+static const size_t kTypesOffsetOffset = 12;
+static const size_t kExtensionsOffsetOffset = 20;
+static const size_t kReferenceCountOffset = 32;
+static const size_t kRulesSizeOffset = 44;
+static const size_t kStringsOffsetOffset = 48;
+static const size_t kStringsSizeOffset = 52;
+// and within a type entry
+static const size_t kTypeSize = 44;
+static const size_t kTypeNameOffset = 0;
+static const size_t kShortDescriptionOffset = 4;
+static const size_t kExtensionCountOffset = 24;
+static const size_t kAttributeCountOffset = 32;
+static const size_t kRuleSizeOffset = 40;
+
+static const char kRule[] = "0.5 [0:4] ('PNG')";
+
+static void
+set_string(MimeDatabase& database, const char* type, mime_field field, const char* value)
+{
+    CHECK_EQUAL(database.SetField(type, field, value, strlen(value) + 1), B_OK);
+}
+
+static void
+set_message(MimeDatabase& database, const char* type, mime_field field,
+    const FlatMessageWriter& message)
+{
+    std::string data;
+    message.Flatten(data);
+    CHECK_EQUAL(database.SetField(type, field, data.data(), data.size()), B_OK);
+}
+
+// a DB with a few types, and its snapshot
+static std::string
+build_snapshot()
+{
+    DirectoryMimeDatabase database((test_directory() + "/db").c_str());
+    CHECK_EQUAL(database.Install("image/png"), B_OK);
+    CHECK_EQUAL(database.Install("image/x-apng"), B_OK);
+    CHECK_EQUAL(database.Install("text/plain"), B_OK);
+
+    set_string(database, "image/png", MIME_FIELD_SHORT_DESCRIPTION, "PNG image");
+    set_string(database, "image/png", MIME_FIELD_LONG_DESCRIPTION, "Portable network graphics");
+    set_string(database, "image/png", MIME_FIELD_SNIFFER_RULE, kRule);
+    FlatMessageWriter extensions;
+    extensions.AddString("extensions", "png");
+    extensions.AddString("extensions", ".PNG");
+    set_message(database, "image/png", MIME_FIELD_EXTENSIONS, extensions);
+
+    FlatMessageWriter attrInfo;
+    attrInfo.AddString("attr:name", "png:width");
+    attrInfo.AddString("attr:public_name", "Width");
+    int32 type = B_INT32_TYPE;
+    attrInfo.AddData("attr:type", B_INT32_TYPE, &type, sizeof(type));
+    int32 width = 60;
+    attrInfo.AddData("attr:width", B_INT32_TYPE, &width, sizeof(width));
+    bool yes = true;
+    attrInfo.AddData("attr:editable", B_BOOL_TYPE, &yes, sizeof(yes));
+    attrInfo.AddData(ATTR_INDEX, B_BOOL_TYPE, &yes, sizeof(yes));
+    attrInfo.AddString("attr:name", "png:comment");
+    attrInfo.AddString("attr:public_name", "Comment");
+    type = B_STRING_TYPE;
+    attrInfo.AddData("attr:type", B_INT32_TYPE, &type, sizeof(type));
+    set_message(database, "image/png", MIME_FIELD_ATTR_INFO, attrInfo);
+
+    FlatMessageWriter apngExtensions;
+    apngExtensions.AddString("extensions", "apng");
+    apngExtensions.AddString("extensions", "png");
+    set_message(database, "image/x-apng", MIME_FIELD_EXTENSIONS, apngExtensions);
+    // a rule that does not compile is kept as string only
+    set_string(database, "image/x-apng", MIME_FIELD_SNIFFER_RULE, "0.5 ('broken'");
+
+    std::string path = test_directory() + "/snapshot";
+    CHECK_EQUAL(MimeSnapshot::Build(database, path.c_str()), B_OK);
+    return path;
+}
+
+static std::string
+read_file(const std::string& path)
+{
+    MappedFile file;
+    if (file.SetTo(path.c_str()) != B_OK)
+        return std::string();
+    return std::string((const char*)file.Data(), file.Size());
+}
+
+static uint32
+get_uint32(const std::string& data, size_t offset)
+{
+    uint32 value = 0;
+    if (offset + sizeof(value) <= data.size())
+        memcpy(&value, data.data() + offset, sizeof(value));
+    return value;
+}
+
+static void
+set_uint32(std::string& data, size_t offset, uint32 value)
+{
+    if (offset + sizeof(value) <= data.size())
+        memcpy(&data[offset], &value, sizeof(value));
+}
+
+// the status of SetTo() with one value of the file changed
+static status_t
+set_to_changed(const std::string& path, const std::string& data, size_t offset, uint32 value)
+{
+    std::string changed = data;
+    set_uint32(changed, offset, value);
+    std::string changedPath = path + ".changed";
+    CHECK_EQUAL(ReplaceFile(changedPath.c_str(), changed.data(), changed.size()), B_OK);
+
+    MimeSnapshot snapshot;
+    status_t result = snapshot.SetTo(changedPath.c_str());
+    if (result != B_OK) {
+        CHECK_EQUAL(snapshot.CountTypes(), 0);
+        CHECK(snapshot.TypeAt(0) == NULL);
+        return result;
+    }
+
+    // nothing a valid snapshot returns points outside of it
+    auto within = [&changed](const char* string) {
+        return string != NULL && strlen(string) < changed.size();
+    };
+    std::vector<int32> types;
+    snapshot.LookupExtension("png", types);
+    for (int32 index : types)
+        CHECK(index >= 0 && index < snapshot.CountTypes());
+    snapshot.FindType("image/png");
+    for (int32 i = 0; i < snapshot.CountTypes(); i++) {
+        CHECK(within(snapshot.TypeAt(i)));
+        for (int32 field = 0; field < MIME_FIELD_COUNT; field++) {
+            const char* string = snapshot.StringFieldAt(i, (mime_field)field);
+            CHECK(string == NULL || within(string));
+        }
+        for (int32 j = 0; j < snapshot.CountExtensions(i); j++)
+            CHECK(within(snapshot.ExtensionAt(i, j)));
+        snapshot_attribute attribute;
+        for (int32 j = 0; j < snapshot.CountAttributes(i); j++) {
+            CHECK(snapshot.GetAttributeAt(i, j, attribute));
+            CHECK(within(attribute.name) && within(attribute.publicName));
+        }
+        SnifferRule rule;
+        snapshot.GetSnifferRuleAt(i, rule);
+    }
+    return result;
+}
+
+TEST(mime_snapshot_round_trip)
+{
+    std::string path = build_snapshot();
+    MimeSnapshot snapshot;
+    CHECK_EQUAL(snapshot.InitCheck(), B_NO_INIT);
+    CHECK_EQUAL(snapshot.SetTo(path.c_str()), B_OK);
+
+    // the supertypes are types, too
+    CHECK_EQUAL(snapshot.CountTypes(), 5);
+    CHECK_EQUAL(snapshot.FindType("nothing/here"), -1);
+    int32 png = snapshot.FindType("Image/PNG");
+    int32 apng = snapshot.FindType("image/x-apng");
+    int32 plain = snapshot.FindType("text/plain");
+    CHECK(png >= 0 && apng >= 0 && plain >= 0);
+    CHECK_EQUAL(std::string(snapshot.TypeAt(png)), "image/png");
+    CHECK_EQUAL(std::string(snapshot.TypeAt(snapshot.FindType("TEXT"))), "text");
+    CHECK(snapshot.TypeAt(-1) == NULL);
+    CHECK(snapshot.TypeAt(5) == NULL);
+
+    CHECK_EQUAL(std::string(snapshot.StringFieldAt(png, MIME_FIELD_SHORT_DESCRIPTION)),
+        "PNG image");
+    CHECK_EQUAL(std::string(snapshot.StringFieldAt(png, MIME_FIELD_LONG_DESCRIPTION)),
+        "Portable network graphics");
+    CHECK_EQUAL(std::string(snapshot.StringFieldAt(png, MIME_FIELD_SNIFFER_RULE)), kRule);
+    CHECK(snapshot.StringFieldAt(png, MIME_FIELD_PREFERRED_APP) == NULL);
+    CHECK(snapshot.StringFieldAt(plain, MIME_FIELD_SHORT_DESCRIPTION) == NULL);
+
+    // extensions are normalized
+    CHECK_EQUAL(snapshot.CountExtensions(png), 1);
+    CHECK_EQUAL(std::string(snapshot.ExtensionAt(png, 0)), "png");
+    CHECK(snapshot.ExtensionAt(png, 1) == NULL);
+    CHECK_EQUAL(snapshot.CountExtensions(plain), 0);
+
+    std::vector<int32> types;
+    CHECK_EQUAL(snapshot.LookupExtension(".Png", types), B_OK);
+    CHECK(types == std::vector<int32>({ png, apng }));
+    CHECK_EQUAL(snapshot.LookupExtension("apng", types), B_OK);
+    CHECK(types == std::vector<int32>({ apng }));
+    CHECK_EQUAL(snapshot.LookupExtension("gif", types), B_ENTRY_NOT_FOUND);
+    CHECK(types.empty());
+
+    CHECK_EQUAL(snapshot.CountAttributes(png), 2);
+    snapshot_attribute attribute;
+    CHECK(snapshot.GetAttributeAt(png, 0, attribute));
+    CHECK_EQUAL(std::string(attribute.name), "png:width");
+    CHECK_EQUAL(std::string(attribute.publicName), "Width");
+    CHECK_EQUAL(attribute.type, (type_code)B_INT32_TYPE);
+    CHECK_EQUAL(attribute.width, 60);
+    CHECK_EQUAL(attribute.flags, (uint32)(SNAPSHOT_ATTR_VIEWABLE | SNAPSHOT_ATTR_EDITABLE
+        | SNAPSHOT_ATTR_SEARCHABLE));
+    CHECK(snapshot.GetAttributeAt(png, 1, attribute));
+    CHECK_EQUAL(std::string(attribute.name), "png:comment");
+    CHECK_EQUAL(attribute.type, (type_code)B_STRING_TYPE);
+    CHECK_EQUAL(attribute.flags, (uint32)SNAPSHOT_ATTR_VIEWABLE);
+    CHECK(!snapshot.GetAttributeAt(png, 2, attribute));
+    CHECK(!snapshot.GetAttributeAt(plain, 0, attribute));
+
+    SnifferRule rule;
+    CHECK_EQUAL(snapshot.GetSnifferRuleAt(png, rule), B_OK);
+    CHECK(rule.Matches("\x89PNG", 4));
+    CHECK(!rule.Matches("GIF8", 4));
+    CHECK_EQUAL(snapshot.GetSnifferRuleAt(apng, rule), B_ENTRY_NOT_FOUND);
+    CHECK_EQUAL(std::string(snapshot.StringFieldAt(apng, MIME_FIELD_SNIFFER_RULE)),
+        "0.5 ('broken'");
+    CHECK_EQUAL(snapshot.GetSnifferRuleAt(plain, rule), B_ENTRY_NOT_FOUND);
+    CHECK_EQUAL(snapshot.GetSnifferRuleAt(5, rule), B_BAD_VALUE);
+
+    snapshot.Unset();
+    CHECK_EQUAL(snapshot.CountTypes(), 0);
+    CHECK_EQUAL(snapshot.FindType("image/png"), -1);
+    CHECK_EQUAL(snapshot.LookupExtension("png", types), B_NO_INIT);
+    CHECK_EQUAL(snapshot.SetTo((test_directory() + "/missing").c_str()), B_ENTRY_NOT_FOUND);
+}
+
+TEST(mime_snapshot_bad_offsets)
+{
+    std::string path = build_snapshot();
+    const std::string data = read_file(path);
+    CHECK_EQUAL(set_to_changed(path, data, 0, 0), B_BAD_DATA);
+
+    // tables that reach past the file, or wrap around
+    CHECK_EQUAL(set_to_changed(path, data, kTypeCountOffset, 0x10000000), B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, kTypesOffsetOffset, 0xfffffff0), B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, kReferenceCountOffset, 0x40000000), B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, kRulesSizeOffset, 0xffffffff), B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, kStringsOffsetOffset, (uint32)data.size()),
+        B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, kStringsSizeOffset, 0xffffffff), B_BAD_DATA);
+    // misaligned tables, and strings that don't end with a NUL
+    CHECK_EQUAL(set_to_changed(path, data, kExtensionsOffsetOffset,
+        get_uint32(data, kExtensionsOffsetOffset) + 2), B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, kStringsSizeOffset, 1), B_BAD_DATA);
+
+    // offsets within the tables that point outside of their targets
+    uint32 types = get_uint32(data, kTypesOffsetOffset);
+    uint32 stringsSize = get_uint32(data, kStringsSizeOffset);
+    CHECK_EQUAL(set_to_changed(path, data, types + kTypeNameOffset, stringsSize), B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, types + kTypeNameOffset, 0xffffffff), B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, types + kShortDescriptionOffset, stringsSize),
+        B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, types + kExtensionCountOffset, 0xffffffff),
+        B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, types + kAttributeCountOffset, 1000), B_BAD_DATA);
+    CHECK_EQUAL(set_to_changed(path, data, types + kRuleSizeOffset, 0x80000000), B_BAD_DATA);
+    uint32 extensions = get_uint32(data, kExtensionsOffsetOffset);
+    CHECK_EQUAL(set_to_changed(path, data, extensions + 4, 0xfffffffe), B_BAD_DATA);
+
+    // an unset optional string is fine
+    MimeSnapshot snapshot;
+    CHECK_EQUAL(snapshot.SetTo(path.c_str()), B_OK);
+    uint32 png = types + snapshot.FindType("image/png") * kTypeSize;
+    CHECK_EQUAL(set_to_changed(path, data, png + kShortDescriptionOffset, 0xffffffff), B_OK);
+
+    // every table ends within the file, cutting any of it is noticed
+    for (size_t size = 0; size < data.size(); size += size < 64 ? 1 : 29) {
+        CHECK_EQUAL(ReplaceFile(path.c_str(), data.data(), size), B_OK);
+        CHECK_EQUAL(snapshot.SetTo(path.c_str()), B_BAD_DATA);
+    }
+
+    // whatever else is damaged, the offsets are checked before they are used
+    for (size_t offset = 0; offset + 4 <= data.size(); offset += 4) {
+        status_t result = set_to_changed(path, data, offset,
+            get_uint32(data, offset) ^ 0x00ff00ff);
+        CHECK(result == B_OK || result == B_BAD_DATA);
+    }
+}
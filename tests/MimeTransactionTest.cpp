@@ -0,0 +1,95 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <strings.h>
+
+#include "DirectoryMimeDatabase.h"
+#include "MimeTransaction.h"
+
+// fails the first field write to one type, to force a rollback
+class FailingMimeDatabase : public DirectoryMimeDatabase {
+public:
+    FailingMimeDatabase(const char* directory, const char* failingType)
+        :
+        DirectoryMimeDatabase(directory),
+        fFailingType(failingType),
+        fFailed(false)
+    {
+    }
+
+    virtual status_t SetFields(const char* type, const mime_field_value* values,
+        int32 count)
+    {
+        if (strcasecmp(type, fFailingType) == 0 && !fFailed) {
+            fFailed = true;
+            return B_IO_ERROR;
+        }
+        return DirectoryMimeDatabase::SetFields(type, values, count);
+    }
+
+private:
+    const char*     fFailingType;
+    bool            fFailed;
+};
+
+static const char kDescription[] = "Test type";
+
+static void
+check_rollback(int32 jobs)
+{
+    FailingMimeDatabase database((test_directory() + "/db").c_str(), "newsuper/failing");
+    CHECK_EQUAL(database.Install("text/plain"), B_OK);
+
+    MimeTransaction transaction(database);
+    transaction.Install("newsuper/one");
+    transaction.SetField("newsuper/one", MIME_FIELD_SHORT_DESCRIPTION, kDescription,
+        sizeof(kDescription));
+    transaction.Install("text/x-new");
+    transaction.Install("newsuper/failing");
+    transaction.SetField("newsuper/failing", MIME_FIELD_SHORT_DESCRIPTION, kDescription,
+        sizeof(kDescription));
+    CHECK_EQUAL(transaction.Commit(jobs), B_IO_ERROR);
+
+    // the supertype the DB would have created on its own is gone, too
+    CHECK(!database.IsInstalled("newsuper/one"));
+    CHECK(!database.IsInstalled("newsuper/failing"));
+    CHECK(!database.IsInstalled("newsuper"));
+    CHECK(!database.IsInstalled("text/x-new"));
+    CHECK(database.IsInstalled("text/plain"));
+    CHECK(database.IsInstalled("text"));
+
+    std::vector<std::string> supertypes;
+    CHECK_EQUAL(database.GetInstalledSupertypes(supertypes), B_OK);
+    CHECK_EQUAL(supertypes.size(), 1u);
+}
+
+TEST(mime_transaction_rollback)
+{
+    check_rollback(1);
+}
+
+TEST(mime_transaction_parallel_rollback)
+{
+    check_rollback(4);
+}
+
+TEST(mime_transaction_commit)
+{
+    DirectoryMimeDatabase database((test_directory() + "/db").c_str());
+
+    MimeTransaction transaction(database);
+    transaction.Install("newsuper/one");
+    transaction.SetField("newsuper/one", MIME_FIELD_SHORT_DESCRIPTION, kDescription,
+        sizeof(kDescription));
+    CHECK_EQUAL(transaction.Commit(), B_OK);
+
+    CHECK(database.IsInstalled("newsuper"));
+    CHECK(database.IsInstalled("newsuper/one"));
+    std::string data;
+    CHECK_EQUAL(database.GetField("newsuper/one", MIME_FIELD_SHORT_DESCRIPTION, data), B_OK);
+    CHECK_EQUAL(data, std::string(kDescription, sizeof(kDescription)));
+}
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "FileAttributes.h"
+#include "MappedFile.h"
+#include "Query.h"
+#include "TypeIdentifier.h"
+
+static const char kType[] = "text/x-test";
+
+// META:ATTR_INFO of the test type
+static FlatMessage
+attr_info(std::string& data)
+{
+    FlatMessageWriter writer;
+    const struct {
+        const char* name;
+        type_code   type;
+    } attributes[] = {
+        { "test:name", B_STRING_TYPE },
+        { "test:size", B_INT32_TYPE },
+        { "test:rating", B_FLOAT_TYPE },
+        { "test:flag", B_INT32_TYPE },
+        { "test:other", B_INT32_TYPE },
+        { "test:blob", B_RAW_TYPE }
+    };
+    for (const auto& attribute : attributes) {
+        writer.AddString("attr:name", attribute.name);
+        int32 type = (int32)attribute.type;
+        writer.AddData("attr:type", B_INT32_TYPE, &type, sizeof(type));
+    }
+    data.clear();
+    writer.Flatten(data);
+
+    FlatMessage message;
+    CHECK_EQUAL(message.SetTo(data.data(), data.size()), B_OK);
+    return message;
+}
+
+static std::string
+parse_error(const char* predicate)
+{
+    std::string data;
+    FlatMessage message = attr_info(data);
+    Query query;
+    if (query.SetTo(kType, message, predicate) != B_BAD_VALUE)
+        return "parsed";
+    return query.Error();
+}
+
+static bool
+contains(const std::string& text, const char* part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+// the attributes of the terms, in the order the plan has them
+static std::string
+term_order(const Query& query)
+{
+    std::string order;
+    for (int32 i = 0; i < query.CountTerms(); i++) {
+        const query_term& term = query.TermAt(i);
+        if (!order.empty())
+            order += ", ";
+        order += term.attribute + " " + query_op_name(term.op) + " " + term.value;
+    }
+    return order;
+}
+
+// knows its indices, but can't estimate ranges
+class ListingIndexVolume : public IndexVolume {
+public:
+    ListingIndexVolume(const std::vector<index_entry>& indices)
+        :
+        IndexVolume("listing"),
+        fIndices(indices)
+    {
+    }
+
+    virtual status_t InitCheck() const { return B_OK; }
+    virtual status_t GetIndices(std::vector<index_entry>& indices)
+    {
+        indices = fIndices;
+        return B_OK;
+    }
+    virtual status_t CreateIndex(const char*, type_code) { return B_NOT_SUPPORTED; }
+    virtual status_t RemoveIndex(const char*) { return B_NOT_SUPPORTED; }
+
+private:
+    std::vector<index_entry> fIndices;
+};
+
+TEST(query_parse)
+{
+    std::string data;
+    FlatMessage message = attr_info(data);
+    Query query;
+    CHECK_EQUAL(query.SetTo(kType, message,
+        "  test:size>=3&&test:name == \"a \\\"b\\\"\" && test:name != 'x*' "), B_OK);
+    CHECK_EQUAL(query.CountTerms(), 3);
+    if (query.CountTerms() == 3) {
+        CHECK_EQUAL(query.TermAt(0).op, QUERY_OP_GREATER_EQUAL);
+        CHECK_EQUAL(query.TermAt(0).type, (type_code)B_INT32_TYPE);
+        std::string key;
+        ParseIndexKey(B_INT32_TYPE, "3", key);
+        CHECK_EQUAL(query.TermAt(0).key, key);
+        CHECK_EQUAL(query.TermAt(1).value, "a \"b\"");
+        CHECK(!query.TermAt(1).pattern);
+        // a pattern keeps its prefix as key
+        CHECK(query.TermAt(2).pattern);
+        CHECK_EQUAL(query.TermAt(2).key, "x");
+    }
+
+    // wildcards are only patterns for == and !=
+    CHECK_EQUAL(query.SetTo(kType, message, "test:name > a*"), B_OK);
+    CHECK(query.CountTerms() == 1 && !query.TermAt(0).pattern);
+    CHECK_EQUAL(query.SetTo(kType, message, ""), B_OK);
+    CHECK_EQUAL(query.CountTerms(), 0);
+
+    CHECK_EQUAL(query.FsPredicate(), "(" FILE_TYPE_ATTR "==\"text/x-test\")");
+    CHECK_EQUAL(query.SetTo(kType, message, "test:size < 7 && test:name == 'a\"'"), B_OK);
+    CHECK_EQUAL(query.FsPredicate(),
+        "(test:size<7)&&(test:name==\"a\\\"\")&&(" FILE_TYPE_ATTR "==\"text/x-test\")");
+}
+
+TEST(query_parse_errors)
+{
+    CHECK(contains(parse_error("== 3"), "expected an attribute name"));
+    CHECK(contains(parse_error("test:size 3"), "expected ==, !=, <, <=, > or >= after test:size"));
+    CHECK(contains(parse_error("test:size =< 3"), "expected ==, !=, <, <=, > or >="));
+    CHECK(contains(parse_error("test:size =="), "expected a value after test:size =="));
+    CHECK(contains(parse_error("test:size == && test:flag == 1"), "expected a value"));
+    CHECK(contains(parse_error("test:name == \"open"), "unterminated string after test:name"));
+    CHECK(contains(parse_error("test:size == 1 test:flag == 1"), "expected && before"));
+    CHECK(contains(parse_error("test:size == 1 &&"), "expected a term after &&"));
+    CHECK(contains(parse_error("test:size == 1 && && test:flag == 1"),
+        "expected ==, !=, <, <=, > or >= after &&"));
+    CHECK(contains(parse_error("test:missing == 1"),
+        "text/x-test has no attribute test:missing, it has test:name, test:size"));
+    CHECK(contains(parse_error("test:blob == 1"), "cannot be queried"));
+    CHECK(contains(parse_error("test:size == big"), "\"big\" is not a value of type"));
+    CHECK(contains(parse_error("test:size == 4294967296"), "is not a value of type"));
+    CHECK(contains(parse_error("test:rating == nan"), "is not a value of type"));
+
+    Query query;
+    FlatMessage empty;
+    std::string data;
+    FlatMessageWriter().Flatten(data);
+    CHECK_EQUAL(empty.SetTo(data.data(), data.size()), B_OK);
+    CHECK_EQUAL(query.SetTo(kType, empty, "test:size == 1"), B_BAD_VALUE);
+    CHECK(contains(query.Error(), "text/x-test declares no attributes to query"));
+}
+
+// Without estimates the planner goes by operator: indexed equality, then
+// ranges, then patterns, then the terms it can't use an index for.
+TEST(query_plan_without_estimates)
+{
+    std::string data;
+    FlatMessage message = attr_info(data);
+    ListingIndexVolume volume({ { "test:name", B_STRING_TYPE }, { "test:size", B_INT32_TYPE },
+        { "test:rating", B_FLOAT_TYPE }, { "test:other", B_STRING_TYPE } });
+
+    Query query;
+    CHECK_EQUAL(query.SetTo(kType, message,
+        "test:flag == 1 && test:name == 'ab*' && test:size != 4 && test:rating > 2"
+        " && test:other == 5 && test:name == '*b' && test:size == 3"), B_OK);
+    CHECK_EQUAL(query.Plan(volume), B_OK);
+    CHECK_EQUAL(term_order(query), "test:size == 3, test:rating > 2, test:name == ab*, "
+        "test:flag == 1, test:other == 5, test:name == *b, test:size != 4");
+
+    const char* access[] = { "index", "index", "index", "no index", "index of another type",
+        "index, not used for a leading wildcard", "index, not used for !=" };
+    for (int32 i = 0; i < query.CountTerms() && i < 7; i++) {
+        CHECK_EQUAL(std::string(query.TermAt(i).access), access[i]);
+        CHECK_EQUAL(query.TermAt(i).indexed, i < 3);
+        CHECK_EQUAL(query.TermAt(i).estimate, -1);
+    }
+    CHECK(contains(query.Describe(), "1. test:size == 3  [index, selects]\n"));
+    CHECK(contains(query.Describe(), "4. test:flag == 1  [no index]\n"));
+
+    CHECK_EQUAL(query.SetTo(kType, message, "test:flag == 1 && test:size != 2"), B_OK);
+    CHECK_EQUAL(query.Plan(volume), B_OK);
+    CHECK(contains(query.Describe(), "no term selects from an index, all files are checked"));
+}
+
+#ifndef __HAIKU__
+
+// The stand-in volume estimates from its index files: the term with the
+// fewest files in its range selects, whatever its operator.
+TEST(query_plan_by_estimates)
+{
+    std::string directory = test_directory() + "/volume";
+    CHECK_EQUAL(CreateDirectories(directory.c_str()), B_OK);
+    for (int32 i = 0; i < 20; i++) {
+        std::string path = directory + "/file" + std::to_string(i);
+        FILE* file = fopen(path.c_str(), "w");
+        if (file != NULL)
+            fclose(file);
+        WriteAttribute(path.c_str(), FILE_TYPE_ATTR, B_MIME_STRING_TYPE, kType,
+            sizeof(kType));
+        std::string name = i % 2 == 0 ? "even" : "odd" + std::to_string(i);
+        WriteAttribute(path.c_str(), "test:name", B_STRING_TYPE, name.c_str(),
+            name.size() + 1);
+        WriteAttribute(path.c_str(), "test:size", B_INT32_TYPE, &i, sizeof(i));
+    }
+
+    DirectoryIndexVolume volume(directory.c_str());
+    CHECK_EQUAL(volume.CreateIndex("test:name", B_STRING_TYPE), B_OK);
+    CHECK_EQUAL(volume.CreateIndex("test:size", B_INT32_TYPE), B_OK);
+
+    std::string data;
+    FlatMessage message = attr_info(data);
+    Query query;
+    CHECK_EQUAL(query.SetTo(kType, message,
+        "test:name == even && test:size >= 17 && test:flag == 1"), B_OK);
+
+    // not filled yet, so no index is used
+    CHECK_EQUAL(query.Plan(volume), B_OK);
+    CHECK_EQUAL(std::string(query.TermAt(0).access), "index, empty until index update");
+    CHECK(!query.TermAt(0).indexed);
+
+    int64 files, keys;
+    CHECK_EQUAL(volume.UpdateIndices(files, keys), B_OK);
+    CHECK_EQUAL(files, 20);
+    CHECK_EQUAL(query.Plan(volume), B_OK);
+    // three files are >= 17, ten are even
+    CHECK_EQUAL(term_order(query), "test:size >= 17, test:name == even, test:flag == 1");
+    CHECK_EQUAL(query.TermAt(0).estimate, 3);
+    CHECK_EQUAL(query.TermAt(1).estimate, 10);
+    CHECK(contains(query.Describe(), "1. test:size >= 17  [index, ~3 file(s), selects]\n"));
+
+    CHECK_EQUAL(query.SetTo(kType, message, "test:name == even && test:size >= 5"), B_OK);
+    CHECK_EQUAL(query.Plan(volume), B_OK);
+    CHECK_EQUAL(term_order(query), "test:name == even, test:size >= 5");
+
+    // the files of the selecting term's range are checked against the others
+    std::vector<std::string> found;
+    int64 checked;
+    CHECK_EQUAL(query.Run(volume, [&found](const char* path) {
+            found.push_back(path);
+            return true;
+        }, checked), B_OK);
+    CHECK_EQUAL(checked, 10);
+    std::sort(found.begin(), found.end());
+    CHECK(found.size() == 7 && found[0] == directory + "/file10"
+        && found[6] == directory + "/file8");
+}
+
+#endif // !__HAIKU__
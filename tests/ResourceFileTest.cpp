@@ -0,0 +1,398 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "BufferedWriter.h"
+#include "ResourceFile.h"
+
+struct test_resource {
+    type_code       type;
+    int32           id;
+    const char*     name;
+    std::string     data;
+};
+
+// where the parts of a built resource file are, for corrupting them
+struct resource_layout {
+    size_t          indexEntries;
+    size_t          infoTable;
+};
+
+static const uint32 kMagic = 0x444f1000;
+
+static void
+append16(std::string& data, uint16 value, bool bigEndian)
+{
+    for (int32 i = 0; i < 2; i++) {
+        int32 shift = bigEndian ? 8 * (1 - i) : 8 * i;
+        data += (char)(value >> shift);
+    }
+}
+
+static void
+append32(std::string& data, uint32 value, bool bigEndian)
+{
+    for (int32 i = 0; i < 4; i++) {
+        int32 shift = bigEndian ? 8 * (3 - i) : 8 * i;
+        data += (char)(value >> shift);
+    }
+}
+
+static void
+patch32(std::string& data, size_t offset, uint32 value, bool bigEndian)
+{
+    std::string bytes;
+    append32(bytes, value, bigEndian);
+    data.replace(offset, 4, bytes);
+}
+
+// Lays out a resource file by hand, independent of ResourceWriter: header,
+// index section, data, and the info table with one block per run of equal
+// types.
+static std::string
+build_resources(const std::vector<test_resource>& resources, bool bigEndian,
+    resource_layout* layout = NULL)
+{
+    const size_t indexSection = 68;
+    const size_t indexEntries = indexSection + 132;
+    size_t dataOffset = indexEntries + resources.size() * 12;
+
+    std::string data;
+    std::string entries;
+    for (const test_resource& resource : resources) {
+        append32(entries, (uint32)(dataOffset + data.size()), bigEndian);
+        append32(entries, (uint32)resource.data.size(), bigEndian);
+        append32(entries, 0, bigEndian);
+        data += resource.data;
+    }
+
+    std::string table;
+    for (size_t i = 0; i < resources.size(); i++) {
+        const test_resource& resource = resources[i];
+        if (i == 0 || resources[i - 1].type != resource.type)
+            append32(table, resource.type, bigEndian);
+        append32(table, (uint32)resource.id, bigEndian);
+        append32(table, (uint32)i + 1, bigEndian);
+        append16(table, (uint16)(strlen(resource.name) + 1), bigEndian);
+        table.append(resource.name, strlen(resource.name) + 1);
+        if (i + 1 == resources.size() || resources[i + 1].type != resource.type) {
+            append32(table, 0xffffffff, bigEndian);
+            append32(table, 0xffffffff, bigEndian);
+        }
+    }
+    append32(table, 0, bigEndian);
+    append32(table, 0, bigEndian);
+    size_t tableOffset = dataOffset + data.size();
+
+    std::string file;
+    append32(file, kMagic, bigEndian);
+    append32(file, (uint32)resources.size(), bigEndian);
+    append32(file, (uint32)indexSection, bigEndian);
+    file.append(68 - file.size(), '\0');
+    append32(file, (uint32)indexSection, bigEndian);
+    file.append(indexSection + 120 - file.size(), '\0');
+    append32(file, (uint32)tableOffset, bigEndian);
+    append32(file, (uint32)table.size(), bigEndian);
+    file.append(indexEntries - file.size(), '\0');
+    file += entries + data + table;
+
+    if (layout != NULL) {
+        layout->indexEntries = indexEntries;
+        layout->infoTable = tableOffset;
+    }
+    return file;
+}
+
+static std::vector<test_resource>
+sample_resources()
+{
+    return {
+        { 'MIMS', 1, "META:TYPE", std::string("text/x-test", 12) },
+        { 'MSDC', 2, "META:S:DESC", std::string("Test", 5) },
+        { 'MSDC', 3, "META:L:DESC", std::string("A longer test", 14) },
+        { 'RAWT', 7, "blob", std::string("\x00\x01\x02", 3) }
+    };
+}
+
+static void
+check_sample(const ResourceFile& file)
+{
+    CHECK_EQUAL(file.InitCheck(), B_OK);
+    CHECK_EQUAL(file.CountResources(), 4);
+    const char* type = file.FindString('MIMS', "META:TYPE");
+    CHECK(type != NULL && strcmp(type, "text/x-test") == 0);
+    const char* description = file.FindString('MSDC', "META:L:DESC");
+    CHECK(description != NULL && strcmp(description, "A longer test") == 0);
+
+    size_t size = 0;
+    const void* blob = file.FindResource('RAWT', "blob", &size);
+    CHECK(blob != NULL && size == 3 && memcmp(blob, "\x00\x01\x02", 3) == 0);
+    // not NUL terminated, so not a string
+    CHECK(file.FindString('RAWT', "blob") == NULL);
+    // the name alone does not match, nor does the type alone
+    CHECK(file.FindResource('MSDC', "META:TYPE", NULL) == NULL);
+    CHECK(file.FindResource('MIMS', "missing", NULL) == NULL);
+
+    bool foundId = false;
+    for (int32 i = 0; i < file.CountResources(); i++) {
+        const ResourceEntry& entry = file.ResourceAt(i);
+        if (entry.type == 'MSDC' && entry.name == "META:S:DESC")
+            foundId = entry.id == 2;
+    }
+    CHECK(foundId);
+}
+
+static status_t
+read_resources(const std::string& data)
+{
+    ResourceFile file;
+    return file.SetTo(test_write_file("test.rsrc", data).c_str());
+}
+
+TEST(resource_file_little_endian)
+{
+    ResourceFile file;
+    file.SetTo(test_write_file("little.rsrc", build_resources(sample_resources(), false)).c_str());
+    check_sample(file);
+}
+
+TEST(resource_file_big_endian)
+{
+    ResourceFile file;
+    file.SetTo(test_write_file("big.rsrc", build_resources(sample_resources(), true)).c_str());
+    check_sample(file);
+}
+
+TEST(resource_file_reads_resource_writer_output)
+{
+    ResourceWriter writer;
+    for (const test_resource& resource : sample_resources()) {
+        writer.AddResource(resource.type, resource.id, resource.name, resource.data.data(),
+            resource.data.size());
+    }
+    std::string path = test_directory() + "/written.rsrc";
+    BufferedWriter output;
+    CHECK_EQUAL(output.SetTo(path.c_str()), B_OK);
+    CHECK_EQUAL(writer.WriteTo(output), B_OK);
+    CHECK_EQUAL(output.Close(), B_OK);
+
+    ResourceFile file;
+    file.SetTo(path.c_str());
+    check_sample(file);
+}
+
+// an ELF64 little endian image whose only segment ends at 200 and asks for
+// 64 byte alignment, so the resources start at 256
+TEST(resource_file_elf64_little_endian)
+{
+    std::string elf("\x7f" "ELF\x02\x01\x01", 7);
+    elf.append(64 - elf.size(), '\0');
+    patch32(elf, 32, 64, false);        // e_phoff
+    elf[54] = 56;                       // e_phentsize
+    elf[56] = 1;                        // e_phnum
+    std::string segment(56, '\0');
+    patch32(segment, 32, 200, false);   // p_filesz
+    patch32(segment, 48, 64, false);    // p_align
+    elf += segment;
+    elf.append(256 - elf.size(), '\0');
+
+    ResourceFile file;
+    file.SetTo(test_write_file("app", elf + build_resources(sample_resources(), false)).c_str());
+    check_sample(file);
+}
+
+// an ELF32 big endian image with a section up to 100 and a NOBITS section
+// that takes no room in the file, resources at the next 32 byte boundary
+TEST(resource_file_elf32_big_endian)
+{
+    std::string elf("\x7f" "ELF\x01\x02\x01", 7);
+    elf.append(52 - elf.size(), '\0');
+    patch32(elf, 32, 52, true);         // e_shoff
+    elf[47] = 40;                       // e_shentsize
+    elf[49] = 2;                        // e_shnum
+    std::string section(40, '\0');
+    patch32(section, 20, 100, true);    // sh_size
+    elf += section;
+    patch32(section, 4, 8, true);       // SHT_NOBITS
+    patch32(section, 20, 0x100000, true);
+    elf += section;
+    elf.append(160 - elf.size(), '\0');
+
+    ResourceFile file;
+    file.SetTo(test_write_file("app", elf + build_resources(sample_resources(), true)).c_str());
+    check_sample(file);
+}
+
+TEST(resource_file_elf_without_resources)
+{
+    std::string elf("\x7f" "ELF\x02\x01\x01", 7);
+    elf.append(128 - elf.size(), '\0');
+    CHECK_EQUAL(read_resources(elf), B_ENTRY_NOT_FOUND);
+}
+
+TEST(resource_file_truncated)
+{
+    std::string valid = build_resources(sample_resources(), false);
+    CHECK_EQUAL(read_resources(""), B_BAD_DATA);
+    CHECK_EQUAL(read_resources(valid.substr(0, 40)), B_BAD_DATA);
+    CHECK_EQUAL(read_resources(valid.substr(0, 150)), B_BAD_DATA);
+    // the info table is cut off
+    CHECK_EQUAL(read_resources(valid.substr(0, valid.size() - 20)), B_BAD_DATA);
+    CHECK_EQUAL(read_resources(std::string("\x7f" "ELF", 4)), B_BAD_DATA);
+    CHECK_EQUAL(read_resources(std::string("\x7f" "ELF\x02\x01", 6)), B_BAD_DATA);
+
+    ResourceFile file;
+    CHECK_EQUAL(file.SetTo("/nonexistent/test.rsrc"), B_ENTRY_NOT_FOUND);
+    CHECK_EQUAL(file.SetTo(test_directory().c_str()), B_BAD_DATA);
+    CHECK(file.FindResource('MIMS', "META:TYPE", NULL) == NULL);
+}
+
+TEST(resource_file_bad_magic)
+{
+    std::string data = build_resources(sample_resources(), false);
+    patch32(data, 0, 0x12345678, false);
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+}
+
+TEST(resource_file_out_of_range)
+{
+    resource_layout layout;
+    const std::string valid = build_resources(sample_resources(), false, &layout);
+    CHECK_EQUAL(read_resources(valid), B_OK);
+
+    // more resources than the index section holds
+    std::string data = valid;
+    patch32(data, 4, 0x10000000, false);
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+
+    // the index section behind the end of the file
+    data = valid;
+    patch32(data, 8, 0xfffffff0, false);
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+
+    // data behind the end of the file, and a size that wraps around
+    data = valid;
+    patch32(data, layout.indexEntries, (uint32)valid.size(), false);
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+    data = valid;
+    patch32(data, layout.indexEntries + 4, 0xffffffff, false);
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+
+    // the info table behind the end of the file, or too small
+    data = valid;
+    patch32(data, 68 + 120, 0xfffffff0, false);
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+    data = valid;
+    patch32(data, 68 + 124, 4, false);
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+
+    // an info naming a resource index beyond the count, or none
+    size_t firstIndex = layout.infoTable + 4 + 4;
+    data = valid;
+    patch32(data, firstIndex, 5, false);
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+    data = valid;
+    patch32(data, firstIndex, 0, false);
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+
+    // a name running past the info table
+    data = valid;
+    data[firstIndex + 4] = (char)0xff;
+    data[firstIndex + 5] = (char)0xff;
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+}
+
+TEST(resource_file_elf_out_of_range)
+{
+    // program headers behind the end of the file
+    std::string elf("\x7f" "ELF\x02\x01\x01", 7);
+    elf.append(128 - elf.size(), '\0');
+    std::string data = elf;
+    patch32(data, 32, 0xfffff000, false);
+    data[54] = 56;
+    data[56] = 1;
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+
+    // program headers too small to hold the fields that are read
+    data = elf;
+    patch32(data, 32, 120, false);
+    data[54] = 1;
+    data[56] = 8;
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+
+    // section headers too small
+    data = elf;
+    patch32(data, 40, 100, false);
+    data[58] = 4;
+    data[60] = 2;
+    CHECK_EQUAL(read_resources(data), B_BAD_DATA);
+}
+
+// segments and sections whose offsets wrap around, which would move the
+// resources back into the file, or in front of it
+TEST(resource_file_elf_wrapping_offsets)
+{
+    std::string elf("\x7f" "ELF\x02\x01\x01", 7);
+    elf.append(64 - elf.size(), '\0');
+    patch32(elf, 32, 64, false);        // e_phoff
+    elf[54] = 56;                       // e_phentsize
+    elf[56] = 1;                        // e_phnum
+    std::string segment(56, '\0');
+    patch32(segment, 32, 200, false);   // p_filesz
+    patch32(segment, 48, 64, false);    // p_align
+    std::string resources = build_resources(sample_resources(), false);
+
+    // an empty segment just below 2^64
+    std::string header = segment;
+    patch32(header, 8, 0xffffffc0, false);
+    patch32(header, 12, 0xffffffff, false);
+    patch32(header, 32, 0, false);
+    std::string data = elf + header;
+    data.append(256 - data.size(), '\0');
+    CHECK_EQUAL(read_resources(data + resources), B_BAD_DATA);
+
+    // a segment reaching past the end of the file
+    header = segment;
+    patch32(header, 32, 0xfffffff0, false);
+    data = elf + header;
+    data.append(256 - data.size(), '\0');
+    CHECK_EQUAL(read_resources(data + resources), B_BAD_DATA);
+
+    // alignments that are no power of two, or larger than the file
+    header = segment;
+    patch32(header, 48, 96, false);
+    data = elf + header;
+    data.append(256 - data.size(), '\0');
+    CHECK_EQUAL(read_resources(data + resources), B_BAD_DATA);
+    header = segment;
+    patch32(header, 52, 0x80000000, false);
+    data = elf + header;
+    data.append(256 - data.size(), '\0');
+    CHECK_EQUAL(read_resources(data + resources), B_BAD_DATA);
+
+    // a section just below 2^64
+    std::string sections("\x7f" "ELF\x02\x01\x01", 7);
+    sections.append(64 - sections.size(), '\0');
+    patch32(sections, 40, 64, false);   // e_shoff
+    sections[58] = 64;                  // e_shentsize
+    sections[60] = 1;                   // e_shnum
+    std::string section(64, '\0');
+    patch32(section, 24, 0xffffffe0, false);
+    patch32(section, 28, 0xffffffff, false);
+    patch32(section, 32, 0x20, false);
+    data = sections + section;
+    data.append(160 - data.size(), '\0');
+    CHECK_EQUAL(read_resources(data + resources), B_BAD_DATA);
+
+    // unchanged, the image is fine
+    data = elf + segment;
+    data.append(256 - data.size(), '\0');
+    CHECK_EQUAL(read_resources(data + resources), B_OK);
+}
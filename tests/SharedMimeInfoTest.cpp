@@ -0,0 +1,262 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <algorithm>
+
+#include "ExtensionIndex.h"
+#include "SharedMimeInfo.h"
+
+// a shared-mime-info file with the given <mime-type> elements
+static std::string
+write_types(const std::string& types)
+{
+    return test_write_file("types.xml", "<?xml version=\"1.0\"?>\n"
+        "<mime-info xmlns=\"http://www.freedesktop.org/standards/shared-mime-info\">\n"
+        + types + "</mime-info>\n");
+}
+
+// a field of the bundle as string, empty if it is not set
+static std::string
+field(const MimeTypeBundle& bundle, mime_field which)
+{
+    if (bundle.fields[which] == NULL || bundle.fieldSizes[which] == 0)
+        return std::string();
+    return std::string((const char*)bundle.fields[which], bundle.fieldSizes[which] - 1);
+}
+
+// the sniffer rule converted from the magic of a single type
+static std::string
+convert_magic(const std::string& magic)
+{
+    SharedMimeInfo info;
+    CHECK_EQUAL(info.SetTo(write_types("<mime-type type=\"text/x-test\">"
+        "<comment>Test</comment>" + magic + "</mime-type>\n").c_str()), B_OK);
+    if (info.CountTypes() != 1)
+        return "no type";
+
+    MimeTypeBundle bundle;
+    info.GetBundle(0, bundle);
+    if (bundle.status != B_OK)
+        return "error: " + bundle.error;
+    return field(bundle, MIME_FIELD_SNIFFER_RULE);
+}
+
+TEST(shared_mime_info_texts_and_globs)
+{
+    SharedMimeInfo info;
+    std::string path = write_types(
+        "<mime-type type=\"text/x-test\">\n"
+        "  <comment xml:lang=\"de\">Testdatei</comment>\n"
+        "  <comment> Test file </comment>\n"
+        "  <expanded-acronym>Test &amp; Example</expanded-acronym>\n"
+        "  <glob pattern=\"*.foo\"/>\n"
+        "  <glob pattern=\"*.FOO\"/>\n"
+        "  <glob pattern=\"*.Bar\"/>\n"
+        "  <glob pattern=\"Makefile\"/>\n"
+        "  <glob pattern=\"*.[ch]\"/>\n"
+        "  <glob pattern=\"*.\"/>\n"
+        "  <glob pattern=\"*..\"/>\n"
+        "  <alias type=\"text/x-other\"/>\n"
+        "</mime-type>\n"
+        "<mime-type type=\"text/x-plain\"><comment>Plain</comment></mime-type>\n");
+    CHECK_EQUAL(info.SetTo(path.c_str()), B_OK);
+    CHECK_EQUAL(info.CountTypes(), 2);
+    CHECK_EQUAL(info.CountSkippedGlobs(), 4);
+    CHECK_EQUAL(info.CountSimplifiedRules(), 0);
+    if (info.CountTypes() != 2)
+        return;
+
+    MimeTypeBundle bundle;
+    info.GetBundle(0, bundle);
+    CHECK_EQUAL(bundle.status, B_OK);
+    CHECK_EQUAL(std::string(bundle.type), "text/x-test");
+    CHECK_EQUAL(bundle.path, path + ":3");
+    CHECK_EQUAL(field(bundle, MIME_FIELD_SHORT_DESCRIPTION), "Test file");
+    CHECK_EQUAL(field(bundle, MIME_FIELD_LONG_DESCRIPTION), "Test & Example");
+    CHECK_EQUAL(field(bundle, MIME_FIELD_SNIFFER_RULE), "");
+
+    // extensions are normalized, so different cases are one extension
+    std::vector<std::string> extensions;
+    ExtensionIndex::GetExtensions(bundle.extensions, extensions);
+    CHECK(extensions == std::vector<std::string>({ "foo", "bar" }));
+
+    MimeTypeBundle plain;
+    info.GetBundle(1, plain);
+    CHECK_EQUAL(plain.status, B_OK);
+    CHECK(plain.fields[MIME_FIELD_EXTENSIONS] == NULL);
+    CHECK(plain.fields[MIME_FIELD_LONG_DESCRIPTION] == NULL);
+}
+
+TEST(shared_mime_info_magic)
+{
+    // siblings are alternatives
+    CHECK_EQUAL(convert_magic("<magic priority=\"60\">"
+            "<match type=\"string\" value=\"GIF8\" offset=\"0\"/>"
+            "<match type=\"string\" value=\"\\x89PNG\" offset=\"0:4\"/></magic>"),
+        "0.60 ([0] 0x47494638 | [0:4] 0x89504e47)");
+
+    // nested matches have to match as well
+    CHECK_EQUAL(convert_magic("<magic><match type=\"string\" value=\"PK\" offset=\"0\">"
+            "<match type=\"string\" value=\"mimetype\" offset=\"30\"/>"
+            "<match type=\"string\" value=\"META\" offset=\"30:40\"/></match></magic>"),
+        "0.50 ([0] 0x504b) ([30] 0x6d696d6574797065 | [30:40] 0x4d455441)");
+
+    // (a & b) | (c & d) becomes (a | c) (a | d) (b | c) (b | d)
+    CHECK_EQUAL(convert_magic("<magic priority=\"40\">"
+            "<match type=\"string\" value=\"a\" offset=\"0\">"
+            "<match type=\"string\" value=\"b\" offset=\"1\"/></match>"
+            "<match type=\"string\" value=\"c\" offset=\"2\">"
+            "<match type=\"string\" value=\"d\" offset=\"3\"/></match></magic>"),
+        "0.40 ([0] 0x61 | [2] 0x63) ([0] 0x61 | [3] 0x64) ([1] 0x62 | [2] 0x63) "
+        "([1] 0x62 | [3] 0x64)");
+
+    // escapes in strings, masks, and a mask of all bits is left out
+    CHECK_EQUAL(convert_magic("<magic><match type=\"string\" value=\"a\\n\\101\\\\\" offset=\"0\""
+            " mask=\"0xdfffffff\"/><match type=\"string\" value=\"x\" offset=\"8\""
+            " mask=\"0xff\"/></magic>"),
+        "0.50 ([0] 0x610a415c & 0xdfffffff | [8] 0x78)");
+    CHECK_EQUAL(convert_magic("<magic><match type=\"string\" value=\"ab\" offset=\"0\""
+            " mask=\"0xff\"/></magic>"),
+        "error: " + test_directory() + "/types.xml:3: mask length of string match 'ab' "
+        "differs from its value");
+}
+
+TEST(shared_mime_info_magic_numbers)
+{
+    CHECK_EQUAL(convert_magic("<magic><match type=\"byte\" value=\"0x7f\" offset=\"0\"/>"
+            "<match type=\"big16\" value=\"0x1234\" offset=\"1\" mask=\"0xff00\"/>"
+            "<match type=\"big32\" value=\"0xcafebabe\" offset=\"2\"/>"
+            "<match type=\"little16\" value=\"258\" offset=\"3\"/>"
+            "<match type=\"little32\" value=\"010\" offset=\"4\"/></magic>"),
+        "0.50 ([0] 0x7f | [1] 0x1234 & 0xff00 | [2] 0xcafebabe | [3] 0x0201"
+        " | [4] 0x08000000)");
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    CHECK_EQUAL(convert_magic("<magic><match type=\"host16\" value=\"0x0102\" offset=\"0\"/>"
+        "</magic>"), "0.50 ([0] 0x0102)");
+#else
+    CHECK_EQUAL(convert_magic("<magic><match type=\"host16\" value=\"0x0102\" offset=\"0\"/>"
+        "</magic>"), "0.50 ([0] 0x0201)");
+#endif
+
+    // values that don't fit, and types without a counterpart
+    std::string source = test_directory() + "/types.xml:3: ";
+    CHECK_EQUAL(convert_magic("<magic><match type=\"byte\" value=\"256\" offset=\"0\"/>"
+            "</magic>"),
+        "error: " + source + "cannot convert byte match '256'");
+    CHECK_EQUAL(convert_magic("<magic><match type=\"big16\" value=\"12x\" offset=\"0\"/>"
+            "</magic>"),
+        "error: " + source + "cannot convert big16 match '12x'");
+    CHECK_EQUAL(convert_magic("<magic><match type=\"regex\" value=\"^a+\" offset=\"0\"/>"
+            "</magic>"),
+        "error: " + source + "cannot convert regex match '^a+'");
+    CHECK_EQUAL(convert_magic("<magic><match type=\"string\" value=\"a\" offset=\"4:2\"/>"
+            "</magic>"),
+        "error: " + source + "invalid offset 4:2");
+}
+
+// alternatives with a nested match each, "a" & "A" | "b" & "B" | ...
+static std::string
+nested_alternatives(int32 count)
+{
+    std::string magic = "<magic>";
+    for (int32 i = 0; i < count; i++) {
+        magic += std::string("<match type=\"string\" value=\"") + (char)('a' + i)
+            + "\" offset=\"0\"><match type=\"string\" value=\"" + (char)('A' + i)
+            + "\" offset=\"1\"/></match>";
+    }
+    return magic + "</magic>";
+}
+
+// Six alternatives with a nested match each take 64 expressions, more than
+// a rule may have, so only the top level is used; five still fit.
+TEST(shared_mime_info_magic_too_large)
+{
+    SharedMimeInfo info;
+    CHECK_EQUAL(info.SetTo(write_types("<mime-type type=\"text/x-test\">"
+        "<comment>Test</comment>" + nested_alternatives(6) + "</mime-type>\n").c_str()), B_OK);
+    CHECK_EQUAL(info.CountSimplifiedRules(), 1);
+    MimeTypeBundle bundle;
+    info.GetBundle(0, bundle);
+    CHECK_EQUAL(field(bundle, MIME_FIELD_SNIFFER_RULE),
+        "0.50 ([0] 0x61 | [0] 0x62 | [0] 0x63 | [0] 0x64 | [0] 0x65 | [0] 0x66)");
+
+    CHECK_EQUAL(info.SetTo(write_types("<mime-type type=\"text/x-test\">"
+        "<comment>Test</comment>" + nested_alternatives(5) + "</mime-type>\n").c_str()), B_OK);
+    CHECK_EQUAL(info.CountSimplifiedRules(), 0);
+    info.GetBundle(0, bundle);
+    std::string rule = field(bundle, MIME_FIELD_SNIFFER_RULE);
+    CHECK_EQUAL(std::count(rule.begin(), rule.end(), '('), 32);
+    CHECK_EQUAL(rule.substr(0, 40), "0.50 ([0] 0x61 | [0] 0x62 | [0] 0x63 | [");
+}
+
+TEST(shared_mime_info_sub_class_priority)
+{
+    // the parent comes later in the file, and has a higher priority
+    SharedMimeInfo info;
+    CHECK_EQUAL(info.SetTo(write_types(
+        "<mime-type type=\"application/x-child\"><comment>Child</comment>\n"
+        "  <sub-class-of type=\"Application/X-Parent\"/>\n"
+        "  <magic priority=\"50\"><match type=\"string\" value=\"PK\" offset=\"0\"/></magic>\n"
+        "</mime-type>\n"
+        "<mime-type type=\"application/x-grandchild\"><comment>Grandchild</comment>\n"
+        "  <sub-class-of type=\"application/x-child\"/>\n"
+        "  <magic><match type=\"string\" value=\"PKx\" offset=\"0\"/></magic>\n"
+        "</mime-type>\n"
+        "<mime-type type=\"application/x-parent\"><comment>Parent</comment>\n"
+        "  <magic priority=\"80\"><match type=\"string\" value=\"P\" offset=\"0\"/></magic>\n"
+        "</mime-type>\n"
+        "<mime-type type=\"application/x-loop\"><comment>Loop</comment>\n"
+        "  <sub-class-of type=\"application/x-loop\"/>\n"
+        "  <magic priority=\"100\"><match type=\"string\" value=\"L\" offset=\"0\"/></magic>\n"
+        "</mime-type>\n").c_str()), B_OK);
+    CHECK_EQUAL(info.CountTypes(), 4);
+    if (info.CountTypes() != 4)
+        return;
+
+    const char* expected[] = { "0.81 ([0] 0x504b)", "0.82 ([0] 0x504b78)", "0.80 ([0] 0x50)",
+        "1.00 ([0] 0x4c)" };
+    for (int32 i = 0; i < 4; i++) {
+        MimeTypeBundle bundle;
+        info.GetBundle(i, bundle);
+        CHECK_EQUAL(field(bundle, MIME_FIELD_SNIFFER_RULE), expected[i]);
+    }
+}
+
+TEST(shared_mime_info_errors)
+{
+    // a failed type does not fail the others
+    SharedMimeInfo info;
+    std::string path = write_types(
+        "<mime-type type=\"text/x-untranslated\"><comment xml:lang=\"de\">Nur deutsch</comment>"
+        "</mime-type>\n"
+        "<mime-type><comment>No type</comment></mime-type>\n"
+        "<mime-type type=\"text/x-fine\"><comment>Fine</comment></mime-type>\n");
+    CHECK_EQUAL(info.SetTo(path.c_str()), B_OK);
+    CHECK_EQUAL(info.CountTypes(), 3);
+    if (info.CountTypes() == 3) {
+        MimeTypeBundle bundle;
+        info.GetBundle(0, bundle);
+        CHECK_EQUAL(bundle.status, B_BAD_VALUE);
+        CHECK_EQUAL(bundle.error,
+            path + ":3: no untranslated <comment> for the short description");
+        info.GetBundle(1, bundle);
+        CHECK_EQUAL(bundle.status, B_BAD_VALUE);
+        CHECK_EQUAL(bundle.error, path + ":4: <mime-type> without type");
+        info.GetBundle(2, bundle);
+        CHECK_EQUAL(bundle.status, B_OK);
+    }
+
+    path = test_write_file("other.xml", "<other/>\n");
+    CHECK_EQUAL(info.SetTo(path.c_str()), B_BAD_DATA);
+    CHECK_EQUAL(info.Error(), path + ":1: not a shared-mime-info file, root element is <other>");
+    CHECK_EQUAL(info.CountTypes(), 0);
+
+    path = test_write_file("broken.xml", "<mime-info>\n<mime-type type=\"a/b\">\n</mime-info>\n");
+    CHECK_EQUAL(info.SetTo(path.c_str()), B_BAD_DATA);
+    CHECK_EQUAL(info.Error(), path + ":3: unexpected </mime-info>, expected </mime-type>");
+    CHECK_EQUAL(info.CountTypes(), 0);
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include "SnifferRule.h"
+
+static bool
+matches(const char* rule, const std::string& data)
+{
+    SnifferRule sniffer;
+    std::string error;
+    CHECK_EQUAL(sniffer.SetTo(rule, &error), B_OK);
+    return sniffer.Matches(data.data(), data.size());
+}
+
+static std::string
+parse_error(const char* rule)
+{
+    std::string error;
+    if (SnifferRule::Check(rule, &error) != B_BAD_VALUE)
+        return "parsed";
+    return error;
+}
+
+TEST(sniffer_rule_priority)
+{
+    SnifferRule rule("0.25 ('abc')");
+    CHECK_EQUAL(rule.InitCheck(), B_OK);
+    CHECK_EQUAL(rule.Priority(), 0.25f);
+    CHECK_EQUAL(SnifferRule(".5 ('abc')").Priority(), 0.5f);
+    CHECK_EQUAL(SnifferRule("1 ('abc')").Priority(), 1.0f);
+    CHECK_EQUAL(SnifferRule("0 ('abc')").Priority(), 0.0f);
+    CHECK_EQUAL(SnifferRule("1.5 ('abc')").InitCheck(), B_BAD_VALUE);
+    CHECK_EQUAL(SnifferRule().InitCheck(), B_NO_INIT);
+    CHECK_EQUAL(SnifferRule().SetTo(NULL), B_BAD_VALUE);
+}
+
+TEST(sniffer_rule_ranges)
+{
+    // without a range, a pattern has to be at the start
+    CHECK(matches("0.5 ('ab')", "abc"));
+    CHECK(!matches("0.5 ('ab')", "xab"));
+
+    CHECK(matches("0.5 [2] ('ab')", "xxab"));
+    CHECK(!matches("0.5 [2] ('ab')", "xab"));
+    CHECK(!matches("0.5 [2] ('ab')", "xxxab"));
+
+    CHECK(matches("0.5 [1:3] ('ab')", "xab"));
+    CHECK(matches("0.5 [1:3] ('ab')", "xxxab"));
+    CHECK(!matches("0.5 [1:3] ('ab')", "abxxxx"));
+    CHECK(!matches("0.5 [1:3] ('ab')", "xxxxab"));
+    // a range reaching past the data still finds what is within
+    CHECK(matches("0.5 [0:100] ('ab')", "xxab"));
+    CHECK(!matches("0.5 [0:100] ('ab')", "xxa"));
+    CHECK(!matches("0.5 [10] ('ab')", "xxab"));
+
+    // long enough to be searched in blocks, hits before and after them
+    std::string data(200, 'x');
+    data.replace(150, 5, "magic");
+    CHECK(matches("0.5 [0:160] ('magic')", data));
+    CHECK(matches("0.5 [150:160] ('magic')", data));
+    CHECK(!matches("0.5 [0:149] ('magic')", data));
+    CHECK(!matches("0.5 [151:199] ('magic')", data));
+
+    // patterns of a list may have their own range
+    CHECK(matches("0.5 ([2] 'ab' | [4] 'cd')", "xxxxcd"));
+    CHECK(!matches("0.5 ([2] 'ab' | [4] 'cd')", "xxxcd"));
+
+    CHECK_EQUAL(SnifferRule("0.5 [0:30] ('abcd')").MaxLength(), 34u);
+    CHECK_EQUAL(SnifferRule("0.5 ('ab') [8] ('cd')").MaxLength(), 10u);
+}
+
+TEST(sniffer_rule_masks)
+{
+    // the mask picks the bits that are compared
+    CHECK(matches("0.5 (0x4100 & 0xff00)", "Az"));
+    CHECK(matches("0.5 (0x4100 & 0xff00)", "A\xff"));
+    CHECK(!matches("0.5 (0x4100 & 0xff00)", "Bz"));
+    CHECK(matches("0.5 ('\\x80' & '\\xf0')", "\x8f"));
+    CHECK(!matches("0.5 ('\\x80' & '\\xf0')", "\x7f"));
+    // without any fully masked byte, and in blocks
+    std::string data(100, '\0');
+    data[70] = '\x35';
+    CHECK(matches("0.5 [0:90] (0x30 & 0xf0)", data));
+    CHECK(!matches("0.5 [0:69] (0x30 & 0xf0)", data));
+}
+
+TEST(sniffer_rule_case)
+{
+    CHECK(matches("0.5 (-i '<html')", "<HtMl>"));
+    CHECK(matches("0.5 [0:20] (-i \"<HTML\")", "     <html>"));
+    CHECK(!matches("0.5 ('<html')", "<HTML>"));
+    // only ASCII is folded
+    CHECK(!matches("0.5 (-i '\\xc4')", "\xe4"));
+    // masks and case insensitive patterns together
+    CHECK(matches("0.5 (-i 'AB' & 0xff00)", "az"));
+    // "-i" alone is a pattern string
+    CHECK(matches("0.5 (-i)", "-i"));
+}
+
+TEST(sniffer_rule_alternatives)
+{
+    const char* rule = "0.5 ('GIF87a' | 'GIF89a' | [10] 'x')";
+    CHECK(matches(rule, "GIF87a..."));
+    CHECK(matches(rule, "GIF89a..."));
+    CHECK(matches(rule, "0123456789x"));
+    CHECK(!matches(rule, "GIF88a..."));
+
+    // every expression has to match
+    rule = "0.5 ('PK') [2:20] ('mimetype' | 'META')";
+    CHECK(matches(rule, "PK....mimetype"));
+    CHECK(matches(rule, "PKMETA"));
+    CHECK(!matches(rule, "PK...."));
+    CHECK(!matches(rule, "xx....mimetype"));
+}
+
+TEST(sniffer_rule_strings)
+{
+    CHECK(matches("0.5 ('\\x41\\102\\n\\t\\'')", "AB\n\t'"));
+    CHECK(matches("0.5 (abc)", "abc"));
+    CHECK(matches("0.5 (a\\(b)", "a(b"));
+    CHECK(matches("0.5 (0x00ff)", std::string("\x00\xff", 2)));
+    CHECK(matches("0.5 (\"a b\")", "a b"));
+}
+
+TEST(sniffer_rule_malformed)
+{
+    CHECK_EQUAL(parse_error(""), "expected a priority at position 0");
+    CHECK_EQUAL(parse_error("('a')"), "expected a priority at position 0");
+    CHECK_EQUAL(parse_error("2 ('a')"), "priority 2 is not within [0.0, 1.0] at position 0");
+    CHECK_EQUAL(parse_error("0.5"), "expected an expression at position 3");
+    CHECK_EQUAL(parse_error("0.5 'a'"), "expected '(' at position 4");
+    CHECK_EQUAL(parse_error("0.5 ('a'"), "expected ')' or '|' at position 8");
+    CHECK_EQUAL(parse_error("0.5 ('a' 'b')"), "expected ')' or '|' at position 9");
+    CHECK_EQUAL(parse_error("0.5 ('a' |)"), "expected a pattern string at position 10");
+    CHECK_EQUAL(parse_error("0.5 ('')"), "empty pattern at position 7");
+    CHECK_EQUAL(parse_error("0.5 ('a"), "unterminated string at position 7");
+    CHECK_EQUAL(parse_error("0.5 ('a\\"), "unterminated escape sequence at position 8");
+    CHECK_EQUAL(parse_error("0.5 ('\\xzz')"), "expected hex digits at position 8");
+    CHECK_EQUAL(parse_error("0.5 ('\\777')"), "octal escape out of range at position 10");
+    CHECK_EQUAL(parse_error("0.5 (0x123)"),
+        "hex string needs an even number of digits at position 10");
+    CHECK_EQUAL(parse_error("0.5 ('ab' & 'a')"),
+        "mask length differs from pattern length at position 15");
+    CHECK_EQUAL(parse_error("0.5 [3:1] ('a')"),
+        "range end 1 is before its start 3 at position 9");
+    CHECK_EQUAL(parse_error("0.5 [1 ('a')"), "expected ']' at position 7");
+    CHECK_EQUAL(parse_error("0.5 [] ('a')"), "expected a number at position 5");
+    CHECK_EQUAL(parse_error("0.5 [9999999999] ('a')"), "offset too large at position 15");
+    CHECK_EQUAL(parse_error("0.5 [0:4] ([1] 'a')"),
+        "pattern range within a ranged pattern list at position 11");
+    CHECK_EQUAL(parse_error("0.5 ('a') junk"), "expected '(' at position 10");
+
+    // a failed rule matches nothing, and says nothing but its status
+    SnifferRule rule("0.5 ('a'");
+    CHECK_EQUAL(rule.InitCheck(), B_BAD_VALUE);
+    CHECK(!rule.Matches("a", 1));
+    CHECK_EQUAL(rule.MaxLength(), 0u);
+    std::string data;
+    CHECK_EQUAL(rule.Flatten(data), B_BAD_VALUE);
+}
+
+TEST(sniffer_rule_flatten)
+{
+    SnifferRule rule("0.75 [0:40] (-i 'abc' | 0x00ff & 0x00f0) ('x')");
+    std::string data;
+    CHECK_EQUAL(rule.Flatten(data), B_OK);
+
+    SnifferRule restored;
+    CHECK_EQUAL(restored.Unflatten(data.data(), data.size()), B_OK);
+    CHECK_EQUAL(restored.Priority(), 0.75f);
+    CHECK_EQUAL(restored.MaxLength(), rule.MaxLength());
+    CHECK(restored.Matches("x..ABC", 6));
+    CHECK(restored.Matches(std::string("x\x00\xf5", 3).data(), 3));
+    CHECK(!restored.Matches("y..abc", 6));
+
+    // cut, or with a count that does not fit the size
+    CHECK_EQUAL(restored.Unflatten(data.data(), data.size() - 1), B_BAD_DATA);
+    CHECK_EQUAL(restored.Unflatten(data.data(), 8), B_BAD_DATA);
+    CHECK(!restored.Matches("x..abc", 6));
+    std::string bad = data;
+    bad[4] = 100;
+    CHECK_EQUAL(restored.Unflatten(bad.data(), bad.size()), B_BAD_DATA);
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "SnifferSet.h"
+
+// Patterns that overlap each other or themselves, run past the longest
+// anchor, are masked around their anchor or have no fully masked byte at all,
+// and rules that tie on priority.
+static const char* const kRules[] = {
+    "0.5 ('abc')",
+    "0.5 [0:20] ('bcd')",
+    "0.6 [0:20] ('abcd')",
+    "0.4 [0:30] ('b')",
+    "0.5 [0:30] (-i 'ABCD') ('a')",
+    "0.7 [2:10] ('c\\x03' & 0xff0f)",
+    "0.3 [0:40] (0x30 & 0xf0)",
+    "0.3 [0:40] ('\\x00b' & 0x00ff)",
+    "0.8 [5:30] ('xyz' | 'zyx')",
+    "0.2 [0:63] ('<>')",
+    "0.9 [0:5] ('dcba') [0:40] ('5')",
+    "0.5 [0:20] ('bc' | 'cb')",
+    "0.55 [0:60] ('aaaa')",
+    "0.55 [1:3] ('aa')",
+    "0.45 [0:10] (-i 'Xy' & 0xdfff)",
+    "0.35 [0:50] ('abcdabcdabcd')",
+    "0.65 [3] ('d')",
+    "0.15 [0:60] ('\\x35\\x30' & 0xf0f0)",
+    "0.25 [0:63] ('y') [0:63] ('z') [0:63] ('x')",
+    "0.5 ('a')",
+    "0.6 ([0:4] 'd' | [8:12] 'dd' | [30:40] 'ddd')"
+};
+static const int32 kRuleCount = sizeof(kRules) / sizeof(kRules[0]);
+
+// the rule with the highest priority that matches, the first one on ties
+static int32
+match_one_by_one(const std::vector<SnifferRule>& rules, const std::string& data)
+{
+    int32 best = -1;
+    for (int32 i = 0; i < (int32)rules.size(); i++) {
+        if (rules[i].Matches(data.data(), data.size())
+            && (best < 0 || rules[i].Priority() > rules[best].Priority()))
+            best = i;
+    }
+    return best;
+}
+
+// random data from the bytes the rules use, with some of their patterns in it
+static std::string
+random_data(uint32& seed)
+{
+    static const char kBytes[] = "abcdABCDxyzXY<>05\x03\x30\x35";
+    static const char* const kParts[] = { "abcd", "abcdabcdabcd", "aaaa", "dcba", "xyz",
+        "zyx", "<>", "\x35\x30", "Xy", "c\x03", "bc" };
+    auto next = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7fff;
+    };
+
+    std::string data;
+    uint32 length = next() % 72;
+    while (data.size() < length) {
+        if (next() % 4 == 0)
+            data += kParts[next() % (sizeof(kParts) / sizeof(kParts[0]))];
+        else if (next() % 16 == 0)
+            data += '\0';
+        else
+            data += kBytes[next() % (sizeof(kBytes) - 1)];
+    }
+    return data;
+}
+
+static void
+check_same_matches(int32 count)
+{
+    std::vector<SnifferRule> rules;
+    SnifferSet set;
+    for (int32 i = 0; i < count; i++) {
+        rules.push_back(SnifferRule(kRules[i % kRuleCount]));
+        CHECK_EQUAL(rules.back().InitCheck(), B_OK);
+        set.AddRule(rules.back(), i);
+    }
+    CHECK_EQUAL(set.Compile(), B_OK);
+    CHECK_EQUAL(set.CountRules(), count);
+
+    const char* const samples[] = { "", "a", "abc", "abcd", "xbcd", "aaaa", "-aa",
+        "ABCDa", "abcdabcdabcd", "dcba5", "\x35\x30", "0", "zzzzzyx",
+        "xyz", "dddd", "........dd", "<>" };
+    for (const char* sample : samples) {
+        std::string data(sample);
+        CHECK_EQUAL(set.Match(data.data(), data.size()), match_one_by_one(rules, data));
+    }
+    std::string withNul("xx\0b", 4);
+    CHECK_EQUAL(set.Match(withNul.data(), withNul.size()), match_one_by_one(rules, withNul));
+
+    uint32 seed = 42;
+    int32 mismatches = 0;
+    std::vector<bool> found(count + 1, false);
+    for (int32 i = 0; i < 20000; i++) {
+        std::string data = random_data(seed);
+        int32 expected = match_one_by_one(rules, data);
+        if (set.Match(data.data(), data.size()) != expected)
+            mismatches++;
+        found[expected + 1] = true;
+    }
+    CHECK_EQUAL(mismatches, 0);
+
+    // the data is not so random that only few rules ever match
+    int32 distinct = 0;
+    for (bool result : found)
+        distinct += result ? 1 : 0;
+    CHECK(found[0]);
+    CHECK(distinct > std::min(count, kRuleCount) / 2);
+}
+
+// below the threshold, the rules are checked one by one
+TEST(sniffer_set_few_rules)
+{
+    check_same_matches(8);
+}
+
+// from 16 rules on, the set scans with its automaton
+TEST(sniffer_set_many_rules)
+{
+    check_same_matches(kRuleCount);
+    check_same_matches(3 * kRuleCount);
+}
+
+TEST(sniffer_set_priorities)
+{
+    SnifferSet set;
+    CHECK_EQUAL(set.Match("abc", 3), -1);
+
+    // a failed rule is left out
+    set.AddRule(SnifferRule("0.5 ('a'"), 99);
+    for (int32 i = 0; i < 20; i++)
+        set.AddRule(SnifferRule(i % 2 == 0 ? "0.4 [0:10] ('abc')" : "0.6 [0:10] ('bcd')"), i);
+    set.AddRule(SnifferRule("0.6 [0:10] ('abcd')"), 20);
+    CHECK_EQUAL(set.CountRules(), 21);
+    CHECK_EQUAL(set.Compile(), B_OK);
+    CHECK_EQUAL(set.MaxLength(), 14u);
+
+    // the first added on ties
+    CHECK_EQUAL(set.Match("xabcd", 5), 1);
+    CHECK_EQUAL(set.Match("xabc", 4), 0);
+    CHECK_EQUAL(set.Match("xab", 3), -1);
+    CHECK_EQUAL(set.Match("...........abcd", 15), -1);
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+#ifndef _TEST_H
+#define _TEST_H
+
+#include "Platform.h"
+
+#include <string>
+
+// A minimal test harness: TEST(name) defines a test that registers itself,
+// CHECK() records a failure and carries on, so one run reports every broken
+// assertion. The tests of each source file live in <Source>Test.cpp.
+
+typedef void (*test_function)();
+
+struct test_registration {
+                    test_registration(const char* name, test_function function);
+};
+
+void test_failed(const char* file, int line, const char* expression);
+// a fresh directory for the files of the running test
+std::string test_directory();
+// writes the data to a file in the test directory, returns its path
+std::string test_write_file(const char* name, const std::string& data);
+
+#define TEST(name) \
+    static void name(); \
+    static test_registration name##_registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) \
+            test_failed(__FILE__, __LINE__, #condition); \
+    } while (false)
+
+#define CHECK_EQUAL(actual, expected) CHECK((actual) == (expected))
+
+#endif // _TEST_H
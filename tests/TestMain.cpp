@@ -0,0 +1,97 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+struct registered_test {
+    const char*     name;
+    test_function   function;
+};
+
+static std::vector<registered_test>&
+registered_tests()
+{
+    static std::vector<registered_test> tests;
+    return tests;
+}
+
+static int32 sFailures = 0;
+static std::string sBaseDirectory;
+static int32 sTestIndex = 0;
+
+test_registration::test_registration(const char* name, test_function function)
+{
+    registered_tests().push_back({ name, function });
+}
+
+void
+test_failed(const char* file, int line, const char* expression)
+{
+    fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+    sFailures++;
+}
+
+std::string
+test_directory()
+{
+    std::string directory = sBaseDirectory + "/" + std::to_string(sTestIndex);
+    mkdir(directory.c_str(), 0755);
+    return directory;
+}
+
+std::string
+test_write_file(const char* name, const std::string& data)
+{
+    std::string path = test_directory() + "/" + name;
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        test_failed(__FILE__, __LINE__, "fopen");
+        return path;
+    }
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+    return path;
+}
+
+// Runs all tests, or those whose name contains the argument. The files of
+// passing runs are removed, those of failing ones kept for inspection.
+int
+main(int argc, char** argv)
+{
+    char base[] = "/tmp/mime_tests.XXXXXX";
+    if (mkdtemp(base) == NULL) {
+        perror("cannot create test directory");
+        return EXIT_FAILURE;
+    }
+    sBaseDirectory = base;
+
+    int32 count = 0;
+    for (const registered_test& test : registered_tests()) {
+        if (argc > 1 && strstr(test.name, argv[1]) == NULL)
+            continue;
+        int32 failures = sFailures;
+        sTestIndex++;
+        test.function();
+        printf("%-48s %s\n", test.name, sFailures == failures ? "ok" : "FAILED");
+        count++;
+    }
+
+    printf("%" B_PRId32 " tests, %" B_PRId32 " failed checks\n", count, sFailures);
+    if (sFailures == 0) {
+        std::string command = "rm -rf " + sBaseDirectory;
+        if (system(command.c_str()) != 0)
+            fprintf(stderr, "cannot remove %s\n", sBaseDirectory.c_str());
+    } else
+        fprintf(stderr, "test files kept in %s\n", sBaseDirectory.c_str());
+    return sFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
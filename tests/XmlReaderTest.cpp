@@ -0,0 +1,154 @@
+/*
+ * Copyright 2024, Gregor Rosenauer <gregor.rosenauer@gmail.com>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Test.h"
+
+#include <string.h>
+
+#include "XmlReader.h"
+
+// writes the events as "<name a=v>", "</name>" and the text, joining the
+// pieces character data is reported in
+class RecordingHandler : public XmlHandler {
+public:
+    RecordingHandler()
+        :
+        fTextEvents(0),
+        fStopAt(NULL)
+    {
+    }
+
+    virtual status_t StartElement(const char* name, const xml_attribute* attributes,
+        int32 count)
+    {
+        fEvents += std::string("<") + name;
+        for (int32 i = 0; i < count; i++)
+            fEvents += std::string(" ") + attributes[i].name + "=" + attributes[i].value;
+        fEvents += ">";
+        if (fStopAt != NULL && strcmp(name, fStopAt) == 0)
+            return B_INTERRUPTED;
+        return B_OK;
+    }
+
+    virtual status_t EndElement(const char* name)
+    {
+        fEvents += std::string("</") + name + ">";
+        return B_OK;
+    }
+
+    virtual status_t Characters(const char* text, size_t length)
+    {
+        fEvents.append(text, length);
+        fTextEvents++;
+        return B_OK;
+    }
+
+    std::string     fEvents;
+    int32           fTextEvents;
+    const char*     fStopAt;
+};
+
+static std::string
+parse(const std::string& document)
+{
+    RecordingHandler handler;
+    XmlReader reader(handler);
+    if (reader.Parse(test_write_file("test.xml", document).c_str()) != B_OK)
+        return "error: " + reader.Error();
+    return handler.fEvents;
+}
+
+// "line: message" of a document that fails to parse
+static std::string
+parse_error(const std::string& document)
+{
+    RecordingHandler handler;
+    XmlReader reader(handler);
+    if (reader.Parse(test_write_file("test.xml", document).c_str()) != B_BAD_DATA)
+        return "parsed";
+    return std::to_string(reader.Line()) + ": " + reader.Error();
+}
+
+TEST(xml_reader_elements)
+{
+    CHECK_EQUAL(parse("<a/>"), "<a></a>");
+    CHECK_EQUAL(parse("<?xml version=\"1.0\"?>\n<a x=\"1\" y='two'><b/>text<c z = \"3\"></c></a>\n"),
+        "<a x=1 y=two><b></b>text<c z=3></c></a>");
+    CHECK_EQUAL(parse("<a\n  x=\"a > b\"\n/>"), "<a x=a > b></a>");
+    // comments, processing instructions and the DOCTYPE are skipped
+    CHECK_EQUAL(parse("<!DOCTYPE a [ <!ELEMENT a ANY> ]>\n<a><!-- <b> -- --><?pi <c>?>d</a>"),
+        "<a>d</a>");
+    CHECK_EQUAL(parse("<a><![CDATA[<b> & ]] ]]></a>"), "<a><b> & ]] </a>");
+}
+
+TEST(xml_reader_entities)
+{
+    CHECK_EQUAL(parse("<a t=\"&lt;&gt;&amp;&quot;&apos;\">&lt;b&gt; &amp;amp;</a>"),
+        "<a t=<>&\"'><b> &amp;</a>");
+    // character references become UTF-8
+    CHECK_EQUAL(parse("<a>&#65;&#x42;&#xe4;&#x20AC;&#x1F600;</a>"),
+        "<a>AB\xc3\xa4\xe2\x82\xac\xf0\x9f\x98\x80</a>");
+    CHECK_EQUAL(parse_error("<a>&nbsp;</a>"), "1: unknown entity &nbsp;");
+    CHECK_EQUAL(parse_error("<a>&#0;</a>"), "1: invalid character reference &#0;");
+    CHECK_EQUAL(parse_error("<a>&#x110000;</a>"), "1: invalid character reference &#x110000;");
+    CHECK_EQUAL(parse_error("<a>&amp</a>"), "1: unterminated entity reference");
+    CHECK_EQUAL(parse_error("<a t=\"&foo;\"/>"), "1: unknown entity &foo;");
+}
+
+// text longer than the chunks it is reported in, and than the read buffer,
+// with entities across both boundaries
+TEST(xml_reader_long_text)
+{
+    std::string text;
+    std::string expected;
+    for (int32 i = 0; text.size() < 200 * 1024; i++) {
+        text += "line " + std::to_string(i) + " &amp; &#x41;\n";
+        expected += "line " + std::to_string(i) + " & A\n";
+    }
+
+    RecordingHandler handler;
+    XmlReader reader(handler);
+    std::string path = test_write_file("long.xml", "<a>" + text + "</a>\n<!-- end -->\n");
+    CHECK_EQUAL(reader.Parse(path.c_str()), B_OK);
+    CHECK(handler.fEvents == "<a>" + expected + "</a>");
+    CHECK(handler.fTextEvents > 1);
+
+    std::string cdata(100 * 1024, 'x');
+    cdata[50000] = ']';
+    cdata[50001] = ']';
+    CHECK(parse("<a><![CDATA[" + cdata + "]]></a>") == "<a>" + cdata + "</a>");
+}
+
+TEST(xml_reader_errors)
+{
+    CHECK_EQUAL(parse_error(""), "1: no root element");
+    CHECK_EQUAL(parse_error("<!-- nothing -->"), "1: no root element");
+    CHECK_EQUAL(parse_error("<a>\n<b>\n</a>"), "3: unexpected </a>, expected </b>");
+    CHECK_EQUAL(parse_error("<a>\n</a>\n</b>"), "3: unexpected </b>, expected no end tag");
+    CHECK_EQUAL(parse_error("<a>\n<b>"), "2: unexpected end of file, <b> is not closed");
+    CHECK_EQUAL(parse_error("<a><b"), "1: unexpected end of file within markup");
+    CHECK_EQUAL(parse_error("text<a/>"), "1: text outside of the root element");
+    CHECK_EQUAL(parse_error("<a/>\ntext"), "2: text outside of the root element");
+    CHECK_EQUAL(parse_error("<a/><b/>"), "1: more than one root element");
+    CHECK_EQUAL(parse_error("<a><></a>"), "1: empty tag");
+    CHECK_EQUAL(parse_error("<a>< b/></a>"), "1: tag without a name");
+    CHECK_EQUAL(parse_error("<a x=1/>"), "1: attribute value of x is not quoted");
+    CHECK_EQUAL(parse_error("<a x/>"), "1: expected name=\"value\" in tag");
+    CHECK_EQUAL(parse_error("<a x=\"1\"y=\"2\"/>"), "1: expected a space after attribute x");
+    CHECK_EQUAL(parse_error("<a><!ELEMENT></a>"), "1: unsupported markup <!ELEMENT");
+    CHECK_EQUAL(parse_error(std::string("<a x=\"") + std::string(70000, 'v') + "\"/>"),
+        "1: tag longer than 65536 bytes");
+
+    RecordingHandler handler;
+    XmlReader reader(handler);
+    CHECK_EQUAL(reader.Parse((test_directory() + "/missing.xml").c_str()), B_BAD_DATA);
+    CHECK_EQUAL(reader.Error(), "cannot open file: No such file or directory");
+
+    // the handler stops the parser with its own error
+    handler.fStopAt = "b";
+    CHECK_EQUAL(reader.Parse(test_write_file("stop.xml", "<a><b/><c/></a>").c_str()),
+        B_INTERRUPTED);
+    CHECK_EQUAL(handler.fEvents, "<a><b>");
+}